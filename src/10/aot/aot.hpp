@@ -0,0 +1,585 @@
+#ifndef H_AOT_H
+#define H_AOT_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+
+#include "code/code.hpp"
+#include "objects/objects.hpp"
+#include "compiler/compiler.hpp"
+
+namespace aot
+{
+    // 把编译好的ByteCode翻译为C++源码, 与aot/runtime.hpp一起用系统编译器构建成可执行文件或共享库.
+    // 每个CompiledFunction常量生成一个C++函数; 字节码栈上的槽位和局部变量都成为C++局部变量,
+    // 栈深度在生成时静态确定, 跳转成为goto
+    struct Options
+    {
+        std::string Namespace = "monkey";
+        std::string SourceName;    // 写在文件头的注释中
+        bool EmitMain = true;      // 生成monkey_run和main(定义MONKEY_AOT_NO_MAIN时不编译main, 用于构建共享库)
+        bool PrintResult = false;  // main打印最后弹出的值
+    };
+
+    // 生成代码时需要的编译选项, 必须与运行时的编译选项一致
+    std::string BuildDefines()
+    {
+        std::string defines;
+#ifdef MONKEY_INTRUSIVE_REFCOUNT
+        defines += " -DMONKEY_INTRUSIVE_REFCOUNT";
+#endif
+#ifdef MONKEY_SYSTEM_ALLOCATOR
+        defines += " -DMONKEY_SYSTEM_ALLOCATOR";
+#endif
+#ifdef MONKEY_SMALL_INT_MIN
+        defines += " -DMONKEY_SMALL_INT_MIN=" + std::to_string(MONKEY_SMALL_INT_MIN);
+#endif
+#ifdef MONKEY_SMALL_INT_MAX
+        defines += " -DMONKEY_SMALL_INT_MAX=" + std::to_string(MONKEY_SMALL_INT_MAX);
+#endif
+        return defines;
+    }
+
+    std::string cppStringLiteral(std::string_view str)
+    {
+        std::string out = "\"";
+        for (unsigned char c : str)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (c >= 0x20 && c < 0x7f && c != '?')
+            {
+                out += c;
+            }
+            else
+            {
+                // 八进制转义最多三位, 不会吞掉后面的字符
+                char buf[5];
+                std::snprintf(buf, sizeof(buf), "\\%03o", c);
+                out += buf;
+            }
+        }
+        return out + "\"";
+    }
+
+    struct Generator
+    {
+        const compiler::ByteCode &code;
+        Options options;
+        std::ostringstream out;
+
+        Generator(const compiler::ByteCode &c, const Options &opts) : code(c), options(opts) {}
+
+        static int operandWidth(bytecode::OpcodeType op)
+        {
+            auto def = bytecode::Lookup(op);
+            if (def == nullptr)
+            {
+                return -1;
+            }
+            int width = 1;
+            for (auto w : def->OperandWidths)
+            {
+                width += w;
+            }
+            return width;
+        }
+
+        static int operand(const bytecode::Instructions &ins, int pos, int width)
+        {
+            if (width == 2)
+            {
+                uint16_t v;
+                bytecode::ReadUint16(ins, pos, v);
+                return v;
+            }
+            uint8_t v;
+            bytecode::ReadUint8(ins, pos, v);
+            return v;
+        }
+
+        std::string slot(int depth) { return "s" + std::to_string(depth); }
+
+        std::string opName(bytecode::OpcodeType op) { return "bytecode::OpcodeType::" + bytecode::Lookup(op)->Name; }
+
+        // 静态计算每条指令执行前的栈深度, 不可达的指令为-1
+        objects::Ref<objects::Object> stackDepths(const bytecode::Instructions &ins, std::vector<int> &depths, std::vector<bool> &targets)
+        {
+            const int size = ins.size();
+            depths.assign(size + 1, -1);
+            targets.assign(size + 1, false);
+
+            std::vector<std::pair<int, int>> work{{0, 0}};
+            auto reach = [&](int ip, int depth) -> bool {
+                if (ip < 0 || ip > size || depth < 0)
+                {
+                    return false;
+                }
+                if (depths[ip] == -1)
+                {
+                    depths[ip] = depth;
+                    work.emplace_back(ip, depth);
+                }
+                return depths[ip] == depth;
+            };
+            depths[0] = 0;
+
+            while (!work.empty())
+            {
+                auto [ip, depth] = work.back();
+                work.pop_back();
+                if (ip == size)
+                {
+                    continue;
+                }
+
+                auto op = static_cast<bytecode::OpcodeType>(ins[ip]);
+                int width = operandWidth(op);
+                if (width < 0 || ip + width > size)
+                {
+                    return objects::newError("aot: unknown opcode at " + std::to_string(ip));
+                }
+                int a = (width > 1) ? operand(ins, ip + 1, bytecode::Lookup(op)->OperandWidths[0]) : 0;
+                int next = depth;
+                bool fallthrough = true;
+
+                switch (op)
+                {
+                case bytecode::OpcodeType::OpConstant:
+                case bytecode::OpcodeType::OpTrue:
+                case bytecode::OpcodeType::OpFalse:
+                case bytecode::OpcodeType::OpNull:
+                case bytecode::OpcodeType::OpGetGlobal:
+                case bytecode::OpcodeType::OpGetGlobalMove:
+                case bytecode::OpcodeType::OpGetLocal:
+                case bytecode::OpcodeType::OpGetLocalMove:
+                case bytecode::OpcodeType::OpGetBuiltin:
+                case bytecode::OpcodeType::OpGetFree:
+                case bytecode::OpcodeType::OpCurrentClosure:
+                    next = depth + 1;
+                    break;
+                case bytecode::OpcodeType::OpPop:
+                case bytecode::OpcodeType::OpSetGlobal:
+                case bytecode::OpcodeType::OpSetLocal:
+                case bytecode::OpcodeType::OpAdd:
+                case bytecode::OpcodeType::OpSub:
+                case bytecode::OpcodeType::OpMul:
+                case bytecode::OpcodeType::OpDiv:
+                case bytecode::OpcodeType::OpEqual:
+                case bytecode::OpcodeType::OpNotEqual:
+                case bytecode::OpcodeType::OpGreaterThan:
+                case bytecode::OpcodeType::OpIndex:
+                    next = depth - 1;
+                    break;
+                case bytecode::OpcodeType::OpBang:
+                case bytecode::OpcodeType::OpMinus:
+                    break;
+                case bytecode::OpcodeType::OpJump:
+                    if (!reach(a, depth))
+                    {
+                        return objects::newError("aot: inconsistent stack at " + std::to_string(a));
+                    }
+                    targets[a] = true;
+                    fallthrough = false;
+                    break;
+                case bytecode::OpcodeType::OpJumpNotTruthy:
+                    next = depth - 1;
+                    if (!reach(a, next))
+                    {
+                        return objects::newError("aot: inconsistent stack at " + std::to_string(a));
+                    }
+                    targets[a] = true;
+                    break;
+                case bytecode::OpcodeType::OpArray:
+                case bytecode::OpcodeType::OpHash:
+                    next = depth - a + 1;
+                    break;
+                case bytecode::OpcodeType::OpCall:
+                    next = depth - a;
+                    break;
+                case bytecode::OpcodeType::OpClosure:
+                    next = depth - operand(ins, ip + 3, 1) + 1;
+                    break;
+                case bytecode::OpcodeType::OpReturnValue:
+                case bytecode::OpcodeType::OpReturn:
+                    fallthrough = false;
+                    break;
+                default:
+                    return objects::newError("aot: unsupported opcode " + bytecode::OpcodeTypeStr(op));
+                }
+
+                if (fallthrough && !reach(ip + width, next))
+                {
+                    return objects::newError("aot: inconsistent stack at " + std::to_string(ip + width));
+                }
+            }
+
+            return nullptr;
+        }
+
+        // isMain时没有参数和返回指令, 返回最后弹出的值
+        objects::Ref<objects::Object> function(const std::string &name, const bytecode::Instructions &ins, int numLocals, int numParameters, bool isMain)
+        {
+            std::vector<int> depths;
+            std::vector<bool> targets;
+            auto err = stackDepths(ins, depths, targets);
+            if (err != nullptr)
+            {
+                return err;
+            }
+            int maxDepth = *std::max_element(depths.begin(), depths.end()) + 1;
+
+            out << "\n    aot::Value " << name << "([[maybe_unused]] const aot::Value &self, [[maybe_unused]] aot::Value *args)\n    {\n";
+            for (int i = 0; i < numLocals; i++)
+            {
+                out << "        aot::Value l" << i;
+                if (i < numParameters)
+                {
+                    out << " = std::move(args[" << i << "])";
+                }
+                out << ";\n";
+            }
+            for (int i = 0; i < maxDepth; i++)
+            {
+                out << "        aot::Value " << slot(i) << ";\n";
+            }
+            if (isMain)
+            {
+                out << "        aot::Value last;\n";
+            }
+            out << "\n";
+
+            const int size = ins.size();
+            for (int ip = 0; ip < size;)
+            {
+                auto op = static_cast<bytecode::OpcodeType>(ins[ip]);
+                int width = operandWidth(op);
+                int d = depths[ip];
+
+                if (targets[ip])
+                {
+                    out << "    L" << ip << ":;\n";
+                }
+                if (d < 0)
+                {
+                    ip += width;
+                    continue;
+                }
+
+                int a = (width > 1) ? operand(ins, ip + 1, bytecode::Lookup(op)->OperandWidths[0]) : 0;
+                std::string top = (d > 0) ? slot(d - 1) : "";
+                std::string second = (d > 1) ? slot(d - 2) : "";
+                auto check = [&](const std::string &s) { out << "        if (" << s << " == nullptr) return nullptr;\n"; };
+                auto moved = [&](int from, int count) {
+                    std::string list;
+                    for (int i = from; i < from + count; i++)
+                    {
+                        list += (i > from ? ", " : "") + std::string("std::move(") + slot(i) + ")";
+                    }
+                    return list;
+                };
+
+                switch (op)
+                {
+                case bytecode::OpcodeType::OpConstant:
+                    out << "        " << slot(d) << " = constants[" << a << "];\n";
+                    break;
+                case bytecode::OpcodeType::OpPop:
+                    if (isMain)
+                    {
+                        out << "        last = std::move(" << top << ");\n";
+                    }
+                    else
+                    {
+                        out << "        " << top << " = nullptr;\n";
+                    }
+                    break;
+                case bytecode::OpcodeType::OpAdd:
+                case bytecode::OpcodeType::OpSub:
+                case bytecode::OpcodeType::OpMul:
+                case bytecode::OpcodeType::OpDiv:
+                    out << "        " << second << " = aot::binary(" << opName(op) << ", std::move(" << second << "), std::move(" << top << "));\n";
+                    check(second);
+                    break;
+                case bytecode::OpcodeType::OpTrue:
+                    out << "        " << slot(d) << " = objects::TRUE_OBJ;\n";
+                    break;
+                case bytecode::OpcodeType::OpFalse:
+                    out << "        " << slot(d) << " = objects::FALSE_OBJ;\n";
+                    break;
+                case bytecode::OpcodeType::OpNull:
+                    out << "        " << slot(d) << " = objects::NULL_OBJ;\n";
+                    break;
+                case bytecode::OpcodeType::OpEqual:
+                case bytecode::OpcodeType::OpNotEqual:
+                case bytecode::OpcodeType::OpGreaterThan:
+                    // 紧跟条件跳转时直接按比较结果跳转, 不构造布尔对象
+                    if (ip + 1 < size && !targets[ip + 1] && static_cast<bytecode::OpcodeType>(ins[ip + 1]) == bytecode::OpcodeType::OpJumpNotTruthy)
+                    {
+                        int target = operand(ins, ip + 2, 2);
+                        out << "        {\n            int t = aot::compare(" << opName(op) << ", " << second << ", " << top << ");\n"
+                            << "            " << second << " = nullptr;\n            " << top << " = nullptr;\n"
+                            << "            if (t < 0) return nullptr;\n"
+                            << "            if (t == 0) goto L" << target << ";\n        }\n";
+                        ip += width + 3;
+                        continue;
+                    }
+                    out << "        " << second << " = aot::comparison(" << opName(op) << ", std::move(" << second << "), std::move(" << top << "));\n";
+                    check(second);
+                    break;
+                case bytecode::OpcodeType::OpBang:
+                    out << "        " << top << " = aot::bang(std::move(" << top << "));\n";
+                    break;
+                case bytecode::OpcodeType::OpMinus:
+                    out << "        " << top << " = aot::minus(std::move(" << top << "));\n";
+                    check(top);
+                    break;
+                case bytecode::OpcodeType::OpJump:
+                    out << "        goto L" << a << ";\n";
+                    break;
+                case bytecode::OpcodeType::OpJumpNotTruthy:
+                    out << "        if (!aot::truthy(std::move(" << top << "))) goto L" << a << ";\n";
+                    break;
+                case bytecode::OpcodeType::OpGetGlobal:
+                    out << "        " << slot(d) << " = globals[" << a << "];\n";
+                    break;
+                case bytecode::OpcodeType::OpGetGlobalMove:
+                    out << "        " << slot(d) << " = std::move(globals[" << a << "]);\n";
+                    break;
+                case bytecode::OpcodeType::OpSetGlobal:
+                    out << "        globals[" << a << "] = std::move(" << top << ");\n";
+                    break;
+                case bytecode::OpcodeType::OpGetLocal:
+                    out << "        " << slot(d) << " = l" << a << ";\n";
+                    break;
+                case bytecode::OpcodeType::OpGetLocalMove:
+                    out << "        " << slot(d) << " = std::move(l" << a << ");\n";
+                    break;
+                case bytecode::OpcodeType::OpSetLocal:
+                    out << "        l" << a << " = std::move(" << top << ");\n";
+                    break;
+                case bytecode::OpcodeType::OpArray:
+                case bytecode::OpcodeType::OpHash:
+                {
+                    auto fn = (op == bytecode::OpcodeType::OpArray) ? "aot::array" : "aot::hash";
+                    if (a == 0)
+                    {
+                        out << "        " << slot(d) << " = " << fn << "(nullptr, 0);\n";
+                    }
+                    else
+                    {
+                        out << "        {\n            aot::Value items[] = {" << moved(d - a, a) << "};\n"
+                            << "            " << slot(d - a) << " = " << fn << "(items, " << a << ");\n        }\n";
+                    }
+                    check(slot(d - a));
+                    break;
+                }
+                case bytecode::OpcodeType::OpIndex:
+                    out << "        " << second << " = aot::index(std::move(" << second << "), std::move(" << top << "));\n";
+                    check(second);
+                    break;
+                case bytecode::OpcodeType::OpCall:
+                {
+                    auto callee = slot(d - a - 1);
+                    if (a == 0)
+                    {
+                        out << "        " << callee << " = aot::call(" << callee << ", nullptr, 0);\n";
+                    }
+                    else
+                    {
+                        out << "        {\n            aot::Value callArgs[] = {" << moved(d - a, a) << "};\n"
+                            << "            " << callee << " = aot::call(" << callee << ", callArgs, " << a << ");\n        }\n";
+                    }
+                    check(callee);
+                    break;
+                }
+                case bytecode::OpcodeType::OpReturnValue:
+                    out << "        return " << top << ";\n";
+                    break;
+                case bytecode::OpcodeType::OpReturn:
+                    out << "        return objects::NULL_OBJ;\n";
+                    break;
+                case bytecode::OpcodeType::OpGetBuiltin:
+                    out << "        " << slot(d) << " = aot::builtin(" << a << ");\n";
+                    break;
+                case bytecode::OpcodeType::OpClosure:
+                {
+                    int numFree = operand(ins, ip + 3, 1);
+                    if (numFree == 0)
+                    {
+                        out << "        " << slot(d) << " = aot::closure(constants[" << a << "], nullptr, 0);\n";
+                    }
+                    else
+                    {
+                        out << "        {\n            aot::Value free[] = {" << moved(d - numFree, numFree) << "};\n"
+                            << "            " << slot(d - numFree) << " = aot::closure(constants[" << a << "], free, " << numFree << ");\n        }\n";
+                    }
+                    break;
+                }
+                case bytecode::OpcodeType::OpGetFree:
+                    out << "        " << slot(d) << " = aot::getFree(self, " << a << ");\n";
+                    break;
+                case bytecode::OpcodeType::OpCurrentClosure:
+                    out << "        " << slot(d) << " = self;\n";
+                    break;
+                default:
+                    return objects::newError("aot: unsupported opcode " + bytecode::OpcodeTypeStr(op));
+                }
+
+                ip += width;
+            }
+
+            if (targets[size])
+            {
+                out << "    L" << size << ":;\n";
+            }
+            if (isMain)
+            {
+                out << "        if (last == nullptr) return objects::NULL_OBJ;\n        return last;\n    }\n";
+            }
+            else
+            {
+                out << "        return objects::NULL_OBJ;\n    }\n";
+            }
+            return nullptr;
+        }
+
+        objects::Ref<objects::Object> Generate(std::string &result)
+        {
+            auto &constants = code.Constants;
+
+            size_t numGlobals = 1;
+            auto scanGlobals = [&](const bytecode::Instructions &ins) {
+                for (size_t ip = 0; ip < ins.size();)
+                {
+                    auto op = static_cast<bytecode::OpcodeType>(ins[ip]);
+                    int width = operandWidth(op);
+                    if (width < 0)
+                    {
+                        return;
+                    }
+                    if (op == bytecode::OpcodeType::OpGetGlobal || op == bytecode::OpcodeType::OpSetGlobal || op == bytecode::OpcodeType::OpGetGlobalMove)
+                    {
+                        numGlobals = std::max(numGlobals, static_cast<size_t>(operand(ins, ip + 1, 2)) + 1);
+                    }
+                    ip += width;
+                }
+            };
+            scanGlobals(code.Instructions);
+
+            for (auto &constant : constants)
+            {
+                if (constant == nullptr)
+                {
+                    return objects::newError("aot: constants must be materialized");
+                }
+                if (constant->Type() == objects::ObjectType::COMPILED_FUNCTION)
+                {
+                    scanGlobals(objects::staticRefCast<objects::CompiledFunction>(constant)->Instructions);
+                }
+            }
+
+            out << "// Generated by monkeyc";
+            if (!options.SourceName.empty())
+            {
+                out << " from " << options.SourceName;
+            }
+            out << ". Do not edit.\n\n#include <iostream>\n\n#include \"aot/runtime.hpp\"\n\nnamespace " << options.Namespace << "\n{\n";
+            out << "    aot::Value globals[" << numGlobals << "];\n";
+            out << "    aot::Value constants[" << std::max<size_t>(constants.size(), 1) << "];\n\n";
+
+            for (size_t i = 0; i < constants.size(); i++)
+            {
+                if (constants[i]->Type() == objects::ObjectType::COMPILED_FUNCTION)
+                {
+                    out << "    aot::Value fn" << i << "(const aot::Value &self, aot::Value *args);\n";
+                }
+            }
+
+            for (size_t i = 0; i < constants.size(); i++)
+            {
+                if (constants[i]->Type() == objects::ObjectType::COMPILED_FUNCTION)
+                {
+                    auto fn = objects::staticRefCast<objects::CompiledFunction>(constants[i]);
+                    auto err = function("fn" + std::to_string(i), fn->Instructions, fn->NumLocals, fn->NumParameters, false);
+                    if (err != nullptr)
+                    {
+                        return err;
+                    }
+                }
+            }
+
+            auto err = function("program", code.Instructions, 0, 0, true);
+            if (err != nullptr)
+            {
+                return err;
+            }
+
+            out << "\n    void initialize()\n    {\n";
+            for (size_t i = 0; i < constants.size(); i++)
+            {
+                auto &constant = constants[i];
+                out << "        constants[" << i << "] = ";
+                switch (constant->Type())
+                {
+                case objects::ObjectType::INTEGER:
+                    out << "objects::makeImmortal(objects::newInteger(" << objects::staticRefCast<objects::Integer>(constant)->Value << "LL));\n";
+                    break;
+                case objects::ObjectType::STRING:
+                {
+                    auto view = objects::staticRefCast<objects::String>(constant)->View();
+                    out << "objects::makeImmortal(objects::makeRef<objects::String>(std::string(" << cppStringLiteral(view) << ", " << view.size() << ")));\n";
+                    break;
+                }
+                case objects::ObjectType::COMPILED_FUNCTION:
+                {
+                    auto fn = objects::staticRefCast<objects::CompiledFunction>(constant);
+                    out << "aot::newFunction(&fn" << i << ", " << fn->NumLocals << ", " << fn->NumParameters << ");\n";
+                    break;
+                }
+                default:
+                    return objects::newError("aot: unsupported constant " + constant->TypeStr());
+                }
+            }
+            out << "    }\n\n";
+
+            out << "    // 运行整个程序, 返回最后弹出的值; 出错时返回nullptr, 错误在aot::Error中\n"
+                << "    aot::Value Run()\n    {\n"
+                << "        static bool initialized = false;\n"
+                << "        if (!initialized)\n        {\n            initialize();\n            initialized = true;\n        }\n"
+                << "        return program(aot::Value(), nullptr);\n    }\n}\n";
+
+            if (options.EmitMain)
+            {
+                out << "\nextern \"C\" int monkey_run()\n{\n"
+                    << "    auto result = " << options.Namespace << "::Run();\n"
+                    << "    if (result == nullptr)\n    {\n"
+                    << "        std::cout << \"Woops! Executing bytecode failed: \\n\" << aot::Error->Inspect() << std::endl;\n"
+                    << "        return 1;\n    }\n";
+                if (options.PrintResult)
+                {
+                    out << "    std::cout << result->Inspect() << std::endl;\n";
+                }
+                out << "    return 0;\n}\n\n#ifndef MONKEY_AOT_NO_MAIN\nint main()\n{\n    return monkey_run();\n}\n#endif\n";
+            }
+
+            result = out.str();
+            return nullptr;
+        }
+    };
+
+    // 失败时返回错误对象(含有不支持的指令或栈深度不一致)
+    objects::Ref<objects::Object> Generate(const compiler::ByteCode &code, const Options &options, std::string &result)
+    {
+        Generator generator(code, options);
+        return generator.Generate(result);
+    }
+}
+
+#endif // H_AOT_H
@@ -0,0 +1,219 @@
+#ifndef H_AOT_RUNTIME_H
+#define H_AOT_RUNTIME_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "code/code.hpp"
+#include "objects/objects.hpp"
+#include "objects/builtins.hpp"
+
+// AOT生成的C++代码使用的运行时: 语义和错误信息与vm::VM中对应的指令一致.
+// 会中止执行的错误不作为值传递: 函数返回nullptr, 错误对象放在aot::Error中.
+// 内置函数返回的错误对象仍然是普通的值, 与VM相同
+namespace aot
+{
+    using Value = objects::Ref<objects::Object>;
+
+    // 生成的函数: self是被调用的闭包, args是参数, 个数已经过检查
+    using Function = Value (*)(const Value &self, Value *args);
+
+    Value Error;
+
+    Value fail(Value err)
+    {
+        Error = std::move(err);
+        return nullptr;
+    }
+
+    bool isInteger(const Value &obj)
+    {
+        return obj->Type() == objects::ObjectType::INTEGER;
+    }
+
+    long long int integerValue(const Value &obj)
+    {
+        return static_cast<objects::Integer *>(obj.get())->Value;
+    }
+
+    // 生成代码中的CompiledFunction常量: 只需要参数个数和入口
+    Value newFunction(Function fn, int numLocals, int numParameters)
+    {
+        auto compiled = objects::makeRef<objects::CompiledFunction>(bytecode::Instructions{}, numLocals, numParameters);
+        compiled->Native = reinterpret_cast<void *>(fn);
+        return objects::makeImmortal(Value(std::move(compiled)));
+    }
+
+    Value binary(bytecode::OpcodeType op, Value left, Value right)
+    {
+        if (isInteger(left) && isInteger(right))
+        {
+            auto l = integerValue(left);
+            auto r = integerValue(right);
+            switch (op)
+            {
+            case bytecode::OpcodeType::OpAdd:
+                return objects::newYoungInteger(l + r);
+            case bytecode::OpcodeType::OpSub:
+                return objects::newYoungInteger(l - r);
+            case bytecode::OpcodeType::OpMul:
+                return objects::newYoungInteger(l * r);
+            case bytecode::OpcodeType::OpDiv:
+                return objects::newYoungInteger(l / r);
+            default:
+                return fail(objects::newError("unknow integer operator: " + bytecode::OpcodeTypeStr(op)));
+            }
+        }
+        else if (left->Type() == objects::ObjectType::STRING && right->Type() == objects::ObjectType::STRING)
+        {
+            if (op != bytecode::OpcodeType::OpAdd)
+            {
+                return fail(objects::newError("unknow string operator: " + bytecode::OpcodeTypeStr(op)));
+            }
+            return objects::concatStrings(objects::staticRefCast<objects::String>(left), objects::staticRefCast<objects::String>(right));
+        }
+
+        return fail(objects::newError("unsupported types for binary operaction: " + left->TypeStr() + " " + right->TypeStr()));
+    }
+
+    // 返回1/0表示比较结果, -1表示出错
+    int compare(bytecode::OpcodeType op, const Value &left, const Value &right)
+    {
+        if (isInteger(left) && isInteger(right))
+        {
+            auto l = integerValue(left);
+            auto r = integerValue(right);
+            switch (op)
+            {
+            case bytecode::OpcodeType::OpEqual:
+                return l == r;
+            case bytecode::OpcodeType::OpNotEqual:
+                return l != r;
+            case bytecode::OpcodeType::OpGreaterThan:
+                return l > r;
+            default:
+                fail(objects::newError("unknow operator: " + bytecode::OpcodeTypeStr(op)));
+                return -1;
+            }
+        }
+
+        switch (op)
+        {
+        case bytecode::OpcodeType::OpEqual:
+            return right == left;
+        case bytecode::OpcodeType::OpNotEqual:
+            return right != left;
+        default:
+            fail(objects::newError("unknow operator: " + bytecode::OpcodeTypeStr(op) + " (" + left->TypeStr() + " " + right->TypeStr() + ")"));
+            return -1;
+        }
+    }
+
+    Value comparison(bytecode::OpcodeType op, Value left, Value right)
+    {
+        int result = compare(op, left, right);
+        if (result < 0)
+        {
+            return nullptr;
+        }
+        return objects::nativeBoolToBooleanObject(result == 1);
+    }
+
+    Value bang(Value operand)
+    {
+        return objects::nativeBoolToBooleanObject(operand == objects::FALSE_OBJ);
+    }
+
+    Value minus(Value operand)
+    {
+        if (!isInteger(operand))
+        {
+            return fail(objects::newError("unsupported type for negation: " + operand->TypeStr()));
+        }
+        return objects::newYoungInteger(-1 * integerValue(operand));
+    }
+
+    bool truthy(Value condition)
+    {
+        return objects::isTruthy(condition);
+    }
+
+    Value array(Value *elements, int numElements)
+    {
+        std::vector<Value> items(std::make_move_iterator(elements), std::make_move_iterator(elements + numElements));
+        return objects::makePooled<objects::Array>(std::move(items));
+    }
+
+    Value hash(Value *elements, int numElements)
+    {
+        auto hash = objects::makeRef<objects::Hash>();
+        for (int i = 0; i < numElements; i += 2)
+        {
+            auto &key = elements[i];
+            if (!key->Hashable())
+            {
+                return fail(objects::newError("unusable as hash type: " + key->TypeStr()));
+            }
+
+            auto hashed = key->GetHashKey();
+            hash->Pairs.Insert(hashed, objects::makePooledShared<objects::HashPair>(std::move(key), std::move(elements[i + 1])));
+        }
+        return hash;
+    }
+
+    Value index(Value left, Value index)
+    {
+        if (left->Type() == objects::ObjectType::ARRAY && isInteger(index))
+        {
+            auto result = objects::evalArrayIndexExpression(left, index);
+            return objects::isError(result) ? fail(result) : result;
+        }
+        else if (left->Type() == objects::ObjectType::HASH)
+        {
+            auto result = objects::evalHashIndexExpression(left, index);
+            return objects::isError(result) ? fail(result) : result;
+        }
+
+        return fail(objects::newError("index operator not supported: " + left->TypeStr()));
+    }
+
+    Value call(const Value &callee, Value *args, int numArgs)
+    {
+        if (callee->Type() == objects::ObjectType::CLOSURE)
+        {
+            auto &fn = static_cast<objects::Closure *>(callee.get())->Fn;
+            if (fn->NumParameters != numArgs)
+            {
+                return fail(objects::newError("wrong number of arguments: want=" + std::to_string(fn->NumParameters) + ", got=" + std::to_string(numArgs)));
+            }
+            return reinterpret_cast<Function>(fn->Native)(callee, args);
+        }
+        else if (callee->Type() == objects::ObjectType::BUILTIN)
+        {
+            std::vector<Value> builtinArgs(std::make_move_iterator(args), std::make_move_iterator(args + numArgs));
+            auto result = static_cast<objects::Builtin *>(callee.get())->Fn(builtinArgs);
+            return (result != nullptr) ? result : objects::NULL_OBJ;
+        }
+
+        return fail(objects::newError("calling non-function and non-built-in"));
+    }
+
+    Value closure(const Value &fn, Value *free, int numFree)
+    {
+        std::vector<Value> items(std::make_move_iterator(free), std::make_move_iterator(free + numFree));
+        return objects::makePooled<objects::Closure>(objects::staticRefCast<objects::CompiledFunction>(fn), std::move(items));
+    }
+
+    const Value &getFree(const Value &self, int freeIndex)
+    {
+        return static_cast<objects::Closure *>(self.get())->Free[freeIndex];
+    }
+
+    Value builtin(int builtinIndex)
+    {
+        return objects::Builtins[builtinIndex]->Builtin;
+    }
+}
+
+#endif // H_AOT_RUNTIME_H
@@ -0,0 +1,128 @@
+#ifndef H_ARENA_H
+#define H_ARENA_H
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+namespace ast
+{
+    // 一次解析产生的所有节点都在同一个arena中做指针碰撞分配, 随Program一起整体释放.
+    // Make返回的std::shared_ptr不带控制块(别名到空的所有者), 复制不做引用计数,
+    // 相当于裸指针; 需要在Program之外持有节点时用Retain换成让arena保持存活的句柄
+    struct Arena : std::enable_shared_from_this<Arena>
+    {
+        static const size_t ChunkSize = 64 * 1024;
+
+        // 需要析构的节点前面紧挨着一条析构记录, 释放时逆序调用
+        struct Destructor
+        {
+            void (*destroy)(void *);
+            Destructor *next;
+        };
+
+        static const size_t HeaderSize = (sizeof(Destructor) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+        std::vector<void *> chunks;
+        char *cursor = nullptr;
+        size_t remaining = 0;
+        Destructor *destructors = nullptr;
+
+        size_t Nodes = 0;
+        size_t BytesUsed = 0;
+        size_t BytesReserved = 0;
+
+        Arena() {}
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        ~Arena()
+        {
+            for (auto d = destructors; d != nullptr; d = d->next)
+            {
+                d->destroy(reinterpret_cast<char *>(d) + HeaderSize);
+            }
+
+            for (auto chunk : chunks)
+            {
+                std::free(chunk);
+            }
+        }
+
+        void *Allocate(size_t size, size_t align)
+        {
+            size_t padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+            if (cursor == nullptr || padding + size > remaining)
+            {
+                // 过大的请求单独占用一块, 当前块继续使用
+                if (size + align > ChunkSize / 4)
+                {
+                    char *mem = newChunk(size + align);
+                    size_t offset = (align - reinterpret_cast<uintptr_t>(mem) % align) % align;
+                    BytesUsed += size;
+                    return mem + offset;
+                }
+
+                cursor = newChunk(ChunkSize);
+                remaining = ChunkSize;
+                padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+            }
+
+            char *p = cursor + padding;
+            cursor += padding + size;
+            remaining -= padding + size;
+            BytesUsed += size;
+            return p;
+        }
+
+        template <typename T, typename... Args>
+        std::shared_ptr<T> Make(Args &&...args)
+        {
+            static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned node type");
+
+            T *obj;
+            if constexpr (std::is_trivially_destructible_v<T>)
+            {
+                obj = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            }
+            else
+            {
+                char *mem = static_cast<char *>(Allocate(HeaderSize + sizeof(T), alignof(std::max_align_t)));
+                obj = new (mem + HeaderSize) T(std::forward<Args>(args)...);
+
+                auto d = reinterpret_cast<Destructor *>(mem);
+                d->destroy = [](void *p) { static_cast<T *>(p)->~T(); };
+                d->next = destructors;
+                destructors = d;
+            }
+
+            Nodes += 1;
+            return std::shared_ptr<T>(std::shared_ptr<T>(), obj);
+        }
+
+        template <typename T>
+        std::shared_ptr<T> Retain(const std::shared_ptr<T> &node)
+        {
+            return std::shared_ptr<T>(shared_from_this(), node.get());
+        }
+
+        char *newChunk(size_t size)
+        {
+            void *mem = std::malloc(size);
+            if (mem == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            chunks.push_back(mem);
+            BytesReserved += size;
+            return static_cast<char *>(mem);
+        }
+    };
+}
+
+#endif // H_ARENA_H
@@ -10,6 +10,7 @@
 #include <memory>
 
 #include "token/token.hpp"
+#include "ast/arena.hpp"
 
 namespace ast
 {
@@ -391,16 +392,47 @@ namespace ast
         virtual NodeType GetNodeType() { return ast::NodeType::IfExpression; }
     };
 
+    struct FunctionLiteral;
+
+    // 预解析时跳过的函数体: 只记录在源码中的范围和其中出现的名字(含嵌套函数)
+    struct SkippedBody
+    {
+        std::shared_ptr<const std::string> Source; // 整个源文件, 同一次解析跳过的函数体共享
+        int Begin = 0;                             // '{'的位置
+        int End = 0;                               // '}'之后的位置
+        std::vector<std::string> Names;            // 被引用的标识符, 已排序去重
+        std::vector<std::string> Declared;         // let和嵌套函数参数定义的名字, 已排序去重
+        std::string (*Parse)(FunctionLiteral &fn) = nullptr; // 解析函数体填入pBody, 返回错误信息
+    };
+
     struct FunctionLiteral : Expression
     {
         token::Token Token; // The 'fn' token
         std::vector<std::shared_ptr<Identifier>> v_pParameters;
         std::shared_ptr<BlockStatement> pBody;
+        std::shared_ptr<SkippedBody> pSkipped; // 不为空时pBody还没有解析
         std::string Name;
+        Arena *pArena = nullptr; // 节点所在的arena, 求值得到的函数对象要让它保持存活
 
         FunctionLiteral(token::Token tok) : Token(tok) {}
         virtual ~FunctionLiteral() {}
 
+        // 第一次编译或求值前解析跳过的函数体, 失败时返回错误信息
+        std::string ParseBody()
+        {
+            if (pSkipped == nullptr)
+            {
+                return "";
+            }
+
+            auto err = pSkipped->Parse(*this);
+            if (err.empty())
+            {
+                pSkipped.reset();
+            }
+            return err;
+        }
+
         virtual void ExpressionNode() {}
         virtual std::string TokenLiteral() { return Token.Literal; }
         virtual std::string String()
@@ -418,7 +450,15 @@ namespace ast
                 oss << "<" << Name << ">";
             }
             
-            oss << "(" << Join(params, ", ") << ") " << pBody->String();
+            oss << "(" << Join(params, ", ") << ") ";
+            if (pSkipped != nullptr)
+            {
+                oss << pSkipped->Source->substr(pSkipped->Begin, pSkipped->End - pSkipped->Begin);
+            }
+            else
+            {
+                oss << pBody->String();
+            }
             return oss.str();
         }
         virtual NodeType GetNodeType() { return ast::NodeType::FunctionLiteral; }
@@ -451,6 +491,7 @@ namespace ast
 
     struct Program: Node
     {
+        std::shared_ptr<Arena> pArena; // 持有所有节点, 为空时节点各自在堆上分配
         std::vector<std::shared_ptr<Statement>> v_pStatements;
 
         std::string TokenLiteral()
@@ -4,6 +4,7 @@
 #include <map>
 #include <memory>
 #include <chrono>
+#include <sstream>
 
 #define STRIP_FLAG_HELP 1
 #include <gflags/gflags.h>
@@ -14,7 +15,12 @@
 #include "objects/environment.hpp"
 #include "evaluator/evaluator.hpp"
 #include "compiler/compiler.hpp"
+#include "compiler/cache.hpp"
 #include "vm/vm.hpp"
+#include "regvm/compiler.hpp"
+#include "regvm/vm.hpp"
+#include "ir/compiler.hpp"
+#include "tier/tier.hpp"
 
 std::string input = R""(
 let fibonacci = fn(x){
@@ -34,14 +40,87 @@ fibonacci(35);
 
 std::string input2 = "fibonacci(35);";
 
-DEFINE_string(engine, ":)", "use 'vm' or 'eval'");
+// 比较和减法放在小函数里, 用来观察内联的效果
+std::string input3 = R""(
+let less = fn(a, b) { a < b };
+let minus = fn(a, b) { a - b };
+let fibonacci = fn(x){
+    if(less(x, 2)){
+        x
+    } else {
+        fibonacci(minus(x, 1)) + fibonacci(minus(x, 2))
+    }
+};
+
+fibonacci(35);
+)"";
+
+// 小函数定义在函数体内, 每次调用都创建闭包, 用来观察闭包提升的效果
+std::string input4 = R""(
+let fibonacci = fn(x){
+    let small = fn(n) { n < 2 };
+    let minus = fn(k) { x - k };
+    if(small(x)){
+        x
+    } else {
+        fibonacci(minus(1)) + fibonacci(minus(2))
+    }
+};
+
+fibonacci(35);
+)"";
+
+DEFINE_string(engine, ":)", "use 'vm', 'jit', 'reg', 'tier' or 'eval'");
 DEFINE_bool(builtin, false, "use builtin fibonacci function");
+DEFINE_bool(helpers, false, "call small helper functions for the comparison and the subtraction");
+DEFINE_bool(local_helpers, false, "define the helper functions as closures inside fibonacci");
+DEFINE_bool(lift_closures, false, "pass the values captured by non-escaping local closures as extra arguments (vm/jit only)");
+DEFINE_int32(inline_threshold, 0, "inline global functions with at most this many AST nodes (vm/jit only)");
+DEFINE_bool(constant_globals, false, "read globals bound once to a literal or function from the constant pool (vm/jit only)");
+DEFINE_string(cache_dir, "", "load/store the compiled bytecode in this directory (vm/jit only)");
+DEFINE_int32(jit_threshold, 2, "calls before a function is compiled to machine code (jit only)");
+DEFINE_int32(tier_threshold, 10, "calls before a function literal is compiled to bytecode (tier only)");
+DEFINE_bool(ir, false, "compile through the SSA IR and its optimization pipeline (vm/jit only)");
+DEFINE_string(ir_disable, "", "comma separated IR passes to turn off: copyprop,cse,gvn,dce");
+
+// 主程序和所有函数常量的静态指令条数
+int stackInstructionCount(const bytecode::Instructions &ins)
+{
+    int count = 0;
+    for(int i = 0, size = ins.size(); i < size; count++)
+    {
+        auto def = bytecode::Lookup(static_cast<bytecode::OpcodeType>(ins[i]));
+        i += 1;
+        for(auto &w: def->OperandWidths)
+        {
+            i += w;
+        }
+    }
+    return count;
+}
+
+template <typename Counter>
+void printCodeSize(const bytecode::Instructions &mainIns, const std::vector<objects::Ref<objects::Object>> &constants, Counter count)
+{
+    int instructions = count(mainIns);
+    size_t bytes = mainIns.size();
+    for(auto &constant: constants)
+    {
+        if(constant != nullptr && constant->Type() == objects::ObjectType::COMPILED_FUNCTION)
+        {
+            auto &ins = static_cast<objects::CompiledFunction *>(constant.get())->Instructions;
+            instructions += count(ins);
+            bytes += ins.size();
+        }
+    }
+    std::cout << "code: instructions=" << instructions << ", bytes=" << bytes << std::endl;
+}
 
 int main(int argc, char **argv)
 {
     gflags::ParseCommandLineFlags(&argc, &argv, false);
 
-    auto result = std::make_shared<objects::Object>();
+    auto result = objects::makeRef<objects::Object>();
 
     auto start = std::chrono::system_clock::now();
     auto end = start;
@@ -50,6 +129,10 @@ int main(int argc, char **argv)
 
     if(FLAGS_builtin){
         pLexer = lexer::New(input2);
+    } else if(FLAGS_helpers){
+        pLexer = lexer::New(input3);
+    } else if(FLAGS_local_helpers){
+        pLexer = lexer::New(input4);
     }
 
     auto pParser = parser::New(std::move(pLexer));
@@ -57,9 +140,90 @@ int main(int argc, char **argv)
 
     std::shared_ptr<ast::Node> astNode(reinterpret_cast<ast::Node *>(pProgram.release()));
 
-    if(FLAGS_engine == "vm")
+    if(FLAGS_engine == "vm" || FLAGS_engine == "jit")
     {
-        auto comp = compiler::New();
+        auto source = FLAGS_builtin ? input2 : (FLAGS_helpers ? input3 : (FLAGS_local_helpers ? input4 : input));
+        auto cache = compiler::NewBytecodeCache(FLAGS_cache_dir);
+
+        auto frontStart = std::chrono::system_clock::now();
+        auto code = (FLAGS_cache_dir.empty() || FLAGS_ir) ? nullptr : cache->Load(source);
+        if(FLAGS_ir)
+        {
+            auto comp = ir::New();
+            std::stringstream passes(FLAGS_ir_disable);
+            for(std::string name; std::getline(passes, name, ',');)
+            {
+                if(!comp->pipeline.Enable(name, false))
+                {
+                    std::cout << "unknown IR pass: " << name << std::endl;
+                    return -1;
+                }
+            }
+
+            auto error = comp->Compile(astNode);
+            if(objects::isError(error))
+            {
+                std::cout << "compiler error: " << error->Inspect() << std::endl;
+                return -1;
+            }
+            code = comp->Bytecode();
+        }
+        else if(code == nullptr)
+        {
+            auto comp = compiler::New();
+            comp->InlineThreshold = FLAGS_inline_threshold;
+            // 缓存不保存常量池中的闭包
+            comp->ConstantGlobals = FLAGS_constant_globals && FLAGS_cache_dir.empty();
+            comp->LiftClosures = FLAGS_lift_closures;
+            auto error = comp->Compile(astNode);
+            if(objects::isError(error))
+            {
+                std::cout << "compiler error: " << error->Inspect() << std::endl;
+                return -1;
+            }
+            if(comp->inlining != nullptr)
+            {
+                std::cout << "inlined call sites=" << comp->inlining->Sites.size() << std::endl;
+            }
+
+            code = comp->Bytecode();
+            if(!FLAGS_cache_dir.empty())
+            {
+                cache->Store(source, *code, *comp->symbolTable);
+            }
+        }
+        std::chrono::duration<double, std::micro> frontTime = std::chrono::system_clock::now() - frontStart;
+        if(!FLAGS_cache_dir.empty())
+        {
+            std::cout << "bytecode cache " << (cache->Hits > 0 ? "hit" : "miss") << ", load/compile=" << frontTime.count() << "us" << std::endl;
+        }
+
+        auto machine = vm::New(code);
+        if(FLAGS_engine == "jit")
+        {
+            machine->JitThreshold = FLAGS_jit_threshold;
+        }
+
+        start = std::chrono::system_clock::now();
+
+        result = machine->Run();
+        if(objects::isError(result))
+        {
+            std::cout << "vm error: " << result->Inspect() << std::endl;
+            return -1;
+        }
+
+        end = std::chrono::system_clock::now();
+
+        result = machine->LastPoppedStackElem();
+
+        printCodeSize(code->Instructions, code->Constants, stackInstructionCount);
+        if(machine->Dispatched > 0)
+        {
+            std::cout << "dispatched instructions=" << machine->Dispatched << std::endl;
+        }
+    } else if(FLAGS_engine == "reg") {
+        auto comp = regvm::New();
         auto error = comp->Compile(astNode);
         if(objects::isError(error))
         {
@@ -67,7 +231,8 @@ int main(int argc, char **argv)
             return -1;
         }
 
-        auto machine = vm::New(comp->Bytecode());
+        auto code = comp->Bytecode();
+        auto machine = regvm::New(code);
 
         start = std::chrono::system_clock::now();
 
@@ -81,6 +246,27 @@ int main(int argc, char **argv)
         end = std::chrono::system_clock::now();
 
         result = machine->LastPoppedStackElem();
+
+        printCodeSize(code->Instructions, code->Constants, regvm::InstructionCount);
+        if(machine->Dispatched > 0)
+        {
+            std::cout << "dispatched instructions=" << machine->Dispatched << std::endl;
+        }
+    } else if(FLAGS_engine == "tier") {
+        tier::Engine engine;
+        engine.HotThreshold = FLAGS_tier_threshold;
+        auto env = objects::NewEnvironment();
+
+        start = std::chrono::system_clock::now();
+
+        result = engine.Run(astNode, env);
+
+        end = std::chrono::system_clock::now();
+
+        std::cout << "tier: compiled=" << engine.Compiled
+                  << ", rejected=" << engine.Rejected
+                  << ", interpreted calls=" << engine.InterpretedCalls
+                  << ", calls into vm=" << engine.CompiledCalls << std::endl;
     } else if(FLAGS_engine == "eval") {
         auto env = objects::NewEnvironment();
 
@@ -90,7 +276,7 @@ int main(int argc, char **argv)
 
         end = std::chrono::system_clock::now();
     } else {
-        std::cout << "usage: fibonacci -engine vm|eval [-builtin]" << std::endl;
+        std::cout << "usage: fibonacci -engine vm|jit|reg|tier|eval [-builtin | -helpers | -local_helpers] [-ir [-ir_disable passes]] [-inline_threshold n] [-constant_globals] [-lift_closures]" << std::endl;
         return -1;
     }
 
@@ -98,5 +284,29 @@ int main(int argc, char **argv)
 
     std::cout << "engine=" << FLAGS_engine << ", fibonacci(35)=" << result->Inspect() << ", duration=" << diff.count() << "s" << std::endl;
 
+    auto seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "nursery: allocations=" << objects::Nursery.Allocations
+              << ", bytes=" << objects::Nursery.AllocatedBytes
+              << ", throughput=" << static_cast<size_t>(objects::Nursery.Allocations / (seconds > 0 ? seconds : 1)) << "/s"
+              << ", minor collections=" << objects::Nursery.MinorCollections
+              << ", promoted=" << objects::Nursery.Promoted << std::endl;
+    std::cout << "small integers: hits=" << objects::SmallInts.Hits.load()
+              << ", misses=" << objects::SmallInts.Misses.load()
+              << ", hit rate=" << objects::SmallInts.HitRate() << std::endl;
+    std::cout << "pool: slabs=" << objects::Pool.Slabs
+              << ", utilization=" << objects::Pool.Utilization()
+              << ", peak bytes=" << objects::Pool.PeakBytes << std::endl;
+    for (size_t i = 0; i < objects::PoolSpace::TypeCount; i++)
+    {
+        auto &stats = objects::Pool.Types[i];
+        std::cout << "  " << objects::PoolSpace::TypeInfo[i].Name << ": live=" << stats.Live << ", allocations=" << stats.Allocations << std::endl;
+    }
+    if(FLAGS_engine == "jit")
+    {
+        std::cout << "jit: compiled=" << vm::JitCode.Compiled
+                  << ", rejected=" << vm::JitCode.Rejected
+                  << ", code bytes=" << vm::JitCode.CodeBytes << std::endl;
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <malloc.h>
+
+#define STRIP_FLAG_HELP 1
+#include <gflags/gflags.h>
+
+#include "lexer/lexer.hpp"
+#include "parser/parser.hpp"
+
+DEFINE_int32(size, 4, "size of the generated source in MB");
+DEFINE_string(mode, "both", "use 'arena', 'heap' or 'both'");
+
+// 标识符不能含数字, 用字母编号
+std::string name(size_t i)
+{
+    std::string result;
+    do
+    {
+        result += static_cast<char>('a' + i % 26);
+        i /= 26;
+    } while (i > 0);
+    return result;
+}
+
+// 生成由函数定义、调用、数组和哈希表组成的源码
+std::string generate(size_t bytes)
+{
+    std::string source;
+    source.reserve(bytes + 256);
+
+    for (size_t i = 0; source.size() < bytes; i++)
+    {
+        auto n = std::to_string(i);
+        auto id = name(i);
+        source += "let fun" + id + " = fn(a, b) { if (a < b) { return a * " + n + " + b; } else { return [a, b, \"s" + n + "\"][1]; } };\n";
+        source += "let tbl" + id + " = {\"k\": fun" + id + "(" + n + ", -2), \"v\": [1, 2, 3]};\n";
+        source += "puts(tbl" + id + "[\"k\"] + len(tbl" + id + "[\"v\"]) - (" + n + " / 3));\n";
+    }
+
+    return source;
+}
+
+size_t heapInUse()
+{
+    return mallinfo2().uordblks;
+}
+
+void run(const std::string &source, bool useArena)
+{
+    auto before = heapInUse();
+    auto start = std::chrono::steady_clock::now();
+
+    auto pParser = parser::New(lexer::New(source));
+    pParser->UseArena = useArena;
+    auto pProgram = pParser->ParseProgram();
+
+    auto parsed = std::chrono::steady_clock::now();
+    auto held = heapInUse() - before;
+
+    if (pParser->Errors().size() > 0)
+    {
+        std::cout << "parser error: " << pParser->Errors()[0] << std::endl;
+        return;
+    }
+
+    auto statements = pProgram->v_pStatements.size();
+    pProgram.reset();
+    auto freed = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::milli> parseTime = parsed - start;
+    std::chrono::duration<double, std::milli> freeTime = freed - parsed;
+
+    std::cout << (useArena ? "arena" : "heap ") << ": statements=" << statements
+              << ", parse=" << parseTime.count() << "ms"
+              << ", free=" << freeTime.count() << "ms"
+              << ", memory=" << held / 1024 << "KB" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, false);
+
+    auto source = generate(static_cast<size_t>(FLAGS_size) * 1024 * 1024);
+    std::cout << "source=" << source.size() / 1024 << "KB" << std::endl;
+
+    if (FLAGS_mode == "heap" || FLAGS_mode == "both")
+    {
+        run(source, false);
+    }
+
+    if (FLAGS_mode == "arena" || FLAGS_mode == "both")
+    {
+        run(source, true);
+    }
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <chrono>
+
+#define STRIP_FLAG_HELP 1
+#include <gflags/gflags.h>
+
+#include "lexer/lexer.hpp"
+#include "parser/parser.hpp"
+#include "compiler/compiler.hpp"
+#include "compiler/cache.hpp"
+#include "vm/vm.hpp"
+
+DEFINE_int32(functions, 16000, "number of generated functions (4 constants each, OpConstant indexes at most 65536)");
+DEFINE_string(cache_dir, "/tmp/monkey-startup-cache", "directory of the bytecode cache");
+DEFINE_string(mode, "both", "use 'eager', 'lazy' or 'both'");
+DEFINE_bool(from_source, true, "also time parsing and compiling from source with eager and lazy function bodies");
+
+// 标识符不能含数字, 用字母编号
+std::string name(size_t i)
+{
+    std::string result;
+    do
+    {
+        result += static_cast<char>('a' + i % 26);
+        i /= 26;
+    } while (i > 0);
+    return result;
+}
+
+// 大量函数定义, 每个带有字符串和整数常量, 运行时只调用其中一个
+std::string generate(int functions)
+{
+    std::string source;
+    for (int i = 0; i < functions; i++)
+    {
+        auto n = std::to_string(100000 + i);
+        source += "let fun" + name(i) + " = fn(a) { if (a > " + n + ") { \"big " + n + "\" } else { a * " + n + " } };\n";
+    }
+    source += "funa(2);\n";
+    return source;
+}
+
+void run(const std::string &source, compiler::BytecodeCache &cache, bool lazy)
+{
+    cache.Lazy = lazy;
+
+    auto start = std::chrono::steady_clock::now();
+    auto code = cache.Load(source);
+    if (code == nullptr)
+    {
+        std::cout << "cache miss" << std::endl;
+        return;
+    }
+    auto machine = vm::New(code);
+    auto ready = std::chrono::steady_clock::now();
+
+    auto result = machine->Run();
+    auto done = std::chrono::steady_clock::now();
+
+    if (objects::isError(result))
+    {
+        std::cout << "vm error: " << result->Inspect() << std::endl;
+        return;
+    }
+
+    std::chrono::duration<double, std::milli> startup = ready - start;
+    std::chrono::duration<double, std::milli> total = done - start;
+
+    std::cout << (lazy ? "lazy : " : "eager: ") << "constants=" << code->Constants.size()
+              << ", time to first instruction=" << startup.count() << "ms"
+              << ", total=" << total.count() << "ms"
+              << ", result=" << machine->LastPoppedStackElem()->Inspect() << std::endl;
+}
+
+// 不经过缓存: 解析编译整个程序后执行, lazy时函数体只做预解析, 在第一次调用时才解析和编译
+void compileAndRun(const std::string &source, bool lazy)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto pParser = parser::New(lexer::New(source));
+    pParser->Preparse = lazy;
+    std::shared_ptr<ast::Program> pProgram{pParser->ParseProgram()};
+    if (pParser->Errors().size() > 0)
+    {
+        std::cout << "parser error: " << pParser->Errors()[0] << std::endl;
+        return;
+    }
+    auto parsed = std::chrono::steady_clock::now();
+
+    auto comp = compiler::New();
+    comp->LazyFunctions = lazy;
+    auto error = comp->Compile(pProgram);
+    if (objects::isError(error))
+    {
+        std::cout << "compiler error: " << error->Inspect() << std::endl;
+        return;
+    }
+    auto machine = vm::New(comp->Bytecode());
+    auto ready = std::chrono::steady_clock::now();
+
+    auto result = machine->Run();
+    auto done = std::chrono::steady_clock::now();
+
+    if (objects::isError(result))
+    {
+        std::cout << "vm error: " << result->Inspect() << std::endl;
+        return;
+    }
+
+    std::chrono::duration<double, std::milli> parse = parsed - start;
+    std::chrono::duration<double, std::milli> startup = ready - start;
+    std::chrono::duration<double, std::milli> total = done - start;
+
+    std::cout << (lazy ? "source lazy : " : "source eager: ") << "ast nodes=" << pProgram->pArena->Nodes
+              << ", ast bytes=" << pProgram->pArena->BytesUsed
+              << ", constants=" << machine->constants.size()
+              << ", parse=" << parse.count() << "ms"
+              << ", time to first instruction=" << startup.count() << "ms"
+              << ", total=" << total.count() << "ms"
+              << ", result=" << machine->LastPoppedStackElem()->Inspect() << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, false);
+
+    auto source = generate(FLAGS_functions);
+    auto cache = compiler::NewBytecodeCache(FLAGS_cache_dir);
+
+    auto pParser = parser::New(lexer::New(source));
+    auto pProgram = pParser->ParseProgram();
+    if (pParser->Errors().size() > 0)
+    {
+        std::cout << "parser error: " << pParser->Errors()[0] << std::endl;
+        return -1;
+    }
+
+    std::shared_ptr<ast::Node> astNode(reinterpret_cast<ast::Node *>(pProgram.release()));
+    auto comp = compiler::New();
+    auto error = comp->Compile(astNode);
+    if (objects::isError(error))
+    {
+        std::cout << "compiler error: " << error->Inspect() << std::endl;
+        return -1;
+    }
+
+    if (!cache->Store(source, *comp->Bytecode(), *comp->symbolTable))
+    {
+        std::cout << "could not write " << cache->PathFor(compiler::HashSource(source)) << std::endl;
+        return -1;
+    }
+
+    if (FLAGS_mode == "eager" || FLAGS_mode == "both")
+    {
+        run(source, *cache, false);
+    }
+
+    if (FLAGS_mode == "lazy" || FLAGS_mode == "both")
+    {
+        run(source, *cache, true);
+    }
+
+    if (FLAGS_from_source)
+    {
+        compileAndRun(source, false);
+        compileAndRun(source, true);
+    }
+
+    return 0;
+}
@@ -76,6 +76,9 @@ namespace bytecode
         OpClosure,
         OpGetFree,
         OpCurrentClosure,
+
+        OpGetLocalMove,  // OpGetLocal on a dead slot, hands its reference over
+        OpGetGlobalMove, // OpGetGlobal on a binding about to be overwritten
     };
 
     std::string OpcodeTypeStr(OpcodeType op)
@@ -142,6 +145,10 @@ namespace bytecode
                 return "OpGetFree";
             case OpcodeType::OpCurrentClosure:
                 return "OpCurrentClosure";
+            case OpcodeType::OpGetLocalMove:
+                return "OpGetLocalMove";
+            case OpcodeType::OpGetGlobalMove:
+                return "OpGetGlobalMove";
             default:
                 return std::to_string(static_cast<int>(op));
         }
@@ -208,6 +215,9 @@ namespace bytecode
         {OpcodeType::OpClosure, std::make_shared<Definition>("OpClosure", std::vector<int>{2, 1})},
         {OpcodeType::OpGetFree, std::make_shared<Definition>("OpGetFree", 1)},
         {OpcodeType::OpCurrentClosure, std::make_shared<Definition>("OpCurrentClosure")},
+
+        {OpcodeType::OpGetLocalMove, std::make_shared<Definition>("OpGetLocalMove", 1)},
+        {OpcodeType::OpGetGlobalMove, std::make_shared<Definition>("OpGetGlobalMove", 2)},
     };
 
     std::shared_ptr<Definition> Lookup(OpcodeType op){
@@ -219,14 +229,14 @@ namespace bytecode
         return fit->second;
     }
 
-    void ReadUint8(Instructions &ins, int offset, uint8_t& uint8Value)
+    void ReadUint8(const Instructions &ins, int offset, uint8_t& uint8Value)
     {
-        memcpy(&uint8Value, (unsigned char*)(&ins[offset]), sizeof(uint8Value));
+        memcpy(&uint8Value, (const unsigned char*)(&ins[offset]), sizeof(uint8Value));
     }
 
-    void ReadUint16(Instructions &ins, int offset, uint16_t& uint16Value)
+    void ReadUint16(const Instructions &ins, int offset, uint16_t& uint16Value)
     {
-        memcpy(&uint16Value, (unsigned char*)(&ins[offset]), sizeof(uint16Value));
+        memcpy(&uint16Value, (const unsigned char*)(&ins[offset]), sizeof(uint16Value));
 
         if(bytecode::BinaryEndian() == bytecode::BinaryEndianType::SMALLENDIAN) // from BIGENDIAN
         {
@@ -0,0 +1,778 @@
+#ifndef H_CACHE_H
+#define H_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "compiler/compiler.hpp"
+#include "objects/builtins.hpp"
+
+namespace compiler
+{
+    // 字节码缓存文件(.mkc)的布局, 所有整数按本机字节序存放:
+    //   magic u32 | version u32 | sourceHash u64 | checksum u64 (其后全部内容的FNV-1a)
+    //   instructions: u32 长度 + 字节
+    //   constants:    u32 个数n, u32 偏移表[n+1] (相对常量区起点, 最后一项为常量区长度), 常量区
+    //                 每个常量为 u8 类型 + 内容:
+    //                 INTEGER i64 | STRING u32 长度 + 字节
+    //                 COMPILED_FUNCTION i32 NumLocals, i32 NumParameters, i32 NumFree, u32 长度 + 指令字节
+    //   symbols:      u32 个数, 每个为 i32 Index + u32 长度 + 名字 (全局变量)
+    // 字节序不同的机器读到的magic不一致, 会当作无效缓存.
+    // 有偏移表就可以直接在映射的文件上按下标解码单个常量, 不必先全部构造出来.
+    // 校验和只防止文件损坏; 载入时还会检查指令的操作数、跳转目标和栈深度, 避免VM越界访问
+    const uint32_t CacheMagic = 0x434B4D00; // "\0MKC"
+    const uint32_t CacheFormatVersion = 4;   // 指令集或布局变化时递增
+    const size_t CacheHeaderSize = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+    enum class CacheConstantType : uint8_t
+    {
+        Integer = 1,
+        String = 2,
+        CompiledFunction = 3,
+    };
+
+    const uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+
+    uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+    {
+        auto p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // 源码内容哈希(FNV-1a), 同时覆盖格式版本和内置函数表, 二者变化时旧缓存自然失效
+    uint64_t HashSource(const std::string &source)
+    {
+        uint64_t hash = FnvOffsetBasis;
+        auto mix = [&](const void *data, size_t size) { hash = fnv1a(hash, data, size); };
+
+        mix(&CacheFormatVersion, sizeof(CacheFormatVersion));
+        for (auto &fn : objects::Builtins)
+        {
+            mix(fn->Name.data(), fn->Name.size() + 1);
+        }
+        mix(source.data(), source.size());
+
+        return hash;
+    }
+
+    struct CacheWriter
+    {
+        std::string buffer;
+
+        template <typename T>
+        void Write(const T &val)
+        {
+            buffer.append(reinterpret_cast<const char *>(&val), sizeof(T));
+        }
+
+        void WriteBytes(const void *data, size_t size)
+        {
+            Write(static_cast<uint32_t>(size));
+            buffer.append(static_cast<const char *>(data), size);
+        }
+    };
+
+    // 按边界检查读取映射的文件内容, 任何越界或格式错误都让ok变为false
+    struct CacheReader
+    {
+        const uint8_t *p;
+        const uint8_t *end;
+        bool ok = true;
+
+        CacheReader(const uint8_t *data, size_t size) : p(data), end(data + size) {}
+
+        template <typename T>
+        T Read()
+        {
+            T val{};
+            if (!ok || static_cast<size_t>(end - p) < sizeof(T))
+            {
+                ok = false;
+                return val;
+            }
+            std::memcpy(&val, p, sizeof(T));
+            p += sizeof(T);
+            return val;
+        }
+
+        std::pair<const uint8_t *, size_t> ReadBytes()
+        {
+            auto size = Read<uint32_t>();
+            if (!ok || static_cast<size_t>(end - p) < size)
+            {
+                ok = false;
+                return {nullptr, 0};
+            }
+            auto data = p;
+            p += size;
+            return {data, size};
+        }
+    };
+
+    // 序列化失败(出现无法存放的常量类型)时返回空串
+    std::string SerializeBytecode(const ByteCode &code, const SymbolTable &symbols, uint64_t sourceHash)
+    {
+        CacheWriter w;
+        w.Write(CacheMagic);
+        w.Write(CacheFormatVersion);
+        w.Write(sourceHash);
+        w.Write(uint64_t(0)); // 校验和, 最后填写
+
+        w.WriteBytes(code.Instructions.data(), code.Instructions.size());
+
+        w.Write(static_cast<uint32_t>(code.Constants.size()));
+        size_t offsetTable = w.buffer.size();
+        w.buffer.append((code.Constants.size() + 1) * sizeof(uint32_t), '\0');
+        size_t entries = w.buffer.size();
+
+        for (size_t i = 0; i < code.Constants.size(); i++)
+        {
+            uint32_t offset = w.buffer.size() - entries;
+            std::memcpy(&w.buffer[offsetTable + i * sizeof(uint32_t)], &offset, sizeof(offset));
+
+            auto &constant = code.Constants[i];
+            switch (constant->Type())
+            {
+            case objects::ObjectType::INTEGER:
+                w.Write(CacheConstantType::Integer);
+                w.Write(static_cast<int64_t>(objects::staticRefCast<objects::Integer>(constant)->Value));
+                break;
+            case objects::ObjectType::STRING:
+            {
+                auto view = objects::staticRefCast<objects::String>(constant)->View();
+                w.Write(CacheConstantType::String);
+                w.WriteBytes(view.data(), view.size());
+                break;
+            }
+            case objects::ObjectType::COMPILED_FUNCTION:
+            {
+                auto fn = objects::staticRefCast<objects::CompiledFunction>(constant);
+                if (fn->Lazy != nullptr)
+                {
+                    return ""; // 函数体还没有编译
+                }
+                w.Write(CacheConstantType::CompiledFunction);
+                w.Write(static_cast<int32_t>(fn->NumLocals));
+                w.Write(static_cast<int32_t>(fn->NumParameters));
+                w.Write(static_cast<int32_t>(fn->NumFree));
+                w.WriteBytes(fn->Instructions.data(), fn->Instructions.size());
+                break;
+            }
+            default:
+                return "";
+            }
+        }
+
+        uint32_t end = w.buffer.size() - entries;
+        std::memcpy(&w.buffer[offsetTable + code.Constants.size() * sizeof(uint32_t)], &end, sizeof(end));
+
+        std::vector<std::shared_ptr<Symbol>> globals;
+        for (auto &[name, symbol] : symbols.store)
+        {
+            if (symbol->Scope == SymbolScopeType::GlobalScope)
+            {
+                globals.push_back(symbol);
+            }
+        }
+        std::sort(globals.begin(), globals.end(), [](auto &a, auto &b) { return a->Index < b->Index; });
+
+        w.Write(static_cast<uint32_t>(globals.size()));
+        for (auto &symbol : globals)
+        {
+            w.Write(static_cast<int32_t>(symbol->Index));
+            w.WriteBytes(symbol->Name.data(), symbol->Name.size());
+        }
+
+        uint64_t checksum = fnv1a(FnvOffsetBasis, w.buffer.data() + CacheHeaderSize, w.buffer.size() - CacheHeaderSize);
+        std::memcpy(&w.buffer[CacheHeaderSize - sizeof(checksum)], &checksum, sizeof(checksum));
+
+        return w.buffer;
+    }
+
+    // 检查载入的指令: 操作码已知且操作数完整, 常量、全局变量、局部变量、捕获变量和内置函数的下标都在范围内,
+    // 跳转目标落在指令边界上, 每条指令弹出的值不多于当前帧已压入的. 顶层代码没有局部变量和捕获变量
+    bool validInstructions(const bytecode::Instructions &ins, size_t numConstants, size_t numGlobals, size_t numLocals, size_t numFree)
+    {
+        const size_t size = ins.size();
+        std::vector<bool> isStart(size + 1, false);
+        std::vector<size_t> targets;
+        std::vector<int> pops(size, 0);   // 每条指令需要栈上已有的值
+        std::vector<int> pushes(size, 0); // 每条指令执行后压入的值
+
+        for (size_t ip = 0; ip < size;)
+        {
+            auto op = static_cast<bytecode::OpcodeType>(ins[ip]);
+            auto def = bytecode::Lookup(op);
+            if (def == nullptr)
+            {
+                return false;
+            }
+
+            size_t width = 1;
+            for (auto w : def->OperandWidths)
+            {
+                width += w;
+            }
+            if (ip + width > size)
+            {
+                return false;
+            }
+            isStart[ip] = true;
+
+            uint16_t operand = 0;
+            if (!def->OperandWidths.empty())
+            {
+                if (def->OperandWidths[0] == 2)
+                {
+                    bytecode::ReadUint16(ins, ip + 1, operand);
+                }
+                else
+                {
+                    operand = ins[ip + 1];
+                }
+            }
+
+            switch (op)
+            {
+            case bytecode::OpcodeType::OpConstant:
+                if (operand >= numConstants)
+                {
+                    return false;
+                }
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpClosure:
+                if (operand >= numConstants)
+                {
+                    return false;
+                }
+                pops[ip] = ins[ip + 3];
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpGetGlobal:
+            case bytecode::OpcodeType::OpGetGlobalMove:
+                if (operand >= numGlobals)
+                {
+                    return false;
+                }
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpSetGlobal:
+                if (operand >= numGlobals)
+                {
+                    return false;
+                }
+                pops[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpGetLocal:
+            case bytecode::OpcodeType::OpGetLocalMove:
+                if (operand >= numLocals)
+                {
+                    return false;
+                }
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpSetLocal:
+                if (operand >= numLocals)
+                {
+                    return false;
+                }
+                pops[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpGetFree:
+                if (operand >= numFree)
+                {
+                    return false;
+                }
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpGetBuiltin:
+                if (operand >= objects::Builtins.size())
+                {
+                    return false;
+                }
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpJump:
+                targets.push_back(operand);
+                break;
+            case bytecode::OpcodeType::OpJumpNotTruthy:
+                targets.push_back(operand);
+                pops[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpTrue:
+            case bytecode::OpcodeType::OpFalse:
+            case bytecode::OpcodeType::OpNull:
+            case bytecode::OpcodeType::OpCurrentClosure:
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpPop:
+            case bytecode::OpcodeType::OpReturnValue:
+                pops[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpAdd:
+            case bytecode::OpcodeType::OpSub:
+            case bytecode::OpcodeType::OpMul:
+            case bytecode::OpcodeType::OpDiv:
+            case bytecode::OpcodeType::OpEqual:
+            case bytecode::OpcodeType::OpNotEqual:
+            case bytecode::OpcodeType::OpGreaterThan:
+            case bytecode::OpcodeType::OpIndex:
+                pops[ip] = 2;
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpMinus:
+            case bytecode::OpcodeType::OpBang:
+                pops[ip] = 1;
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpHash:
+                if (operand % 2 != 0)
+                {
+                    return false;
+                }
+                pops[ip] = operand;
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpArray:
+                pops[ip] = operand;
+                pushes[ip] = 1;
+                break;
+            case bytecode::OpcodeType::OpCall:
+                pops[ip] = operand + 1;
+                pushes[ip] = 1;
+                break;
+            default:
+                break;
+            }
+
+            ip += width;
+        }
+        isStart[size] = true;
+
+        for (auto target : targets)
+        {
+            if (target > size || !isStart[target])
+            {
+                return false;
+            }
+        }
+
+        // 沿控制流推算每条指令前的栈深度, 同一位置从不同路径到达时深度必须相同
+        std::vector<int> depths(size + 1, -1);
+        std::vector<size_t> work{0};
+        depths[0] = 0;
+        auto reach = [&](size_t ip, int depth) {
+            if (depths[ip] == -1)
+            {
+                depths[ip] = depth;
+                work.push_back(ip);
+            }
+            return depths[ip] == depth;
+        };
+
+        while (!work.empty())
+        {
+            auto ip = work.back();
+            work.pop_back();
+            if (ip == size)
+            {
+                continue;
+            }
+
+            int depth = depths[ip];
+            if (depth < pops[ip])
+            {
+                return false;
+            }
+            int next = depth - pops[ip] + pushes[ip];
+
+            auto op = static_cast<bytecode::OpcodeType>(ins[ip]);
+            size_t width = 1;
+            for (auto w : bytecode::Lookup(op)->OperandWidths)
+            {
+                width += w;
+            }
+
+            if (op == bytecode::OpcodeType::OpJump || op == bytecode::OpcodeType::OpJumpNotTruthy)
+            {
+                uint16_t target = 0;
+                bytecode::ReadUint16(ins, ip + 1, target);
+                if (!reach(target, next))
+                {
+                    return false;
+                }
+            }
+            if (op == bytecode::OpcodeType::OpJump || op == bytecode::OpcodeType::OpReturnValue || op == bytecode::OpcodeType::OpReturn)
+            {
+                continue;
+            }
+            if (!reach(ip + width, next))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 解码一个常量, 内容不完整、类型未知或函数指令无效时返回nullptr
+    objects::Ref<objects::Object> decodeConstant(CacheReader &r, size_t numConstants, size_t numGlobals)
+    {
+        objects::Ref<objects::Object> constant;
+        switch (r.Read<CacheConstantType>())
+        {
+        case CacheConstantType::Integer:
+            constant = objects::newInteger(r.Read<int64_t>());
+            break;
+        case CacheConstantType::String:
+        {
+            auto [str, len] = r.ReadBytes();
+            constant = objects::makeRef<objects::String>(std::string(reinterpret_cast<const char *>(str), len));
+            break;
+        }
+        case CacheConstantType::CompiledFunction:
+        {
+            auto numLocals = r.Read<int32_t>();
+            auto numParameters = r.Read<int32_t>();
+            auto numFree = r.Read<int32_t>();
+            auto [fnIns, fnSize] = r.ReadBytes();
+            if (!r.ok || numParameters < 0 || numParameters > numLocals || numLocals > 256 || numFree < 0 || numFree > UINT8_MAX)
+            {
+                return nullptr;
+            }
+            bytecode::Instructions fnInstructions(fnIns, fnIns + fnSize);
+            if (!validInstructions(fnInstructions, numConstants, numGlobals, numLocals, numFree))
+            {
+                return nullptr;
+            }
+            auto fn = objects::makeRef<objects::CompiledFunction>(fnInstructions, numLocals, numParameters);
+            fn->NumFree = numFree;
+            constant = std::move(fn);
+            break;
+        }
+        default:
+            return nullptr;
+        }
+
+        if (!r.ok || r.p != r.end)
+        {
+            return nullptr;
+        }
+        return objects::makeImmortal(std::move(constant));
+    }
+
+    // 只读映射的缓存文件, 随最后一个使用者一起解除映射
+    struct MappedFile
+    {
+        const uint8_t *Data = nullptr;
+        size_t Size = 0;
+
+        MappedFile() {}
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile()
+        {
+            if (Data != nullptr)
+            {
+                munmap(const_cast<uint8_t *>(Data), Size);
+            }
+        }
+    };
+
+    std::shared_ptr<MappedFile> MapFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<MappedFile> file;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                file = std::make_shared<MappedFile>();
+                file->Data = static_cast<const uint8_t *>(data);
+                file->Size = st.st_size;
+            }
+        }
+        close(fd);
+
+        return file;
+    }
+
+    // 直接在映射的文件上按偏移表解码常量
+    struct ImageConstants : ConstantLoader
+    {
+        std::shared_ptr<MappedFile> file;
+        const uint8_t *offsets;
+        const uint8_t *entries;
+        size_t count;
+        size_t globals; // 全局变量个数, 用于检查函数里的OpGetGlobal/OpSetGlobal
+
+        size_t Decoded = 0;
+
+        objects::Ref<objects::Object> Load(size_t index) override
+        {
+            uint32_t begin = 0, end = 0;
+            if (index < count)
+            {
+                std::memcpy(&begin, offsets + index * sizeof(uint32_t), sizeof(begin));
+                std::memcpy(&end, offsets + (index + 1) * sizeof(uint32_t), sizeof(end));
+            }
+
+            uint32_t size = 0;
+            std::memcpy(&size, offsets + count * sizeof(uint32_t), sizeof(size));
+
+            if (index >= count || begin >= end || end > size)
+            {
+                return objects::newError("corrupt bytecode cache: bad constant " + std::to_string(index));
+            }
+
+            CacheReader r(entries + begin, end - begin);
+            auto constant = decodeConstant(r, count, globals);
+            if (constant == nullptr)
+            {
+                return objects::newError("corrupt bytecode cache: bad constant " + std::to_string(index));
+            }
+
+            Decoded += 1;
+            return constant;
+        }
+    };
+
+    // 内容无效、校验和不符或与sourceHash不符时返回nullptr; symbols不为空时按原索引恢复全局变量.
+    // 给出file(data位于其中)时常量不在这里解码, 由ByteCode::Loader在首次使用时解码
+    std::shared_ptr<ByteCode> DeserializeBytecode(const uint8_t *data, size_t size, uint64_t sourceHash,
+                                                  std::shared_ptr<SymbolTable> symbols = nullptr,
+                                                  std::shared_ptr<MappedFile> file = nullptr)
+    {
+        CacheReader r(data, size);
+        if (r.Read<uint32_t>() != CacheMagic || r.Read<uint32_t>() != CacheFormatVersion || r.Read<uint64_t>() != sourceHash)
+        {
+            return nullptr;
+        }
+        auto checksum = r.Read<uint64_t>();
+        if (!r.ok || checksum != fnv1a(FnvOffsetBasis, r.p, r.end - r.p))
+        {
+            return nullptr;
+        }
+
+        auto [ins, insSize] = r.ReadBytes();
+        bytecode::Instructions instructions(ins, ins + insSize);
+
+        auto numConstants = r.Read<uint32_t>();
+        if (!r.ok || static_cast<size_t>(r.end - r.p) / sizeof(uint32_t) <= numConstants)
+        {
+            return nullptr;
+        }
+        auto offsets = r.p;
+        r.p += numConstants * sizeof(uint32_t);
+        auto entriesSize = r.Read<uint32_t>();
+        if (!r.ok || static_cast<size_t>(r.end - r.p) < entriesSize)
+        {
+            return nullptr;
+        }
+        auto entries = r.p;
+        r.p += entriesSize;
+
+        std::vector<std::pair<int32_t, std::string>> globals;
+        size_t numGlobals = 0;
+        auto numSymbols = r.Read<uint32_t>();
+        for (uint32_t i = 0; i < numSymbols && r.ok; i++)
+        {
+            auto index = r.Read<int32_t>();
+            auto [name, len] = r.ReadBytes();
+            if (index < 0 || index > UINT16_MAX)
+            {
+                return nullptr;
+            }
+            numGlobals = std::max(numGlobals, static_cast<size_t>(index) + 1);
+            globals.emplace_back(index, std::string(reinterpret_cast<const char *>(name), len));
+        }
+
+        if (!r.ok || r.p != r.end || !validInstructions(instructions, numConstants, numGlobals, 0, 0))
+        {
+            return nullptr;
+        }
+
+        auto loader = std::make_shared<ImageConstants>();
+        loader->file = file;
+        loader->offsets = offsets;
+        loader->entries = entries;
+        loader->count = numConstants;
+        loader->globals = numGlobals;
+
+        std::vector<objects::Ref<objects::Object>> constants(numConstants);
+        if (file == nullptr)
+        {
+            for (uint32_t i = 0; i < numConstants; i++)
+            {
+                constants[i] = loader->Load(i);
+                if (objects::isError(constants[i]))
+                {
+                    return nullptr;
+                }
+            }
+        }
+
+        if (symbols != nullptr)
+        {
+            for (auto &[index, name] : globals)
+            {
+                if (symbols->Define(name)->Index != index)
+                {
+                    return nullptr;
+                }
+            }
+        }
+
+        auto code = std::make_shared<ByteCode>(instructions, constants);
+        if (file != nullptr)
+        {
+            code->Loader = loader;
+        }
+        return code;
+    }
+
+    // 默认目录: $MONKEY_CACHE_DIR, 其次$XDG_CACHE_HOME/monkey, $HOME/.cache/monkey
+    std::string DefaultCacheDir()
+    {
+        if (auto dir = std::getenv("MONKEY_CACHE_DIR"); dir != nullptr && *dir != '\0')
+        {
+            return dir;
+        }
+        if (auto dir = std::getenv("XDG_CACHE_HOME"); dir != nullptr && *dir != '\0')
+        {
+            return std::string(dir) + "/monkey";
+        }
+        if (auto home = std::getenv("HOME"); home != nullptr && *home != '\0')
+        {
+            return std::string(home) + "/.cache/monkey";
+        }
+        return ".monkey-cache";
+    }
+
+    // 以源码哈希命名的字节码缓存, 跳过词法分析、语法分析和编译
+    struct BytecodeCache
+    {
+        std::string Dir;
+        bool Lazy = true;
+
+        size_t Hits = 0;
+        size_t Misses = 0;
+
+        std::string PathFor(uint64_t hash) const
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%016llx.mkc", static_cast<unsigned long long>(hash));
+            return Dir + "/" + name;
+        }
+
+        // Lazy为true时保持文件映射, 常量在VM首次用到时才解码
+        std::shared_ptr<ByteCode> Load(const std::string &source, std::shared_ptr<SymbolTable> symbols = nullptr)
+        {
+            auto hash = HashSource(source);
+
+            std::shared_ptr<ByteCode> code;
+            if (auto file = MapFile(PathFor(hash)); file != nullptr)
+            {
+                code = DeserializeBytecode(file->Data, file->Size, hash, symbols, Lazy ? file : nullptr);
+            }
+
+            if (code == nullptr)
+            {
+                Misses += 1;
+                return nullptr;
+            }
+
+            Hits += 1;
+            return code;
+        }
+
+        // 先写临时文件再改名, 并发运行的进程不会读到写了一半的缓存
+        bool Store(const std::string &source, const ByteCode &code, const SymbolTable &symbols)
+        {
+            auto hash = HashSource(source);
+            auto data = SerializeBytecode(code, symbols, hash);
+            if (data.empty() || !makeDirs(Dir))
+            {
+                return false;
+            }
+
+            auto path = PathFor(hash);
+            auto tmp = path + "." + std::to_string(getpid()) + ".tmp";
+
+            int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            size_t written = 0;
+            while (written < data.size())
+            {
+                auto n = write(fd, data.data() + written, data.size() - written);
+                if (n <= 0)
+                {
+                    break;
+                }
+                written += n;
+            }
+            close(fd);
+
+            if (written != data.size() || rename(tmp.c_str(), path.c_str()) != 0)
+            {
+                unlink(tmp.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        static bool makeDirs(const std::string &dir)
+        {
+            for (size_t pos = 1; pos <= dir.size(); pos++)
+            {
+                if (pos == dir.size() || dir[pos] == '/')
+                {
+                    auto prefix = dir.substr(0, pos);
+                    if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+    };
+
+    std::shared_ptr<BytecodeCache> NewBytecodeCache(const std::string &dir = DefaultCacheDir())
+    {
+        auto cache = std::make_shared<BytecodeCache>();
+        cache->Dir = dir;
+        return cache;
+    }
+}
+
+#endif // H_CACHE_H
@@ -6,6 +6,7 @@
 #include <map>
 #include <memory>
 #include <algorithm>
+#include <bitset>
 
 #include "ast/ast.hpp"
 #include "objects/objects.hpp"
@@ -13,16 +14,26 @@
 //#include "evaluator/evaluator.hpp"
 //#include "objects/environment.hpp"
 #include "compiler/symbol_table.hpp"
+#include "compiler/inline.hpp"
+#include "compiler/escape.hpp"
 #include "objects/builtins.hpp"
 
 namespace compiler
 {
+    // 按需解码常量: Constants中为空的项在第一次使用时由Loader生成
+    struct ConstantLoader
+    {
+        virtual ~ConstantLoader() {}
+        virtual objects::Ref<objects::Object> Load(size_t index) = 0;
+    };
+
     struct ByteCode {
         bytecode::Instructions Instructions;
-        std::vector<std::shared_ptr<objects::Object>> Constants;
+        std::vector<objects::Ref<objects::Object>> Constants;
+        std::shared_ptr<ConstantLoader> Loader;
 
         ByteCode(bytecode::Instructions &instructions,
-                 std::vector<std::shared_ptr<objects::Object>> &constants) : Instructions(instructions),
+                 std::vector<objects::Ref<objects::Object>> &constants) : Instructions(instructions),
                                                                              Constants(constants)
         {
         }
@@ -40,16 +51,46 @@ namespace compiler
         bytecode::Instructions instructions;
         EmittedInstruction lastInstruction;
         EmittedInstruction prevInstruction;
+        std::vector<int> moveCandidates; // 作为调用参数读取局部变量的OpGetLocal位置
+    };
+
+    // 延迟编译的函数: 保存函数字面量, 创建时已解析出的全局名字和捕获变量的顺序,
+    // 第一次调用时按同样的符号布局编译函数体
+    struct LazyFunction : objects::LazyBody
+    {
+        std::shared_ptr<ast::FunctionLiteral> Literal;
+        std::shared_ptr<SymbolTable> Globals; // 函数体用到的全局变量和内置函数, 不受之后的定义影响
+        std::vector<std::string> Free;
+        std::shared_ptr<InlineState> Inlining;
+        bool LiftClosures = false;
+        bool Lifted = false; // 捕获的值作为参数之后的额外参数传入, 见Compiler::LiftClosures
+
+        virtual objects::Ref<objects::Object> Compile(objects::CompiledFunction &fn, std::vector<objects::Ref<objects::Object>> &constants);
     };
 
     struct Compiler
     {
-        std::vector<std::shared_ptr<objects::Object>> constants;
+        std::vector<objects::Ref<objects::Object>> constants;
         std::shared_ptr<compiler::SymbolTable> symbolTable;
+        bool LazyFunctions = false; // 函数体在第一次调用时才编译, 常量池属于执行它的VM
+        int InlineThreshold = 0;    // 不超过这么多AST节点的全局函数在调用处展开, 0表示不内联; 全局变量之后不能再被重新定义(不适用于REPL)
+        bool ConstantGlobals = false; // 只绑定一次的全局字面量和函数在使用处直接读常量池, 同样不适用于REPL
+        bool LiftClosures = false;    // 只在所在函数中被直接调用的局部闭包不再捕获变量, 捕获的值在调用时作为额外参数传入
+
+        std::map<std::string, int> globalLets; // 整个程序中每个全局名字被let的次数
+
+        std::shared_ptr<InlineState> inlining;
+        std::shared_ptr<compiler::SymbolTable> inlineFrame; // 正在展开时, 参数和局部变量所在的调用方作用域
+        std::vector<int> inlineStack;                      // 正在展开的函数, 避免间接递归时无限展开
 
         std::vector<std::shared_ptr<CompilationScope>> scopes;
         int scopeIndex;
 
+        std::shared_ptr<compiler::Symbol> consumedGlobal; // `let a = push(a, x)`中被覆盖的全局绑定
+
+        std::shared_ptr<ast::FunctionLiteral> function; // 正在编译其函数体的函数
+        std::shared_ptr<compiler::Symbol> liftTarget;   // 接下来编译的函数字面量绑定到这个可以提升的局部变量
+
         Compiler(){
             symbolTable = compiler::NewSymbolTable();
 
@@ -58,11 +99,23 @@ namespace compiler
             scopeIndex = 0;
         }
 
-        std::shared_ptr<objects::Error> Compile([[maybe_unused]] std::shared_ptr<ast::Node> node)
+        objects::Ref<objects::Error> Compile(const std::shared_ptr<ast::Node> &node)
         {
-            if(node->GetNodeType() == ast::NodeType::Program)
+            switch (node->GetNodeType())
+            {
+            case ast::NodeType::Program:
             {
-                std::shared_ptr<ast::Program> program = std::dynamic_pointer_cast<ast::Program>(node);
+                std::shared_ptr<ast::Program> program = std::static_pointer_cast<ast::Program>(node);
+                if((InlineThreshold > 0 || ConstantGlobals) && globalLets.empty())
+                {
+                    countLets(program, globalLets);
+                }
+                if(InlineThreshold > 0 && inlining == nullptr)
+                {
+                    inlining = std::make_shared<InlineState>();
+                    inlining->Threshold = InlineThreshold;
+                }
+
                 for(auto &stmt: program->v_pStatements)
                 {
                     auto resultObj = Compile(stmt);
@@ -70,11 +123,18 @@ namespace compiler
                     {
                         return resultObj;
                     }
+
+                    // 只有顶层的let在之后的代码执行前一定已经执行过
+                    if(ConstantGlobals && stmt->GetNodeType() == ast::NodeType::LetStatement)
+                    {
+                        bindConstant(std::static_pointer_cast<ast::LetStatement>(stmt));
+                    }
                 }
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::BlockStatement)
+            case ast::NodeType::BlockStatement:
             {
-                std::shared_ptr<ast::BlockStatement> blockObj = std::dynamic_pointer_cast<ast::BlockStatement>(node);
+                std::shared_ptr<ast::BlockStatement> blockObj = std::static_pointer_cast<ast::BlockStatement>(node);
                 for(auto &stmt: blockObj->v_pStatements)
                 {
                     auto resultObj = Compile(stmt);
@@ -83,10 +143,11 @@ namespace compiler
                         return resultObj;
                     }
                 }
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::ExpressionStatement)
+            case ast::NodeType::ExpressionStatement:
             {
-                std::shared_ptr<ast::ExpressionStatement> exprStmt = std::dynamic_pointer_cast<ast::ExpressionStatement>(node);
+                std::shared_ptr<ast::ExpressionStatement> exprStmt = std::static_pointer_cast<ast::ExpressionStatement>(node);
 
                 auto resultObj = Compile(exprStmt->pExpression);
                 if (objects::isError(resultObj))
@@ -94,10 +155,11 @@ namespace compiler
                     return resultObj;
                 }
                 emit(bytecode::OpcodeType::OpPop, {});
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::InfixExpression)
+            case ast::NodeType::InfixExpression:
             {
-                std::shared_ptr<ast::InfixExpression> infixObj = std::dynamic_pointer_cast<ast::InfixExpression>(node);
+                std::shared_ptr<ast::InfixExpression> infixObj = std::static_pointer_cast<ast::InfixExpression>(node);
 
                 if (infixObj->Operator == "<")
                 {
@@ -162,10 +224,11 @@ namespace compiler
                 else {
                     return objects::newError("unknow operator: " + infixObj->Operator);
                 }
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::PrefixExpression)
+            case ast::NodeType::PrefixExpression:
             {
-                std::shared_ptr<ast::PrefixExpression> prefixObj = std::dynamic_pointer_cast<ast::PrefixExpression>(node);
+                std::shared_ptr<ast::PrefixExpression> prefixObj = std::static_pointer_cast<ast::PrefixExpression>(node);
                 auto resultObj = Compile(prefixObj->pRight);
                 if (objects::isError(resultObj))
                 {
@@ -183,10 +246,11 @@ namespace compiler
                 else{
                     return objects::newError("unknow operator: " + prefixObj->Operator);
                 }
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::IfExpression)
+            case ast::NodeType::IfExpression:
             {
-                std::shared_ptr<ast::IfExpression> ifObj = std::dynamic_pointer_cast<ast::IfExpression>(node);
+                std::shared_ptr<ast::IfExpression> ifObj = std::static_pointer_cast<ast::IfExpression>(node);
 
                 auto resultObj = Compile(ifObj->pCondition);
                 if (objects::isError(resultObj))
@@ -202,11 +266,7 @@ namespace compiler
                 {
                     return resultObj;
                 }
-
-                if(lastInstructionIsPop())
-                {
-                    removeLastPop();
-                }
+                keepBranchValue();
 
                 auto jumpPos = emit(bytecode::OpcodeType::OpJump, {9999});
 
@@ -224,23 +284,39 @@ namespace compiler
                     {
                         return resultObj;
                     }
-
-                    if (lastInstructionIsPop())
-                    {
-                        removeLastPop();
-                    }
+                    keepBranchValue();
                 }
 
                 afterConsequencePos = scopes[scopeIndex]->instructions.size();
                 changeOperand(jumpPos, afterConsequencePos);
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::LetStatement)
+            case ast::NodeType::LetStatement:
             {
-                std::shared_ptr<ast::LetStatement> letObj = std::dynamic_pointer_cast<ast::LetStatement>(node);
+                std::shared_ptr<ast::LetStatement> letObj = std::static_pointer_cast<ast::LetStatement>(node);
 
                 auto symbol = symbolTable->Define(letObj->pName->Value);
 
+                if(symbol->Scope == compiler::SymbolScopeType::GlobalScope && isConsumingRebind(letObj))
+                {
+                    consumedGlobal = symbol;
+                }
+
+                if(symbol->Scope == compiler::SymbolScopeType::GlobalScope && inlining != nullptr && inlineFrame == nullptr &&
+                   letObj->pValue != nullptr && letObj->pValue->GetNodeType() == ast::NodeType::FunctionLiteral &&
+                   globalLets[symbol->Name] == 1)
+                {
+                    addInlineCandidate(symbol, std::static_pointer_cast<ast::FunctionLiteral>(letObj->pValue));
+                }
+
+                if(LiftClosures && symbol->Scope == compiler::SymbolScopeType::LocalScope && function != nullptr &&
+                   letObj->pValue != nullptr && letObj->pValue->GetNodeType() == ast::NodeType::FunctionLiteral && canLift(letObj))
+                {
+                    liftTarget = symbol;
+                }
+
                 auto resultObj = Compile(letObj->pValue);
+                consumedGlobal.reset();
                 if (objects::isError(resultObj))
                 {
                     return resultObj;
@@ -254,10 +330,11 @@ namespace compiler
                 } else {
                     emit(bytecode::OpcodeType::OpSetLocal, {symbol->Index});
                 }
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::Identifier)
+            case ast::NodeType::Identifier:
             {
-                std::shared_ptr<ast::Identifier> identObj = std::dynamic_pointer_cast<ast::Identifier>(node);
+                std::shared_ptr<ast::Identifier> identObj = std::static_pointer_cast<ast::Identifier>(node);
                 auto symbol = symbolTable->Resolve(identObj->Value);
                 if(symbol == nullptr)
                 {
@@ -265,34 +342,38 @@ namespace compiler
                 }
 
                 loadSymbol(symbol);
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::IntegerLiteral)
+            case ast::NodeType::IntegerLiteral:
             {
-                std::shared_ptr<ast::IntegerLiteral> integerLiteral = std::dynamic_pointer_cast<ast::IntegerLiteral>(node);
-			    auto integerObj = std::make_shared<objects::Integer>(integerLiteral->Value);
+                std::shared_ptr<ast::IntegerLiteral> integerLiteral = std::static_pointer_cast<ast::IntegerLiteral>(node);
+			    auto integerObj = objects::newInteger(integerLiteral->Value);
                 auto pos = addConstant(integerObj);
                 emit(bytecode::OpcodeType::OpConstant, {pos});
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::Boolean)
+            case ast::NodeType::Boolean:
             {
-                auto boolAst = std::dynamic_pointer_cast<ast::Boolean>(node);
+                auto boolAst = std::static_pointer_cast<ast::Boolean>(node);
                 if(boolAst->Value)
                 {
                     emit(bytecode::OpcodeType::OpTrue,{});
                 } else {
                     emit(bytecode::OpcodeType::OpFalse,{});
                 }
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::StringLiteral)
+            case ast::NodeType::StringLiteral:
             {
-                std::shared_ptr<ast::StringLiteral> stringLiteral = std::dynamic_pointer_cast<ast::StringLiteral>(node);
-                auto strObj = std::make_shared<objects::String>(stringLiteral->Value);
+                std::shared_ptr<ast::StringLiteral> stringLiteral = std::static_pointer_cast<ast::StringLiteral>(node);
+                auto strObj = objects::makeRef<objects::String>(stringLiteral->Value);
                 auto pos = addConstant(strObj);
                 emit(bytecode::OpcodeType::OpConstant, {pos});
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::ArrayLiteral)
+            case ast::NodeType::ArrayLiteral:
             {
-                std::shared_ptr<ast::ArrayLiteral> arrayLiteral = std::dynamic_pointer_cast<ast::ArrayLiteral>(node);
+                std::shared_ptr<ast::ArrayLiteral> arrayLiteral = std::static_pointer_cast<ast::ArrayLiteral>(node);
                 for(auto &stmt: arrayLiteral->Elements)
                 {
                     auto resultObj = Compile(stmt);
@@ -303,10 +384,11 @@ namespace compiler
                 }
 
                 emit(bytecode::OpcodeType::OpArray, {static_cast<int>(arrayLiteral->Elements.size())});
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::HashLiteral)
+            case ast::NodeType::HashLiteral:
             {
-                std::shared_ptr<ast::HashLiteral> hashLiteral = std::dynamic_pointer_cast<ast::HashLiteral>(node);
+                std::shared_ptr<ast::HashLiteral> hashLiteral = std::static_pointer_cast<ast::HashLiteral>(node);
 
                 std::vector<std::shared_ptr<ast::Expression>> keys{};
                 for(auto &pair: hashLiteral->Pairs)
@@ -332,10 +414,11 @@ namespace compiler
                 }  
 
                 emit(bytecode::OpcodeType::OpHash, {2 * static_cast<int>(hashLiteral->Pairs.size())});              
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::IndexExpression)
+            case ast::NodeType::IndexExpression:
             {
-                std::shared_ptr<ast::IndexExpression> indexObj = std::dynamic_pointer_cast<ast::IndexExpression>(node);
+                std::shared_ptr<ast::IndexExpression> indexObj = std::static_pointer_cast<ast::IndexExpression>(node);
 
                 auto resultObj = Compile(indexObj->Left);
                 if (objects::isError(resultObj))
@@ -350,58 +433,64 @@ namespace compiler
                 }
 
                 emit(bytecode::OpcodeType::OpIndex);
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::FunctionLiteral)
+            case ast::NodeType::FunctionLiteral:
             {
-                std::shared_ptr<ast::FunctionLiteral> funcObj = std::dynamic_pointer_cast<ast::FunctionLiteral>(node);
-
-                enterScope();
+                std::shared_ptr<ast::FunctionLiteral> funcObj = std::static_pointer_cast<ast::FunctionLiteral>(node);
+                auto lift = std::move(liftTarget);
+                liftTarget.reset();
 
-                if(funcObj->Name != "")
+                if(LazyFunctions)
                 {
-                    symbolTable->DefineFunctionName(funcObj->Name);
+                    return compileLazyFunction(funcObj, lift);
                 }
 
-                for(auto &args: funcObj->v_pParameters)
+                auto err = funcObj->ParseBody();
+                if(!err.empty())
                 {
-                    symbolTable->Define(args->Value);
+                    return objects::newError(err);
                 }
 
-                auto resultObj = Compile(funcObj->pBody);
+                enterScope();
+                defineFunctionSymbols(funcObj);
+
+                auto resultObj = compileFunctionBody(funcObj);
                 if (objects::isError(resultObj))
                 {
                     return resultObj;
                 }
 
-                if (lastInstructionIs(bytecode::OpcodeType::OpPop))
-                {
-                    removeLastPopWithReturn();
-                }
-
-                if(!lastInstructionIs(bytecode::OpcodeType::OpReturnValue))
-                {
-                    emit(bytecode::OpcodeType::OpReturn);
-                }
-
                 auto freeSymbols = symbolTable->FreeSymbols;
                 auto numLocals = symbolTable->numDefinitions;
                 auto numParameters = funcObj->v_pParameters.size();
                 auto ins = leaveScope();
 
+                if(lift != nullptr && canPassFree(freeSymbols))
+                {
+                    liftFreeToLocals(ins, numParameters, freeSymbols.size());
+                    numLocals += freeSymbols.size();
+                    numParameters += freeSymbols.size();
+                    lift->Captured = std::move(freeSymbols);
+                    freeSymbols.clear();
+                }
+
                 for(auto &sym: freeSymbols)
                 {
                     loadSymbol(sym);
                 }
 
-                auto compiledFn = std::make_shared<objects::CompiledFunction>(ins, numLocals, numParameters);
+                auto compiledFn = objects::makeRef<objects::CompiledFunction>(std::move(ins), numLocals, numParameters);
+                compiledFn->NumFree = freeSymbols.size();
                 auto pos = addConstant(compiledFn);
 
                 //emit(bytecode::OpcodeType::OpConstant, {pos});
                 emit(bytecode::OpcodeType::OpClosure, {pos, static_cast<int>(freeSymbols.size())});
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::ReturnStatement)
+            case ast::NodeType::ReturnStatement:
             {
-                std::shared_ptr<ast::ReturnStatement> returnObj = std::dynamic_pointer_cast<ast::ReturnStatement>(node);
+                std::shared_ptr<ast::ReturnStatement> returnObj = std::static_pointer_cast<ast::ReturnStatement>(node);
 
                 auto resultObj = Compile(returnObj->pReturnValue);
                 if (objects::isError(resultObj))
@@ -410,37 +499,707 @@ namespace compiler
                 }
 
                 emit(bytecode::OpcodeType::OpReturnValue);
+                break;
             }
-            else if(node->GetNodeType() == ast::NodeType::CallExpression)
+            case ast::NodeType::CallExpression:
             {
-                std::shared_ptr<ast::CallExpression> callObj = std::dynamic_pointer_cast<ast::CallExpression>(node);
+                std::shared_ptr<ast::CallExpression> callObj = std::static_pointer_cast<ast::CallExpression>(node);
+
+                auto candidate = inlineCandidateFor(callObj);
+                if(candidate != nullptr)
+                {
+                    return compileInlineCall(*candidate, callObj);
+                }
 
                 auto resultObj = Compile(callObj->pFunction);
                 if (objects::isError(resultObj))
                 {
                     return resultObj;
                 }
+                auto lifted = liftedCallee(callObj);
 
                 for(auto &args: callObj->pArguments)
                 {
+                    int argPos = scopes[scopeIndex]->instructions.size();
+
                     resultObj = Compile(args);
                     if (objects::isError(resultObj))
                     {
                         return resultObj;
                     }
+
+                    if(args->GetNodeType() != ast::NodeType::Identifier)
+                    {
+                        continue;
+                    }
+
+                    if(lastInstructionIs(bytecode::OpcodeType::OpGetLocal))
+                    {
+                        scopes[scopeIndex]->moveCandidates.push_back(argPos);
+                    }
+                    else if(lastInstructionIs(bytecode::OpcodeType::OpGetGlobal) && consumedGlobal != nullptr
+                            && std::static_pointer_cast<ast::Identifier>(args)->Value == consumedGlobal->Name)
+                    {
+                        replaceInstruction(argPos, bytecode::Make(bytecode::OpcodeType::OpGetGlobalMove, {consumedGlobal->Index}));
+                        scopes[scopeIndex]->lastInstruction.Opcode = bytecode::OpcodeType::OpGetGlobalMove;
+                    }
                 }
 
                 int argsNum = callObj->pArguments.size();
+                if(lifted != nullptr)
+                {
+                    for(auto &sym: lifted->Captured)
+                    {
+                        loadSymbol(sym);
+                    }
+                    argsNum += lifted->Captured.size();
+                }
                 emit(bytecode::OpcodeType::OpCall, {argsNum});
+                break;
+            }
+            default:
+                break;
+            }
+
+
+            return nullptr;
+        }
+
+        void defineFunctionSymbols(const std::shared_ptr<ast::FunctionLiteral> &funcObj)
+        {
+            if(funcObj->Name != "")
+            {
+                symbolTable->DefineFunctionName(funcObj->Name);
+            }
+
+            for(auto &args: funcObj->v_pParameters)
+            {
+                symbolTable->Define(args->Value);
+            }
+        }
+
+        objects::Ref<objects::Error> compileFunctionBody(const std::shared_ptr<ast::FunctionLiteral> &funcObj)
+        {
+            auto enclosing = function;
+            function = funcObj;
+            auto resultObj = Compile(funcObj->pBody);
+            function = enclosing;
+            if (objects::isError(resultObj))
+            {
+                return resultObj;
+            }
+
+            if (lastInstructionIs(bytecode::OpcodeType::OpPop))
+            {
+                removeLastPopWithReturn();
+            }
+
+            if(!lastInstructionIs(bytecode::OpcodeType::OpReturnValue))
+            {
+                emit(bytecode::OpcodeType::OpReturn);
+            }
+
+            moveDeadLocalArguments();
+            return nullptr;
+        }
+
+        // 只解析函数体中的名字求出捕获的变量, 不生成指令; 生成占位的函数常量, 指令在第一次调用时生成
+        objects::Ref<objects::Error> compileLazyFunction(const std::shared_ptr<ast::FunctionLiteral> &funcObj, const std::shared_ptr<compiler::Symbol> &lift)
+        {
+            auto lazy = std::make_shared<LazyFunction>();
+            lazy->Literal = (funcObj->pArena != nullptr) ? funcObj->pArena->Retain(funcObj) : funcObj;
+            lazy->Globals = NewSymbolTable();
+
+            symbolTable = NewEnclosedSymbolTable(symbolTable);
+            defineFunctionSymbols(funcObj);
+            auto resultObj = (funcObj->pSkipped != nullptr) ? resolveSkippedNames(*funcObj->pSkipped, *lazy->Globals)
+                                                            : resolveNames(funcObj->pBody, *lazy->Globals);
+            auto freeSymbols = symbolTable->FreeSymbols;
+            symbolTable = symbolTable->Outer;
+
+            if (objects::isError(resultObj))
+            {
+                return resultObj;
+            }
+
+            lazy->Lifted = (lift != nullptr && canPassFree(freeSymbols));
+            for(auto &sym: freeSymbols)
+            {
+                if(!lazy->Lifted)
+                {
+                    loadSymbol(sym);
+                }
+                lazy->Free.push_back(sym->Name);
+            }
+
+            lazy->Inlining = inlining;
+            lazy->LiftClosures = LiftClosures;
+            int numParameters = funcObj->v_pParameters.size();
+            int numFree = freeSymbols.size();
+            if(lazy->Lifted)
+            {
+                numParameters += numFree;
+                numFree = 0;
+                lift->Captured = std::move(freeSymbols);
+            }
+
+            auto compiledFn = objects::makeRef<objects::CompiledFunction>(bytecode::Instructions{}, 0, numParameters);
+            compiledFn->Lazy = lazy;
+            compiledFn->NumFree = numFree;
+            auto pos = addConstant(compiledFn);
+
+            emit(bytecode::OpcodeType::OpClosure, {pos, numFree});
+            return nullptr;
+        }
+
+        // 按Compile的顺序定义和解析名字, 捕获变量的登记结果和完整编译时相同
+        objects::Ref<objects::Error> resolveNames(const std::shared_ptr<ast::Node> &node, SymbolTable &globals)
+        {
+            if(node == nullptr)
+            {
+                return nullptr;
+            }
+
+            objects::Ref<objects::Error> resultObj;
+            auto resolve = [&](const std::shared_ptr<ast::Node> &child) {
+                if(resultObj == nullptr)
+                {
+                    resultObj = resolveNames(child, globals);
+                }
+            };
+
+            switch (node->GetNodeType())
+            {
+            case ast::NodeType::Identifier:
+            {
+                auto &name = std::static_pointer_cast<ast::Identifier>(node)->Value;
+                auto symbol = symbolTable->Resolve(name);
+                if(symbol == nullptr)
+                {
+                    return objects::newError("undefined variable " + name);
+                }
+
+                if(symbol->Scope == compiler::SymbolScopeType::GlobalScope || symbol->Scope == compiler::SymbolScopeType::BuiltinScope)
+                {
+                    globals.store[name] = symbol;
+                }
+                break;
+            }
+            case ast::NodeType::BlockStatement:
+                for(auto &stmt: std::static_pointer_cast<ast::BlockStatement>(node)->v_pStatements)
+                {
+                    resolve(stmt);
+                }
+                break;
+            case ast::NodeType::ExpressionStatement:
+                resolve(std::static_pointer_cast<ast::ExpressionStatement>(node)->pExpression);
+                break;
+            case ast::NodeType::LetStatement:
+            {
+                auto letObj = std::static_pointer_cast<ast::LetStatement>(node);
+                symbolTable->Define(letObj->pName->Value);
+                resolve(letObj->pValue);
+                break;
+            }
+            case ast::NodeType::ReturnStatement:
+                resolve(std::static_pointer_cast<ast::ReturnStatement>(node)->pReturnValue);
+                break;
+            case ast::NodeType::PrefixExpression:
+                resolve(std::static_pointer_cast<ast::PrefixExpression>(node)->pRight);
+                break;
+            case ast::NodeType::InfixExpression:
+            {
+                auto infixObj = std::static_pointer_cast<ast::InfixExpression>(node);
+                if(infixObj->Operator == "<")
+                {
+                    resolve(infixObj->pRight);
+                    resolve(infixObj->pLeft);
+                } else {
+                    resolve(infixObj->pLeft);
+                    resolve(infixObj->pRight);
+                }
+                break;
+            }
+            case ast::NodeType::IfExpression:
+            {
+                auto ifObj = std::static_pointer_cast<ast::IfExpression>(node);
+                resolve(ifObj->pCondition);
+                resolve(ifObj->pConsequence);
+                resolve(ifObj->pAlternative);
+                break;
+            }
+            case ast::NodeType::ArrayLiteral:
+                for(auto &elem: std::static_pointer_cast<ast::ArrayLiteral>(node)->Elements)
+                {
+                    resolve(elem);
+                }
+                break;
+            case ast::NodeType::HashLiteral:
+            {
+                auto hashLiteral = std::static_pointer_cast<ast::HashLiteral>(node);
+
+                std::vector<std::shared_ptr<ast::Expression>> keys{};
+                for(auto &pair: hashLiteral->Pairs)
+                {
+                    keys.push_back(pair.first);
+                }
+
+                std::sort(keys.begin(), keys.end(), [](const auto &lhs, const auto& rhs){ return lhs->String() < rhs->String(); });
+
+                for(auto &key: keys)
+                {
+                    resolve(key);
+                    resolve(hashLiteral->Pairs[key]);
+                }
+                break;
+            }
+            case ast::NodeType::IndexExpression:
+            {
+                auto indexObj = std::static_pointer_cast<ast::IndexExpression>(node);
+                resolve(indexObj->Left);
+                resolve(indexObj->Index);
+                break;
+            }
+            case ast::NodeType::FunctionLiteral:
+            {
+                auto funcObj = std::static_pointer_cast<ast::FunctionLiteral>(node);
+                symbolTable = NewEnclosedSymbolTable(symbolTable);
+                defineFunctionSymbols(funcObj);
+                if(funcObj->pSkipped != nullptr)
+                {
+                    resultObj = resolveSkippedNames(*funcObj->pSkipped, globals);
+                } else {
+                    resolve(funcObj->pBody);
+                }
+                symbolTable = symbolTable->Outer;
+                break;
+            }
+            case ast::NodeType::CallExpression:
+            {
+                auto callObj = std::static_pointer_cast<ast::CallExpression>(node);
+                resolve(callObj->pFunction);
+                for(auto &arg: callObj->pArguments)
+                {
+                    resolve(arg);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+
+            return resultObj;
+        }
+
+        // 预解析的函数体不知道名字出现的先后, 能在外层解析到的名字都当作捕获, 多捕获不影响结果;
+        // 函数体内定义的名字在外层找不到时是局部变量, 其余名字找不到时报未定义
+        objects::Ref<objects::Error> resolveSkippedNames(const ast::SkippedBody &skipped, SymbolTable &globals)
+        {
+            for(auto &name: skipped.Names)
+            {
+                if(symbolTable->store.count(name) > 0)
+                {
+                    continue;
+                }
+
+                auto symbol = symbolTable->Resolve(name);
+                if(symbol == nullptr)
+                {
+                    if(std::binary_search(skipped.Declared.begin(), skipped.Declared.end(), name))
+                    {
+                        continue;
+                    }
+                    return objects::newError("undefined variable " + name);
+                }
+
+                if(symbol->Scope == compiler::SymbolScopeType::GlobalScope || symbol->Scope == compiler::SymbolScopeType::BuiltinScope)
+                {
+                    globals.store[name] = symbol;
+                }
+            }
+            return nullptr;
+        }
+
+        // 函数体中直接let一次的局部函数, 只在本函数中被直接调用时可以不再作为闭包捕获变量
+        bool canLift(const std::shared_ptr<ast::LetStatement> &letObj)
+        {
+            auto &name = letObj->pName->Value;
+            auto &stmts = function->pBody->v_pStatements;
+            if(std::find_if(stmts.begin(), stmts.end(), [&](const std::shared_ptr<ast::Statement> &stmt) { return stmt.get() == letObj.get(); }) == stmts.end())
+            {
+                return false;
             }
 
+            std::map<std::string, int> counts;
+            countLets(function->pBody, counts);
+            if(counts[name] != 1 || isParameter(name))
+            {
+                return false;
+            }
+
+            auto funcObj = std::static_pointer_cast<ast::FunctionLiteral>(letObj->pValue);
+            return onlyCalled(function->pBody, name, funcObj->v_pParameters.size());
+        }
+
+        // 捕获的局部变量在创建闭包后不再被重新绑定时, 调用时读到的值和创建时相同
+        bool canPassFree(const std::vector<std::shared_ptr<compiler::Symbol>> &freeSymbols)
+        {
+            if(freeSymbols.empty())
+            {
+                return false;
+            }
+
+            std::map<std::string, int> counts;
+            countLets(function->pBody, counts);
+            for(auto &sym: freeSymbols)
+            {
+                if(sym->Scope == compiler::SymbolScopeType::LocalScope && counts[sym->Name] + (isParameter(sym->Name) ? 1 : 0) > 1)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool isParameter(const std::string &name)
+        {
+            for(auto &param: function->v_pParameters)
+            {
+                if(param->Value == name)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::shared_ptr<compiler::Symbol> liftedCallee(const std::shared_ptr<ast::CallExpression> &callObj)
+        {
+            if(callObj->pFunction->GetNodeType() != ast::NodeType::Identifier)
+            {
+                return nullptr;
+            }
+
+            auto symbol = symbolTable->Resolve(std::static_pointer_cast<ast::Identifier>(callObj->pFunction)->Value);
+            return (symbol != nullptr && !symbol->Captured.empty()) ? symbol : nullptr;
+        }
+
+        // 只let过一次的全局变量绑定的是字面量或函数时, 之后的读取直接用常量池中的值;
+        // 函数在常量池中放一个没有捕获变量的闭包, 全局变量也指向它
+        void bindConstant(const std::shared_ptr<ast::LetStatement> &letObj)
+        {
+            auto symbol = symbolTable->Resolve(letObj->pName->Value);
+            auto scope = scopes[scopeIndex];
+            if(symbol == nullptr || symbol->Scope != compiler::SymbolScopeType::GlobalScope || symbol->Bindings != 1 ||
+               globalLets[symbol->Name] != 1 || scope->lastInstruction.Opcode != bytecode::OpcodeType::OpSetGlobal)
+            {
+                return;
+            }
+
+            auto value = scope->prevInstruction;
+            switch(letObj->pValue->GetNodeType())
+            {
+            case ast::NodeType::IntegerLiteral:
+            case ast::NodeType::StringLiteral:
+                if(value.Opcode == bytecode::OpcodeType::OpConstant)
+                {
+                    uint16_t constIndex;
+                    bytecode::ReadUint16(scope->instructions, value.Position + 1, constIndex);
+                    symbol->Constant = constIndex;
+                }
+                break;
+            case ast::NodeType::Boolean:
+                if(value.Opcode == bytecode::OpcodeType::OpTrue || value.Opcode == bytecode::OpcodeType::OpFalse)
+                {
+                    symbol->Constant = addConstant(objects::nativeBoolToBooleanObject(value.Opcode == bytecode::OpcodeType::OpTrue));
+                }
+                break;
+            case ast::NodeType::FunctionLiteral:
+            {
+                if(value.Opcode != bytecode::OpcodeType::OpClosure)
+                {
+                    break;
+                }
+
+                uint16_t constIndex;
+                uint8_t numFree;
+                bytecode::ReadUint16(scope->instructions, value.Position + 1, constIndex);
+                bytecode::ReadUint8(scope->instructions, value.Position + 3, numFree);
+                if(numFree != 0)
+                {
+                    break;
+                }
+
+                auto fn = objects::staticRefCast<objects::CompiledFunction>(constants[constIndex]);
+                symbol->Constant = addConstant(objects::makeRef<objects::Closure>(fn));
+
+                scope->instructions.resize(value.Position);
+                emit(bytecode::OpcodeType::OpConstant, {symbol->Constant});
+                emit(bytecode::OpcodeType::OpSetGlobal, {symbol->Index});
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        // 全局作用域中只let过一次的小函数: 函数体中的全局名字按定义处解析, 调用处的局部变量不会遮住它们
+        void addInlineCandidate(const std::shared_ptr<compiler::Symbol> &symbol, const std::shared_ptr<ast::FunctionLiteral> &funcObj)
+        {
+            // 预解析跳过的函数体只有足够短时才解析出来
+            if(funcObj->pSkipped != nullptr &&
+               (funcObj->pSkipped->End - funcObj->pSkipped->Begin > 8 * inlining->Threshold || !funcObj->ParseBody().empty()))
+            {
+                return;
+            }
+
+            int cost = inlineCost(funcObj->pBody, symbol->Name);
+            if(cost < 0 || cost > inlining->Threshold)
+            {
+                return;
+            }
+
+            InlineCandidate candidate;
+            candidate.Name = symbol->Name;
+            candidate.Index = symbol->Index;
+            candidate.Literal = (funcObj->pArena != nullptr) ? funcObj->pArena->Retain(funcObj) : funcObj;
+            candidate.Globals = NewSymbolTable();
+
+            symbolTable = NewEnclosedSymbolTable(symbolTable);
+            defineFunctionSymbols(funcObj);
+            auto resultObj = resolveNames(funcObj->pBody, *candidate.Globals);
+            symbolTable = symbolTable->Outer;
+            if(objects::isError(resultObj))
+            {
+                return;
+            }
+
+            collectLets(funcObj->pBody, candidate.Locals);
+            inlining->Candidates[symbol->Index] = std::move(candidate);
+        }
+
+        const InlineCandidate *inlineCandidateFor(const std::shared_ptr<ast::CallExpression> &callObj)
+        {
+            if(inlining == nullptr || callObj->pFunction->GetNodeType() != ast::NodeType::Identifier)
+            {
+                return nullptr;
+            }
+
+            auto symbol = symbolTable->Resolve(std::static_pointer_cast<ast::Identifier>(callObj->pFunction)->Value);
+            if(symbol == nullptr || symbol->Scope != compiler::SymbolScopeType::GlobalScope)
+            {
+                return nullptr;
+            }
+
+            auto fit = inlining->Candidates.find(symbol->Index);
+            if(fit == inlining->Candidates.end() || fit->second.Literal->v_pParameters.size() != callObj->pArguments.size() ||
+               std::find(inlineStack.begin(), inlineStack.end(), symbol->Index) != inlineStack.end())
+            {
+                return nullptr;
+            }
+            return &fit->second;
+        }
+
+        // 参数和函数体中的局部变量放在调用方作用域的隐藏槽位里(名字带'.', 源码中无法引用),
+        // 实参从右到左存入参数槽位后就地编译函数体, 最后一个表达式的值留在栈顶作为调用结果
+        objects::Ref<objects::Error> compileInlineCall(const InlineCandidate &callee, const std::shared_ptr<ast::CallExpression> &callObj)
+        {
+            for(auto &arg: callObj->pArguments)
+            {
+                auto resultObj = Compile(arg);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+            }
+
+            auto frame = (inlineFrame != nullptr) ? inlineFrame : symbolTable;
+            auto table = NewEnclosedSymbolTable(callee.Globals);
+            auto &params = callee.Literal->v_pParameters;
+            for(auto &param: params)
+            {
+                table->store[param->Value] = frame->Define(callee.Name + "." + param->Value);
+            }
+            for(auto &name: callee.Locals)
+            {
+                table->store[name] = frame->Define(callee.Name + "." + name);
+            }
+
+            for(int i = params.size() - 1; i >= 0; i--)
+            {
+                auto slot = table->store[params[i]->Value];
+                if(slot->Scope == compiler::SymbolScopeType::GlobalScope)
+                {
+                    emit(bytecode::OpcodeType::OpSetGlobal, {slot->Index});
+                } else {
+                    emit(bytecode::OpcodeType::OpSetLocal, {slot->Index});
+                }
+            }
 
+            auto callerTable = symbolTable;
+            auto callerFrame = inlineFrame;
+            symbolTable = table;
+            inlineFrame = frame;
+            inlineStack.push_back(callee.Index);
+
+            int start = currentInstructions().size();
+            objects::Ref<objects::Error> resultObj;
+            for(auto &stmt: callee.Literal->pBody->v_pStatements)
+            {
+                resultObj = Compile(stmt);
+                if (objects::isError(resultObj))
+                {
+                    break;
+                }
+            }
+
+            symbolTable = callerTable;
+            inlineFrame = callerFrame;
+            inlineStack.pop_back();
+            if (objects::isError(resultObj))
+            {
+                return resultObj;
+            }
+
+            if(lastInstructionIs(bytecode::OpcodeType::OpPop) && scopes[scopeIndex]->lastInstruction.Position >= start)
+            {
+                removeLastPop();
+            } else {
+                emit(bytecode::OpcodeType::OpNull);
+            }
+
+            inlining->Sites.push_back(callObj->String());
             return nullptr;
         }
 
-        int addConstant(std::shared_ptr<objects::Object> obj)
+        // `let a = builtin(..., a, ...)`: 参数只有字面量和标识符, 不会执行用户代码,
+        // 旧值在读取后到OpSetGlobal之间无法被观察到, 可以直接移交给内置函数
+        bool isConsumingRebind(std::shared_ptr<ast::LetStatement> letObj)
+        {
+            if(letObj->pValue == nullptr || letObj->pValue->GetNodeType() != ast::NodeType::CallExpression)
+            {
+                return false;
+            }
+
+            auto callObj = std::static_pointer_cast<ast::CallExpression>(letObj->pValue);
+            if(callObj->pFunction->GetNodeType() != ast::NodeType::Identifier)
+            {
+                return false;
+            }
+
+            auto callee = symbolTable->Resolve(std::static_pointer_cast<ast::Identifier>(callObj->pFunction)->Value);
+            if(callee == nullptr || callee->Scope != compiler::SymbolScopeType::BuiltinScope)
+            {
+                return false;
+            }
+
+            int uses = 0;
+            for(auto &arg: callObj->pArguments)
+            {
+                auto type = arg->GetNodeType();
+                if(type == ast::NodeType::Identifier)
+                {
+                    if(std::static_pointer_cast<ast::Identifier>(arg)->Value == letObj->pName->Value)
+                    {
+                        uses++;
+                    }
+                }
+                else if(type != ast::NodeType::IntegerLiteral && type != ast::NodeType::StringLiteral && type != ast::NodeType::Boolean)
+                {
+                    return false;
+                }
+            }
+
+            return (uses == 1);
+        }
+
+        // 局部变量作为调用参数最后一次被读取时, 改写为OpGetLocalMove,
+        // 让被调用方拿到唯一引用. Monkey只有向前跳转, 逆序扫描一遍即可求出活跃变量
+        void moveDeadLocalArguments()
         {
-            constants.push_back(obj);
+            auto &scope = scopes[scopeIndex];
+            if(scope->moveCandidates.empty())
+            {
+                return;
+            }
+
+            auto &ins = scope->instructions;
+            int size = ins.size();
+
+            std::vector<int> positions;
+            for(int i = 0; i < size;)
+            {
+                positions.push_back(i);
+
+                auto def = bytecode::Lookup(static_cast<bytecode::OpcodeType>(ins[i]));
+                i += 1;
+                for(auto &w: def->OperandWidths)
+                {
+                    i += w;
+                }
+            }
+
+            std::vector<std::bitset<256>> liveIn(size + 1);
+
+            for(int idx = positions.size() - 1; idx >= 0; idx--)
+            {
+                int pos = positions[idx];
+                int next = (idx + 1 < static_cast<int>(positions.size())) ? positions[idx + 1] : size;
+                auto op = static_cast<bytecode::OpcodeType>(ins[pos]);
+
+                std::bitset<256> live;
+                switch(op)
+                {
+                    case bytecode::OpcodeType::OpReturnValue:
+                    case bytecode::OpcodeType::OpReturn:
+                        break;
+                    case bytecode::OpcodeType::OpJump:
+                        {
+                            uint16_t target;
+                            bytecode::ReadUint16(ins, pos + 1, target);
+                            live = liveIn[target];
+                        }
+                        break;
+                    case bytecode::OpcodeType::OpJumpNotTruthy:
+                        {
+                            uint16_t target;
+                            bytecode::ReadUint16(ins, pos + 1, target);
+                            live = liveIn[next] | liveIn[target];
+                        }
+                        break;
+                    default:
+                        live = liveIn[next];
+                        break;
+                }
+
+                if(op == bytecode::OpcodeType::OpGetLocal || op == bytecode::OpcodeType::OpSetLocal)
+                {
+                    uint8_t localIndex;
+                    bytecode::ReadUint8(ins, pos + 1, localIndex);
+
+                    if(op == bytecode::OpcodeType::OpSetLocal)
+                    {
+                        live.reset(localIndex);
+                    }
+                    else
+                    {
+                        bool candidate = std::find(scope->moveCandidates.begin(), scope->moveCandidates.end(), pos) != scope->moveCandidates.end();
+                        if(candidate && !live.test(localIndex))
+                        {
+                            ins[pos] = static_cast<bytecode::Opcode>(bytecode::OpcodeType::OpGetLocalMove);
+                        }
+                        live.set(localIndex);
+                    }
+                }
+
+                liveIn[pos] = live;
+            }
+        }
+
+        // 常量池对象在整个程序运行期间都存活, 标记为不朽以免每次OpConstant都更新引用计数
+        int addConstant(objects::Ref<objects::Object> obj)
+        {
+            constants.push_back(objects::makeImmortal(std::move(obj)));
             return (constants.size() - 1);
         }
 
@@ -460,7 +1219,11 @@ namespace compiler
 
         void loadSymbol(std::shared_ptr<compiler::Symbol> symbol)
         {
-            if (symbol->Scope == compiler::SymbolScopeType::GlobalScope)
+            if (symbol->Scope == compiler::SymbolScopeType::GlobalScope && symbol->Constant >= 0)
+            {
+                emit(bytecode::OpcodeType::OpConstant, {symbol->Constant});
+            }
+            else if (symbol->Scope == compiler::SymbolScopeType::GlobalScope)
             {
                 emit(bytecode::OpcodeType::OpGetGlobal, {symbol->Index});
             }
@@ -482,15 +1245,13 @@ namespace compiler
             }
         }
 
-        int addInstruction(bytecode::Instructions ins)
+        int addInstruction(const bytecode::Instructions& ins)
         {
-            auto instructions = currentInstructions();
+            auto &instructions = currentInstructions();
             auto posNewInstruction = instructions.size();
             
             instructions.insert(instructions.end(), ins.begin(), ins.end());
 
-            scopes[scopeIndex]->instructions = instructions;
-
             return posNewInstruction;
         }
 
@@ -517,15 +1278,26 @@ namespace compiler
 
         void removeLastPop()
         {
-            auto instructions = currentInstructions();
             auto lastInstruction = scopes[scopeIndex]->lastInstruction;
 
-            instructions.assign(instructions.begin(), instructions.begin() + lastInstruction.Position);
+            currentInstructions().resize(lastInstruction.Position);
 
-            scopes[scopeIndex]->instructions = instructions;
             scopes[scopeIndex]->lastInstruction = scopes[scopeIndex]->prevInstruction;
         }
 
+        // 分支的值留在栈上; 空块或以let结尾的块没有值, 补一个null, 保证两条路径的栈深度相同
+        void keepBranchValue()
+        {
+            if(lastInstructionIsPop())
+            {
+                removeLastPop();
+            }
+            else if(!lastInstructionIs(bytecode::OpcodeType::OpReturnValue))
+            {
+                emit(bytecode::OpcodeType::OpNull);
+            }
+        }
+
         void removeLastPopWithReturn()
         {
             auto lastPos = scopes[scopeIndex]->lastInstruction.Position;
@@ -543,8 +1315,7 @@ namespace compiler
 
         void changeOperand(int opPos, int operand)
         {
-            auto instructions = currentInstructions();
-            bytecode::OpcodeType op = static_cast<bytecode::OpcodeType>(instructions[opPos]);
+            bytecode::OpcodeType op = static_cast<bytecode::OpcodeType>(currentInstructions()[opPos]);
             auto newInstruction = bytecode::Make(op, {operand});
 
             replaceInstruction(opPos, newInstruction);
@@ -555,7 +1326,7 @@ namespace compiler
             return std::make_shared<ByteCode>(scopes[scopeIndex]->instructions, constants);
         }
 
-        bytecode::Instructions currentInstructions()
+        bytecode::Instructions& currentInstructions()
         {
             return scopes[scopeIndex]->instructions;
         }
@@ -570,7 +1341,7 @@ namespace compiler
 
         bytecode::Instructions leaveScope()
         {
-            auto ins = currentInstructions();
+            auto ins = std::move(currentInstructions());
             scopes.pop_back();
             scopeIndex -= 1;
             symbolTable = symbolTable->Outer;
@@ -579,6 +1350,54 @@ namespace compiler
         }
     };
 
+    objects::Ref<objects::Object> LazyFunction::Compile(objects::CompiledFunction &fn, std::vector<objects::Ref<objects::Object>> &constants)
+    {
+        auto err = Literal->ParseBody();
+        if(!err.empty())
+        {
+            return objects::newError(err);
+        }
+
+        Compiler comp;
+        comp.LazyFunctions = true;
+        comp.inlining = Inlining;
+        comp.LiftClosures = LiftClosures;
+        comp.constants.swap(constants);
+
+        // 捕获变量按创建闭包时的顺序登记, 和OpClosure压入的Free一一对应; 提升后按同样的顺序排在参数之后
+        comp.symbolTable = Globals;
+        comp.enterScope();
+        if(!Lifted)
+        {
+            for(auto &name: Free)
+            {
+                comp.symbolTable->DefineFree(std::make_shared<Symbol>(name, SymbolScopeType::FreeScope, 0));
+            }
+        }
+        comp.defineFunctionSymbols(Literal);
+        if(Lifted)
+        {
+            for(auto &name: Free)
+            {
+                comp.symbolTable->Define(name);
+            }
+        }
+
+        auto resultObj = comp.compileFunctionBody(Literal);
+        auto numLocals = comp.symbolTable->numDefinitions;
+        auto ins = comp.leaveScope();
+        comp.constants.swap(constants);
+
+        if (objects::isError(resultObj))
+        {
+            return resultObj;
+        }
+
+        fn.Instructions = std::move(ins);
+        fn.NumLocals = numLocals;
+        return nullptr;
+    }
+
     std::shared_ptr<Compiler> New()
     {
         auto symbolTable = NewSymbolTable();
@@ -597,7 +1416,7 @@ namespace compiler
     }
 
     std::shared_ptr<Compiler> NewWithState(std::shared_ptr<compiler::SymbolTable> symbolTable,
-                                           std::vector<std::shared_ptr<objects::Object>>& constants)
+                                           std::vector<objects::Ref<objects::Object>>& constants)
     {
         std::shared_ptr<Compiler> compiler = New();
         compiler->symbolTable = symbolTable;
@@ -0,0 +1,130 @@
+#ifndef H_ESCAPE_H
+#define H_ESCAPE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+
+#include "ast/ast.hpp"
+#include "code/code.hpp"
+#include "compiler/inline.hpp"
+
+namespace compiler
+{
+    // 名字在node中出现过, 包括嵌套函数的参数和预解析跳过的函数体
+    bool mentions(const std::shared_ptr<ast::Node> &node, const std::string &name)
+    {
+        if (node == nullptr)
+        {
+            return false;
+        }
+
+        switch (node->GetNodeType())
+        {
+        case ast::NodeType::Identifier:
+            return std::static_pointer_cast<ast::Identifier>(node)->Value == name;
+        case ast::NodeType::FunctionLiteral:
+        {
+            auto funcObj = std::static_pointer_cast<ast::FunctionLiteral>(node);
+            for (auto &param : funcObj->v_pParameters)
+            {
+                if (param->Value == name)
+                {
+                    return true;
+                }
+            }
+            if (funcObj->pSkipped != nullptr)
+            {
+                auto &names = funcObj->pSkipped->Names;
+                return std::binary_search(names.begin(), names.end(), name);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        bool found = false;
+        forEachChild(node, [&](const std::shared_ptr<ast::Node> &child) { found = found || mentions(child, name); });
+        return found;
+    }
+
+    // 名字只作为被调用的函数出现, 参数个数都是arity: 没有被当作值传出、保存或被嵌套函数捕获
+    bool onlyCalled(const std::shared_ptr<ast::Node> &node, const std::string &name, size_t arity)
+    {
+        if (node == nullptr)
+        {
+            return true;
+        }
+
+        switch (node->GetNodeType())
+        {
+        case ast::NodeType::Identifier:
+            return std::static_pointer_cast<ast::Identifier>(node)->Value != name;
+        case ast::NodeType::FunctionLiteral:
+            return !mentions(node, name);
+        case ast::NodeType::CallExpression:
+        {
+            auto callObj = std::static_pointer_cast<ast::CallExpression>(node);
+            auto &callee = callObj->pFunction;
+            if (callee->GetNodeType() != ast::NodeType::Identifier || std::static_pointer_cast<ast::Identifier>(callee)->Value != name)
+            {
+                break;
+            }
+            if (callObj->pArguments.size() != arity)
+            {
+                return false;
+            }
+            for (auto &arg : callObj->pArguments)
+            {
+                if (!onlyCalled(arg, name, arity))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            break;
+        }
+
+        bool called = true;
+        forEachChild(node, [&](const std::shared_ptr<ast::Node> &child) { called = called && onlyCalled(child, name, arity); });
+        return called;
+    }
+
+    // 捕获变量改为排在参数之后的局部变量: OpGetFree i读第numParameters+i个局部变量, 原来的局部变量依次后移
+    void liftFreeToLocals(bytecode::Instructions &ins, int numParameters, int numFree)
+    {
+        for (int i = 0, size = ins.size(); i < size;)
+        {
+            auto op = static_cast<bytecode::OpcodeType>(ins[i]);
+            switch (op)
+            {
+            case bytecode::OpcodeType::OpGetFree:
+                ins[i] = static_cast<bytecode::Opcode>(bytecode::OpcodeType::OpGetLocal);
+                ins[i + 1] += numParameters;
+                break;
+            case bytecode::OpcodeType::OpGetLocal:
+            case bytecode::OpcodeType::OpGetLocalMove:
+            case bytecode::OpcodeType::OpSetLocal:
+                if (ins[i + 1] >= numParameters)
+                {
+                    ins[i + 1] += numFree;
+                }
+                break;
+            default:
+                break;
+            }
+
+            i += 1;
+            for (auto &w : bytecode::Lookup(op)->OperandWidths)
+            {
+                i += w;
+            }
+        }
+    }
+}
+
+#endif // H_ESCAPE_H
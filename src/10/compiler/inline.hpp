@@ -0,0 +1,173 @@
+#ifndef H_INLINE_H
+#define H_INLINE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "ast/ast.hpp"
+#include "compiler/symbol_table.hpp"
+
+namespace compiler
+{
+    const int DefaultInlineThreshold = 24;
+
+    // 可以在调用处展开的全局函数
+    struct InlineCandidate
+    {
+        std::string Name;
+        int Index = 0; // 全局变量下标
+        std::shared_ptr<ast::FunctionLiteral> Literal;
+        std::shared_ptr<SymbolTable> Globals; // 函数体用到的全局变量和内置函数, 按定义处解析
+        std::vector<std::string> Locals;      // 函数体中let定义的名字
+    };
+
+    // 一次编译整个程序时的内联状态, 延迟编译的函数体共用同一份
+    struct InlineState
+    {
+        int Threshold = DefaultInlineThreshold; // 函数体的AST节点数上限
+        std::map<int, InlineCandidate> Candidates; // 按全局变量下标
+        std::vector<std::string> Sites;         // 已经展开的调用
+    };
+
+    template <typename Visit>
+    void forEachChild(const std::shared_ptr<ast::Node> &node, Visit visit)
+    {
+        switch (node->GetNodeType())
+        {
+        case ast::NodeType::Program:
+            for (auto &stmt : std::static_pointer_cast<ast::Program>(node)->v_pStatements)
+            {
+                visit(stmt);
+            }
+            break;
+        case ast::NodeType::BlockStatement:
+            for (auto &stmt : std::static_pointer_cast<ast::BlockStatement>(node)->v_pStatements)
+            {
+                visit(stmt);
+            }
+            break;
+        case ast::NodeType::ExpressionStatement:
+            visit(std::static_pointer_cast<ast::ExpressionStatement>(node)->pExpression);
+            break;
+        case ast::NodeType::LetStatement:
+            visit(std::static_pointer_cast<ast::LetStatement>(node)->pValue);
+            break;
+        case ast::NodeType::ReturnStatement:
+            visit(std::static_pointer_cast<ast::ReturnStatement>(node)->pReturnValue);
+            break;
+        case ast::NodeType::PrefixExpression:
+            visit(std::static_pointer_cast<ast::PrefixExpression>(node)->pRight);
+            break;
+        case ast::NodeType::InfixExpression:
+        {
+            auto infixObj = std::static_pointer_cast<ast::InfixExpression>(node);
+            visit(infixObj->pLeft);
+            visit(infixObj->pRight);
+            break;
+        }
+        case ast::NodeType::IfExpression:
+        {
+            auto ifObj = std::static_pointer_cast<ast::IfExpression>(node);
+            visit(ifObj->pCondition);
+            visit(ifObj->pConsequence);
+            visit(ifObj->pAlternative);
+            break;
+        }
+        case ast::NodeType::FunctionLiteral:
+            visit(std::static_pointer_cast<ast::FunctionLiteral>(node)->pBody);
+            break;
+        case ast::NodeType::CallExpression:
+        {
+            auto callObj = std::static_pointer_cast<ast::CallExpression>(node);
+            visit(callObj->pFunction);
+            for (auto &arg : callObj->pArguments)
+            {
+                visit(arg);
+            }
+            break;
+        }
+        case ast::NodeType::ArrayLiteral:
+            for (auto &elem : std::static_pointer_cast<ast::ArrayLiteral>(node)->Elements)
+            {
+                visit(elem);
+            }
+            break;
+        case ast::NodeType::HashLiteral:
+            for (auto &pair : std::static_pointer_cast<ast::HashLiteral>(node)->Pairs)
+            {
+                visit(pair.first);
+                visit(pair.second);
+            }
+            break;
+        case ast::NodeType::IndexExpression:
+        {
+            auto indexObj = std::static_pointer_cast<ast::IndexExpression>(node);
+            visit(indexObj->Left);
+            visit(indexObj->Index);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // 一个作用域中的let(包括if中的), 不进入嵌套的函数体
+    void countLets(const std::shared_ptr<ast::Node> &node, std::map<std::string, int> &counts)
+    {
+        if (node == nullptr || node->GetNodeType() == ast::NodeType::FunctionLiteral)
+        {
+            return;
+        }
+
+        if (node->GetNodeType() == ast::NodeType::LetStatement)
+        {
+            counts[std::static_pointer_cast<ast::LetStatement>(node)->pName->Value]++;
+        }
+        forEachChild(node, [&](const std::shared_ptr<ast::Node> &child) { countLets(child, counts); });
+    }
+
+    // 函数体的节点数; 含有函数字面量(会捕获参数)、return或引用函数自身时不能展开, 返回-1
+    int inlineCost(const std::shared_ptr<ast::Node> &node, const std::string &self)
+    {
+        if (node == nullptr)
+        {
+            return 0;
+        }
+
+        switch (node->GetNodeType())
+        {
+        case ast::NodeType::FunctionLiteral:
+        case ast::NodeType::ReturnStatement:
+            return -1;
+        case ast::NodeType::Identifier:
+            return (std::static_pointer_cast<ast::Identifier>(node)->Value == self) ? -1 : 1;
+        default:
+            break;
+        }
+
+        int cost = 1;
+        forEachChild(node, [&](const std::shared_ptr<ast::Node> &child) {
+            int n = (cost < 0) ? 0 : inlineCost(child, self);
+            cost = (n < 0) ? -1 : cost + n;
+        });
+        return cost;
+    }
+
+    void collectLets(const std::shared_ptr<ast::Node> &node, std::vector<std::string> &names)
+    {
+        if (node == nullptr)
+        {
+            return;
+        }
+
+        if (node->GetNodeType() == ast::NodeType::LetStatement)
+        {
+            names.push_back(std::static_pointer_cast<ast::LetStatement>(node)->pName->Value);
+        }
+        forEachChild(node, [&](const std::shared_ptr<ast::Node> &child) { collectLets(child, names); });
+    }
+}
+
+#endif // H_INLINE_H
@@ -24,6 +24,9 @@ namespace compiler
         std::string Name;
         SymbolScope Scope;
         int Index;
+        int Bindings = 0;  // 被let绑定的次数
+        int Constant = -1; // 只绑定一次且值不变的全局变量: 值在常量池中的下标
+        std::vector<std::shared_ptr<Symbol>> Captured; // 提升为普通函数的局部闭包: 调用时追加传入这些捕获变量
 
         Symbol(std::string name, int idx): Name(name), Index(idx){}
         Symbol(std::string name, SymbolScope scope, int idx): Name(name), Scope(scope), Index(idx){}
@@ -47,7 +50,18 @@ namespace compiler
 
         std::shared_ptr<Symbol> Define(std::string name)
         {
+            // 同一作用域内重复let复用原槽位, 新值覆盖旧值
+            auto fit = store.find(name);
+            if(fit != store.end() && (fit->second->Scope == SymbolScopeType::GlobalScope || fit->second->Scope == SymbolScopeType::LocalScope))
+            {
+                // 重新绑定后不再是常量
+                fit->second->Bindings++;
+                fit->second->Constant = -1;
+                return fit->second;
+            }
+
             auto symbol = std::make_shared<Symbol>(name, numDefinitions);
+            symbol->Bindings = 1;
 
             if(Outer == nullptr)
             {
@@ -11,14 +11,26 @@
 
 namespace evaluator
 {
-    std::map<std::string, std::shared_ptr<objects::Builtin>> builtins{
+    std::map<std::string, objects::Ref<objects::Builtin>> builtins{
         {"len", objects::GetBuiltinByName("len")},
         {"puts", objects::GetBuiltinByName("puts")},
         {"first", objects::GetBuiltinByName("first")},
         {"last", objects::GetBuiltinByName("last")},
         {"rest", objects::GetBuiltinByName("rest")},
         {"push", objects::GetBuiltinByName("push")},
-        {"fibonacci", objects::GetBuiltinByName("fibonacci")}
+        {"fibonacci", objects::GetBuiltinByName("fibonacci")},
+        {"set", objects::GetBuiltinByName("set")},
+        {"substr", objects::GetBuiltinByName("substr")},
+        {"split", objects::GetBuiltinByName("split")},
+        {"join", objects::GetBuiltinByName("join")},
+        {"index_of", objects::GetBuiltinByName("index_of")},
+        {"contains", objects::GetBuiltinByName("contains")},
+        {"starts_with", objects::GetBuiltinByName("starts_with")},
+        {"trim", objects::GetBuiltinByName("trim")},
+        {"delete", objects::GetBuiltinByName("delete")},
+        {"keys", objects::GetBuiltinByName("keys")},
+        {"values", objects::GetBuiltinByName("values")},
+        {"has", objects::GetBuiltinByName("has")}
     };
 }
 
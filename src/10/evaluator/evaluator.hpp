@@ -18,11 +18,15 @@
 
 namespace evaluator
 {
-	std::shared_ptr<objects::Object> Eval(std::shared_ptr<ast::Node> node, std::shared_ptr<objects::Environment> env);
+	objects::Ref<objects::Object> Eval(const std::shared_ptr<ast::Node> &node, const std::shared_ptr<objects::Environment> &env);
 
-	std::shared_ptr<objects::Object> unwrapReturnValue(std::shared_ptr<objects::Object> obj)
+	// 分层执行时接管函数调用(见tier/tier.hpp), 返回nullptr表示仍由解释器执行
+	using CallHook = objects::Ref<objects::Object> (*)(const objects::Ref<objects::Object> &fn, std::vector<objects::Ref<objects::Object>> &args);
+	CallHook Tiering = nullptr;
+
+	objects::Ref<objects::Object> unwrapReturnValue(objects::Ref<objects::Object> obj)
 	{
-		std::shared_ptr<objects::ReturnValue> returnValue = std::dynamic_pointer_cast<objects::ReturnValue>(obj);
+		objects::Ref<objects::ReturnValue> returnValue = objects::refCast<objects::ReturnValue>(obj);
 		if (returnValue != nullptr)
 		{
 			return returnValue->Value;
@@ -33,25 +37,34 @@ namespace evaluator
 		}
 	}
 
-	std::shared_ptr<objects::Environment> extendFunctionEnv(std::shared_ptr<objects::Function> fn, std::vector<std::shared_ptr<objects::Object>> &args)
+	std::shared_ptr<objects::Environment> extendFunctionEnv(objects::Ref<objects::Function> fn, std::vector<objects::Ref<objects::Object>> &args)
 	{
 		std::shared_ptr<objects::Environment> env = objects::NewEnclosedEnvironment(fn->Env);
 		for (unsigned long i = 0; i < fn->Parameters.size(); i++)
 		{
-			env->Set(fn->Parameters[i]->Value, args[i]);
+			env->Set(fn->Parameters[i]->Value, std::move(args[i]));
 		}
 		return env;
 	}
 
-	std::shared_ptr<objects::Object> applyFunction(std::shared_ptr<objects::Object> fn, std::vector<std::shared_ptr<objects::Object>> &args)
+	objects::Ref<objects::Object> applyFunction(objects::Ref<objects::Object> fn, std::vector<objects::Ref<objects::Object>> &args)
 	{
-		if (std::shared_ptr<objects::Function> function = std::dynamic_pointer_cast<objects::Function>(fn); function != nullptr)
+		if (Tiering != nullptr)
+		{
+			auto result = Tiering(fn, args);
+			if (result != nullptr)
+			{
+				return result;
+			}
+		}
+
+		if (objects::Ref<objects::Function> function = objects::refCast<objects::Function>(fn); function != nullptr)
 		{
 			std::shared_ptr<objects::Environment> extendedEnv = extendFunctionEnv(function, args);
-			std::shared_ptr<objects::Object> evaluated = Eval(function->Body, extendedEnv);
+			objects::Ref<objects::Object> evaluated = Eval(function->Body, extendedEnv);
 			return unwrapReturnValue(evaluated);
 		}
-		else if (std::shared_ptr<objects::Builtin> builtin = std::dynamic_pointer_cast<objects::Builtin>(fn); builtin != nullptr)
+		else if (objects::Ref<objects::Builtin> builtin = objects::refCast<objects::Builtin>(fn); builtin != nullptr)
 		{
 			auto result = builtin->Fn(args);
 			if(result != nullptr)
@@ -67,31 +80,32 @@ namespace evaluator
 		}
 	}
 
-	std::vector<std::shared_ptr<objects::Object>> evalExpressions(std::vector<std::shared_ptr<ast::Expression>> exps, std::shared_ptr<objects::Environment> env)
+	std::vector<objects::Ref<objects::Object>> evalExpressions(const std::vector<std::shared_ptr<ast::Expression>>& exps, const std::shared_ptr<objects::Environment> &env)
 	{
-		std::vector<std::shared_ptr<objects::Object>> result;
+		std::vector<objects::Ref<objects::Object>> result;
+		result.reserve(exps.size());
 
 		for (auto &e : exps)
 		{
-			std::shared_ptr<objects::Object> evaluated = Eval(e, env);
+			objects::Ref<objects::Object> evaluated = Eval(e, env);
 			if (objects::isError(evaluated))
 			{
-				std::vector<std::shared_ptr<objects::Object>> x;
+				std::vector<objects::Ref<objects::Object>> x;
 				x.push_back(evaluated);
 				return x;
 			}
-			result.push_back(evaluated);
+			result.push_back(std::move(evaluated));
 		}
 
 		return result;
 	}
 
-	std::shared_ptr<objects::Object> evalIdentifier(std::shared_ptr<ast::Identifier> node, std::shared_ptr<objects::Environment> env)
+	objects::Ref<objects::Object> evalIdentifier(std::shared_ptr<ast::Identifier> node, const std::shared_ptr<objects::Environment> &env)
 	{
 #ifdef DEBUG
 		std::cout << "\t\t evalIdentifier get by :" << node->Value << std::endl;
 #endif
-		std::shared_ptr<objects::Object> val = env->Get(node->Value);
+		objects::Ref<objects::Object> val = env->Get(node->Value);
 
 		if(val != nullptr)
 		{
@@ -114,9 +128,9 @@ namespace evaluator
 		return objects::newError("identifier not found: " + node->Value);
 	}
 
-	std::shared_ptr<objects::Object> evalIfExpression(std::shared_ptr<ast::IfExpression> ie, std::shared_ptr<objects::Environment> env)
+	objects::Ref<objects::Object> evalIfExpression(std::shared_ptr<ast::IfExpression> ie, const std::shared_ptr<objects::Environment> &env)
 	{
-		std::shared_ptr<objects::Object> condition = Eval(ie->pCondition, env);
+		objects::Ref<objects::Object> condition = Eval(ie->pCondition, env);
 		if (objects::isError(condition))
 		{
 			return condition;
@@ -135,32 +149,26 @@ namespace evaluator
 		}
 	}
 
-	std::shared_ptr<objects::Object> evalIntegerInfixExpression(std::string ops, std::shared_ptr<objects::Object> left, std::shared_ptr<objects::Object> right)
+	objects::Ref<objects::Object> evalIntegerInfixExpression(std::string ops, objects::Ref<objects::Object> left, objects::Ref<objects::Object> right)
 	{
-		long long int leftValue = std::dynamic_pointer_cast<objects::Integer>(left)->Value;
-		long long int rightValue = std::dynamic_pointer_cast<objects::Integer>(right)->Value;
-
-		std::shared_ptr<objects::Integer> result = std::make_shared<objects::Integer>();
+		long long int leftValue = objects::refCast<objects::Integer>(left)->Value;
+		long long int rightValue = objects::refCast<objects::Integer>(right)->Value;
 
 		if (ops == "+")
 		{
-			result->Value = leftValue + rightValue;
-			return result;
+			return objects::newInteger(leftValue + rightValue);
 		}
 		else if (ops == "-")
 		{
-			result->Value = leftValue - rightValue;
-			return result;
+			return objects::newInteger(leftValue - rightValue);
 		}
 		else if (ops == "*")
 		{
-			result->Value = leftValue * rightValue;
-			return result;
+			return objects::newInteger(leftValue * rightValue);
 		}
 		else if (ops == "/")
 		{
-			result->Value = leftValue / rightValue;
-			return result;
+			return objects::newInteger(leftValue / rightValue);
 		}
 		else if (ops == "<")
 		{
@@ -185,31 +193,30 @@ namespace evaluator
 	}
 
 
-	std::shared_ptr<objects::Object> evalStringInfixExpression(std::string ops, std::shared_ptr<objects::Object> left, std::shared_ptr<objects::Object> right)
+	objects::Ref<objects::Object> evalStringInfixExpression(std::string ops, objects::Ref<objects::Object> left, objects::Ref<objects::Object> right)
 	{
 		if(ops != "+")
 		{
 			return objects::newError("unknown operator: " + left->TypeStr() + " " + ops + " " + right->TypeStr());
 		}
-		std::string leftValue = std::dynamic_pointer_cast<objects::String>(left)->Value;
-		std::string rightValue = std::dynamic_pointer_cast<objects::String>(right)->Value;
+		auto leftValue = objects::refCast<objects::String>(left);
+		auto rightValue = objects::refCast<objects::String>(right);
 
-		std::shared_ptr<objects::String> result = std::make_shared<objects::String>(leftValue + rightValue);
-		return result;
+		return objects::concatStrings(leftValue, rightValue);
 	}
 
-	std::shared_ptr<objects::Object> evalMinusPrefixOperatorExpression(std::shared_ptr<objects::Object> right)
+	objects::Ref<objects::Object> evalMinusPrefixOperatorExpression(objects::Ref<objects::Object> right)
 	{
 		if (right->Type() != objects::ObjectType::INTEGER)
 		{
 			return objects::newError("unknown operator: -" + right->TypeStr());
 		}
 
-		long long int value = std::dynamic_pointer_cast<objects::Integer>(right)->Value;
-		return std::make_shared<objects::Integer>(-value);
+		long long int value = objects::refCast<objects::Integer>(right)->Value;
+		return objects::newInteger(-value);
 	}
 
-	std::shared_ptr<objects::Object> evalBangOperatorExpression(std::shared_ptr<objects::Object> right)
+	objects::Ref<objects::Object> evalBangOperatorExpression(objects::Ref<objects::Object> right)
 	{
 		if (right == objects::TRUE_OBJ)
 		{
@@ -229,7 +236,7 @@ namespace evaluator
 		}
 	}
 
-	std::shared_ptr<objects::Object> evalPrefixExpression(std::string ops, std::shared_ptr<objects::Object> right)
+	objects::Ref<objects::Object> evalPrefixExpression(std::string ops, objects::Ref<objects::Object> right)
 	{
 		if (ops == "!")
 		{
@@ -245,7 +252,7 @@ namespace evaluator
 		}
 	}
 
-	std::shared_ptr<objects::Object> evalInfixExpression(std::string ops, std::shared_ptr<objects::Object> left, std::shared_ptr<objects::Object> right)
+	objects::Ref<objects::Object> evalInfixExpression(std::string ops, objects::Ref<objects::Object> left, objects::Ref<objects::Object> right)
 	{
 		if (left->Type() == objects::ObjectType::INTEGER && right->Type() == objects::ObjectType::INTEGER)
 		{
@@ -273,7 +280,7 @@ namespace evaluator
 		}
 	}
 
-	std::shared_ptr<objects::Object> evalIndexExpression(std::shared_ptr<objects::Object> left, std::shared_ptr<objects::Object> index)
+	objects::Ref<objects::Object> evalIndexExpression(objects::Ref<objects::Object> left, objects::Ref<objects::Object> index)
 	{
 		if(left->Type() == objects::ObjectType::ARRAY && index->Type() == objects::ObjectType::INTEGER)
 		{
@@ -288,9 +295,9 @@ namespace evaluator
 	}
 
 
-	std::shared_ptr<objects::Object> evalHashLiteral(std::shared_ptr<ast::HashLiteral> hashNode, std::shared_ptr<objects::Environment> env)
+	objects::Ref<objects::Object> evalHashLiteral(std::shared_ptr<ast::HashLiteral> hashNode, const std::shared_ptr<objects::Environment> &env)
 	{
-		std::map<objects::HashKey, std::shared_ptr<objects::HashPair>> pairs{};
+		auto hash = objects::makeRef<objects::Hash>();
 
 		for(auto &[keyNode, valueNode]: hashNode->Pairs)
 		{
@@ -312,15 +319,15 @@ namespace evaluator
 			}
 
 			auto hashed = key->GetHashKey();
-			pairs[hashed] = std::make_shared<objects::HashPair>(key, value);
+			hash->Pairs.Insert(hashed, objects::makePooledShared<objects::HashPair>(key, value));
 		}
 
-		return std::make_shared<objects::Hash>(pairs);
+		return hash;
 	}
 
-	std::shared_ptr<objects::Object> evalBlockStatement(std::shared_ptr<ast::BlockStatement> block, std::shared_ptr<objects::Environment> env)
+	objects::Ref<objects::Object> evalBlockStatement(std::shared_ptr<ast::BlockStatement> block, const std::shared_ptr<objects::Environment> &env)
 	{
-		std::shared_ptr<objects::Object> result;
+		objects::Ref<objects::Object> result;
 
 		for (auto &stmt : block->v_pStatements)
 		{
@@ -338,13 +345,13 @@ namespace evaluator
 		return result;
 	}
 
-	std::shared_ptr<objects::Object> evalProgram(std::shared_ptr<ast::Program> program, std::shared_ptr<objects::Environment> env)
+	objects::Ref<objects::Object> evalProgram(std::shared_ptr<ast::Program> program, const std::shared_ptr<objects::Environment> &env)
 	{
 #ifdef DEBUG
 		std::cout << "\t evalProgram: [Enter]" << std::endl;
 		std::cout << "\t evalProgram: program=" << program->String() << std::endl;
 #endif
-		std::shared_ptr<objects::Object> result = std::make_shared<objects::Object>();
+		objects::Ref<objects::Object> result = objects::makeRef<objects::Object>();
 
 #ifdef DEBUG
 		std::cout << "\t evalProgram: result=" << result->Inspect() << std::endl;
@@ -371,7 +378,7 @@ namespace evaluator
 
 			if (result->Type() == objects::ObjectType::RETURN_VALUE)
 			{
-				return std::dynamic_pointer_cast<objects::ReturnValue>(result)->Value;
+				return objects::refCast<objects::ReturnValue>(result)->Value;
 			}
 			else if (result->Type() == objects::ObjectType::ERROR)
 			{
@@ -382,31 +389,33 @@ namespace evaluator
 		return result;
 	}
 
-	std::shared_ptr<objects::Object> Eval(std::shared_ptr<ast::Node> node, std::shared_ptr<objects::Environment> env)
+	objects::Ref<objects::Object> Eval(const std::shared_ptr<ast::Node> &node, const std::shared_ptr<objects::Environment> &env)
 	{
 		// Statements
-		if (node->GetNodeType() == ast::NodeType::Program)
+		switch (node->GetNodeType())
+		{
+		case ast::NodeType::Program:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: Program" << std::endl;
 #endif
-			std::shared_ptr<ast::Program> program = std::dynamic_pointer_cast<ast::Program>(node);
+			std::shared_ptr<ast::Program> program = std::static_pointer_cast<ast::Program>(node);
 			return evalProgram(program, env);
 		}
-		else if (node->GetNodeType() == ast::NodeType::BlockStatement)
+		case ast::NodeType::BlockStatement:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: BlockStatement" << std::endl;
 #endif
-			std::shared_ptr<ast::BlockStatement> blockStmt = std::dynamic_pointer_cast<ast::BlockStatement>(node);
+			std::shared_ptr<ast::BlockStatement> blockStmt = std::static_pointer_cast<ast::BlockStatement>(node);
 			return evalBlockStatement(blockStmt, env);
 		}
-		else if (node->GetNodeType() == ast::NodeType::ExpressionStatement)
+		case ast::NodeType::ExpressionStatement:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: ExpressionStatement" << std::endl;
 #endif
-			std::shared_ptr<ast::ExpressionStatement> exprStmt = std::dynamic_pointer_cast<ast::ExpressionStatement>(node);
+			std::shared_ptr<ast::ExpressionStatement> exprStmt = std::static_pointer_cast<ast::ExpressionStatement>(node);
 
 #ifdef DEBUG
 			std::cout << "\t exprStmt=" << exprStmt->String() << std::endl;
@@ -414,31 +423,31 @@ namespace evaluator
 
 			return Eval(exprStmt->pExpression, env);
 		}
-		else if (node->GetNodeType() == ast::NodeType::ReturnStatement)
+		case ast::NodeType::ReturnStatement:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: ReturnStatement" << std::endl;
 #endif
-			std::shared_ptr<ast::ReturnStatement> returnStmt = std::dynamic_pointer_cast<ast::ReturnStatement>(node);
-			std::shared_ptr<objects::Object> val = Eval(returnStmt->pReturnValue, env);
+			std::shared_ptr<ast::ReturnStatement> returnStmt = std::static_pointer_cast<ast::ReturnStatement>(node);
+			objects::Ref<objects::Object> val = Eval(returnStmt->pReturnValue, env);
 			if (objects::isError(val))
 			{
 				return val;
 			}
-			return std::make_shared<objects::ReturnValue>(val);
+			return objects::makeRef<objects::ReturnValue>(val);
 		}
-		else if (node->GetNodeType() == ast::NodeType::LetStatement)
+		case ast::NodeType::LetStatement:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: LetStatement" << std::endl;
 #endif
-			std::shared_ptr<ast::LetStatement> lit = std::dynamic_pointer_cast<ast::LetStatement>(node);
+			std::shared_ptr<ast::LetStatement> lit = std::static_pointer_cast<ast::LetStatement>(node);
 
 #ifdef DEBUG
 			std::cout << "\t lit stmt=" << lit->String() << std::endl;
 #endif
 
-			std::shared_ptr<objects::Object> val = Eval(lit->pValue, env);
+			objects::Ref<objects::Object> val = Eval(lit->pValue, env);
 
 #ifdef DEBUG
 			std::cout << "\t lit get val=" << val->Inspect() << std::endl;
@@ -452,60 +461,61 @@ namespace evaluator
 			std::cout << "\t lit set val to :" << lit->pName->Value << std::endl;
 #endif
 			env->Set(lit->pName->Value, val);
+			break;
 		}
 		// Expressions
-		else if (node->GetNodeType() == ast::NodeType::IntegerLiteral)
+		case ast::NodeType::IntegerLiteral:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: IntegerLiteral" << std::endl;
 #endif
-			std::shared_ptr<ast::IntegerLiteral> integerLiteral = std::dynamic_pointer_cast<ast::IntegerLiteral>(node);
+			std::shared_ptr<ast::IntegerLiteral> integerLiteral = std::static_pointer_cast<ast::IntegerLiteral>(node);
 
 #ifdef DEBUG
 			std::cout << "\t integerLiteral Value=" << integerLiteral->Value << std::endl;
 #endif
-			return std::make_shared<objects::Integer>(integerLiteral->Value);
+			return objects::newInteger(integerLiteral->Value);
 		}
-		else if (node->GetNodeType() == ast::NodeType::Boolean)
+		case ast::NodeType::Boolean:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: Boolean" << std::endl;
 #endif
-			return objects::nativeBoolToBooleanObject(std::dynamic_pointer_cast<ast::Boolean>(node)->Value);
+			return objects::nativeBoolToBooleanObject(std::static_pointer_cast<ast::Boolean>(node)->Value);
 		}
-		else if(node->GetNodeType() == ast::NodeType::StringLiteral)
+		case ast::NodeType::StringLiteral:
 		{
-			std::shared_ptr<ast::StringLiteral> stringLiteral = std::dynamic_pointer_cast<ast::StringLiteral>(node);
-			return std::make_shared<objects::String>(stringLiteral->Value);
+			std::shared_ptr<ast::StringLiteral> stringLiteral = std::static_pointer_cast<ast::StringLiteral>(node);
+			return objects::makeRef<objects::String>(stringLiteral->Value);
 		}
-		else if (node->GetNodeType() == ast::NodeType::PrefixExpression)
+		case ast::NodeType::PrefixExpression:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: PrefixExpression" << std::endl;
 #endif
-			std::shared_ptr<ast::PrefixExpression> infixObj = std::dynamic_pointer_cast<ast::PrefixExpression>(node);
+			std::shared_ptr<ast::PrefixExpression> infixObj = std::static_pointer_cast<ast::PrefixExpression>(node);
 
-			std::shared_ptr<objects::Object> right = Eval(infixObj->pRight, env);
+			objects::Ref<objects::Object> right = Eval(infixObj->pRight, env);
 			if (objects::isError(right))
 			{
 				return right;
 			}
 			return evalPrefixExpression(infixObj->Operator, right);
 		}
-		else if (node->GetNodeType() == ast::NodeType::InfixExpression)
+		case ast::NodeType::InfixExpression:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: InfixExpression" << std::endl;
 #endif
-			std::shared_ptr<ast::InfixExpression> infixObj = std::dynamic_pointer_cast<ast::InfixExpression>(node);
+			std::shared_ptr<ast::InfixExpression> infixObj = std::static_pointer_cast<ast::InfixExpression>(node);
 
-			std::shared_ptr<objects::Object> left = Eval(infixObj->pLeft, env);
+			objects::Ref<objects::Object> left = Eval(infixObj->pLeft, env);
 			if (objects::isError(left))
 			{
 				return left;
 			}
 
-			std::shared_ptr<objects::Object> right = Eval(infixObj->pRight, env);
+			objects::Ref<objects::Object> right = Eval(infixObj->pRight, env);
 			if (objects::isError(right))
 			{
 				return right;
@@ -513,20 +523,20 @@ namespace evaluator
 
 			return evalInfixExpression(infixObj->Operator, left, right);
 		}
-		else if (node->GetNodeType() == ast::NodeType::IfExpression)
+		case ast::NodeType::IfExpression:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: IfExpression" << std::endl;
 #endif
-			std::shared_ptr<ast::IfExpression> x = std::dynamic_pointer_cast<ast::IfExpression>(node);
+			std::shared_ptr<ast::IfExpression> x = std::static_pointer_cast<ast::IfExpression>(node);
 			return evalIfExpression(x, env);
 		}
-		else if (node->GetNodeType() == ast::NodeType::Identifier)
+		case ast::NodeType::Identifier:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: Identifier" << std::endl;
 #endif
-			std::shared_ptr<ast::Identifier> ident = std::dynamic_pointer_cast<ast::Identifier>(node);
+			std::shared_ptr<ast::Identifier> ident = std::static_pointer_cast<ast::Identifier>(node);
 
 #ifdef DEBUG
 			std::cout << "\t ident=" << ident->String() << std::endl;
@@ -534,37 +544,47 @@ namespace evaluator
 
 			return evalIdentifier(ident, env);
 		}
-		else if (node->GetNodeType() == ast::NodeType::FunctionLiteral)
+		case ast::NodeType::FunctionLiteral:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: FunctionLiteral" << std::endl;
 #endif
-			std::shared_ptr<ast::FunctionLiteral> funcObj = std::dynamic_pointer_cast<ast::FunctionLiteral>(node);
+			std::shared_ptr<ast::FunctionLiteral> funcObj = std::static_pointer_cast<ast::FunctionLiteral>(node);
+
+			auto err = funcObj->ParseBody();
+			if (!err.empty())
+			{
+				return objects::newError(err);
+			}
 
-			std::shared_ptr<objects::Function> function = std::make_shared<objects::Function>();
+			objects::Ref<objects::Function> function = objects::makeRef<objects::Function>();
+
+			// 函数对象可能比Program活得久, 从arena中取出的节点换成让arena保持存活的句柄
+			auto retain = [&](const auto &x) { return (funcObj->pArena != nullptr) ? funcObj->pArena->Retain(x) : x; };
 
 			std::for_each(funcObj->v_pParameters.begin(), funcObj->v_pParameters.end(), [&](std::shared_ptr<ast::Identifier> &x)
-						  { function->Parameters.push_back(x); });
+						  { function->Parameters.push_back(retain(x)); });
 
 			function->Env = env;
-			function->Body = funcObj->pBody;
+			function->Body = retain(funcObj->pBody);
+			function->Name = funcObj->Name;
 
 			return function;
 		}
-		else if (node->GetNodeType() == ast::NodeType::CallExpression)
+		case ast::NodeType::CallExpression:
 		{
 #ifdef DEBUG
 			std::cout << "Eval: CallExpression" << std::endl;
 #endif
-			std::shared_ptr<ast::CallExpression> callObj = std::dynamic_pointer_cast<ast::CallExpression>(node);
+			std::shared_ptr<ast::CallExpression> callObj = std::static_pointer_cast<ast::CallExpression>(node);
 
-			std::shared_ptr<objects::Object> function = Eval(callObj->pFunction, env);
+			objects::Ref<objects::Object> function = Eval(callObj->pFunction, env);
 			if (objects::isError(function))
 			{
 				return function;
 			}
 
-			std::vector<std::shared_ptr<objects::Object>> args = evalExpressions(callObj->pArguments, env);
+			std::vector<objects::Ref<objects::Object>> args = evalExpressions(callObj->pArguments, env);
 			if (args.size() == 1 && objects::isError(args[0]))
 			{
 				return args[0];
@@ -572,20 +592,20 @@ namespace evaluator
 
 			return applyFunction(function, args);
 		}
-		else if(node->GetNodeType() == ast::NodeType::ArrayLiteral)
+		case ast::NodeType::ArrayLiteral:
 		{
-			std::shared_ptr<ast::ArrayLiteral> arrayObj = std::dynamic_pointer_cast<ast::ArrayLiteral>(node);
+			std::shared_ptr<ast::ArrayLiteral> arrayObj = std::static_pointer_cast<ast::ArrayLiteral>(node);
 			auto elements = evalExpressions(arrayObj->Elements, env);
 			if(elements.size() == 1 && objects::isError(elements[0]))
 			{
 				return elements[0];
 			}
 
-			return std::make_shared<objects::Array>(elements);
+			return objects::makePooled<objects::Array>(std::move(elements));
 		}
-		else if(node->GetNodeType() == ast::NodeType::IndexExpression)
+		case ast::NodeType::IndexExpression:
 		{
-			std::shared_ptr<ast::IndexExpression> idxObj = std::dynamic_pointer_cast<ast::IndexExpression>(node);
+			std::shared_ptr<ast::IndexExpression> idxObj = std::static_pointer_cast<ast::IndexExpression>(node);
 
 			auto left = Eval(idxObj->Left, env);
 			if(objects::isError(left))
@@ -601,11 +621,14 @@ namespace evaluator
 
 			return evalIndexExpression(left, index);
 		}
-		else if(node->GetNodeType() == ast::NodeType::HashLiteral)
+		case ast::NodeType::HashLiteral:
 		{
-			std::shared_ptr<ast::HashLiteral> hashObj = std::dynamic_pointer_cast<ast::HashLiteral>(node);
+			std::shared_ptr<ast::HashLiteral> hashObj = std::static_pointer_cast<ast::HashLiteral>(node);
 			return evalHashLiteral(hashObj, env);
 		}
+		default:
+			break;
+		}
 
 		return nullptr;
 	}
@@ -0,0 +1,704 @@
+#ifndef H_IR_BUILDER_H
+#define H_IR_BUILDER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+
+#include "ast/ast.hpp"
+#include "objects/objects.hpp"
+#include "objects/builtins.hpp"
+#include "ir/ir.hpp"
+
+namespace ir
+{
+    // 正在构建的函数: env是局部变量名到当前SSA值的映射, cur为nullptr表示控制流已经返回
+    struct FunctionBuilder
+    {
+        Function *fn;
+        FunctionBuilder *outer;
+        std::map<std::string, Value *> env;
+        std::string selfName;
+        std::vector<std::string> freeNames;
+        Block *cur = nullptr;
+        std::vector<Block *> layout;
+
+        FunctionBuilder(Function *f, FunctionBuilder *o) : fn(f), outer(o) {}
+    };
+
+    struct Builder
+    {
+        Module *module;
+        std::map<std::string, int> globals;
+        std::map<std::string, int> builtins;
+        std::map<long long int, int> integerConstants;
+        FunctionBuilder *fb = nullptr;
+
+        Builder(Module *m) : module(m)
+        {
+            int i = -1;
+            for (auto &fn : objects::Builtins)
+            {
+                i += 1;
+                builtins[fn->Name] = i;
+            }
+        }
+
+        objects::Ref<objects::Error> Build(const std::shared_ptr<ast::Node> &node)
+        {
+            module->Functions.push_back(std::make_unique<Function>());
+            auto mainFn = module->Main();
+            mainFn->Name = "main";
+            mainFn->IsMain = true;
+
+            FunctionBuilder mainBuilder(mainFn, nullptr);
+            fb = &mainBuilder;
+            place(mainFn->NewBlock());
+
+            auto program = std::static_pointer_cast<ast::Program>(node);
+            for (auto &stmt : program->v_pStatements)
+            {
+                if (fb->cur == nullptr)
+                {
+                    break;
+                }
+
+                auto resultObj = buildStatement(stmt);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+            }
+
+            if (fb->cur != nullptr)
+            {
+                terminate(Op::Exit, {}, {});
+            }
+            finishLayout();
+
+            module->NumGlobals = globals.size();
+            fb = nullptr;
+            return nullptr;
+        }
+
+        objects::Ref<objects::Error> buildStatement(const std::shared_ptr<ast::Node> &node)
+        {
+            switch (node->GetNodeType())
+            {
+            case ast::NodeType::ExpressionStatement:
+            {
+                Value *value;
+                auto resultObj = buildExpression(std::static_pointer_cast<ast::ExpressionStatement>(node)->pExpression, value);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                if (fb->fn->IsMain && fb->cur != nullptr)
+                {
+                    emit(Op::Pop, {value});
+                }
+                break;
+            }
+            case ast::NodeType::LetStatement:
+            {
+                auto letObj = std::static_pointer_cast<ast::LetStatement>(node);
+
+                if (fb->fn->IsMain)
+                {
+                    // 和compiler::Compiler一样, 先定义再编译右边的值
+                    auto fit = globals.find(letObj->pName->Value);
+                    int index = (fit != globals.end()) ? fit->second : globals.size();
+                    globals[letObj->pName->Value] = index;
+
+                    Value *value;
+                    auto resultObj = buildExpression(letObj->pValue, value);
+                    if (objects::isError(resultObj))
+                    {
+                        return resultObj;
+                    }
+
+                    if (fb->cur != nullptr)
+                    {
+                        emit(Op::SetGlobal, {value}, index);
+                    }
+                }
+                else
+                {
+                    Value *value;
+                    auto resultObj = buildExpression(letObj->pValue, value);
+                    if (objects::isError(resultObj))
+                    {
+                        return resultObj;
+                    }
+
+                    if (fb->cur != nullptr)
+                    {
+                        fb->env[letObj->pName->Value] = emit(Op::Copy, {value});
+                    }
+                }
+                break;
+            }
+            case ast::NodeType::ReturnStatement:
+            {
+                Value *value;
+                auto resultObj = buildExpression(std::static_pointer_cast<ast::ReturnStatement>(node)->pReturnValue, value);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                if (fb->cur != nullptr)
+                {
+                    terminate(Op::Return, {value}, {});
+                }
+                break;
+            }
+            default:
+                break;
+            }
+
+            return nullptr;
+        }
+
+        // 代码块的值是最后一条表达式语句的值, 否则为null; 块内返回后value为nullptr
+        objects::Ref<objects::Error> buildBlockValue(const std::shared_ptr<ast::BlockStatement> &block, Value *&value)
+        {
+            value = nullptr;
+
+            auto &stmts = block->v_pStatements;
+            for (unsigned long i = 0; i < stmts.size() && fb->cur != nullptr; i++)
+            {
+                if (i + 1 == stmts.size() && stmts[i]->GetNodeType() == ast::NodeType::ExpressionStatement)
+                {
+                    return buildExpression(std::static_pointer_cast<ast::ExpressionStatement>(stmts[i])->pExpression, value);
+                }
+
+                auto resultObj = buildStatement(stmts[i]);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+            }
+
+            if (fb->cur != nullptr)
+            {
+                value = emit(Op::Null, {});
+            }
+            return nullptr;
+        }
+
+        objects::Ref<objects::Error> buildExpression(const std::shared_ptr<ast::Node> &node, Value *&value)
+        {
+            value = nullptr;
+
+            switch (node->GetNodeType())
+            {
+            case ast::NodeType::IntegerLiteral:
+            {
+                auto integerLiteral = std::static_pointer_cast<ast::IntegerLiteral>(node);
+                auto fit = integerConstants.find(integerLiteral->Value);
+                int index;
+                if (fit != integerConstants.end())
+                {
+                    index = fit->second;
+                }
+                else
+                {
+                    index = addConstant(objects::newInteger(integerLiteral->Value));
+                    integerConstants[integerLiteral->Value] = index;
+                }
+                value = emit(Op::Const, {}, index);
+                break;
+            }
+            case ast::NodeType::StringLiteral:
+            {
+                // 字符串按对象身份比较, 每个字面量各占一个常量, 和compiler::Compiler一致
+                auto stringLiteral = std::static_pointer_cast<ast::StringLiteral>(node);
+                value = emit(Op::Const, {}, addConstant(objects::makeRef<objects::String>(stringLiteral->Value)));
+                break;
+            }
+            case ast::NodeType::Boolean:
+                value = emit(std::static_pointer_cast<ast::Boolean>(node)->Value ? Op::True : Op::False, {});
+                break;
+            case ast::NodeType::Identifier:
+            {
+                auto name = std::static_pointer_cast<ast::Identifier>(node)->Value;
+
+                value = resolveLocal(fb, name);
+                if (value != nullptr)
+                {
+                    break;
+                }
+
+                auto git = globals.find(name);
+                if (git != globals.end())
+                {
+                    value = emit(Op::GetGlobal, {}, git->second);
+                    break;
+                }
+
+                auto bit = builtins.find(name);
+                if (bit != builtins.end())
+                {
+                    value = emit(Op::GetBuiltin, {}, bit->second);
+                    break;
+                }
+
+                return objects::newError("undefined variable " + name);
+            }
+            case ast::NodeType::PrefixExpression:
+            {
+                auto prefixObj = std::static_pointer_cast<ast::PrefixExpression>(node);
+
+                Value *operand;
+                auto resultObj = buildExpression(prefixObj->pRight, operand);
+                if (objects::isError(resultObj) || fb->cur == nullptr)
+                {
+                    return resultObj;
+                }
+
+                if (prefixObj->Operator == "!")
+                {
+                    value = emit(Op::Bang, {operand});
+                }
+                else if (prefixObj->Operator == "-")
+                {
+                    value = emit(Op::Minus, {operand});
+                }
+                else
+                {
+                    return objects::newError("unknow operator: " + prefixObj->Operator);
+                }
+                break;
+            }
+            case ast::NodeType::InfixExpression:
+            {
+                auto infixObj = std::static_pointer_cast<ast::InfixExpression>(node);
+
+                // `a < b`按`b > a`计算, 和compiler::Compiler一样先求右边
+                bool swapped = (infixObj->Operator == "<");
+                Value *left, *right;
+                auto resultObj = buildExpression(swapped ? infixObj->pRight : infixObj->pLeft, left);
+                if (objects::isError(resultObj) || fb->cur == nullptr)
+                {
+                    return resultObj;
+                }
+                resultObj = buildExpression(swapped ? infixObj->pLeft : infixObj->pRight, right);
+                if (objects::isError(resultObj) || fb->cur == nullptr)
+                {
+                    return resultObj;
+                }
+
+                static const std::map<std::string, std::pair<Op, bytecode::OpcodeType>> operators{
+                    {"+", {Op::Binary, bytecode::OpcodeType::OpAdd}},
+                    {"-", {Op::Binary, bytecode::OpcodeType::OpSub}},
+                    {"*", {Op::Binary, bytecode::OpcodeType::OpMul}},
+                    {"/", {Op::Binary, bytecode::OpcodeType::OpDiv}},
+                    {">", {Op::Compare, bytecode::OpcodeType::OpGreaterThan}},
+                    {"<", {Op::Compare, bytecode::OpcodeType::OpGreaterThan}},
+                    {"==", {Op::Compare, bytecode::OpcodeType::OpEqual}},
+                    {"!=", {Op::Compare, bytecode::OpcodeType::OpNotEqual}},
+                };
+
+                auto fit = operators.find(infixObj->Operator);
+                if (fit == operators.end())
+                {
+                    return objects::newError("unknow operator: " + infixObj->Operator);
+                }
+
+                value = emit(fit->second.first, {left, right});
+                value->Kind = fit->second.second;
+                break;
+            }
+            case ast::NodeType::IfExpression:
+                return buildIf(std::static_pointer_cast<ast::IfExpression>(node), value);
+            case ast::NodeType::ArrayLiteral:
+            {
+                std::vector<Value *> elements;
+                for (auto &elem : std::static_pointer_cast<ast::ArrayLiteral>(node)->Elements)
+                {
+                    Value *element;
+                    auto resultObj = buildExpression(elem, element);
+                    if (objects::isError(resultObj) || fb->cur == nullptr)
+                    {
+                        return resultObj;
+                    }
+                    elements.push_back(element);
+                }
+                value = emit(Op::Array, elements);
+                break;
+            }
+            case ast::NodeType::HashLiteral:
+            {
+                auto hashLiteral = std::static_pointer_cast<ast::HashLiteral>(node);
+
+                std::vector<std::shared_ptr<ast::Expression>> keys{};
+                for (auto &pair : hashLiteral->Pairs)
+                {
+                    keys.push_back(pair.first);
+                }
+                std::sort(keys.begin(), keys.end(), [](const auto &lhs, const auto &rhs) { return lhs->String() < rhs->String(); });
+
+                std::vector<Value *> elements;
+                for (auto &key : keys)
+                {
+                    Value *k, *v;
+                    auto resultObj = buildExpression(key, k);
+                    if (objects::isError(resultObj) || fb->cur == nullptr)
+                    {
+                        return resultObj;
+                    }
+                    resultObj = buildExpression(hashLiteral->Pairs[key], v);
+                    if (objects::isError(resultObj) || fb->cur == nullptr)
+                    {
+                        return resultObj;
+                    }
+                    elements.push_back(k);
+                    elements.push_back(v);
+                }
+                value = emit(Op::Hash, elements);
+                break;
+            }
+            case ast::NodeType::IndexExpression:
+            {
+                auto indexObj = std::static_pointer_cast<ast::IndexExpression>(node);
+
+                Value *left, *index;
+                auto resultObj = buildExpression(indexObj->Left, left);
+                if (objects::isError(resultObj) || fb->cur == nullptr)
+                {
+                    return resultObj;
+                }
+                resultObj = buildExpression(indexObj->Index, index);
+                if (objects::isError(resultObj) || fb->cur == nullptr)
+                {
+                    return resultObj;
+                }
+                value = emit(Op::Index, {left, index});
+                break;
+            }
+            case ast::NodeType::CallExpression:
+            {
+                auto callObj = std::static_pointer_cast<ast::CallExpression>(node);
+
+                std::vector<Value *> args;
+                Value *callee;
+                auto resultObj = buildExpression(callObj->pFunction, callee);
+                if (objects::isError(resultObj) || fb->cur == nullptr)
+                {
+                    return resultObj;
+                }
+                args.push_back(callee);
+
+                for (auto &arg : callObj->pArguments)
+                {
+                    Value *argValue;
+                    resultObj = buildExpression(arg, argValue);
+                    if (objects::isError(resultObj) || fb->cur == nullptr)
+                    {
+                        return resultObj;
+                    }
+                    args.push_back(argValue);
+                }
+                value = emit(Op::Call, args);
+                break;
+            }
+            case ast::NodeType::FunctionLiteral:
+                return buildFunction(std::static_pointer_cast<ast::FunctionLiteral>(node), value);
+            default:
+                break;
+            }
+
+            return nullptr;
+        }
+
+        objects::Ref<objects::Error> buildIf(const std::shared_ptr<ast::IfExpression> &ifObj, Value *&value)
+        {
+            Value *condition;
+            auto resultObj = buildExpression(ifObj->pCondition, condition);
+            if (objects::isError(resultObj) || fb->cur == nullptr)
+            {
+                return resultObj;
+            }
+
+            auto fn = fb->fn;
+            auto thenBlock = fn->NewBlock();
+            auto elseBlock = fn->NewBlock();
+            auto mergeBlock = fn->NewBlock();
+            terminate(Op::Branch, {condition}, {thenBlock, elseBlock});
+
+            auto envBefore = fb->env;
+
+            place(thenBlock);
+            Value *thenValue;
+            resultObj = buildBlockValue(ifObj->pConsequence, thenValue);
+            if (objects::isError(resultObj))
+            {
+                return resultObj;
+            }
+            auto thenEnd = fb->cur;
+            auto thenEnv = fb->env;
+
+            fb->env = envBefore;
+            place(elseBlock);
+            Value *elseValue = nullptr;
+            if (ifObj->pAlternative != nullptr)
+            {
+                resultObj = buildBlockValue(ifObj->pAlternative, elseValue);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+            }
+            else
+            {
+                elseValue = emit(Op::Null, {});
+            }
+            auto elseEnd = fb->cur;
+            auto elseEnv = fb->env;
+
+            if (thenEnd == nullptr && elseEnd == nullptr)
+            {
+                // 两个分支都返回了, 之后的代码不可达
+                place(mergeBlock);
+                value = emit(Op::Null, {});
+                return nullptr;
+            }
+
+            if (thenEnd == nullptr || elseEnd == nullptr)
+            {
+                auto end = (thenEnd != nullptr) ? thenEnd : elseEnd;
+                fb->cur = end;
+                terminate(Op::Jump, {}, {mergeBlock});
+                fb->env = (thenEnd != nullptr) ? thenEnv : elseEnv;
+                place(mergeBlock);
+                value = (thenEnd != nullptr) ? thenValue : elseValue;
+                return nullptr;
+            }
+
+            // 两个分支都流向汇合块: 取值不同的变量都需要Phi, 只在一边定义的变量另一边取null
+            std::vector<std::string> names;
+            for (auto &item : thenEnv)
+            {
+                names.push_back(item.first);
+            }
+            for (auto &item : elseEnv)
+            {
+                if (thenEnv.find(item.first) == thenEnv.end())
+                {
+                    names.push_back(item.first);
+                }
+            }
+
+            std::vector<std::pair<std::string, std::pair<Value *, Value *>>> merges;
+            for (auto &name : names)
+            {
+                auto a = thenEnv.find(name);
+                auto b = elseEnv.find(name);
+                if (a != thenEnv.end() && b != elseEnv.end() && a->second == b->second)
+                {
+                    continue;
+                }
+
+                Value *thenIncoming = (a != thenEnv.end()) ? a->second : nullptr;
+                Value *elseIncoming = (b != elseEnv.end()) ? b->second : nullptr;
+                if (thenIncoming == nullptr)
+                {
+                    fb->cur = thenEnd;
+                    thenIncoming = emit(Op::Null, {});
+                }
+                if (elseIncoming == nullptr)
+                {
+                    fb->cur = elseEnd;
+                    elseIncoming = emit(Op::Null, {});
+                }
+                merges.push_back({name, {thenIncoming, elseIncoming}});
+            }
+
+            fb->cur = thenEnd;
+            terminate(Op::Jump, {}, {mergeBlock});
+            fb->cur = elseEnd;
+            terminate(Op::Jump, {}, {mergeBlock});
+
+            place(mergeBlock);
+            fb->env = thenEnv;
+            for (auto &merge : merges)
+            {
+                fb->env[merge.first] = emit(Op::Phi, {merge.second.first, merge.second.second});
+            }
+
+            value = (thenValue == elseValue) ? thenValue : emit(Op::Phi, {thenValue, elseValue});
+            return nullptr;
+        }
+
+        objects::Ref<objects::Error> buildFunction(const std::shared_ptr<ast::FunctionLiteral> &funcObj, Value *&value)
+        {
+            auto err = funcObj->ParseBody();
+            if (!err.empty())
+            {
+                return objects::newError(err);
+            }
+
+            module->Functions.push_back(std::make_unique<Function>());
+            auto fn = module->Functions.back().get();
+            fn->Name = (funcObj->Name != "") ? funcObj->Name : "fn" + std::to_string(module->Functions.size() - 1);
+            fn->NumParameters = funcObj->v_pParameters.size();
+            fn->ConstantIndex = addConstant(nullptr); // 降级时填入CompiledFunction
+
+            FunctionBuilder inner(fn, fb);
+            inner.selfName = funcObj->Name;
+
+            auto outer = fb;
+            fb = &inner;
+            place(fn->NewBlock());
+
+            for (int i = 0; i < fn->NumParameters; i++)
+            {
+                fb->env[funcObj->v_pParameters[i]->Value] = emit(Op::Param, {}, i);
+            }
+
+            objects::Ref<objects::Error> resultObj;
+            auto &stmts = funcObj->pBody->v_pStatements;
+            for (unsigned long i = 0; i < stmts.size() && fb->cur != nullptr; i++)
+            {
+                if (i + 1 == stmts.size() && stmts[i]->GetNodeType() == ast::NodeType::ExpressionStatement)
+                {
+                    Value *result;
+                    resultObj = buildExpression(std::static_pointer_cast<ast::ExpressionStatement>(stmts[i])->pExpression, result);
+                    if (!objects::isError(resultObj) && fb->cur != nullptr)
+                    {
+                        terminate(Op::Return, {result}, {});
+                    }
+                    break;
+                }
+
+                resultObj = buildStatement(stmts[i]);
+                if (objects::isError(resultObj))
+                {
+                    break;
+                }
+            }
+
+            if (!objects::isError(resultObj) && fb->cur != nullptr)
+            {
+                terminate(Op::ReturnNull, {}, {});
+            }
+            finishLayout();
+            fb = outer;
+
+            if (objects::isError(resultObj))
+            {
+                return resultObj;
+            }
+
+            fn->NumFree = inner.freeNames.size();
+
+            std::vector<Value *> free;
+            for (auto &name : inner.freeNames)
+            {
+                free.push_back(resolveLocal(fb, name));
+            }
+            value = emit(Op::Closure, free, fn->ConstantIndex);
+            return nullptr;
+        }
+
+        // 名字是否是b或外层函数的局部变量(参数/let/函数自身/自由变量)
+        bool isLocalName(FunctionBuilder *b, const std::string &name)
+        {
+            if (b == nullptr || b->fn->IsMain)
+            {
+                return false;
+            }
+            return b->env.count(name) > 0 || b->selfName == name || isLocalName(b->outer, name);
+        }
+
+        // 在b的当前块中取出局部变量的值, 需要时登记为自由变量; 不是局部变量时返回nullptr
+        Value *resolveLocal(FunctionBuilder *b, const std::string &name)
+        {
+            if (b->fn->IsMain)
+            {
+                return nullptr;
+            }
+
+            auto fit = b->env.find(name);
+            if (fit != b->env.end())
+            {
+                return fit->second;
+            }
+
+            if (b->selfName == name)
+            {
+                return emit(Op::CurrentClosure, {});
+            }
+
+            if (isLocalName(b->outer, name))
+            {
+                auto it = std::find(b->freeNames.begin(), b->freeNames.end(), name);
+                int index = it - b->freeNames.begin();
+                if (it == b->freeNames.end())
+                {
+                    b->freeNames.push_back(name);
+                }
+                return emit(Op::GetFree, {}, index);
+            }
+
+            return nullptr;
+        }
+
+        int addConstant(objects::Ref<objects::Object> obj)
+        {
+            module->Constants.push_back((obj != nullptr) ? objects::makeImmortal(std::move(obj)) : nullptr);
+            return module->Constants.size() - 1;
+        }
+
+        Value *emit(Op op, std::vector<Value *> args, int imm = 0)
+        {
+            auto value = fb->fn->NewValue(op);
+            value->Args = std::move(args);
+            value->Imm = imm;
+            value->Parent = fb->cur;
+            fb->cur->Instrs.push_back(value);
+            return value;
+        }
+
+        void terminate(Op op, std::vector<Value *> args, std::vector<Block *> targets)
+        {
+            auto term = emit(op, std::move(args));
+            term->Targets = targets;
+            for (auto target : targets)
+            {
+                target->Preds.push_back(fb->cur);
+            }
+            fb->cur = nullptr;
+        }
+
+        void place(Block *block)
+        {
+            fb->layout.push_back(block);
+            fb->cur = block;
+        }
+
+        // 按块开始生成代码的顺序排列, 和compiler::Compiler的指令顺序一致
+        void finishLayout()
+        {
+            auto &blocks = fb->fn->blocks;
+            std::map<Block *, std::unique_ptr<Block>> owned;
+            for (auto &block : blocks)
+            {
+                auto ptr = block.get();
+                owned[ptr] = std::move(block);
+            }
+
+            blocks.clear();
+            for (auto block : fb->layout)
+            {
+                blocks.push_back(std::move(owned[block]));
+            }
+        }
+    };
+}
+
+#endif // H_IR_BUILDER_H
@@ -0,0 +1,48 @@
+#ifndef H_IR_COMPILER_H
+#define H_IR_COMPILER_H
+
+#include <string>
+#include <memory>
+
+#include "ast/ast.hpp"
+#include "compiler/compiler.hpp"
+#include "ir/ir.hpp"
+#include "ir/builder.hpp"
+#include "ir/passes.hpp"
+#include "ir/lower.hpp"
+
+// AST -> SSA IR -> 优化 -> 栈式字节码, 生成的ByteCode和compiler::Compiler一样在vm::VM上运行
+namespace ir
+{
+    struct Compiler
+    {
+        Module module;
+        Pipeline pipeline = DefaultPipeline();
+        bytecode::Instructions instructions;
+
+        objects::Ref<objects::Error> Compile(const std::shared_ptr<ast::Node> &node)
+        {
+            Builder builder(&module);
+            auto err = builder.Build(node);
+            if (err != nullptr)
+            {
+                return err;
+            }
+
+            pipeline.Run(module);
+            return Lower(module, instructions);
+        }
+
+        std::shared_ptr<compiler::ByteCode> Bytecode()
+        {
+            return std::make_shared<compiler::ByteCode>(instructions, module.Constants);
+        }
+    };
+
+    std::shared_ptr<Compiler> New()
+    {
+        return std::make_shared<Compiler>();
+    }
+}
+
+#endif // H_IR_COMPILER_H
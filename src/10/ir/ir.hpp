@@ -0,0 +1,327 @@
+#ifndef H_IR_H
+#define H_IR_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <algorithm>
+
+#include "code/code.hpp"
+#include "objects/objects.hpp"
+
+// SSA形式的中间表示: 函数由基本块组成, 每条指令定义一个值.
+// 函数内的局部变量是SSA值, 分支汇合处用Phi合并; 全局变量仍然是内存(GetGlobal/SetGlobal)
+namespace ir
+{
+    enum class Op
+    {
+        Const,          // Imm: 常量池下标
+        True,
+        False,
+        Null,
+        Param,          // Imm: 参数下标
+        Copy,
+        Phi,            // Args与所在块的Preds一一对应
+        Binary,         // Kind: OpAdd/OpSub/OpMul/OpDiv
+        Compare,        // Kind: OpEqual/OpNotEqual/OpGreaterThan
+        Minus,
+        Bang,
+        GetGlobal,      // Imm: 全局变量下标
+        SetGlobal,
+        GetBuiltin,
+        GetFree,
+        CurrentClosure,
+        Closure,        // Imm: 函数在常量池中的下标, Args: 自由变量
+        Array,
+        Hash,
+        Index,
+        Call,           // Args[0]是被调用者
+        Pop,            // 顶层表达式语句的结果
+
+        // 终结指令
+        Jump,
+        Branch,         // Args[0]为真转到Targets[0], 否则Targets[1]
+        Return,
+        ReturnNull,
+        Exit,           // 顶层代码结束
+    };
+
+    struct Block;
+
+    struct Value
+    {
+        int Id;
+        Op Opcode;
+        bytecode::OpcodeType Kind = bytecode::OpcodeType::OpPop;
+        int Imm = 0;
+        std::vector<Value *> Args;
+        std::vector<Block *> Targets;
+        Block *Parent = nullptr;
+
+        Value(int id, Op op) : Id(id), Opcode(op) {}
+
+        bool IsTerminator() const
+        {
+            return Opcode >= Op::Jump;
+        }
+
+        // 不产生值的指令
+        bool IsVoid() const
+        {
+            return IsTerminator() || Opcode == Op::SetGlobal || Opcode == Op::Pop;
+        }
+    };
+
+    struct Block
+    {
+        int Id;
+        std::vector<Value *> Instrs; // 最后一条是终结指令
+        std::vector<Block *> Preds;
+
+        Block(int id) : Id(id) {}
+
+        Value *Terminator() const
+        {
+            return (!Instrs.empty() && Instrs.back()->IsTerminator()) ? Instrs.back() : nullptr;
+        }
+
+        std::vector<Block *> Succs() const
+        {
+            auto term = Terminator();
+            return (term != nullptr) ? term->Targets : std::vector<Block *>{};
+        }
+    };
+
+    struct Function
+    {
+        std::string Name;
+        int NumParameters = 0;
+        int NumFree = 0;
+        bool IsMain = false;
+        int ConstantIndex = -1; // 降级后的CompiledFunction放在常量池的这个位置
+        int nextBlockId = 0;
+
+        std::vector<std::unique_ptr<Value>> values;
+        std::vector<std::unique_ptr<Block>> blocks; // 按代码布局顺序, blocks[0]是入口
+
+        Value *NewValue(Op op)
+        {
+            values.push_back(std::make_unique<Value>(values.size(), op));
+            return values.back().get();
+        }
+
+        Block *NewBlock()
+        {
+            blocks.push_back(std::make_unique<Block>(nextBlockId++));
+            return blocks.back().get();
+        }
+
+        Block *Entry() const
+        {
+            return blocks.front().get();
+        }
+    };
+
+    struct Module
+    {
+        std::vector<objects::Ref<objects::Object>> Constants;
+        std::vector<std::unique_ptr<Function>> Functions; // Functions[0]是顶层代码
+        int NumGlobals = 0;
+
+        Function *Main() const
+        {
+            return Functions.front().get();
+        }
+    };
+
+    // 值的使用者, 同一个使用者用到两次就出现两次
+    std::map<Value *, std::vector<Value *>> ComputeUses(Function &fn)
+    {
+        std::map<Value *, std::vector<Value *>> uses;
+        for (auto &block : fn.blocks)
+        {
+            for (auto instr : block->Instrs)
+            {
+                for (auto arg : instr->Args)
+                {
+                    uses[arg].push_back(instr);
+                }
+            }
+        }
+        return uses;
+    }
+
+    void ReplaceAllUses(Function &fn, Value *from, Value *to)
+    {
+        for (auto &block : fn.blocks)
+        {
+            for (auto instr : block->Instrs)
+            {
+                std::replace(instr->Args.begin(), instr->Args.end(), from, to);
+            }
+        }
+    }
+
+    void RemoveInstruction(Value *instr)
+    {
+        auto &instrs = instr->Parent->Instrs;
+        instrs.erase(std::find(instrs.begin(), instrs.end(), instr));
+        instr->Parent = nullptr;
+    }
+
+    // 计算/读全局变量以外没有可观察效果的指令; 可能报错的运算也算有副作用
+    bool HasSideEffects(const Value *v)
+    {
+        switch (v->Opcode)
+        {
+        case Op::Const:
+        case Op::True:
+        case Op::False:
+        case Op::Null:
+        case Op::Param:
+        case Op::Copy:
+        case Op::Phi:
+        case Op::GetGlobal:
+        case Op::GetBuiltin:
+        case Op::GetFree:
+        case Op::CurrentClosure:
+        case Op::Closure:
+        case Op::Array:
+        case Op::Bang:
+            return false;
+        case Op::Compare:
+            return v->Kind == bytecode::OpcodeType::OpGreaterThan;
+        default:
+            return true;
+        }
+    }
+
+    std::string OpName(Op op)
+    {
+        switch (op)
+        {
+        case Op::Const:
+            return "const";
+        case Op::True:
+            return "true";
+        case Op::False:
+            return "false";
+        case Op::Null:
+            return "null";
+        case Op::Param:
+            return "param";
+        case Op::Copy:
+            return "copy";
+        case Op::Phi:
+            return "phi";
+        case Op::Binary:
+            return "binary";
+        case Op::Compare:
+            return "compare";
+        case Op::Minus:
+            return "minus";
+        case Op::Bang:
+            return "bang";
+        case Op::GetGlobal:
+            return "getglobal";
+        case Op::SetGlobal:
+            return "setglobal";
+        case Op::GetBuiltin:
+            return "getbuiltin";
+        case Op::GetFree:
+            return "getfree";
+        case Op::CurrentClosure:
+            return "currentclosure";
+        case Op::Closure:
+            return "closure";
+        case Op::Array:
+            return "array";
+        case Op::Hash:
+            return "hash";
+        case Op::Index:
+            return "index";
+        case Op::Call:
+            return "call";
+        case Op::Pop:
+            return "pop";
+        case Op::Jump:
+            return "jump";
+        case Op::Branch:
+            return "branch";
+        case Op::Return:
+            return "return";
+        case Op::ReturnNull:
+            return "returnnull";
+        case Op::Exit:
+            return "exit";
+        }
+        return "?";
+    }
+
+    std::string String(const Function &fn)
+    {
+        std::stringstream oss;
+        oss << "fn " << fn.Name << "(" << fn.NumParameters << ")\n";
+
+        for (auto &block : fn.blocks)
+        {
+            oss << "b" << block->Id << ":";
+            if (!block->Preds.empty())
+            {
+                oss << " <-";
+                for (auto pred : block->Preds)
+                {
+                    oss << " b" << pred->Id;
+                }
+            }
+            oss << "\n";
+
+            for (auto instr : block->Instrs)
+            {
+                oss << "  ";
+                if (!instr->IsVoid())
+                {
+                    oss << "v" << instr->Id << " = ";
+                }
+                oss << OpName(instr->Opcode);
+
+                if (instr->Opcode == Op::Binary || instr->Opcode == Op::Compare)
+                {
+                    oss << " " << bytecode::OpcodeTypeStr(instr->Kind);
+                }
+
+                switch (instr->Opcode)
+                {
+                case Op::Const:
+                case Op::Param:
+                case Op::GetGlobal:
+                case Op::SetGlobal:
+                case Op::GetBuiltin:
+                case Op::GetFree:
+                case Op::Closure:
+                    oss << " " << instr->Imm;
+                    break;
+                default:
+                    break;
+                }
+
+                for (auto arg : instr->Args)
+                {
+                    oss << " v" << arg->Id;
+                }
+                for (auto target : instr->Targets)
+                {
+                    oss << " b" << target->Id;
+                }
+                oss << "\n";
+            }
+        }
+
+        return oss.str();
+    }
+}
+
+#endif // H_IR_H
@@ -0,0 +1,467 @@
+#ifndef H_IR_LOWER_H
+#define H_IR_LOWER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "code/code.hpp"
+#include "objects/objects.hpp"
+#include "ir/ir.hpp"
+
+// 把IR降级为compiler::Compiler同样的栈式字节码:
+// 只用一次且紧挨着使用者的值直接留在栈上(还原成表达式树), 其余的值存进槽位.
+// 函数中槽位是参数之后的局部变量, 顶层代码中是NumGlobals之后的全局变量.
+namespace ir
+{
+    struct Lowering
+    {
+        Module *module;
+        Function *fn;
+
+        bytecode::Instructions instructions;
+        std::map<Value *, std::vector<Value *>> uses;
+        std::set<Value *> folded;
+        std::map<Value *, int> slots;
+        int numSlots = 0;
+        std::set<Block *> returnMerges; // 只有Phi和`return phi`的汇合块, 前驱直接返回
+        std::map<Block *, int> blockStarts;
+        std::vector<std::pair<int, Block *>> jumps;
+        std::vector<int> exits;
+
+        Lowering(Module *m, Function *f) : module(m), fn(f) {}
+
+        static bool isRematerialized(const Value *v)
+        {
+            switch (v->Opcode)
+            {
+            case Op::Const:
+            case Op::True:
+            case Op::False:
+            case Op::Null:
+            case Op::Param:
+            case Op::GetBuiltin:
+            case Op::GetFree:
+            case Op::CurrentClosure:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // 跳转指令在目标块的Phi上的参数: 前驱在Jump之前把它们存进Phi的槽位
+        std::vector<Value *> phiOperands(Block *block, Block *target)
+        {
+            std::vector<Value *> operands;
+            auto pos = std::find(target->Preds.begin(), target->Preds.end(), block) - target->Preds.begin();
+            for (auto instr : target->Instrs)
+            {
+                if (instr->Opcode == Op::Phi)
+                {
+                    operands.push_back(instr->Args[pos]);
+                }
+            }
+            return operands;
+        }
+
+        std::vector<Value *> operandsOf(Block *block, Value *instr)
+        {
+            if (instr->Opcode == Op::Jump)
+            {
+                return phiOperands(block, instr->Targets[0]);
+            }
+            return instr->Args;
+        }
+
+        bool isReturnMerge(Block *block)
+        {
+            auto term = block->Terminator();
+            if (term == nullptr || term->Opcode != Op::Return || term->Args[0]->Opcode != Op::Phi || term->Args[0]->Parent != block)
+            {
+                return false;
+            }
+            for (auto instr : block->Instrs)
+            {
+                if (instr != term && instr->Opcode != Op::Phi)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // 从块尾往前, 使用者前面紧挨着的参数可以留在栈上; 可重新生成的值不占位置
+        void foldBlock(Block *block)
+        {
+            std::vector<Value *> order;
+            std::map<Value *, int> position, start;
+            for (auto instr : block->Instrs)
+            {
+                if (!isRematerialized(instr) && instr->Opcode != Op::Phi)
+                {
+                    position[instr] = order.size();
+                    order.push_back(instr);
+                }
+            }
+
+            for (unsigned long i = 0; i < order.size(); i++)
+            {
+                auto instr = order[i];
+                int prev = i - 1;
+
+                std::vector<Value *> operands;
+                if (instr->Opcode == Op::Jump && returnMerges.count(instr->Targets[0]) > 0)
+                {
+                    operands = {phiOperands(block, instr->Targets[0])[returnPhiIndex(instr->Targets[0])]};
+                }
+                else
+                {
+                    operands = operandsOf(block, instr);
+                }
+
+                for (auto it = operands.rbegin(); it != operands.rend(); ++it)
+                {
+                    auto arg = *it;
+                    if (prev >= 0 && order[prev] == arg && uses[arg].size() == 1)
+                    {
+                        folded.insert(arg);
+                        prev = start[arg] - 1;
+                    }
+                }
+                start[instr] = prev + 1;
+            }
+        }
+
+        int returnPhiIndex(Block *merge)
+        {
+            auto phi = merge->Terminator()->Args[0];
+            int index = 0;
+            for (auto instr : merge->Instrs)
+            {
+                if (instr == phi)
+                {
+                    return index;
+                }
+                if (instr->Opcode == Op::Phi)
+                {
+                    index++;
+                }
+            }
+            return index;
+        }
+
+        objects::Ref<objects::Error> assignSlots()
+        {
+            for (auto &block : fn->blocks)
+            {
+                for (auto instr : block->Instrs)
+                {
+                    if (instr->IsVoid() || isRematerialized(instr) || folded.count(instr) > 0)
+                    {
+                        continue;
+                    }
+                    if (instr->Opcode == Op::Phi || !uses[instr].empty())
+                    {
+                        slots[instr] = numSlots++;
+                    }
+                }
+            }
+
+            if (!fn->IsMain && fn->NumParameters + numSlots > 256)
+            {
+                return objects::newError("too many locals in function " + fn->Name);
+            }
+            if (fn->IsMain && module->NumGlobals + numSlots > 65536)
+            {
+                return objects::newError("too many globals");
+            }
+            return nullptr;
+        }
+
+        void emit(bytecode::OpcodeType op, std::vector<int> operands = {})
+        {
+            auto ins = bytecode::Make(op, operands);
+            instructions.insert(instructions.end(), ins.begin(), ins.end());
+        }
+
+        void emitJump(bytecode::OpcodeType op, Block *target)
+        {
+            jumps.push_back({static_cast<int>(instructions.size()), target});
+            emit(op, {9999});
+        }
+
+        void load(Value *v)
+        {
+            switch (v->Opcode)
+            {
+            case Op::Const:
+                emit(bytecode::OpcodeType::OpConstant, {v->Imm});
+                return;
+            case Op::True:
+                emit(bytecode::OpcodeType::OpTrue);
+                return;
+            case Op::False:
+                emit(bytecode::OpcodeType::OpFalse);
+                return;
+            case Op::Null:
+                emit(bytecode::OpcodeType::OpNull);
+                return;
+            case Op::Param:
+                emit(bytecode::OpcodeType::OpGetLocal, {v->Imm});
+                return;
+            case Op::GetBuiltin:
+                emit(bytecode::OpcodeType::OpGetBuiltin, {v->Imm});
+                return;
+            case Op::GetFree:
+                emit(bytecode::OpcodeType::OpGetFree, {v->Imm});
+                return;
+            case Op::CurrentClosure:
+                emit(bytecode::OpcodeType::OpCurrentClosure);
+                return;
+            default:
+                break;
+            }
+
+            if (folded.count(v) > 0)
+            {
+                emitTree(v);
+            }
+            else if (fn->IsMain)
+            {
+                emit(bytecode::OpcodeType::OpGetGlobal, {module->NumGlobals + slots[v]});
+            }
+            else
+            {
+                emit(bytecode::OpcodeType::OpGetLocal, {fn->NumParameters + slots[v]});
+            }
+        }
+
+        void store(Value *v)
+        {
+            if (fn->IsMain)
+            {
+                emit(bytecode::OpcodeType::OpSetGlobal, {module->NumGlobals + slots[v]});
+            }
+            else
+            {
+                emit(bytecode::OpcodeType::OpSetLocal, {fn->NumParameters + slots[v]});
+            }
+        }
+
+        // 计算值并把结果留在栈顶, 终结指令之外不产生值的指令栈不变
+        void emitTree(Value *v)
+        {
+            for (auto arg : v->Args)
+            {
+                load(arg);
+            }
+
+            int n = v->Args.size();
+            switch (v->Opcode)
+            {
+            case Op::Copy:
+                break;
+            case Op::Binary:
+            case Op::Compare:
+                emit(v->Kind);
+                break;
+            case Op::Minus:
+                emit(bytecode::OpcodeType::OpMinus);
+                break;
+            case Op::Bang:
+                emit(bytecode::OpcodeType::OpBang);
+                break;
+            case Op::GetGlobal:
+                emit(bytecode::OpcodeType::OpGetGlobal, {v->Imm});
+                break;
+            case Op::SetGlobal:
+                emit(bytecode::OpcodeType::OpSetGlobal, {v->Imm});
+                break;
+            case Op::Closure:
+                emit(bytecode::OpcodeType::OpClosure, {v->Imm, n});
+                break;
+            case Op::Array:
+                emit(bytecode::OpcodeType::OpArray, {n});
+                break;
+            case Op::Hash:
+                emit(bytecode::OpcodeType::OpHash, {n});
+                break;
+            case Op::Index:
+                emit(bytecode::OpcodeType::OpIndex);
+                break;
+            case Op::Call:
+                emit(bytecode::OpcodeType::OpCall, {n - 1});
+                break;
+            case Op::Pop:
+                emit(bytecode::OpcodeType::OpPop);
+                break;
+            default:
+                break;
+            }
+        }
+
+        void emitTerminator(Block *block, Value *term, Block *next)
+        {
+            switch (term->Opcode)
+            {
+            case Op::Jump:
+            {
+                auto target = term->Targets[0];
+                auto operands = phiOperands(block, target);
+
+                if (returnMerges.count(target) > 0)
+                {
+                    load(operands[returnPhiIndex(target)]);
+                    emit(bytecode::OpcodeType::OpReturnValue);
+                    break;
+                }
+
+                int index = 0;
+                for (auto instr : target->Instrs)
+                {
+                    if (instr->Opcode == Op::Phi)
+                    {
+                        load(operands[index++]);
+                        store(instr);
+                    }
+                }
+                if (target != next)
+                {
+                    emitJump(bytecode::OpcodeType::OpJump, target);
+                }
+                break;
+            }
+            case Op::Branch:
+                load(term->Args[0]);
+                emitJump(bytecode::OpcodeType::OpJumpNotTruthy, term->Targets[1]);
+                if (term->Targets[0] != next)
+                {
+                    emitJump(bytecode::OpcodeType::OpJump, term->Targets[0]);
+                }
+                break;
+            case Op::Return:
+                load(term->Args[0]);
+                emit(bytecode::OpcodeType::OpReturnValue);
+                break;
+            case Op::ReturnNull:
+                emit(bytecode::OpcodeType::OpReturn);
+                break;
+            case Op::Exit:
+                if (next != nullptr)
+                {
+                    exits.push_back(instructions.size());
+                    emit(bytecode::OpcodeType::OpJump, {9999});
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        void patch(int pos, int target)
+        {
+            auto op = static_cast<bytecode::OpcodeType>(instructions[pos]);
+            auto ins = bytecode::Make(op, {target});
+            std::copy(ins.begin(), ins.end(), instructions.begin() + pos);
+        }
+
+        objects::Ref<objects::Error> Run()
+        {
+            uses = ComputeUses(*fn);
+            for (auto &block : fn->blocks)
+            {
+                if (isReturnMerge(block.get()))
+                {
+                    returnMerges.insert(block.get());
+                }
+            }
+            for (auto &block : fn->blocks)
+            {
+                foldBlock(block.get());
+            }
+
+            auto err = assignSlots();
+            if (err != nullptr)
+            {
+                return err;
+            }
+
+            for (unsigned long i = 0; i < fn->blocks.size(); i++)
+            {
+                auto block = fn->blocks[i].get();
+                auto next = (i + 1 < fn->blocks.size()) ? fn->blocks[i + 1].get() : nullptr;
+                blockStarts[block] = instructions.size();
+
+                for (auto instr : block->Instrs)
+                {
+                    if (instr->IsTerminator())
+                    {
+                        emitTerminator(block, instr, next);
+                        continue;
+                    }
+                    if (instr->Opcode == Op::Phi || isRematerialized(instr) || folded.count(instr) > 0)
+                    {
+                        continue;
+                    }
+
+                    emitTree(instr);
+                    if (instr->IsVoid())
+                    {
+                        continue;
+                    }
+                    if (slots.find(instr) != slots.end())
+                    {
+                        store(instr);
+                    }
+                    else
+                    {
+                        emit(bytecode::OpcodeType::OpPop);
+                    }
+                }
+            }
+
+            for (auto &jump : jumps)
+            {
+                patch(jump.first, blockStarts[jump.second]);
+            }
+            for (auto pos : exits)
+            {
+                patch(pos, instructions.size());
+            }
+
+            if (!fn->IsMain)
+            {
+                auto compiled = objects::makeRef<objects::CompiledFunction>(instructions, fn->NumParameters + numSlots, fn->NumParameters);
+                compiled->NumFree = fn->NumFree;
+                module->Constants[fn->ConstantIndex] = objects::makeImmortal(std::move(compiled));
+            }
+            return nullptr;
+        }
+    };
+
+    // 降级整个模块, 返回顶层代码的指令; 函数对象填进常量池
+    objects::Ref<objects::Error> Lower(Module &module, bytecode::Instructions &main)
+    {
+        for (unsigned long i = 1; i < module.Functions.size(); i++)
+        {
+            Lowering lowering(&module, module.Functions[i].get());
+            auto err = lowering.Run();
+            if (err != nullptr)
+            {
+                return err;
+            }
+        }
+
+        Lowering lowering(&module, module.Main());
+        auto err = lowering.Run();
+        if (err != nullptr)
+        {
+            return err;
+        }
+        main = lowering.instructions;
+        return nullptr;
+    }
+}
+
+#endif // H_IR_LOWER_H
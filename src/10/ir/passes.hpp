@@ -0,0 +1,433 @@
+#ifndef H_IR_PASSES_H
+#define H_IR_PASSES_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <algorithm>
+
+#include "ir/ir.hpp"
+
+namespace ir
+{
+    // 返回true表示修改了函数
+    typedef bool (*PassFunction)(Module &module, Function &fn);
+
+    struct Pass
+    {
+        std::string Name;
+        PassFunction Run;
+        bool Enabled = true;
+    };
+
+    // 删除Copy以及所有参数都相同的Phi
+    bool CopyPropagation(Module &, Function &fn)
+    {
+        bool changed = false;
+        bool again = true;
+        while (again)
+        {
+            again = false;
+            for (auto &block : fn.blocks)
+            {
+                for (unsigned long i = 0; i < block->Instrs.size(); i++)
+                {
+                    auto instr = block->Instrs[i];
+
+                    Value *same = nullptr;
+                    if (instr->Opcode == Op::Copy)
+                    {
+                        same = instr->Args[0];
+                    }
+                    else if (instr->Opcode == Op::Phi)
+                    {
+                        for (auto arg : instr->Args)
+                        {
+                            if (arg == instr || arg == same)
+                            {
+                                continue;
+                            }
+                            same = (same == nullptr) ? arg : instr;
+                        }
+                        if (same == instr)
+                        {
+                            continue;
+                        }
+                    }
+
+                    if (same == nullptr)
+                    {
+                        continue;
+                    }
+
+                    ReplaceAllUses(fn, instr, same);
+                    RemoveInstruction(instr);
+                    i--;
+                    changed = again = true;
+                }
+            }
+        }
+        return changed;
+    }
+
+    // 结果一定是整数的值; 字符串和数组按对象身份比较, 只有整数加法可以合并
+    bool isIntegerValue(const Module &module, const Value *v)
+    {
+        switch (v->Opcode)
+        {
+        case Op::Const:
+            return module.Constants[v->Imm] != nullptr && module.Constants[v->Imm]->Type() == objects::ObjectType::INTEGER;
+        case Op::Minus:
+            return true;
+        case Op::Binary:
+            return v->Kind != bytecode::OpcodeType::OpAdd || (isIntegerValue(module, v->Args[0]) && isIntegerValue(module, v->Args[1]));
+        default:
+            return false;
+        }
+    }
+
+    // 可以按(操作, 参数)合并的值, 分配新对象的指令(Array/Hash/Closure/字符串拼接)除外
+    bool isNumberable(const Module &module, const Function &fn, const Value *v)
+    {
+        switch (v->Opcode)
+        {
+        case Op::Const:
+        case Op::True:
+        case Op::False:
+        case Op::Null:
+        case Op::GetBuiltin:
+        case Op::GetFree:
+        case Op::CurrentClosure:
+        case Op::Compare:
+        case Op::Minus:
+        case Op::Bang:
+            return true;
+        case Op::Binary:
+            return v->Kind != bytecode::OpcodeType::OpAdd || isIntegerValue(module, v);
+        case Op::GetGlobal:
+            // 只有顶层代码会写全局变量
+            return !fn.IsMain;
+        default:
+            return false;
+        }
+    }
+
+    using ValueKey = std::tuple<Op, bytecode::OpcodeType, int, std::vector<int>>;
+
+    ValueKey keyOf(const Value *v)
+    {
+        std::vector<int> args;
+        for (auto arg : v->Args)
+        {
+            args.push_back(arg->Id);
+        }
+        return ValueKey(v->Opcode, v->Kind, v->Imm, args);
+    }
+
+    // 在一个块内把相同的值替换为第一次出现的值, table中保留之前的可用值
+    bool numberBlock(Module &module, Function &fn, Block *block, std::map<ValueKey, Value *> &table, std::vector<ValueKey> &added)
+    {
+        bool changed = false;
+        for (unsigned long i = 0; i < block->Instrs.size(); i++)
+        {
+            auto instr = block->Instrs[i];
+            if (!isNumberable(module, fn, instr))
+            {
+                continue;
+            }
+
+            auto key = keyOf(instr);
+            auto fit = table.find(key);
+            if (fit != table.end())
+            {
+                ReplaceAllUses(fn, instr, fit->second);
+                RemoveInstruction(instr);
+                i--;
+                changed = true;
+            }
+            else
+            {
+                table[key] = instr;
+                added.push_back(key);
+            }
+        }
+        return changed;
+    }
+
+    bool LocalCSE(Module &module, Function &fn)
+    {
+        bool changed = false;
+        for (auto &block : fn.blocks)
+        {
+            std::map<ValueKey, Value *> table;
+            std::vector<ValueKey> added;
+            changed |= numberBlock(module, fn, block.get(), table, added);
+        }
+        return changed;
+    }
+
+    // 按逆后序排列的可达块
+    std::vector<Block *> ReversePostOrder(Function &fn)
+    {
+        std::vector<Block *> order;
+        std::set<Block *> visited;
+        std::vector<std::pair<Block *, unsigned long>> stack{{fn.Entry(), 0}};
+        visited.insert(fn.Entry());
+
+        while (!stack.empty())
+        {
+            auto &top = stack.back();
+            auto succs = top.first->Succs();
+            if (top.second < succs.size())
+            {
+                auto next = succs[top.second++];
+                if (visited.insert(next).second)
+                {
+                    stack.push_back({next, 0});
+                }
+            }
+            else
+            {
+                order.push_back(top.first);
+                stack.pop_back();
+            }
+        }
+
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    // Cooper-Harvey-Kennedy迭代算法, 入口块的直接支配者是它自己
+    std::map<Block *, Block *> Dominators(Function &fn)
+    {
+        auto order = ReversePostOrder(fn);
+        std::map<Block *, int> index;
+        for (unsigned long i = 0; i < order.size(); i++)
+        {
+            index[order[i]] = i;
+        }
+
+        std::map<Block *, Block *> idom;
+        idom[fn.Entry()] = fn.Entry();
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (unsigned long i = 1; i < order.size(); i++)
+            {
+                auto block = order[i];
+                Block *newIdom = nullptr;
+                for (auto pred : block->Preds)
+                {
+                    if (idom.find(pred) == idom.end())
+                    {
+                        continue;
+                    }
+                    if (newIdom == nullptr)
+                    {
+                        newIdom = pred;
+                        continue;
+                    }
+
+                    auto a = pred, b = newIdom;
+                    while (a != b)
+                    {
+                        while (index[a] > index[b])
+                        {
+                            a = idom[a];
+                        }
+                        while (index[b] > index[a])
+                        {
+                            b = idom[b];
+                        }
+                    }
+                    newIdom = a;
+                }
+
+                if (newIdom != nullptr && idom[block] != newIdom)
+                {
+                    idom[block] = newIdom;
+                    changed = true;
+                }
+            }
+        }
+        return idom;
+    }
+
+    // 沿支配树遍历, 支配块中的值在被支配块中可以直接复用
+    bool GlobalValueNumbering(Module &module, Function &fn)
+    {
+        auto idom = Dominators(fn);
+
+        std::map<Block *, std::vector<Block *>> children;
+        for (auto &item : idom)
+        {
+            if (item.first != item.second)
+            {
+                children[item.second].push_back(item.first);
+            }
+        }
+
+        bool changed = false;
+        std::map<ValueKey, Value *> table;
+        std::vector<std::pair<Block *, unsigned long>> stack{{fn.Entry(), 0}};
+        std::vector<std::vector<ValueKey>> scopes(1);
+        changed |= numberBlock(module, fn, fn.Entry(), table, scopes.back());
+
+        while (!stack.empty())
+        {
+            auto &top = stack.back();
+            auto &kids = children[top.first];
+            if (top.second < kids.size())
+            {
+                auto next = kids[top.second++];
+                stack.push_back({next, 0});
+                scopes.emplace_back();
+                changed |= numberBlock(module, fn, next, table, scopes.back());
+            }
+            else
+            {
+                for (auto &key : scopes.back())
+                {
+                    table.erase(key);
+                }
+                scopes.pop_back();
+                stack.pop_back();
+            }
+        }
+        return changed;
+    }
+
+    // 删除不可达的块和没有用到的无副作用值
+    bool DeadCodeElimination(Module &, Function &fn)
+    {
+        bool changed = false;
+
+        auto order = ReversePostOrder(fn);
+        std::set<Block *> reachable(order.begin(), order.end());
+        for (unsigned long i = 0; i < fn.blocks.size(); i++)
+        {
+            auto block = fn.blocks[i].get();
+            if (reachable.count(block) > 0)
+            {
+                continue;
+            }
+
+            for (auto succ : block->Succs())
+            {
+                if (reachable.count(succ) == 0)
+                {
+                    continue;
+                }
+
+                for (auto p = std::find(succ->Preds.begin(), succ->Preds.end(), block); p != succ->Preds.end();
+                     p = std::find(succ->Preds.begin(), succ->Preds.end(), block))
+                {
+                    auto pos = p - succ->Preds.begin();
+                    succ->Preds.erase(p);
+                    for (auto instr : succ->Instrs)
+                    {
+                        if (instr->Opcode == Op::Phi)
+                        {
+                            instr->Args.erase(instr->Args.begin() + pos);
+                        }
+                    }
+                }
+            }
+
+            for (auto instr : block->Instrs)
+            {
+                instr->Parent = nullptr;
+            }
+            fn.blocks.erase(fn.blocks.begin() + i);
+            i--;
+            changed = true;
+        }
+
+        bool again = true;
+        while (again)
+        {
+            again = false;
+            auto uses = ComputeUses(fn);
+            for (auto &block : fn.blocks)
+            {
+                for (unsigned long i = 0; i < block->Instrs.size(); i++)
+                {
+                    auto instr = block->Instrs[i];
+                    if (instr->IsVoid() || HasSideEffects(instr) || !uses[instr].empty())
+                    {
+                        continue;
+                    }
+
+                    RemoveInstruction(instr);
+                    i--;
+                    changed = again = true;
+                }
+            }
+        }
+
+        return changed;
+    }
+
+    // 可插拔的优化流水线, 每个pass可以单独关闭以便对比效果
+    struct Pipeline
+    {
+        std::vector<Pass> Passes;
+        int MaxRounds = 4;
+
+        void Add(const std::string &name, PassFunction run)
+        {
+            Passes.push_back(Pass{name, run, true});
+        }
+
+        bool Enable(const std::string &name, bool enabled)
+        {
+            for (auto &pass : Passes)
+            {
+                if (pass.Name == name)
+                {
+                    pass.Enabled = enabled;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Run(Module &module)
+        {
+            for (auto &fn : module.Functions)
+            {
+                for (int round = 0; round < MaxRounds; round++)
+                {
+                    bool changed = false;
+                    for (auto &pass : Passes)
+                    {
+                        if (pass.Enabled)
+                        {
+                            changed |= pass.Run(module, *fn);
+                        }
+                    }
+                    if (!changed)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+    };
+
+    Pipeline DefaultPipeline()
+    {
+        Pipeline pipeline;
+        pipeline.Add("copyprop", CopyPropagation);
+        pipeline.Add("cse", LocalCSE);
+        pipeline.Add("gvn", GlobalValueNumbering);
+        pipeline.Add("dce", DeadCodeElimination);
+        return pipeline;
+    }
+}
+
+#endif // H_IR_PASSES_H
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <memory>
 
 #include "token/token.hpp"
@@ -114,6 +115,72 @@ namespace lexer
             return input.substr(oldPosition, position - oldPosition);
         }
 
+        // 预解析: 从'{'之后扫描到匹配的'}'并停在它后面, 不生成词法单元.
+        // 记录引用的标识符, let之后和fn参数列表中的标识符算作定义; 没有匹配的'}'时返回false
+        bool SkipBlock(std::vector<std::string> &names, std::vector<std::string> &declared)
+        {
+            int depth = 1;
+            bool afterLet = false;
+            bool afterFn = false;
+            bool inParams = false;
+
+            while (ch != 0)
+            {
+                if (isLetter(ch))
+                {
+                    auto ident = readIdentifier();
+                    auto type = token::LookupIdent(ident);
+                    if (type == token::types::IDENT)
+                    {
+                        (afterLet || inParams ? declared : names).push_back(ident);
+                    }
+                    afterLet = (type == token::types::LET);
+                    afterFn = (type == token::types::FUNCTION);
+                    continue;
+                }
+
+                if (isDigit(ch))
+                {
+                    readNumber();
+                    afterLet = afterFn = false;
+                    continue;
+                }
+
+                switch (ch)
+                {
+                case '{':
+                    depth++;
+                    break;
+                case '}':
+                    if (--depth == 0)
+                    {
+                        readChar();
+                        return true;
+                    }
+                    break;
+                case '"':
+                    readString();
+                    break;
+                case '(':
+                    inParams = afterFn;
+                    break;
+                case ')':
+                    inParams = false;
+                    break;
+                default:
+                    break;
+                }
+
+                if (ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r' && ch != ',')
+                {
+                    afterLet = afterFn = false;
+                }
+                readChar();
+            }
+
+            return false;
+        }
+
         token::Token NextToken()
         {
             token::Token tok;
@@ -3,8 +3,55 @@
 
 #include "repl/repl.hpp"
 
-int main()
+// monkey [-cache-dir DIR | -no-cache | -tier | -inline-report] FILE 执行文件, 不带参数时启动REPL
+int main(int argc, char **argv)
 {
+    if (argc > 1)
+    {
+        auto cache = compiler::NewBytecodeCache();
+        bool useCache = true;
+        bool tiered = false;
+        bool inlineReport = false;
+        std::string path;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "-cache-dir" && i + 1 < argc)
+            {
+                cache->Dir = argv[++i];
+            }
+            else if (arg == "-no-cache")
+            {
+                useCache = false;
+            }
+            else if (arg == "-tier")
+            {
+                tiered = true;
+            }
+            else if (arg == "-inline-report")
+            {
+                inlineReport = true;
+            }
+            else
+            {
+                path = arg;
+            }
+        }
+
+        if (path.empty())
+        {
+            std::cout << "usage: monkey [-cache-dir DIR | -no-cache | -tier | -inline-report] FILE" << std::endl;
+            return 2;
+        }
+
+        if (tiered)
+        {
+            return repl::RunFileTiered(path);
+        }
+
+        return repl::RunFile(path, useCache ? cache : nullptr, inlineReport);
+    }
+
     char *user = getlogin();
 
 
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+
+#include "lexer/lexer.hpp"
+#include "parser/parser.hpp"
+#include "compiler/compiler.hpp"
+#include "aot/aot.hpp"
+
+#ifndef MONKEY_SOURCE_DIR
+#define MONKEY_SOURCE_DIR "."
+#endif
+
+// 用单引号包住参数交给shell, 参数中的单引号写成'\''
+std::string shellQuote(const std::string &arg)
+{
+    std::string quoted = "'";
+    for (char c : arg)
+    {
+        if (c == '\'')
+        {
+            quoted += "'\\''";
+        }
+        else
+        {
+            quoted += c;
+        }
+    }
+    return quoted + "'";
+}
+
+// monkeyc [-o OUT.cpp] [-exe BINARY] [-print] FILE
+// 把Monkey源码编译为C++; 给出-exe时再调用系统编译器($CXX, 默认c++)构建可执行文件
+int main(int argc, char **argv)
+{
+    std::string path, output, exe;
+    aot::Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (arg == "-exe" && i + 1 < argc)
+        {
+            exe = argv[++i];
+        }
+        else if (arg == "-print")
+        {
+            options.PrintResult = true;
+        }
+        else
+        {
+            path = arg;
+        }
+    }
+
+    if (path.empty())
+    {
+        std::cout << "usage: monkeyc [-o OUT.cpp] [-exe BINARY] [-print] FILE" << std::endl;
+        return 2;
+    }
+
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "could not open " << path << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    auto pParser = parser::New(lexer::New(buffer.str()));
+    auto pProgram = pParser->ParseProgram();
+    if (pParser->Errors().size() > 0)
+    {
+        for (auto &e : pParser->Errors())
+        {
+            std::cout << "parser error: " << e << std::endl;
+        }
+        return 1;
+    }
+
+    std::shared_ptr<ast::Node> astNode(reinterpret_cast<ast::Node *>(pProgram.release()));
+    auto comp = compiler::New();
+    auto err = comp->Compile(astNode);
+    if (objects::isError(err))
+    {
+        std::cout << "compiler error: " << err->Inspect() << std::endl;
+        return 1;
+    }
+
+    std::string source;
+    options.SourceName = path;
+    auto genErr = aot::Generate(*comp->Bytecode(), options, source);
+    if (genErr != nullptr)
+    {
+        std::cout << genErr->Inspect() << std::endl;
+        return 1;
+    }
+
+    if (output.empty())
+    {
+        output = path + ".cpp";
+    }
+    std::ofstream out(output);
+    out << source;
+    out.close();
+    if (!out)
+    {
+        std::cout << "could not write " << output << std::endl;
+        return 1;
+    }
+
+    if (!exe.empty())
+    {
+        // $CXX可以带选项, 原样交给shell拆分; 路径逐个加引号
+        const char *cxx = std::getenv("CXX");
+        std::string command = std::string((cxx != nullptr && *cxx != '\0') ? cxx : "c++") +
+                              " -std=c++17 -O2" + aot::BuildDefines() + " -I" + shellQuote(MONKEY_SOURCE_DIR) +
+                              " " + shellQuote(output) + " -o " + shellQuote(exe);
+        if (std::system(command.c_str()) != 0)
+        {
+            std::cout << "build failed: " << command << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
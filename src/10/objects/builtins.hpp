@@ -7,6 +7,7 @@
 #include <map>
 
 #include "objects/objects.hpp"
+#include "objects/string_search.hpp"
 
 namespace objects
 {
@@ -20,7 +21,7 @@ namespace objects
         }
     }
 
-    using BuiltinFunction = std::shared_ptr<objects::Object> (*)(std::vector<std::shared_ptr<objects::Object>>& args);
+    using BuiltinFunction = objects::Ref<objects::Object> (*)(std::vector<objects::Ref<objects::Object>>& args);
 
 	struct Builtin: Object
 	{
@@ -32,20 +33,20 @@ namespace objects
 		virtual std::string Inspect() { return "builltin function"; }
 	};
 
-    std::shared_ptr<objects::Object> BuiltinFunc_Len([[maybe_unused]] std::vector<std::shared_ptr<objects::Object>>& args)
+    objects::Ref<objects::Object> BuiltinFunc_Len([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
     {
         if(args.size() != 1)
         {
             return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
         }
 
-        if(std::shared_ptr<objects::String> obj = std::dynamic_pointer_cast<objects::String>(args[0]); obj != nullptr)
+        if(objects::Ref<objects::String> obj = objects::refCast<objects::String>(args[0]); obj != nullptr)
         {
-            return std::make_shared<objects::Integer>(obj->Value.size());
+            return objects::newInteger(obj->Length);
         }
-        else if(std::shared_ptr<objects::Array> obj = std::dynamic_pointer_cast<objects::Array>(args[0]); obj != nullptr)
+        else if(objects::Ref<objects::Array> obj = objects::refCast<objects::Array>(args[0]); obj != nullptr)
         {
-            return std::make_shared<objects::Integer>(obj->Elements.size());
+            return objects::newInteger(obj->Elements.size());
         }
         else
         {
@@ -53,14 +54,14 @@ namespace objects
         }
     }
 
-    std::shared_ptr<objects::Object> BuiltinFunc_First([[maybe_unused]] std::vector<std::shared_ptr<objects::Object>>& args)
+    objects::Ref<objects::Object> BuiltinFunc_First([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
     {
         if(args.size() != 1)
         {
             return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
         }
 
-        if(std::shared_ptr<objects::Array> obj = std::dynamic_pointer_cast<objects::Array>(args[0]); obj != nullptr)
+        if(objects::Ref<objects::Array> obj = objects::refCast<objects::Array>(args[0]); obj != nullptr)
         {
             if(obj->Elements.size() > 0)
             {
@@ -75,14 +76,14 @@ namespace objects
         }
     }
 
-    std::shared_ptr<objects::Object> BuiltinFunc_Last([[maybe_unused]] std::vector<std::shared_ptr<objects::Object>>& args)
+    objects::Ref<objects::Object> BuiltinFunc_Last([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
     {
         if(args.size() != 1)
         {
             return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
         }
 
-        if(std::shared_ptr<objects::Array> obj = std::dynamic_pointer_cast<objects::Array>(args[0]); obj != nullptr)
+        if(objects::Ref<objects::Array> obj = objects::refCast<objects::Array>(args[0]); obj != nullptr)
         {
             auto len = obj->Elements.size();
             if(len > 0)
@@ -98,21 +99,20 @@ namespace objects
         }
     }
 
-    std::shared_ptr<objects::Object> BuiltinFunc_Rest([[maybe_unused]] std::vector<std::shared_ptr<objects::Object>>& args)
+    objects::Ref<objects::Object> BuiltinFunc_Rest([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
     {
         if(args.size() != 1)
         {
             return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
         }
 
-        if(std::shared_ptr<objects::Array> obj = std::dynamic_pointer_cast<objects::Array>(args[0]); obj != nullptr)
+        if(objects::Ref<objects::Array> obj = objects::refCast<objects::Array>(args[0]); obj != nullptr)
         {
             auto len = obj->Elements.size();
             if(len > 0)
             {
-                std::vector<std::shared_ptr<objects::Object>> elements;
-                std::copy(obj->Elements.begin()+1, obj->Elements.end(), back_inserter(elements));
-                return std::make_shared<objects::Array>(elements);
+                std::vector<objects::Ref<objects::Object>> elements(obj->Elements.begin()+1, obj->Elements.end());
+                return objects::makePooled<objects::Array>(std::move(elements));
             } else {
                 return nullptr;
             }
@@ -123,19 +123,29 @@ namespace objects
         }
     }
 
-    std::shared_ptr<objects::Object> BuiltinFunc_Push([[maybe_unused]] std::vector<std::shared_ptr<objects::Object>>& args)
+    objects::Ref<objects::Object> BuiltinFunc_Push([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
     {
         if(args.size() != 2)
         {
             return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2");
         }
 
-        if(std::shared_ptr<objects::Array> obj = std::dynamic_pointer_cast<objects::Array>(args[0]); obj != nullptr)
+        // 参数是唯一持有者时, 脚本无法观察到修改, 直接原地追加
+        bool unique = objects::isUniquelyOwned(args[0]);
+
+        if(objects::Ref<objects::Array> obj = objects::refCast<objects::Array>(args[0]); obj != nullptr)
         {
-            std::vector<std::shared_ptr<objects::Object>> elements;
+            if(unique)
+            {
+                obj->Elements.push_back(std::move(args[1]));
+                return obj;
+            }
+
+            std::vector<objects::Ref<objects::Object>> elements;
+            elements.reserve(obj->Elements.size() + 1);
             std::copy(obj->Elements.begin(), obj->Elements.end(), back_inserter(elements));
-            elements.push_back(args[1]);
-            return std::make_shared<objects::Array>(elements);
+            elements.push_back(std::move(args[1]));
+            return objects::makePooled<objects::Array>(std::move(elements));
         }
         else
         {
@@ -143,7 +153,338 @@ namespace objects
         }
     }
 
-    std::shared_ptr<objects::Object> BuiltinFunc_Puts([[maybe_unused]] std::vector<std::shared_ptr<objects::Object>>& args)
+    objects::Ref<objects::Object> BuiltinFunc_Set([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        if(args.size() != 3)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=3");
+        }
+
+        bool unique = objects::isUniquelyOwned(args[0]);
+
+        if(objects::Ref<objects::Hash> obj = objects::refCast<objects::Hash>(args[0]); obj != nullptr)
+        {
+            if(!args[1]->Hashable())
+            {
+                return objects::newError("unusable as hash key: " + args[1]->TypeStr());
+            }
+
+            auto pair = objects::makePooledShared<objects::HashPair>(args[1], args[2]);
+
+            if(unique)
+            {
+                obj->Pairs.Insert(args[1]->GetHashKey(), pair);
+                return obj;
+            }
+
+            return objects::makeRef<objects::Hash>(obj->Pairs.Set(args[1]->GetHashKey(), pair));
+        }
+        else
+        {
+            return objects::newError("argument to `set` must be HASH, got " + args[0]->TypeStr());
+        }
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Delete([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        if(args.size() != 2)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2");
+        }
+
+        bool unique = objects::isUniquelyOwned(args[0]);
+
+        if(objects::Ref<objects::Hash> obj = objects::refCast<objects::Hash>(args[0]); obj != nullptr)
+        {
+            if(!args[1]->Hashable())
+            {
+                return objects::newError("unusable as hash key: " + args[1]->TypeStr());
+            }
+
+            if(unique)
+            {
+                obj->Pairs.Erase(args[1]->GetHashKey());
+                return obj;
+            }
+
+            return objects::makeRef<objects::Hash>(obj->Pairs.Remove(args[1]->GetHashKey()));
+        }
+        else
+        {
+            return objects::newError("argument to `delete` must be HASH, got " + args[0]->TypeStr());
+        }
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Has([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        if(args.size() != 2)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2");
+        }
+
+        if(objects::Ref<objects::Hash> obj = objects::refCast<objects::Hash>(args[0]); obj != nullptr)
+        {
+            if(!args[1]->Hashable())
+            {
+                return objects::newError("unusable as hash key: " + args[1]->TypeStr());
+            }
+
+            return objects::nativeBoolToBooleanObject(obj->Pairs.contains(args[1]->GetHashKey()));
+        }
+        else
+        {
+            return objects::newError("argument to `has` must be HASH, got " + args[0]->TypeStr());
+        }
+    }
+
+    // keys和values按同一顺序遍历, 结果下标一一对应
+    objects::Ref<objects::Object> hashEntries(std::vector<objects::Ref<objects::Object>>& args, const std::string& name, bool wantKeys)
+    {
+        if(args.size() != 1)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+        }
+
+        if(objects::Ref<objects::Hash> obj = objects::refCast<objects::Hash>(args[0]); obj != nullptr)
+        {
+            std::vector<objects::Ref<objects::Object>> elements;
+            elements.reserve(obj->Pairs.size());
+            for(auto &[key, pair]: obj->Pairs)
+            {
+                [[maybe_unused]] auto &x = key;
+                elements.push_back(wantKeys ? pair->Key : pair->Value);
+            }
+
+            return objects::makePooled<objects::Array>(std::move(elements));
+        }
+        else
+        {
+            return objects::newError("argument to `" + name + "` must be HASH, got " + args[0]->TypeStr());
+        }
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Keys([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        return hashEntries(args, "keys", true);
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Values([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        return hashEntries(args, "values", false);
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Substr([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        if(args.size() != 2 && args.size() != 3)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2 or 3");
+        }
+
+        auto str = objects::refCast<objects::String>(args[0]);
+        if(str == nullptr)
+        {
+            return objects::newError("argument to `substr` must be STRING, got " + args[0]->TypeStr());
+        }
+
+        auto start = objects::refCast<objects::Integer>(args[1]);
+        if(start == nullptr)
+        {
+            return objects::newError("argument to `substr` must be INTEGER, got " + args[1]->TypeStr());
+        }
+
+        long long int length = static_cast<long long int>(str->Length) - start->Value;
+        if(args.size() == 3)
+        {
+            auto lengthObj = objects::refCast<objects::Integer>(args[2]);
+            if(lengthObj == nullptr)
+            {
+                return objects::newError("argument to `substr` must be INTEGER, got " + args[2]->TypeStr());
+            }
+            length = lengthObj->Value;
+        }
+
+        if(start->Value < 0 || length < 0 || start->Value + length > static_cast<long long int>(str->Length))
+        {
+            return objects::newError("argument to `substr` out of range");
+        }
+
+        return objects::sliceString(str, start->Value, length);
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Split([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        if(args.size() != 2)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2");
+        }
+
+        auto str = objects::refCast<objects::String>(args[0]);
+        auto sep = objects::refCast<objects::String>(args[1]);
+        if(str == nullptr || sep == nullptr)
+        {
+            return objects::newError("arguments to `split` must be STRING, got " + args[0]->TypeStr() + " and " + args[1]->TypeStr());
+        }
+
+        auto haystack = str->View();
+        auto needle = sep->View();
+
+        std::vector<objects::Ref<objects::Object>> elements;
+
+        if(needle.empty())
+        {
+            for(size_t i = 0; i < haystack.size(); i++)
+            {
+                elements.push_back(objects::sliceString(str, i, 1));
+            }
+            return objects::makePooled<objects::Array>(std::move(elements));
+        }
+
+        size_t from = 0;
+        while(true)
+        {
+            auto pos = objects::findSubstring(haystack, needle, from);
+            if(pos == objects::NotFound)
+            {
+                elements.push_back(objects::sliceString(str, from, haystack.size() - from));
+                break;
+            }
+
+            elements.push_back(objects::sliceString(str, from, pos - from));
+            from = pos + needle.size();
+        }
+
+        return objects::makePooled<objects::Array>(std::move(elements));
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Join([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        if(args.size() != 2)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2");
+        }
+
+        auto arr = objects::refCast<objects::Array>(args[0]);
+        if(arr == nullptr)
+        {
+            return objects::newError("argument to `join` must be ARRAY, got " + args[0]->TypeStr());
+        }
+
+        auto sep = objects::refCast<objects::String>(args[1]);
+        if(sep == nullptr)
+        {
+            return objects::newError("argument to `join` must be STRING, got " + args[1]->TypeStr());
+        }
+
+        size_t total = 0;
+        for(auto &item: arr->Elements)
+        {
+            auto itemStr = objects::refCast<objects::String>(item);
+            if(itemStr == nullptr)
+            {
+                return objects::newError("elements of `join` must be STRING, got " + item->TypeStr());
+            }
+            total += itemStr->Length + sep->Length;
+        }
+
+        std::string buffer;
+        buffer.reserve(total);
+
+        auto delimiter = sep->View();
+        for(size_t i = 0; i < arr->Elements.size(); i++)
+        {
+            if(i > 0)
+            {
+                buffer.append(delimiter);
+            }
+            buffer.append(objects::staticRefCast<objects::String>(arr->Elements[i])->View());
+        }
+
+        return objects::makeRef<objects::String>(std::move(buffer));
+    }
+
+    // index_of/contains/starts_with共用的参数检查
+    objects::Ref<objects::Object> searchArguments(const std::string &name, std::vector<objects::Ref<objects::Object>>& args,
+                                                     std::string_view &haystack, std::string_view &needle)
+    {
+        if(args.size() != 2)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2");
+        }
+
+        auto str = objects::refCast<objects::String>(args[0]);
+        auto sub = objects::refCast<objects::String>(args[1]);
+        if(str == nullptr || sub == nullptr)
+        {
+            return objects::newError("arguments to `" + name + "` must be STRING, got " + args[0]->TypeStr() + " and " + args[1]->TypeStr());
+        }
+
+        haystack = str->View();
+        needle = sub->View();
+        return nullptr;
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_IndexOf([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        std::string_view haystack, needle;
+        if(auto error = searchArguments("index_of", args, haystack, needle); error != nullptr)
+        {
+            return error;
+        }
+
+        auto pos = objects::findSubstring(haystack, needle);
+        return objects::newInteger(pos == objects::NotFound ? -1 : static_cast<long long int>(pos));
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Contains([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        std::string_view haystack, needle;
+        if(auto error = searchArguments("contains", args, haystack, needle); error != nullptr)
+        {
+            return error;
+        }
+
+        return objects::nativeBoolToBooleanObject(objects::findSubstring(haystack, needle) != objects::NotFound);
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_StartsWith([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        std::string_view haystack, needle;
+        if(auto error = searchArguments("starts_with", args, haystack, needle); error != nullptr)
+        {
+            return error;
+        }
+
+        return objects::nativeBoolToBooleanObject(haystack.substr(0, needle.size()) == needle);
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Trim([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
+    {
+        if(args.size() != 1)
+        {
+            return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+        }
+
+        auto str = objects::refCast<objects::String>(args[0]);
+        if(str == nullptr)
+        {
+            return objects::newError("argument to `trim` must be STRING, got " + args[0]->TypeStr());
+        }
+
+        auto view = str->View();
+        size_t begin = 0, end = view.size();
+        while(begin < end && objects::isSpace(view[begin]))
+        {
+            begin++;
+        }
+        while(end > begin && objects::isSpace(view[end - 1]))
+        {
+            end--;
+        }
+
+        return objects::sliceString(str, begin, end - begin);
+    }
+
+    objects::Ref<objects::Object> BuiltinFunc_Puts([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
     {
         for(const auto& obj: args)
         {
@@ -153,21 +494,21 @@ namespace objects
         return nullptr;
     }
 
-    std::shared_ptr<objects::Object> BuiltinFunc_Fibonacci([[maybe_unused]] std::vector<std::shared_ptr<objects::Object>>& args)
+    objects::Ref<objects::Object> BuiltinFunc_Fibonacci([[maybe_unused]] std::vector<objects::Ref<objects::Object>>& args)
     {
         if(args.size() != 1)
         {
             return objects::newError("wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
         }
 
-        if(std::shared_ptr<objects::Integer> obj = std::dynamic_pointer_cast<objects::Integer>(args[0]); obj != nullptr)
+        if(objects::Ref<objects::Integer> obj = objects::refCast<objects::Integer>(args[0]); obj != nullptr)
         {
             if(obj->Value < 0)
             {
                 return objects::newError("argument to `fibonacci` can not be negative, got " + std::to_string(obj->Value));
             }
 
-            return std::make_shared<objects::Integer>(fibonacci(obj->Value));
+            return objects::newInteger(fibonacci(obj->Value));
         }
         else
         {
@@ -178,12 +519,12 @@ namespace objects
     struct BuiltinWithName
     {
         std::string Name;
-        std::shared_ptr<objects::Builtin> Builtin;
+        objects::Ref<objects::Builtin> Builtin;
 
         BuiltinWithName(const std::string name, BuiltinFunction fn)
             : Name(name)
         {
-            Builtin = std::make_shared<objects::Builtin>(fn);
+            Builtin = objects::makeImmortal(objects::makeRef<objects::Builtin>(fn));
         }
     };
 
@@ -195,9 +536,21 @@ namespace objects
         std::make_shared<objects::BuiltinWithName>("rest", &BuiltinFunc_Rest),
         std::make_shared<objects::BuiltinWithName>("push", &BuiltinFunc_Push),
         std::make_shared<objects::BuiltinWithName>("fibonacci", &BuiltinFunc_Fibonacci),
+        std::make_shared<objects::BuiltinWithName>("set", &BuiltinFunc_Set),
+        std::make_shared<objects::BuiltinWithName>("substr", &BuiltinFunc_Substr),
+        std::make_shared<objects::BuiltinWithName>("split", &BuiltinFunc_Split),
+        std::make_shared<objects::BuiltinWithName>("join", &BuiltinFunc_Join),
+        std::make_shared<objects::BuiltinWithName>("index_of", &BuiltinFunc_IndexOf),
+        std::make_shared<objects::BuiltinWithName>("contains", &BuiltinFunc_Contains),
+        std::make_shared<objects::BuiltinWithName>("starts_with", &BuiltinFunc_StartsWith),
+        std::make_shared<objects::BuiltinWithName>("trim", &BuiltinFunc_Trim),
+        std::make_shared<objects::BuiltinWithName>("delete", &BuiltinFunc_Delete),
+        std::make_shared<objects::BuiltinWithName>("keys", &BuiltinFunc_Keys),
+        std::make_shared<objects::BuiltinWithName>("values", &BuiltinFunc_Values),
+        std::make_shared<objects::BuiltinWithName>("has", &BuiltinFunc_Has),
     };
 
-    std::shared_ptr<objects::Builtin> GetBuiltinByName(const std::string& name)
+    objects::Ref<objects::Builtin> GetBuiltinByName(const std::string& name)
     {
         for(auto &def: Builtins)
         {
@@ -13,9 +13,9 @@
 namespace objects
 {
 
-	struct Environment
+	struct Environment : Traceable
 	{
-		std::map<std::string, std::shared_ptr<Object>> store;
+		std::map<std::string, Ref<Object>> store;
 		std::shared_ptr<Environment> outer;
 
 		~Environment(){
@@ -23,7 +23,28 @@ namespace objects
 			outer.reset();
 		}
 
-		std::shared_ptr<Object> Get(std::string name)
+		virtual void Trace(const TraceVisitor &visit)
+		{
+			for (auto &[name, val] : store)
+			{
+				[[maybe_unused]] auto &x = name;
+				traceRef(visit, val);
+			}
+			traceRef(visit, outer);
+		}
+
+		virtual void Unlink(std::vector<std::shared_ptr<void>> &graveyard)
+		{
+			for (auto &[name, val] : store)
+			{
+				[[maybe_unused]] auto &x = name;
+				unlinkRef(graveyard, val);
+			}
+			store.clear();
+			unlinkRef(graveyard, outer);
+		}
+
+		Ref<Object> Get(const std::string& name)
 		{
 
 #ifdef DEBUG
@@ -54,7 +75,7 @@ namespace objects
 			}
 		}
 
-		std::shared_ptr<Object> Set(std::string name, std::shared_ptr<Object> val)
+		Ref<Object> Set(const std::string& name, Ref<Object> val)
 		{
 #ifdef DEBUG
 			std::cout << "\t Set get val=" << val->Inspect() << ",Type=" << val->TypeStr() << std::endl;
@@ -88,10 +109,22 @@ namespace objects
 		}
 	};
 
+	void Function::Trace(const TraceVisitor &visit)
+	{
+		traceRef(visit, Env);
+	}
+
+	void Function::Unlink(std::vector<std::shared_ptr<void>> &graveyard)
+	{
+		unlinkRef(graveyard, Env);
+	}
+
+	// 函数与其定义环境互相引用, 所有环境都交给环回收器跟踪
 	std::shared_ptr<objects::Environment> NewEnvironment()
 	{
-		std::shared_ptr<Environment> env = std::make_shared<Environment>();
+		std::shared_ptr<Environment> env = makePooledShared<Environment>();
 		env->outer = nullptr;
+		GC.Track(env);
 		return env;
 	}
 
@@ -0,0 +1,185 @@
+#ifndef H_GC_H
+#define H_GC_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+
+namespace objects
+{
+    struct Traceable;
+
+    // 访问一个子引用: 子对象指针及其引用计数
+    using TraceVisitor = std::function<void(Traceable *, long)>;
+
+    // 可能参与引用环的对象: Trace报告直接持有的子引用, Unlink把它们交给graveyard以打断环
+    struct Traceable
+    {
+        virtual ~Traceable() {}
+        virtual void Trace([[maybe_unused]] const TraceVisitor &visit) {}
+        virtual void Unlink([[maybe_unused]] std::vector<std::shared_ptr<void>> &graveyard) {}
+    };
+
+    template <typename Ptr>
+    void traceRef(const TraceVisitor &visit, const Ptr &ref)
+    {
+        if (ref != nullptr)
+        {
+            visit(ref.get(), ref.use_count());
+        }
+    }
+
+    template <typename T>
+    void unlinkRef(std::vector<std::shared_ptr<void>> &graveyard, std::shared_ptr<T> &ref)
+    {
+        if (ref != nullptr)
+        {
+            graveyard.push_back(std::move(ref));
+        }
+    }
+
+    // 非shared_ptr的句柄由删除器持有, graveyard清空时一并释放
+    template <typename Ptr>
+    void unlinkRef(std::vector<std::shared_ptr<void>> &graveyard, Ptr &ref)
+    {
+        if (ref != nullptr)
+        {
+            auto raw = ref.get();
+            graveyard.push_back(std::shared_ptr<void>(raw, [held = std::move(ref)]([[maybe_unused]] void *p) {}));
+        }
+    }
+
+    // 环回收器: 引用计数负责绝大多数对象, 这里只回收计数无法释放的环.
+    // 从被跟踪的环境出发找出可达子图, 引用计数减去子图内部引用即为外部引用;
+    // 有外部引用的对象(VM栈、全局变量、常量、宿主持有的环境等)是根, 根不可达的对象就是环垃圾.
+    // 每个线程一个回收器, 只跟踪本线程创建的环境
+    struct CycleCollector
+    {
+        bool Enabled = true;
+        size_t Threshold = 4096;  // 跟踪对象少于该值时不回收
+        double GrowthFactor = 2.0; // 跟踪对象数超过上次存活数的该倍数时回收
+
+        size_t Collections = 0;
+        size_t Collected = 0;
+
+        std::vector<std::weak_ptr<Traceable>> tracked;
+        size_t survivors = 0;
+
+        void Track(const std::shared_ptr<Traceable> &obj)
+        {
+            tracked.push_back(obj);
+
+            if (Enabled && tracked.size() >= std::max(Threshold, static_cast<size_t>(survivors * GrowthFactor)))
+            {
+                Collect();
+            }
+        }
+
+        size_t Collect()
+        {
+            struct Node
+            {
+                long refs;
+                long internal = 0;
+                bool live = false;
+            };
+
+            std::vector<std::shared_ptr<Traceable>> held;
+            held.reserve(tracked.size());
+            for (auto &weak : tracked)
+            {
+                if (auto obj = weak.lock(); obj != nullptr)
+                {
+                    held.push_back(std::move(obj));
+                }
+            }
+
+            std::unordered_map<Traceable *, Node> graph;
+            std::vector<Traceable *> pending;
+
+            // held自身持有一个引用, 不算外部引用
+            for (auto &obj : held)
+            {
+                if (graph.try_emplace(obj.get(), Node{obj.use_count() - 1}).second)
+                {
+                    pending.push_back(obj.get());
+                }
+            }
+
+            while (!pending.empty())
+            {
+                auto obj = pending.back();
+                pending.pop_back();
+
+                obj->Trace([&](Traceable *child, long refs) {
+                    auto [it, inserted] = graph.try_emplace(child, Node{refs});
+                    it->second.internal += 1;
+                    if (inserted)
+                    {
+                        pending.push_back(child);
+                    }
+                });
+            }
+
+            for (auto &[obj, node] : graph)
+            {
+                if (node.refs > node.internal)
+                {
+                    node.live = true;
+                    pending.push_back(obj);
+                }
+            }
+
+            while (!pending.empty())
+            {
+                auto obj = pending.back();
+                pending.pop_back();
+
+                obj->Trace([&](Traceable *child, [[maybe_unused]] long refs) {
+                    auto &node = graph.at(child);
+                    if (!node.live)
+                    {
+                        node.live = true;
+                        pending.push_back(child);
+                    }
+                });
+            }
+
+            // 先把所有垃圾的引用移入graveyard, 再统一释放, 避免在遍历中析构
+            std::vector<std::shared_ptr<void>> graveyard;
+            size_t garbage = 0;
+            for (auto &[obj, node] : graph)
+            {
+                if (!node.live)
+                {
+                    obj->Unlink(graveyard);
+                    garbage += 1;
+                }
+            }
+
+            tracked.clear();
+            for (auto &obj : held)
+            {
+                if (graph.at(obj.get()).live)
+                {
+                    tracked.push_back(obj);
+                }
+            }
+            survivors = tracked.size();
+
+            held.clear();
+            graveyard.clear();
+
+            Collections += 1;
+            Collected += garbage;
+
+            return garbage;
+        }
+    };
+
+    thread_local CycleCollector GC;
+}
+
+#endif // H_GC_H
@@ -0,0 +1,465 @@
+#ifndef H_HAMT_H
+#define H_HAMT_H
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <type_traits>
+
+#include "objects/gc.hpp"
+
+namespace objects
+{
+    // 持久化的哈希数组映射前缀树(HAMT): 每层用哈希值的5位在32路位图节点中定位,
+    // Set/Remove只复制从根到目标的路径, 新旧两个版本共享其余节点.
+    // Insert/Erase在节点只被当前版本持有时原地修改, 用于构造和唯一持有者的更新.
+    // 节点向环回收器报告子节点和值, 共享的节点在图中只出现一次, 内部引用按节点统计
+    template <typename K, typename V, typename Hasher>
+    struct HashTrie
+    {
+        static const int Bits = 5;
+        static const uint32_t Mask = (1u << Bits) - 1;
+
+        struct Entry
+        {
+            K first;
+            V second;
+
+            Entry(const K &key, const V &val) : first(key), second(val) {}
+        };
+
+        struct Node;
+
+        // 位图节点中的一个槽位: child为空时存放的是键值对
+        struct Slot
+        {
+            std::shared_ptr<Node> child;
+            Entry entry;
+
+            Slot(const Entry &e) : entry(e) {}
+            Slot(std::shared_ptr<Node> node, const Entry &e) : child(node), entry(e) {}
+        };
+
+        struct Node : Traceable
+        {
+            uint32_t bitmap = 0;
+            std::vector<Slot> slots;
+
+            bool collision = false; // 哈希值完全相同的键放在冲突节点里线性查找
+            std::vector<Entry> entries;
+
+            // 值是指向Traceable的智能指针时才报告
+            static constexpr bool tracesValues = std::is_convertible_v<decltype(std::declval<V>().get()), Traceable *>;
+
+            virtual void Trace(const TraceVisitor &visit)
+            {
+                for (auto &slot : slots)
+                {
+                    traceRef(visit, slot.child);
+                    if constexpr (tracesValues)
+                    {
+                        traceRef(visit, slot.entry.second);
+                    }
+                }
+                if constexpr (tracesValues)
+                {
+                    for (auto &entry : entries)
+                    {
+                        traceRef(visit, entry.second);
+                    }
+                }
+            }
+
+            virtual void Unlink(std::vector<std::shared_ptr<void>> &graveyard)
+            {
+                for (auto &slot : slots)
+                {
+                    unlinkRef(graveyard, slot.child);
+                    if constexpr (tracesValues)
+                    {
+                        unlinkRef(graveyard, slot.entry.second);
+                    }
+                }
+                if constexpr (tracesValues)
+                {
+                    for (auto &entry : entries)
+                    {
+                        unlinkRef(graveyard, entry.second);
+                    }
+                }
+            }
+        };
+
+        struct iterator
+        {
+            std::vector<std::pair<const Node *, size_t>> path;
+            const Entry *current = nullptr;
+
+            const Entry &operator*() const { return *current; }
+            const Entry *operator->() const { return current; }
+
+            bool operator==(const iterator &rhs) const { return current == rhs.current; }
+            bool operator!=(const iterator &rhs) const { return current != rhs.current; }
+
+            iterator &operator++()
+            {
+                current = nullptr;
+                advance();
+                return *this;
+            }
+
+            // path栈顶记录下一个要访问的位置, 深度优先找到下一个键值对
+            void advance()
+            {
+                while (!path.empty())
+                {
+                    auto &[node, index] = path.back();
+
+                    if (node->collision)
+                    {
+                        if (index < node->entries.size())
+                        {
+                            current = &node->entries[index++];
+                            return;
+                        }
+                    }
+                    else if (index < node->slots.size())
+                    {
+                        auto &slot = node->slots[index++];
+                        if (slot.child != nullptr)
+                        {
+                            path.emplace_back(slot.child.get(), 0);
+                            continue;
+                        }
+
+                        current = &slot.entry;
+                        return;
+                    }
+
+                    path.pop_back();
+                }
+            }
+        };
+
+        std::shared_ptr<Node> root;
+        size_t count = 0;
+
+        size_t size() const { return count; }
+        bool empty() const { return (count == 0); }
+
+        iterator begin() const
+        {
+            iterator it;
+            if (root != nullptr)
+            {
+                it.path.emplace_back(root.get(), 0);
+                it.advance();
+            }
+            return it;
+        }
+
+        iterator end() const { return iterator(); }
+
+        iterator find(const K &key) const
+        {
+            iterator it;
+            const uint64_t hash = Hasher{}(key);
+            const Node *node = root.get();
+            int shift = 0;
+
+            while (node != nullptr)
+            {
+                if (node->collision)
+                {
+                    for (size_t i = 0; i < node->entries.size(); i++)
+                    {
+                        if (node->entries[i].first == key)
+                        {
+                            it.path.emplace_back(node, i + 1);
+                            it.current = &node->entries[i];
+                            return it;
+                        }
+                    }
+                    return end();
+                }
+
+                const uint32_t bit = 1u << ((hash >> shift) & Mask);
+                if ((node->bitmap & bit) == 0)
+                {
+                    return end();
+                }
+
+                const size_t index = slotIndex(node->bitmap, bit);
+                auto &slot = node->slots[index];
+                it.path.emplace_back(node, index + 1);
+
+                if (slot.child == nullptr)
+                {
+                    if (slot.entry.first == key)
+                    {
+                        it.current = &slot.entry;
+                        return it;
+                    }
+                    return end();
+                }
+
+                node = slot.child.get();
+                shift += Bits;
+            }
+
+            return end();
+        }
+
+        bool contains(const K &key) const
+        {
+            return (find(key) != end());
+        }
+
+        // 返回加入(或替换)键值对后的新版本, 原版本不变
+        HashTrie Set(const K &key, const V &val) const
+        {
+            HashTrie result;
+            bool added = false;
+            result.root = assoc(root, Hasher{}(key), Entry(key, val), 0, false, added);
+            result.count = count + (added ? 1 : 0);
+            return result;
+        }
+
+        HashTrie Remove(const K &key) const
+        {
+            HashTrie result;
+            bool removed = false;
+            result.root = dissoc(root, Hasher{}(key), key, 0, false, removed);
+            result.count = count - (removed ? 1 : 0);
+            return result;
+        }
+
+        void Insert(const K &key, const V &val)
+        {
+            bool added = false;
+            root = assoc(root, Hasher{}(key), Entry(key, val), 0, true, added);
+            count += (added ? 1 : 0);
+        }
+
+        void Erase(const K &key)
+        {
+            bool removed = false;
+            root = dissoc(root, Hasher{}(key), key, 0, true, removed);
+            count -= (removed ? 1 : 0);
+        }
+
+        static size_t slotIndex(uint32_t bitmap, uint32_t bit)
+        {
+            return __builtin_popcount(bitmap & (bit - 1));
+        }
+
+        // editable为真且节点没有被其他版本共享时原地修改, 否则复制该节点
+        static std::shared_ptr<Node> editableCopy(const std::shared_ptr<Node> &node, bool editable)
+        {
+            if (editable && node.use_count() == 1)
+            {
+                return node;
+            }
+            return std::make_shared<Node>(*node);
+        }
+
+        static std::shared_ptr<Node> mergeEntries(const Entry &e1, uint64_t h1, const Entry &e2, uint64_t h2, int shift)
+        {
+            auto node = std::make_shared<Node>();
+
+            if (h1 == h2 || shift >= 64)
+            {
+                node->collision = true;
+                node->entries = {e1, e2};
+                return node;
+            }
+
+            const uint32_t b1 = (h1 >> shift) & Mask;
+            const uint32_t b2 = (h2 >> shift) & Mask;
+
+            if (b1 == b2)
+            {
+                node->bitmap = 1u << b1;
+                node->slots.emplace_back(mergeEntries(e1, h1, e2, h2, shift + Bits), e1);
+            }
+            else
+            {
+                node->bitmap = (1u << b1) | (1u << b2);
+                if (b1 < b2)
+                {
+                    node->slots.emplace_back(e1);
+                    node->slots.emplace_back(e2);
+                }
+                else
+                {
+                    node->slots.emplace_back(e2);
+                    node->slots.emplace_back(e1);
+                }
+            }
+
+            return node;
+        }
+
+        static std::shared_ptr<Node> assoc(const std::shared_ptr<Node> &node, uint64_t hash, const Entry &entry, int shift, bool editable, bool &added)
+        {
+            if (node == nullptr)
+            {
+                auto leaf = std::make_shared<Node>();
+                leaf->bitmap = 1u << ((hash >> shift) & Mask);
+                leaf->slots.emplace_back(entry);
+                added = true;
+                return leaf;
+            }
+
+            if (node->collision)
+            {
+                auto result = editableCopy(node, editable);
+                for (auto &e : result->entries)
+                {
+                    if (e.first == entry.first)
+                    {
+                        e.second = entry.second;
+                        return result;
+                    }
+                }
+                result->entries.push_back(entry);
+                added = true;
+                return result;
+            }
+
+            const uint32_t bit = 1u << ((hash >> shift) & Mask);
+            const size_t index = slotIndex(node->bitmap, bit);
+
+            if ((node->bitmap & bit) == 0)
+            {
+                auto result = editableCopy(node, editable);
+                result->bitmap |= bit;
+                result->slots.insert(result->slots.begin() + index, Slot(entry));
+                added = true;
+                return result;
+            }
+
+            auto &slot = node->slots[index];
+
+            if (slot.child != nullptr)
+            {
+                auto child = assoc(slot.child, hash, entry, shift + Bits, editable, added);
+                if (child == slot.child)
+                {
+                    return node;
+                }
+
+                auto result = editableCopy(node, editable);
+                result->slots[index].child = child;
+                return result;
+            }
+
+            auto result = editableCopy(node, editable);
+
+            if (slot.entry.first == entry.first)
+            {
+                result->slots[index].entry.second = entry.second;
+                return result;
+            }
+
+            auto existing = slot.entry;
+            result->slots[index].child = mergeEntries(existing, Hasher{}(existing.first), entry, hash, shift + Bits);
+            added = true;
+            return result;
+        }
+
+        // 只剩一个键值对的子节点可以直接内联回父节点
+        static const Entry *singleEntry(const std::shared_ptr<Node> &node)
+        {
+            if (node->collision)
+            {
+                return (node->entries.size() == 1) ? &node->entries[0] : nullptr;
+            }
+
+            if (node->slots.size() == 1 && node->slots[0].child == nullptr)
+            {
+                return &node->slots[0].entry;
+            }
+
+            return nullptr;
+        }
+
+        static std::shared_ptr<Node> dissoc(const std::shared_ptr<Node> &node, uint64_t hash, const K &key, int shift, bool editable, bool &removed)
+        {
+            if (node == nullptr)
+            {
+                return node;
+            }
+
+            if (node->collision)
+            {
+                for (size_t i = 0; i < node->entries.size(); i++)
+                {
+                    if (node->entries[i].first == key)
+                    {
+                        auto result = editableCopy(node, editable);
+                        result->entries.erase(result->entries.begin() + i);
+                        removed = true;
+                        return result;
+                    }
+                }
+                return node;
+            }
+
+            const uint32_t bit = 1u << ((hash >> shift) & Mask);
+            if ((node->bitmap & bit) == 0)
+            {
+                return node;
+            }
+
+            const size_t index = slotIndex(node->bitmap, bit);
+            auto &slot = node->slots[index];
+
+            if (slot.child != nullptr)
+            {
+                auto child = dissoc(slot.child, hash, key, shift + Bits, editable, removed);
+                if (!removed)
+                {
+                    return node;
+                }
+
+                auto result = editableCopy(node, editable);
+                if (child == nullptr)
+                {
+                    result->bitmap &= ~bit;
+                    result->slots.erase(result->slots.begin() + index);
+                    return result->slots.empty() ? nullptr : result;
+                }
+                else if (auto single = singleEntry(child); single != nullptr)
+                {
+                    result->slots[index] = Slot(*single);
+                }
+                else
+                {
+                    result->slots[index].child = child;
+                }
+                return result;
+            }
+
+            if (!(slot.entry.first == key))
+            {
+                return node;
+            }
+
+            removed = true;
+
+            if (node->slots.size() == 1)
+            {
+                return nullptr;
+            }
+
+            auto result = editableCopy(node, editable);
+            result->bitmap &= ~bit;
+            result->slots.erase(result->slots.begin() + index);
+            return result;
+        }
+    };
+}
+
+#endif // H_HAMT_H
@@ -0,0 +1,125 @@
+#ifndef H_INTCACHE_H
+#define H_INTCACHE_H
+
+#include <memory>
+#include <vector>
+#include <atomic>
+
+#include "objects/objects.hpp"
+
+// 小整数缓存的范围, 可在编译时通过-DMONKEY_SMALL_INT_MIN/-DMONKEY_SMALL_INT_MAX调整
+#ifndef MONKEY_SMALL_INT_MIN
+#define MONKEY_SMALL_INT_MIN (-1024)
+#endif
+
+#ifndef MONKEY_SMALL_INT_MAX
+#define MONKEY_SMALL_INT_MAX 65535
+#endif
+
+namespace objects
+{
+	// 不可变小整数: 范围内的整数结果直接复用同一个对象, 不再分配. 对象永不释放;
+	// Hits/Misses用于统计命中率以调整范围, 各线程都会计数, 用relaxed原子操作.
+	// 侵入式计数下所有对象预先放在一块连续内存里并标记为不朽.
+	// 默认构建中每个整数首次用到时单独创建, 各有自己的控制块, 不同的整数不会争用同一个原子计数;
+	// 槽位表是零初始化的静态数据, 启动时不做任何工作
+	struct SmallIntegerCache
+	{
+		static const long long int Min = MONKEY_SMALL_INT_MIN;
+		static const long long int Max = MONKEY_SMALL_INT_MAX;
+
+#ifdef MONKEY_INTRUSIVE_REFCOUNT
+		std::shared_ptr<std::vector<Integer>> values;
+#else
+		std::atomic<Ref<Integer> *> slots[Max - Min + 1];
+#endif
+
+		std::atomic<size_t> Hits{0};
+		std::atomic<size_t> Misses{0};
+
+#ifdef MONKEY_INTRUSIVE_REFCOUNT
+		SmallIntegerCache() : values(std::make_shared<std::vector<Integer>>(Max - Min + 1))
+		{
+			for (long long int i = Min; i <= Max; i++)
+			{
+				auto &obj = (*values)[i - Min];
+				obj.Value = i;
+				obj.Immortal = true;
+			}
+		}
+#endif
+
+		static bool Contains(long long int value)
+		{
+			return (value >= Min && value <= Max);
+		}
+
+		// 调用前需确认Contains(value)
+		Ref<Integer> Get(long long int value)
+		{
+#ifdef MONKEY_INTRUSIVE_REFCOUNT
+			return Ref<Integer>(&(*values)[value - Min]);
+#else
+			// 缓存自身持有一份引用, 因此永远不会被视为唯一持有
+			auto &slot = slots[value - Min];
+			auto ref = slot.load(std::memory_order_acquire);
+			if (ref == nullptr)
+			{
+				ref = create(slot, value);
+			}
+			return *ref;
+#endif
+		}
+
+#ifndef MONKEY_INTRUSIVE_REFCOUNT
+		// 多个线程同时创建同一个整数时只保留先发布的一个
+		static Ref<Integer> *create(std::atomic<Ref<Integer> *> &slot, long long int value)
+		{
+			auto fresh = new Ref<Integer>(makeRef<Integer>(value));
+			Ref<Integer> *published = nullptr;
+			if (!slot.compare_exchange_strong(published, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				delete fresh;
+				return published;
+			}
+			return fresh;
+		}
+#endif
+
+		double HitRate() const
+		{
+			const size_t hits = Hits.load(std::memory_order_relaxed);
+			const size_t total = hits + Misses.load(std::memory_order_relaxed);
+			return (total == 0) ? 0.0 : static_cast<double>(hits) / total;
+		}
+	};
+
+	SmallIntegerCache SmallInts;
+
+	Ref<Integer> newInteger(long long int value)
+	{
+		if (SmallIntegerCache::Contains(value))
+		{
+			SmallInts.Hits.fetch_add(1, std::memory_order_relaxed);
+			return SmallInts.Get(value);
+		}
+
+		SmallInts.Misses.fetch_add(1, std::memory_order_relaxed);
+		return makePooled<Integer>(value);
+	}
+
+	// 缓存未命中时在新生代分配, 供VM的算术运算使用
+	Ref<Integer> newYoungInteger(long long int value)
+	{
+		if (SmallIntegerCache::Contains(value))
+		{
+			SmallInts.Hits.fetch_add(1, std::memory_order_relaxed);
+			return SmallInts.Get(value);
+		}
+
+		SmallInts.Misses.fetch_add(1, std::memory_order_relaxed);
+		return makeYoung<Integer>(value);
+	}
+}
+
+#endif // H_INTCACHE_H
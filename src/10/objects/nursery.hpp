@@ -0,0 +1,291 @@
+#ifndef H_NURSERY_H
+#define H_NURSERY_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+
+#include "objects/owner.hpp"
+
+namespace objects
+{
+    // 新生代块头, 位于按BlockSize对齐的块起始处, 由对象地址即可找到
+    struct NurseryBlock
+    {
+        size_t live;
+        size_t used;
+        SpaceOwner *owner; // 分配它的线程
+    };
+
+    // 新生代: 运算产生的临时对象在当前块内做指针碰撞分配.
+    // 块内对象全部死亡时整块回收(minor collection); 块用尽时仍存活的对象随块晋升为老年代,
+    // 块在最后一个对象释放后才回到空闲列表. 每个线程一个新生代, 其他线程释放的对象经SpaceOwner交还给所属线程.
+    // 成员都是平凡类型, 线程退出时由NurseryExit归还空闲的块, 仍有存活对象的块由最后释放它的线程还给系统
+    struct NurserySpace
+    {
+        static const size_t BlockSize = 64 * 1024;
+        static const size_t HeaderSize = (sizeof(NurseryBlock) + 15) & ~size_t(15);
+        static const size_t MaxObjectSize = 256;
+        static const size_t MaxFreeBlocks = 8;
+#ifdef MONKEY_SYSTEM_ALLOCATOR
+        static constexpr bool Enabled = false; // 与对象池一样改用系统分配器, 便于对照和排查内存错误
+#else
+        static constexpr bool Enabled = true;
+#endif
+
+        NurseryBlock *current = nullptr;
+        NurseryBlock *freeBlocks[MaxFreeBlocks];
+        size_t freeCount = 0;
+        size_t Blocks = 0;          // 从系统取得且尚未归还的块数
+        SpaceOwner *self = nullptr; // 第一次取块时创建
+        bool exiting = false;
+
+        size_t Allocations = 0;
+        size_t AllocatedBytes = 0;
+        size_t MinorCollections = 0; // 块内对象全部死亡后整块回收的次数
+        size_t Promoted = 0;         // 块用尽时仍存活而晋升的对象数
+
+        static NurseryBlock *blockOf(void *p)
+        {
+            return reinterpret_cast<NurseryBlock *>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(BlockSize - 1));
+        }
+
+        void *Allocate(size_t size, size_t align)
+        {
+            Allocations += 1;
+            AllocatedBytes += size;
+            // 跨线程释放时就地存放RemoteFree
+            size = std::max(size, sizeof(RemoteFree));
+            align = std::max(align, alignof(RemoteFree));
+
+            size_t offset = (current == nullptr) ? BlockSize : (current->used + align - 1) & ~(align - 1);
+            if (offset + size > BlockSize)
+            {
+                nextBlock();
+                offset = (current->used + align - 1) & ~(align - 1);
+            }
+
+            current->used = offset + size;
+            current->live += 1;
+            return reinterpret_cast<char *>(current) + offset;
+        }
+
+        void Release(void *p)
+        {
+            auto block = blockOf(p);
+            if (block->owner != self)
+            {
+                releaseRemote(block, p);
+                return;
+            }
+            releaseLocal(block);
+        }
+
+        void releaseLocal(NurseryBlock *block)
+        {
+            block->live -= 1;
+
+            if (block->live > 0)
+            {
+                return;
+            }
+
+            MinorCollections += 1;
+            block->used = HeaderSize;
+
+            if (exiting)
+            {
+                if (block == current)
+                {
+                    current = nullptr;
+                }
+                std::free(block);
+                Blocks -= 1;
+            }
+            else if (block != current)
+            {
+                if (freeCount < MaxFreeBlocks)
+                {
+                    freeBlocks[freeCount++] = block;
+                }
+                else
+                {
+                    std::free(block);
+                    Blocks -= 1;
+                }
+            }
+        }
+
+        void collectRemote()
+        {
+            for (auto node = self->TakeRemote(); node != nullptr;)
+            {
+                auto next = node->next;
+                releaseLocal(blockOf(node));
+                node = next;
+            }
+        }
+
+        // 其他线程分配的对象: 所属线程还在时交给它回收, 否则块内对象全部死亡后直接还给系统
+        static void releaseRemote(NurseryBlock *block, void *p)
+        {
+            std::lock_guard<std::mutex> lock(SpaceOwner::Lock);
+            auto owner = block->owner;
+            if (owner->Alive)
+            {
+                owner->PushRemote(new (p) RemoteFree{nullptr, 0, 0});
+                return;
+            }
+
+            if (--block->live > 0)
+            {
+                return;
+            }
+            if (owner->Retained == block)
+            {
+                owner->Retained = nullptr;
+            }
+            std::free(block);
+            owner->ReleaseOrphan();
+        }
+
+        void ensureOwner();
+        void nextBlock();
+
+        // 线程退出时调用: 归还空闲的块, 仍有存活对象的块留给释放它们的线程
+        void Trim()
+        {
+            std::lock_guard<std::mutex> lock(SpaceOwner::Lock);
+            exiting = true;
+            if (self == nullptr)
+            {
+                return;
+            }
+
+            collectRemote();
+            while (freeCount > 0)
+            {
+                std::free(freeBlocks[--freeCount]);
+                Blocks -= 1;
+            }
+            if (current != nullptr)
+            {
+                if (current->live == 0)
+                {
+                    std::free(current);
+                    Blocks -= 1;
+                }
+                else
+                {
+                    self->Retained = current;
+                }
+            }
+            current = nullptr;
+
+            self->Orphan(Blocks);
+            self = nullptr;
+            Blocks = 0;
+        }
+    };
+
+    thread_local NurserySpace Nursery;
+
+    struct NurseryExit
+    {
+        ~NurseryExit() { Nursery.Trim(); }
+    };
+
+    void NurserySpace::ensureOwner()
+    {
+        if (self != nullptr)
+        {
+            return;
+        }
+
+        self = new SpaceOwner();
+        if (!exiting)
+        {
+            // 首次取块时登记, 线程退出时析构
+            thread_local NurseryExit guard;
+            (void)guard;
+        }
+    }
+
+    void NurserySpace::nextBlock()
+    {
+        ensureOwner();
+        if (self->HasRemote())
+        {
+            collectRemote();
+            if (current != nullptr && current->live == 0)
+            {
+                // 当前块的对象已全部由其他线程释放, 指针已回退
+                return;
+            }
+        }
+
+        if (current != nullptr)
+        {
+            Promoted += current->live;
+        }
+
+        if (freeCount > 0)
+        {
+            current = freeBlocks[--freeCount];
+            return;
+        }
+
+        void *mem = std::aligned_alloc(BlockSize, BlockSize);
+        if (mem == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+
+        current = static_cast<NurseryBlock *>(mem);
+        current->live = 0;
+        current->used = HeaderSize;
+        current->owner = self;
+        Blocks += 1;
+    }
+
+    // 供std::allocate_shared使用, 对象与控制块一起放入新生代, 过大的请求直接走operator new
+    template <typename T>
+    struct NurseryAllocator
+    {
+        using value_type = T;
+
+        NurseryAllocator() {}
+        template <typename U>
+        NurseryAllocator([[maybe_unused]] const NurseryAllocator<U> &other) {}
+
+        T *allocate(size_t n)
+        {
+            if (n * sizeof(T) > NurserySpace::MaxObjectSize)
+            {
+                return static_cast<T *>(::operator new(n * sizeof(T)));
+            }
+            return static_cast<T *>(Nursery.Allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *p, size_t n)
+        {
+            if (n * sizeof(T) > NurserySpace::MaxObjectSize)
+            {
+                ::operator delete(p);
+                return;
+            }
+            Nursery.Release(p);
+        }
+
+        template <typename U>
+        bool operator==([[maybe_unused]] const NurseryAllocator<U> &other) const { return true; }
+        template <typename U>
+        bool operator!=([[maybe_unused]] const NurseryAllocator<U> &other) const { return false; }
+    };
+}
+
+#endif // H_NURSERY_H
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <fstream>
@@ -11,6 +12,10 @@
 
 #include "ast/ast.hpp"
 #include "code/code.hpp"
+#include "objects/hamt.hpp"
+#include "objects/gc.hpp"
+#include "objects/nursery.hpp"
+#include "objects/ref.hpp"
 
 namespace objects
 {
@@ -53,7 +58,13 @@ namespace objects
 		}
 	};
 
-	struct Object
+	// HashKey.Value本身已是整数值或字符串哈希, 直接作为HAMT的哈希位
+	struct HashKeyHasher
+	{
+		uint64_t operator()(const HashKey &key) const { return key.Value; }
+	};
+
+	struct Object : Traceable, RefCounted
 	{
 		virtual ~Object() {}
 		virtual ObjectType Type() { return ObjectType::Null; }
@@ -146,35 +157,182 @@ namespace objects
 		}
 	};
 
+	// 拼接结果先以二叉树(rope)形式惰性保存, 在需要连续内容时(哈希、Inspect、puts)才展开,
+	// 重复拼接构造大字符串的代价因此是线性的
+	const size_t RopeMinLength = 64; // 短于该长度的拼接直接生成平坦字符串
+	const size_t SliceMinLength = 16; // 短于该长度的子串直接复制, 不再引用父串
+
 	struct String : Object
 	{
-		std::string Value;
+		std::string Value; // 平坦内容, 仅当既不是rope也不是切片时有效
+		Ref<String> Left;
+		Ref<String> Right;
+		Ref<String> Parent; // 切片共享的父串(总是平坦的)
+		size_t Offset;
+		size_t Length;
+
+		String(): Value(""), Offset(0), Length(0) {}
+		String(std::string val) : Value(std::move(val)), Offset(0), Length(Value.size()) {}
+		String(Ref<String> left, Ref<String> right)
+			: Left(left), Right(right), Offset(0), Length(left->Length + right->Length) {}
+		String(Ref<String> parent, size_t offset, size_t length)
+			: Parent(parent), Offset(offset), Length(length) {}
+
+		virtual ~String()
+		{
+			// 逐个拼接得到的树深度与拼接次数相同, 迭代释放以免递归析构耗尽调用栈
+			std::vector<Ref<String>> pending;
+			pending.push_back(std::move(Left));
+			pending.push_back(std::move(Right));
+			while (!pending.empty())
+			{
+				auto node = std::move(pending.back());
+				pending.pop_back();
+				if (node != nullptr && node.use_count() == 1 && node->IsRope())
+				{
+					pending.push_back(std::move(node->Left));
+					pending.push_back(std::move(node->Right));
+				}
+			}
+		}
+
+		bool IsRope() { return (Left != nullptr); }
+		bool IsSlice() { return (Parent != nullptr); }
+
+		// 连续内容的只读视图; rope会先展开, 切片直接指向父串的缓冲区
+		std::string_view View()
+		{
+			if (IsSlice())
+			{
+				return std::string_view(Parent->Value).substr(Offset, Length);
+			}
+
+			return Flatten();
+		}
+
+		const std::string &Flatten()
+		{
+			if (IsSlice())
+			{
+				Value = std::string(View());
+				Parent.reset();
+				Offset = 0;
+				return Value;
+			}
+
+			if (!IsRope())
+			{
+				return Value;
+			}
 
-		String(): Value(""){}
-		String(std::string val) : Value(val) {}
+			std::string buffer;
+			buffer.reserve(Length);
+
+			std::vector<String *> pending{Right.get(), Left.get()};
+			while (!pending.empty())
+			{
+				auto node = pending.back();
+				pending.pop_back();
+				if (node->IsRope())
+				{
+					pending.push_back(node->Right.get());
+					pending.push_back(node->Left.get());
+				}
+				else
+				{
+					buffer.append(node->View());
+				}
+			}
+
+			Value = std::move(buffer);
+			Left.reset();
+			Right.reset();
+			return Value;
+		}
 
-		virtual ~String() {}
 		virtual ObjectType Type() { return ObjectType::STRING; }
 		virtual bool Hashable(){ return true; }
 		virtual std::string Inspect()
 		{
-			return "\"" + Value + "\"";
+			std::string out;
+			out.reserve(Length + 2);
+			out.append("\"").append(View()).append("\"");
+			return out;
 		}
 
 		virtual HashKey GetHashKey() {
-			auto intVal = std::hash<std::string>{}(Value);
+			auto intVal = std::hash<std::string_view>{}(View());
 			return HashKey(Type(), static_cast<uint64_t>(intVal));
 		}
 	};
 
+	Ref<String> concatStrings(Ref<String> left, Ref<String> right)
+	{
+		if (left->Length == 0)
+		{
+			return right;
+		}
+		else if (right->Length == 0)
+		{
+			return left;
+		}
+		else if (left->Length + right->Length < RopeMinLength)
+		{
+			std::string buffer;
+			buffer.reserve(left->Length + right->Length);
+			buffer.append(left->View()).append(right->View());
+			return makeYoung<String>(std::move(buffer));
+		}
+
+		return makeYoung<String>(left, right);
+	}
+
+	// 返回str[offset, offset + length)的切片, 与原串共享缓冲区
+	Ref<String> sliceString(Ref<String> str, size_t offset, size_t length)
+	{
+		if (offset == 0 && length == str->Length)
+		{
+			return str;
+		}
+		else if (length < SliceMinLength)
+		{
+			return makeRef<String>(std::string(str->View().substr(offset, length)));
+		}
+
+		if (str->IsSlice())
+		{
+			return makeRef<String>(str->Parent, str->Offset + offset, length);
+		}
+
+		str->Flatten();
+		return makeRef<String>(str, offset, length);
+	}
+
 	struct Array : Object
 	{
-		std::vector<std::shared_ptr<Object>> Elements;
+		std::vector<Ref<Object>> Elements;
 
 		Array(){}
-		Array(std::vector<std::shared_ptr<Object>>& elements): Elements(elements){}
+		Array(std::vector<Ref<Object>> elements): Elements(std::move(elements)){}
 		virtual ~Array() {}
 		virtual ObjectType Type() { return ObjectType::ARRAY; }
+
+		virtual void Trace(const TraceVisitor &visit)
+		{
+			for (auto &item : Elements)
+			{
+				traceRef(visit, item);
+			}
+		}
+
+		virtual void Unlink(std::vector<std::shared_ptr<void>> &graveyard)
+		{
+			for (auto &item : Elements)
+			{
+				unlinkRef(graveyard, item);
+			}
+			Elements.clear();
+		}
 		virtual std::string Inspect()
 		{
 			std::stringstream oss;
@@ -198,9 +356,9 @@ namespace objects
 
 	struct ReturnValue : Object
 	{
-		std::shared_ptr<Object> Value;
+		Ref<Object> Value;
 
-		ReturnValue(std::shared_ptr<Object> val) : Value(val) {}
+		ReturnValue(Ref<Object> val) : Value(val) {}
 		virtual ~ReturnValue() { Value.reset();}
 		virtual ObjectType Type() { return ObjectType::RETURN_VALUE; }
 		virtual std::string Inspect() { return Value->Inspect(); }
@@ -215,28 +373,55 @@ namespace objects
 		virtual std::string Inspect() { return "ERROR: " + Message; }
 	};
 
-	struct HashPair
+	struct HashPair : Traceable
 	{
-		std::shared_ptr<Object> Key;
-		std::shared_ptr<Object> Value;
+		Ref<Object> Key;
+		Ref<Object> Value;
+
+		HashPair(Ref<Object> key, Ref<Object> val): Key(key), Value(val){}
+
+		virtual void Trace(const TraceVisitor &visit)
+		{
+			traceRef(visit, Key);
+			traceRef(visit, Value);
+		}
 
-		HashPair(std::shared_ptr<Object> key, std::shared_ptr<Object> val): Key(key), Value(val){}
+		virtual void Unlink(std::vector<std::shared_ptr<void>> &graveyard)
+		{
+			unlinkRef(graveyard, Key);
+			unlinkRef(graveyard, Value);
+		}
 	};
 
+	using HashPairs = HashTrie<HashKey, std::shared_ptr<HashPair>, HashKeyHasher>;
+
+	// HAMT节点在多个版本之间共享, Hash只报告根节点, 节点和键值对各自作为图中的对象统计引用
 	struct Hash: Object
 	{
-		std::map<HashKey, std::shared_ptr<HashPair>> Pairs;
+		HashPairs Pairs;
 
-		Hash(std::map<HashKey, std::shared_ptr<HashPair>>& pairs): Pairs(pairs){}
+		Hash(){}
+		Hash(HashPairs pairs): Pairs(std::move(pairs)){}
 		virtual ~Hash(){}
 		virtual ObjectType Type() { return ObjectType::HASH; }
+
+		virtual void Trace(const TraceVisitor &visit)
+		{
+			traceRef(visit, Pairs.root);
+		}
+
+		virtual void Unlink(std::vector<std::shared_ptr<void>> &graveyard)
+		{
+			unlinkRef(graveyard, Pairs.root);
+			Pairs.count = 0;
+		}
 		virtual std::string Inspect() 
 		{ 
 			std::stringstream oss;
 			std::vector<std::string> items{};
 			for (auto &[key, pair] : Pairs)
 			{
-				[[maybe_unused]] auto x = key;
+				[[maybe_unused]] auto &x = key;
 				items.push_back(pair->Key->Inspect() + ": " + pair->Value->Inspect());
 			}
 			oss << "{" << ast::Join(items, ", ") << "}";
@@ -251,6 +436,7 @@ namespace objects
 		std::vector<std::shared_ptr<ast::Identifier>> Parameters;
 		std::shared_ptr<ast::BlockStatement> Body;
 		std::shared_ptr<Environment> Env;
+		std::string Name; // `let name = fn...`中的名字, 编译为字节码时函数体内的递归调用据此直接取当前闭包
 
 		virtual ~Function() {
 			Parameters.clear();
@@ -258,6 +444,10 @@ namespace objects
 			Env.reset();
 		}
 		virtual ObjectType Type() { return ObjectType::FUNCTION; }
+
+		// Environment在此处尚不完整, 定义见environment.hpp
+		virtual void Trace(const TraceVisitor &visit);
+		virtual void Unlink(std::vector<std::shared_ptr<void>> &graveyard);
 		virtual std::string Inspect()
 		{
 			std::stringstream oss;
@@ -275,14 +465,28 @@ namespace objects
 		}
 	};
 
+	struct CompiledFunction;
+
+	// 尚未编译的函数体(见compiler/compiler.hpp), 第一次调用时填充函数的指令, 新常量追加到constants
+	struct LazyBody
+	{
+		virtual ~LazyBody() {}
+		virtual Ref<Object> Compile(CompiledFunction &fn, std::vector<Ref<Object>> &constants) = 0;
+	};
+
 	struct CompiledFunction: Object
 	{
 		bytecode::Instructions Instructions;
 		int NumLocals;
 		int NumParameters;
+		int NumFree = 0; // 函数体用到的捕获变量个数, 创建闭包时至少要提供这么多
+
+		uint32_t Calls = 0;      // 调用次数, VM据此决定何时交给JIT编译
+		void *Native = nullptr;  // JIT生成的机器码入口
+		std::shared_ptr<LazyBody> Lazy; // 不为空时Instructions和NumLocals还没有生成
 
-		CompiledFunction(bytecode::Instructions &ins, const int &numLocals, const int &numParameters)
-			: Instructions(ins),
+		CompiledFunction(bytecode::Instructions ins, const int &numLocals, const int &numParameters)
+			: Instructions(std::move(ins)),
 			  NumLocals(numLocals),
 			  NumParameters(numParameters)
 		{
@@ -299,14 +503,31 @@ namespace objects
 
 	struct Closure: Object
 	{
-		std::shared_ptr<CompiledFunction> Fn;
-		std::vector<std::shared_ptr<Object>> Free;
+		Ref<CompiledFunction> Fn;
+		std::vector<Ref<Object>> Free;
 
-		Closure(std::shared_ptr<CompiledFunction> fn): Fn(fn){}
-		Closure(std::shared_ptr<CompiledFunction> fn, std::vector<std::shared_ptr<Object>> free): Fn(fn), Free(free){}
+		Closure(Ref<CompiledFunction> fn): Fn(std::move(fn)){}
+		Closure(Ref<CompiledFunction> fn, std::vector<Ref<Object>> free): Fn(std::move(fn)), Free(std::move(free)){}
 		virtual ~Closure(){}
 
 		virtual ObjectType Type() { return ObjectType::CLOSURE; }
+
+		virtual void Trace(const TraceVisitor &visit)
+		{
+			for (auto &item : Free)
+			{
+				traceRef(visit, item);
+			}
+		}
+
+		virtual void Unlink(std::vector<std::shared_ptr<void>> &graveyard)
+		{
+			for (auto &item : Free)
+			{
+				unlinkRef(graveyard, item);
+			}
+			Free.clear();
+		}
 		virtual std::string Inspect()
 		{
 			std::stringstream oss;
@@ -315,18 +536,18 @@ namespace objects
 		}
 	};
 
-	static std::shared_ptr<objects::Null> NULL_OBJ = std::make_shared<objects::Null>();
-	static std::shared_ptr<objects::Boolean> TRUE_OBJ = std::make_shared<objects::Boolean>(true);
-	static std::shared_ptr<objects::Boolean> FALSE_OBJ = std::make_shared<objects::Boolean>(false);
+	static objects::Ref<objects::Null> NULL_OBJ = objects::makeImmortal(objects::makeRef<objects::Null>());
+	static objects::Ref<objects::Boolean> TRUE_OBJ = objects::makeImmortal(objects::makeRef<objects::Boolean>(true));
+	static objects::Ref<objects::Boolean> FALSE_OBJ = objects::makeImmortal(objects::makeRef<objects::Boolean>(false));
 
-	std::shared_ptr<objects::Error> newError(std::string msg)
+	objects::Ref<objects::Error> newError(std::string msg)
 	{
-		std::shared_ptr<objects::Error> error = std::make_shared<objects::Error>();
+		objects::Ref<objects::Error> error = objects::makeRef<objects::Error>();
 		error->Message = msg;
 		return error;
 	}
 
-	bool isError(std::shared_ptr<objects::Object> obj)
+	bool isError(const objects::Ref<objects::Object> &obj)
 	{
 		if (obj != nullptr)
 		{
@@ -335,7 +556,13 @@ namespace objects
 		return false;
 	}
 
-	bool isTruthy(std::shared_ptr<objects::Object> obj)
+	// 除参数本身外没有其他引用: 原地修改对脚本不可见
+	bool isUniquelyOwned(const objects::Ref<objects::Object> &obj)
+	{
+		return (obj != nullptr && obj.use_count() == 1);
+	}
+
+	bool isTruthy(const objects::Ref<objects::Object> &obj)
 	{
 		if (obj == objects::NULL_OBJ)
 		{
@@ -356,7 +583,7 @@ namespace objects
 	}
 
 
-	std::shared_ptr<objects::Boolean> nativeBoolToBooleanObject(bool input)
+	const objects::Ref<objects::Boolean> &nativeBoolToBooleanObject(bool input)
 	{
 		if (input)
 		{
@@ -368,10 +595,10 @@ namespace objects
 		}
 	}
 
-	std::shared_ptr<objects::Object> evalArrayIndexExpression(std::shared_ptr<objects::Object> left, std::shared_ptr<objects::Object> index)
+	objects::Ref<objects::Object> evalArrayIndexExpression(objects::Ref<objects::Object> left, objects::Ref<objects::Object> index)
 	{
-		std::shared_ptr<objects::Array> arrayObj = std::dynamic_pointer_cast<objects::Array>(left);
-		auto idx = std::dynamic_pointer_cast<objects::Integer>(index)->Value;
+		objects::Ref<objects::Array> arrayObj = objects::refCast<objects::Array>(left);
+		auto idx = objects::refCast<objects::Integer>(index)->Value;
 		auto max = static_cast<int64_t>(arrayObj->Elements.size() - 1);
 
 		if(idx < 0 || idx > max)
@@ -382,9 +609,9 @@ namespace objects
 		return arrayObj->Elements[idx];
 	}
 
-	std::shared_ptr<objects::Object> evalHashIndexExpression(std::shared_ptr<objects::Object> left, std::shared_ptr<objects::Object> index)
+	objects::Ref<objects::Object> evalHashIndexExpression(objects::Ref<objects::Object> left, objects::Ref<objects::Object> index)
 	{
-		std::shared_ptr<objects::Hash> hashObj = std::dynamic_pointer_cast<objects::Hash>(left);
+		objects::Ref<objects::Hash> hashObj = objects::refCast<objects::Hash>(left);
 
 		if(!index->Hashable())
 		{
@@ -405,4 +632,8 @@ namespace objects
 
 }
 
+// Function::Trace需要完整的Environment类型
+#include "objects/environment.hpp"
+#include "objects/intcache.hpp"
+
 #endif // H_OBJECTS_H
\ No newline at end of file
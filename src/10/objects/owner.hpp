@@ -0,0 +1,95 @@
+#ifndef H_OWNER_H
+#define H_OWNER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+
+namespace objects
+{
+    // 其他线程归还的内存, 就地组成链表; size和type供对象池记回统计项
+    struct RemoteFree
+    {
+        RemoteFree *next;
+        uint32_t size;
+        uint32_t type;
+    };
+
+    // 每个线程的对象池或新生代各有一个, slab头和块头记录它, 释放时据此判断内存是否属于当前线程.
+    // 跨线程释放的内存挂到所属线程的remote链表上, 由所属线程在分配时回收;
+    // 所属线程退出后不再回收, 释放方在Lock下直接把内存还给系统, 最后一份归还后删除自身
+    struct SpaceOwner
+    {
+        static inline std::mutex Lock; // 跨线程释放与线程退出之间的交接
+        static inline SpaceOwner *Orphaned = nullptr; // 已退出线程的链表, 让仍存活的内存保持可达
+
+        bool Alive = true;
+        size_t Orphans = 0;        // 线程退出时仍未归还的对象或块数
+        void *Retained = nullptr;  // 线程退出时仍有存活对象的内存, 由所属的池或新生代串起
+        SpaceOwner *prev = nullptr;
+        SpaceOwner *next = nullptr;
+        std::atomic<RemoteFree *> remote{nullptr};
+
+        bool HasRemote() const
+        {
+            return remote.load(std::memory_order_relaxed) != nullptr;
+        }
+
+        RemoteFree *TakeRemote()
+        {
+            return remote.exchange(nullptr, std::memory_order_acquire);
+        }
+
+        void PushRemote(RemoteFree *node)
+        {
+            node->next = remote.load(std::memory_order_relaxed);
+            while (!remote.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        // 以下两个函数在持有Lock时调用
+        void Orphan(size_t orphans)
+        {
+            Alive = false;
+            Orphans = orphans;
+            if (orphans == 0)
+            {
+                delete this;
+                return;
+            }
+
+            next = Orphaned;
+            if (next != nullptr)
+            {
+                next->prev = this;
+            }
+            Orphaned = this;
+        }
+
+        void ReleaseOrphan()
+        {
+            if (--Orphans > 0)
+            {
+                return;
+            }
+
+            if (prev != nullptr)
+            {
+                prev->next = next;
+            }
+            else
+            {
+                Orphaned = next;
+            }
+            if (next != nullptr)
+            {
+                next->prev = prev;
+            }
+            delete this;
+        }
+    };
+}
+
+#endif // H_OWNER_H
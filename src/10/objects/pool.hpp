@@ -0,0 +1,501 @@
+#ifndef H_POOL_H
+#define H_POOL_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <utility>
+#include <typeinfo>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <cxxabi.h>
+
+#include "objects/owner.hpp"
+
+namespace objects
+{
+	// slab头, 位于按SlabSize对齐的slab起始处, 由对象地址即可找到
+	struct PoolSlab
+	{
+		PoolSlab *prev;
+		PoolSlab *next;
+		void *freeList;    // 已释放槽位组成的单链表
+		SpaceOwner *owner; // 分配它的线程
+		uint32_t sizeClass;
+		uint32_t live;
+		uint32_t capacity;
+		uint32_t bumped;   // 从未使用过的槽位从这里顺序切出
+	};
+
+	// 大对象和MONKEY_SYSTEM_ALLOCATOR下的对象前面的头
+	struct PoolLarge
+	{
+		SpaceOwner *owner;
+		size_t reserved; // 保持对象16字节对齐
+	};
+
+	struct PoolTypeInfo
+	{
+		const char *Name;
+		size_t Size;        // 实际分配的大小(allocate_shared时包含控制块)
+	};
+
+	struct PoolTypeStats
+	{
+		size_t Live;
+		size_t Allocations;
+	};
+
+	// 按大小分级的对象池: 每个级别维护有空闲槽位的slab链表, 槽位释放后进入所在slab的空闲链表,
+	// slab全部空闲后缓存起来供任意级别复用. 每个线程一个池, 其他线程释放的对象经SpaceOwner交还给分配它的池.
+	// 成员都是平凡类型, 线程退出时池不析构, 由PoolExit归还空闲的slab, 之后才释放的对象直接还给系统
+	struct PoolSpace
+	{
+		static const size_t SlabSize = 16 * 1024;
+		static const size_t Granularity = 16;
+		static const size_t MaxObjectSize = 256;
+		static const size_t ClassCount = MaxObjectSize / Granularity;
+		static const size_t HeaderSize = (sizeof(PoolSlab) + Granularity - 1) & ~(Granularity - 1);
+		static const size_t MaxEmptySlabs = 4;
+		static const size_t MaxTypes = 32;
+		static const size_t Other = MaxTypes - 1; // 类型登记满后共用的统计项
+
+		PoolSlab *partial[ClassCount] = {};
+		PoolSlab *emptySlabs[MaxEmptySlabs] = {};
+		size_t emptyCount = 0;
+		SpaceOwner *self = nullptr; // 第一次从系统取内存时创建
+		bool exiting = false;
+
+		// 类型登记在所有线程间共享, 同一类型在每个线程的池中使用同一个统计项
+		static inline PoolTypeInfo TypeInfo[MaxTypes] = {};
+		static inline std::atomic<size_t> TypeCount{0};
+		static inline std::mutex TypeLock;
+
+		PoolTypeStats Types[MaxTypes] = {};
+
+		size_t Slabs = 0;        // 从系统申请且尚未归还的slab数
+		size_t SlabReuses = 0;   // 复用空闲slab的次数
+		size_t SlotCapacity = 0; // 使用中的slab的槽位总数
+		size_t LiveSlots = 0;
+		size_t LiveLarge = 0;    // 不在slab中的存活对象数
+		size_t CurrentBytes = 0;
+		size_t PeakBytes = 0;
+
+		static size_t RegisterType(const char *name, size_t size)
+		{
+			std::lock_guard<std::mutex> lock(TypeLock);
+			size_t count = TypeCount.load(std::memory_order_relaxed);
+			if (count >= Other)
+			{
+				TypeInfo[Other].Name = "other";
+				return Other;
+			}
+
+			TypeInfo[count] = PoolTypeInfo{name, size};
+			TypeCount.store(count + 1, std::memory_order_release);
+			return count;
+		}
+
+		const PoolTypeStats *FindType(const char *name) const
+		{
+			for (size_t i = 0, count = TypeCount.load(std::memory_order_acquire); i < count; i++)
+			{
+				if (std::strcmp(TypeInfo[i].Name, name) == 0)
+				{
+					return &Types[i];
+				}
+			}
+			return nullptr;
+		}
+
+		double Utilization() const
+		{
+			return (SlotCapacity == 0) ? 0.0 : static_cast<double>(LiveSlots) / SlotCapacity;
+		}
+
+		void *Allocate(size_t size, size_t type)
+		{
+			if (self != nullptr && self->HasRemote())
+			{
+				collectRemote();
+			}
+
+			Types[type].Live += 1;
+			Types[type].Allocations += 1;
+
+			CurrentBytes += size;
+			if (CurrentBytes > PeakBytes)
+			{
+				PeakBytes = CurrentBytes;
+			}
+
+			if (inSlab(size))
+			{
+				return allocateSlot((size - 1) / Granularity);
+			}
+			return allocateLarge(size);
+		}
+
+		void Deallocate(void *p, size_t size, size_t type)
+		{
+			auto owner = inSlab(size) ? slabOf(p)->owner : largeOf(p)->owner;
+			if (owner != self)
+			{
+				freeRemote(owner, p, size, type);
+				return;
+			}
+			release(p, size, type);
+		}
+
+		static constexpr bool inSlab([[maybe_unused]] size_t size)
+		{
+#ifdef MONKEY_SYSTEM_ALLOCATOR
+			return false;
+#else
+			return size <= MaxObjectSize;
+#endif
+		}
+
+		static PoolSlab *slabOf(void *p)
+		{
+			return reinterpret_cast<PoolSlab *>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(SlabSize - 1));
+		}
+
+		static PoolLarge *largeOf(void *p)
+		{
+			return static_cast<PoolLarge *>(p) - 1;
+		}
+
+		// 归还本线程分配的对象
+		void release(void *p, size_t size, size_t type)
+		{
+			Types[type].Live -= 1;
+			CurrentBytes -= size;
+
+			if (inSlab(size))
+			{
+				freeSlot(p);
+				return;
+			}
+
+			LiveLarge -= 1;
+			::operator delete(largeOf(p));
+		}
+
+		void collectRemote()
+		{
+			for (auto node = self->TakeRemote(); node != nullptr;)
+			{
+				auto next = node->next;
+				release(node, node->size, node->type);
+				node = next;
+			}
+		}
+
+		// 其他线程分配的对象: 所属线程还在时交给它回收, 否则直接还给系统
+		static void freeRemote(SpaceOwner *owner, void *p, size_t size, size_t type)
+		{
+			std::lock_guard<std::mutex> lock(SpaceOwner::Lock);
+			if (owner->Alive)
+			{
+				owner->PushRemote(new (p) RemoteFree{nullptr, static_cast<uint32_t>(size), static_cast<uint32_t>(type)});
+				return;
+			}
+
+			if (inSlab(size))
+			{
+				auto slab = slabOf(p);
+				if (--slab->live == 0)
+				{
+					unretain(owner, slab);
+					std::free(slab);
+				}
+			}
+			else
+			{
+				::operator delete(largeOf(p));
+			}
+			owner->ReleaseOrphan();
+		}
+
+		// 线程退出后仍有存活对象的slab用prev/next串在owner->Retained上
+		static void unretain(SpaceOwner *owner, PoolSlab *slab)
+		{
+			if (slab->prev != nullptr)
+			{
+				slab->prev->next = slab->next;
+			}
+			else if (owner->Retained == slab)
+			{
+				owner->Retained = slab->next;
+			}
+			if (slab->next != nullptr)
+			{
+				slab->next->prev = slab->prev;
+			}
+		}
+
+		void ensureOwner();
+
+		void *allocateLarge(size_t size)
+		{
+			ensureOwner();
+			auto header = static_cast<PoolLarge *>(::operator new(sizeof(PoolLarge) + std::max(size, sizeof(RemoteFree))));
+			header->owner = self;
+			LiveLarge += 1;
+			return header + 1;
+		}
+
+		void *allocateSlot(size_t cls)
+		{
+			auto slab = partial[cls];
+			if (slab == nullptr)
+			{
+				slab = newSlab(cls);
+			}
+
+			void *p = slab->freeList;
+			if (p != nullptr)
+			{
+				slab->freeList = *static_cast<void **>(p);
+			}
+			else
+			{
+				p = reinterpret_cast<char *>(slab) + HeaderSize + slab->bumped * (cls + 1) * Granularity;
+				slab->bumped += 1;
+			}
+
+			slab->live += 1;
+			LiveSlots += 1;
+
+			if (slab->live == slab->capacity)
+			{
+				unlink(slab);
+			}
+
+			return p;
+		}
+
+		void freeSlot(void *p)
+		{
+			auto slab = slabOf(p);
+
+			*static_cast<void **>(p) = slab->freeList;
+			slab->freeList = p;
+
+			if (slab->live == slab->capacity)
+			{
+				link(slab);
+			}
+
+			slab->live -= 1;
+			LiveSlots -= 1;
+
+			// 每个级别至少保留一个slab, 避免单个对象反复分配释放时来回申请slab
+			if (slab->live > 0 || (partial[slab->sizeClass] == slab && slab->next == nullptr))
+			{
+				return;
+			}
+
+			unlink(slab);
+			SlotCapacity -= slab->capacity;
+
+			if (emptyCount < MaxEmptySlabs)
+			{
+				emptySlabs[emptyCount++] = slab;
+			}
+			else
+			{
+				std::free(slab);
+				Slabs -= 1;
+			}
+		}
+
+		PoolSlab *newSlab(size_t cls)
+		{
+			ensureOwner();
+
+			PoolSlab *slab;
+			if (emptyCount > 0)
+			{
+				slab = emptySlabs[--emptyCount];
+				SlabReuses += 1;
+			}
+			else
+			{
+				slab = static_cast<PoolSlab *>(std::aligned_alloc(SlabSize, SlabSize));
+				if (slab == nullptr)
+				{
+					throw std::bad_alloc();
+				}
+				Slabs += 1;
+			}
+
+			slab->prev = slab->next = nullptr;
+			slab->freeList = nullptr;
+			slab->owner = self;
+			slab->sizeClass = cls;
+			slab->live = 0;
+			slab->capacity = (SlabSize - HeaderSize) / ((cls + 1) * Granularity);
+			slab->bumped = 0;
+
+			SlotCapacity += slab->capacity;
+			link(slab);
+			return slab;
+		}
+
+		void link(PoolSlab *slab)
+		{
+			auto &head = partial[slab->sizeClass];
+			slab->prev = nullptr;
+			slab->next = head;
+			if (head != nullptr)
+			{
+				head->prev = slab;
+			}
+			head = slab;
+		}
+
+		void unlink(PoolSlab *slab)
+		{
+			if (slab->prev != nullptr)
+			{
+				slab->prev->next = slab->next;
+			}
+			else
+			{
+				partial[slab->sizeClass] = slab->next;
+			}
+
+			if (slab->next != nullptr)
+			{
+				slab->next->prev = slab->prev;
+			}
+			slab->prev = slab->next = nullptr;
+		}
+
+		// 线程退出时调用: 归还空闲的slab, 仍存活的对象留给释放它们的线程
+		void Trim()
+		{
+			std::lock_guard<std::mutex> lock(SpaceOwner::Lock);
+			exiting = true;
+			if (self == nullptr)
+			{
+				return;
+			}
+
+			collectRemote();
+			while (emptyCount > 0)
+			{
+				std::free(emptySlabs[--emptyCount]);
+				Slabs -= 1;
+			}
+			PoolSlab *retained = nullptr;
+			for (auto &head : partial)
+			{
+				for (auto slab = head; slab != nullptr;)
+				{
+					auto next = slab->next;
+					if (slab->live == 0)
+					{
+						std::free(slab);
+						Slabs -= 1;
+					}
+					else
+					{
+						slab->prev = nullptr;
+						slab->next = retained;
+						if (retained != nullptr)
+						{
+							retained->prev = slab;
+						}
+						retained = slab;
+					}
+					slab = next;
+				}
+				head = nullptr;
+			}
+			self->Retained = retained;
+
+			self->Orphan(LiveSlots + LiveLarge);
+			self = nullptr;
+		}
+	};
+
+	thread_local PoolSpace Pool;
+
+	struct PoolExit
+	{
+		~PoolExit() { Pool.Trim(); }
+	};
+
+	void PoolSpace::ensureOwner()
+	{
+		if (self != nullptr)
+		{
+			return;
+		}
+
+		self = new SpaceOwner();
+		if (!exiting)
+		{
+			// 首次取内存时登记, 线程退出时析构
+			thread_local PoolExit guard;
+			(void)guard;
+		}
+	}
+
+	template <typename T>
+	const char *poolTypeName()
+	{
+		int status = 0;
+		char *name = abi::__cxa_demangle(typeid(T).name(), nullptr, nullptr, &status);
+		return (status == 0) ? name : typeid(T).name();
+	}
+
+	// U是实际分配的类型, 统计按Tag登记
+	template <typename U, typename Tag>
+	size_t poolTypeIndex()
+	{
+		static const size_t index = PoolSpace::RegisterType(poolTypeName<Tag>(), sizeof(U));
+		return index;
+	}
+
+	// 可用于std::allocate_shared: rebind时Tag保持不变, 因此控制块的分配仍统计在原类型名下
+	template <typename T, typename Tag = T>
+	struct PoolAllocator
+	{
+		using value_type = T;
+
+		PoolAllocator() {}
+		template <typename U>
+		PoolAllocator([[maybe_unused]] const PoolAllocator<U, Tag> &other) {}
+
+		T *allocate(size_t n)
+		{
+			return static_cast<T *>(Pool.Allocate(n * sizeof(T), poolTypeIndex<T, Tag>()));
+		}
+
+		void deallocate(T *p, size_t n)
+		{
+			Pool.Deallocate(p, n * sizeof(T), poolTypeIndex<T, Tag>());
+		}
+
+		template <typename U>
+		bool operator==([[maybe_unused]] const PoolAllocator<U, Tag> &other) const { return true; }
+		template <typename U>
+		bool operator!=([[maybe_unused]] const PoolAllocator<U, Tag> &other) const { return false; }
+	};
+
+	// 总是以std::shared_ptr持有的类型(Environment, HashPair)从池中分配
+	template <typename T, typename... Args>
+	std::shared_ptr<T> makePooledShared(Args &&...args)
+	{
+		return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+	}
+}
+
+#endif // H_POOL_H
@@ -0,0 +1,280 @@
+#ifndef H_REF_H
+#define H_REF_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <limits>
+
+#include "objects/nursery.hpp"
+#include "objects/pool.hpp"
+
+namespace objects
+{
+    // 运行时对象的句柄类型Ref<T>.
+    // 默认就是std::shared_ptr; 定义MONKEY_INTRUSIVE_REFCOUNT后改为嵌入对象头部的非原子引用计数,
+    // 句柄只有一个指针大小, 复制时不做原子操作. 这种模式下对象只能在创建它的线程中使用
+#ifdef MONKEY_INTRUSIVE_REFCOUNT
+
+    enum class RefOrigin : uint8_t
+    {
+        Heap,
+        Nursery,
+        Pool,
+    };
+
+    struct RefCounted
+    {
+        uint32_t RefCount = 0;
+        RefOrigin Origin = RefOrigin::Heap;
+        bool Immortal = false; // 不朽对象跳过引用计数的读写, 永不释放
+        uint8_t PoolType = 0;  // 从对象池分配时的类型统计项
+
+        RefCounted() {}
+        // 复制对象内容时不复制引用计数
+        RefCounted([[maybe_unused]] const RefCounted &other) {}
+        RefCounted &operator=([[maybe_unused]] const RefCounted &other) { return *this; }
+    };
+
+    template <typename T>
+    void destroyRef(T *obj)
+    {
+        if (obj->Origin == RefOrigin::Nursery)
+        {
+            void *mem = dynamic_cast<void *>(obj);
+            obj->~T();
+            Nursery.Release(mem);
+        }
+        else if (obj->Origin == RefOrigin::Pool)
+        {
+            void *mem = dynamic_cast<void *>(obj);
+            size_t type = obj->PoolType;
+            obj->~T();
+            Pool.Deallocate(mem, PoolSpace::TypeInfo[type].Size, type);
+        }
+        else
+        {
+            delete obj;
+        }
+    }
+
+    template <typename T>
+    struct IntrusivePtr
+    {
+        T *ptr = nullptr;
+
+        IntrusivePtr() {}
+        IntrusivePtr(std::nullptr_t) {}
+        explicit IntrusivePtr(T *p) : ptr(p) { retain(); }
+        IntrusivePtr(const IntrusivePtr &other) : ptr(other.ptr) { retain(); }
+        IntrusivePtr(IntrusivePtr &&other) noexcept : ptr(other.ptr) { other.ptr = nullptr; }
+
+        template <typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+        IntrusivePtr(const IntrusivePtr<U> &other) : ptr(other.ptr) { retain(); }
+
+        template <typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+        IntrusivePtr(IntrusivePtr<U> &&other) noexcept : ptr(other.ptr) { other.ptr = nullptr; }
+
+        ~IntrusivePtr() { release(); }
+
+        IntrusivePtr &operator=(IntrusivePtr other) noexcept
+        {
+            std::swap(ptr, other.ptr);
+            return *this;
+        }
+
+        T *get() const { return ptr; }
+        T &operator*() const { return *ptr; }
+        T *operator->() const { return ptr; }
+        explicit operator bool() const { return (ptr != nullptr); }
+
+        long use_count() const
+        {
+            if (ptr == nullptr)
+            {
+                return 0;
+            }
+            return ptr->Immortal ? std::numeric_limits<uint32_t>::max() : ptr->RefCount;
+        }
+
+        void reset()
+        {
+            release();
+            ptr = nullptr;
+        }
+
+        void retain()
+        {
+            if (ptr != nullptr && !ptr->Immortal)
+            {
+                ptr->RefCount += 1;
+            }
+        }
+
+        void release()
+        {
+            if (ptr != nullptr && !ptr->Immortal && --ptr->RefCount == 0)
+            {
+                destroyRef(ptr);
+            }
+        }
+    };
+
+    template <typename T, typename U>
+    bool operator==(const IntrusivePtr<T> &lhs, const IntrusivePtr<U> &rhs) { return (lhs.get() == rhs.get()); }
+    template <typename T, typename U>
+    bool operator!=(const IntrusivePtr<T> &lhs, const IntrusivePtr<U> &rhs) { return (lhs.get() != rhs.get()); }
+    template <typename T>
+    bool operator==(const IntrusivePtr<T> &lhs, std::nullptr_t) { return (lhs.get() == nullptr); }
+    template <typename T>
+    bool operator!=(const IntrusivePtr<T> &lhs, std::nullptr_t) { return (lhs.get() != nullptr); }
+    template <typename T>
+    bool operator==(std::nullptr_t, const IntrusivePtr<T> &rhs) { return (rhs.get() == nullptr); }
+    template <typename T>
+    bool operator!=(std::nullptr_t, const IntrusivePtr<T> &rhs) { return (rhs.get() != nullptr); }
+
+    template <typename T>
+    using Ref = IntrusivePtr<T>;
+
+    template <typename T, typename... Args>
+    Ref<T> makeRef(Args &&...args)
+    {
+        return Ref<T>(new T(std::forward<Args>(args)...));
+    }
+
+    template <typename T, typename U>
+    Ref<T> refCast(const Ref<U> &ref)
+    {
+        return Ref<T>(dynamic_cast<T *>(ref.get()));
+    }
+
+    template <typename T, typename U>
+    Ref<T> staticRefCast(const Ref<U> &ref)
+    {
+        return Ref<T>(static_cast<T *>(ref.get()));
+    }
+
+    // 标记为不朽: 之后句柄的复制和销毁都不再触碰该对象的引用计数
+    template <typename T>
+    Ref<T> makeImmortal(Ref<T> ref)
+    {
+        if (ref != nullptr)
+        {
+            ref->Immortal = true;
+        }
+        return ref;
+    }
+
+    // 分配大概率很快死亡的临时对象
+    template <typename T, typename... Args>
+    Ref<T> makeYoung(Args &&...args)
+    {
+        if constexpr (!NurserySpace::Enabled || sizeof(T) > NurserySpace::MaxObjectSize)
+        {
+            return makeRef<T>(std::forward<Args>(args)...);
+        }
+        else
+        {
+            void *mem = Nursery.Allocate(sizeof(T), alignof(T));
+            T *obj;
+            try
+            {
+                obj = new (mem) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                Nursery.Release(mem);
+                throw;
+            }
+            obj->Origin = RefOrigin::Nursery;
+            return Ref<T>(obj);
+        }
+    }
+
+    // 从当前线程的对象池分配长期存活的运行时对象
+    template <typename T, typename... Args>
+    Ref<T> makePooled(Args &&...args)
+    {
+        const size_t type = poolTypeIndex<T, T>();
+        if (type == PoolSpace::Other)
+        {
+            return makeRef<T>(std::forward<Args>(args)...);
+        }
+
+        void *mem = Pool.Allocate(sizeof(T), type);
+        T *obj;
+        try
+        {
+            obj = new (mem) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            Pool.Deallocate(mem, sizeof(T), type);
+            throw;
+        }
+        obj->Origin = RefOrigin::Pool;
+        obj->PoolType = static_cast<uint8_t>(type);
+        return Ref<T>(obj);
+    }
+
+#else
+
+    struct RefCounted
+    {
+    };
+
+    template <typename T>
+    using Ref = std::shared_ptr<T>;
+
+    template <typename T, typename... Args>
+    Ref<T> makeRef(Args &&...args)
+    {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+
+    // shared_ptr无法跳过计数, 不朽标记没有收益, 对象照常随最后一个持有者(常量池等)释放
+    template <typename T>
+    Ref<T> makeImmortal(Ref<T> ref)
+    {
+        return ref;
+    }
+
+    template <typename T, typename U>
+    Ref<T> refCast(const Ref<U> &ref)
+    {
+        return std::dynamic_pointer_cast<T>(ref);
+    }
+
+    template <typename T, typename U>
+    Ref<T> staticRefCast(const Ref<U> &ref)
+    {
+        return std::static_pointer_cast<T>(ref);
+    }
+
+    // 分配大概率很快死亡的临时对象, 对象与控制块一起放入新生代
+    template <typename T, typename... Args>
+    Ref<T> makeYoung(Args &&...args)
+    {
+        if constexpr (!NurserySpace::Enabled)
+        {
+            return makeRef<T>(std::forward<Args>(args)...);
+        }
+        else
+        {
+            return std::allocate_shared<T>(NurseryAllocator<T>(), std::forward<Args>(args)...);
+        }
+    }
+
+    // 从当前线程的对象池分配长期存活的运行时对象, 对象与控制块一起放入池中
+    template <typename T, typename... Args>
+    Ref<T> makePooled(Args &&...args)
+    {
+        return makePooledShared<T>(std::forward<Args>(args)...);
+    }
+
+#endif
+}
+
+#endif // H_REF_H
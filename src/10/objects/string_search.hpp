@@ -0,0 +1,91 @@
+#ifndef H_STRING_SEARCH_H
+#define H_STRING_SEARCH_H
+
+#include <string>
+#include <string_view>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace objects
+{
+    const size_t NotFound = std::string_view::npos;
+
+    // 单字节查找交给memchr, glibc已用SIMD实现
+    size_t findByte(std::string_view haystack, char c, size_t from = 0)
+    {
+        if (from >= haystack.size())
+        {
+            return NotFound;
+        }
+
+        auto p = static_cast<const char *>(memchr(haystack.data() + from, c, haystack.size() - from));
+        return (p == nullptr) ? NotFound : static_cast<size_t>(p - haystack.data());
+    }
+
+    // 子串查找: 每次比较16个候选位置的首尾字节, 两者都命中的位置才做完整比较
+    size_t findSubstring(std::string_view haystack, std::string_view needle, size_t from = 0)
+    {
+        const size_t n = haystack.size();
+        const size_t k = needle.size();
+
+        if (k == 0)
+        {
+            return (from <= n) ? from : NotFound;
+        }
+        else if (k == 1)
+        {
+            return findByte(haystack, needle[0], from);
+        }
+        else if (from > n || k > n - from)
+        {
+            return NotFound;
+        }
+
+        const char *h = haystack.data();
+        const char *s = needle.data();
+        size_t i = from;
+
+#if defined(__SSE2__)
+        const __m128i first = _mm_set1_epi8(s[0]);
+        const __m128i last = _mm_set1_epi8(s[k - 1]);
+
+        for (; i + k - 1 + 16 <= n; i += 16)
+        {
+            const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i));
+            const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i + k - 1));
+
+            unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                                            _mm_cmpeq_epi8(last, blockLast)));
+            while (mask != 0)
+            {
+                const unsigned bit = __builtin_ctz(mask);
+                if (memcmp(h + i + bit + 1, s + 1, k - 2) == 0)
+                {
+                    return i + bit;
+                }
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        for (; i + k <= n; i++)
+        {
+            if (h[i] == s[0] && h[i + k - 1] == s[k - 1] && memcmp(h + i + 1, s + 1, k - 2) == 0)
+            {
+                return i;
+            }
+        }
+
+        return NotFound;
+    }
+
+    bool isSpace(char c)
+    {
+        return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+    }
+}
+
+#endif // H_STRING_SEARCH_H
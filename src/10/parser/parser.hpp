@@ -6,6 +6,7 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <algorithm>
 
 #include "lexer/lexer.hpp"
 #include "token/token.hpp"
@@ -51,6 +52,13 @@ namespace parser
         std::map<token::TokenType, prefixParseFn> prefixParseFns;
         std::map<token::TokenType, infixParseFn> infixParseFns;
 
+        bool UseArena = true; // 关闭后每个节点单独在堆上分配
+        std::shared_ptr<ast::Arena> pArena;
+
+        bool Preparse = false; // 函数体只做括号匹配, 第一次编译或求值时才解析
+        std::shared_ptr<const std::string> source; // 跳过的函数体共享的源码
+        int sourceBase = 0;                        // 词法分析器输入在source中的起始位置
+
         Parser()
         {
         }
@@ -93,6 +101,16 @@ namespace parser
             }
         }
 
+        template <typename T, typename... Args>
+        std::shared_ptr<T> newNode(Args &&...args)
+        {
+            if (pArena != nullptr)
+            {
+                return pArena->Make<T>(std::forward<Args>(args)...);
+            }
+            return std::make_shared<T>(std::forward<Args>(args)...);
+        }
+
         std::vector<std::string> Errors()
         {
             return errors;
@@ -115,6 +133,11 @@ namespace parser
             std::unique_ptr<ast::Program> pProgram = std::make_unique<ast::Program>();
             pProgram->v_pStatements.clear();
 
+            if (UseArena)
+            {
+                pArena = std::make_shared<ast::Arena>();
+            }
+
             while (!curTokenIs(token::types::EndOF))
             {
                 std::shared_ptr<ast::Statement> pStmt{parseStatement()};
@@ -125,6 +148,8 @@ namespace parser
                 }
                 nextToken();
             }
+
+            pProgram->pArena = std::move(pArena);
             return pProgram;
         }
 
@@ -146,7 +171,7 @@ namespace parser
 
         std::shared_ptr<ast::LetStatement> parseLetStatement()
         {
-            std::shared_ptr<ast::LetStatement> pStmt = std::make_shared<ast::LetStatement>();
+            std::shared_ptr<ast::LetStatement> pStmt = newNode<ast::LetStatement>();
             pStmt->Token = curToken;
 
             if (!expectPeek(token::types::IDENT))
@@ -154,7 +179,7 @@ namespace parser
                 return nullptr;
             }
 
-            pStmt->pName = std::make_shared<ast::Identifier>(curToken, curToken.Literal);
+            pStmt->pName = newNode<ast::Identifier>(curToken, curToken.Literal);
 
             if (!expectPeek(token::types::ASSIGN))
             {
@@ -164,7 +189,7 @@ namespace parser
 
             pStmt->pValue = parseExpression(Priority::LOWEST);
 
-            if(pStmt->pValue->GetNodeType() == ast::NodeType::FunctionLiteral)
+            if(pStmt->pValue != nullptr && pStmt->pValue->GetNodeType() == ast::NodeType::FunctionLiteral)
             {
                 auto fl = std::dynamic_pointer_cast<ast::FunctionLiteral>(pStmt->pValue);
                 fl->Name = pStmt->pName->Value;
@@ -180,7 +205,7 @@ namespace parser
 
         std::shared_ptr<ast::ReturnStatement> parseReturnStatement()
         {
-            std::shared_ptr<ast::ReturnStatement> pStmt = std::make_shared<ast::ReturnStatement>(curToken);
+            std::shared_ptr<ast::ReturnStatement> pStmt = newNode<ast::ReturnStatement>(curToken);
             nextToken();
             pStmt->pReturnValue = parseExpression(Priority::LOWEST);
             if (peekTokenIs(token::types::SEMICOLON))
@@ -192,7 +217,7 @@ namespace parser
 
         std::shared_ptr<ast::ExpressionStatement> parseExpressionStatement()
         {
-            std::shared_ptr<ast::ExpressionStatement> pStmt = std::make_shared<ast::ExpressionStatement>(curToken);
+            std::shared_ptr<ast::ExpressionStatement> pStmt = newNode<ast::ExpressionStatement>(curToken);
             pStmt->pExpression = parseExpression(Priority::LOWEST);
             if (peekTokenIs(token::types::SEMICOLON))
             {
@@ -248,13 +273,13 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseIdentifier()
         {
-            std::shared_ptr<ast::Identifier> pStmt = std::make_shared<ast::Identifier>(curToken, curToken.Literal);
+            std::shared_ptr<ast::Identifier> pStmt = newNode<ast::Identifier>(curToken, curToken.Literal);
             return pStmt;
         }
 
         std::shared_ptr<ast::Expression> parseIntegerLiteral()
         {
-            std::shared_ptr<ast::IntegerLiteral> pLit = std::make_shared<ast::IntegerLiteral>(curToken);
+            std::shared_ptr<ast::IntegerLiteral> pLit = newNode<ast::IntegerLiteral>(curToken);
 
             try
             {
@@ -273,7 +298,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseStringLiteral()
         {
-            std::shared_ptr<ast::StringLiteral> pStr = std::make_shared<ast::StringLiteral>(curToken);
+            std::shared_ptr<ast::StringLiteral> pStr = newNode<ast::StringLiteral>(curToken);
 
             return pStr;
         }
@@ -308,7 +333,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseArrayLiteral()
         {
-            std::shared_ptr<ast::ArrayLiteral> pArray = std::make_shared<ast::ArrayLiteral>(curToken);
+            std::shared_ptr<ast::ArrayLiteral> pArray = newNode<ast::ArrayLiteral>(curToken);
             pArray->Elements = parseExpressionList(token::types::RBRACKET);
 
             return pArray;
@@ -316,7 +341,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseHashLiteral()
         {
-            std::shared_ptr<ast::HashLiteral> pHash = std::make_shared<ast::HashLiteral>(curToken);
+            std::shared_ptr<ast::HashLiteral> pHash = newNode<ast::HashLiteral>(curToken);
             
             while(!peekTokenIs(token::types::RBRACE))
             {
@@ -350,7 +375,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parsePrefixExpression()
         {
-            std::shared_ptr<ast::PrefixExpression> pExpression = std::make_shared<ast::PrefixExpression>(curToken, curToken.Literal);
+            std::shared_ptr<ast::PrefixExpression> pExpression = newNode<ast::PrefixExpression>(curToken, curToken.Literal);
             nextToken();
             pExpression->pRight = parseExpression(Priority::PREFIX);
             return pExpression;
@@ -358,7 +383,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseInfixExpression(std::shared_ptr<ast::Expression> left)
         {
-            std::shared_ptr<ast::InfixExpression> pExpression = std::make_shared<ast::InfixExpression>(curToken, curToken.Literal, left);
+            std::shared_ptr<ast::InfixExpression> pExpression = newNode<ast::InfixExpression>(curToken, curToken.Literal, left);
             Priority precedence = curPrecedence();
             nextToken();
             pExpression->pRight = parseExpression(precedence);
@@ -367,7 +392,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseBoolean()
         {
-            std::shared_ptr<ast::Boolean> pStmt = std::make_shared<ast::Boolean>(curToken, curTokenIs(token::types::TRUE));
+            std::shared_ptr<ast::Boolean> pStmt = newNode<ast::Boolean>(curToken, curTokenIs(token::types::TRUE));
             return pStmt;
         }
 
@@ -384,7 +409,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseIfExpression()
         {
-            std::shared_ptr<ast::IfExpression> pExpression = std::make_shared<ast::IfExpression>(curToken);
+            std::shared_ptr<ast::IfExpression> pExpression = newNode<ast::IfExpression>(curToken);
             if (!expectPeek(token::types::LPAREN))
             {
                 return nullptr;
@@ -414,7 +439,7 @@ namespace parser
 
         std::shared_ptr<ast::BlockStatement> parseBlockStatement()
         {
-            std::shared_ptr<ast::BlockStatement> pBlock = std::make_shared<ast::BlockStatement>(curToken);
+            std::shared_ptr<ast::BlockStatement> pBlock = newNode<ast::BlockStatement>(curToken);
             nextToken();
             while (!curTokenIs(token::types::RBRACE) && !curTokenIs(token::types::EndOF))
             {
@@ -431,13 +456,19 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseFunctionLiteral()
         {
-            std::shared_ptr<ast::FunctionLiteral> pLit = std::make_shared<ast::FunctionLiteral>(curToken);
+            std::shared_ptr<ast::FunctionLiteral> pLit = newNode<ast::FunctionLiteral>(curToken);
+            pLit->pArena = pArena.get();
             if (!expectPeek(token::types::LPAREN))
             {
                 return nullptr;
             }
             pLit->v_pParameters = parseFunctionParameters();
 
+            if (Preparse && peekTokenIs(token::types::LBRACE))
+            {
+                return skipFunctionBody(pLit) ? pLit : nullptr;
+            }
+
             if (!expectPeek(token::types::LBRACE))
             {
                 return nullptr;
@@ -448,6 +479,9 @@ namespace parser
             return pLit;
         }
 
+        // peekToken是函数体的'{', 词法分析器刚好停在它后面; 跳过后curToken是结尾的'}'
+        bool skipFunctionBody(const std::shared_ptr<ast::FunctionLiteral> &pLit);
+
         std::vector<std::shared_ptr<ast::Identifier>> parseFunctionParameters()
         {
             std::vector<std::shared_ptr<ast::Identifier>> v_pIdentifiers{};
@@ -458,14 +492,14 @@ namespace parser
                 return v_pIdentifiers;
             }
             nextToken();
-            std::shared_ptr<ast::Identifier> pIdent = std::make_shared<ast::Identifier>(curToken, curToken.Literal);
+            std::shared_ptr<ast::Identifier> pIdent = newNode<ast::Identifier>(curToken, curToken.Literal);
             v_pIdentifiers.push_back(pIdent);
 
             while (peekTokenIs(token::types::COMMA))
             {
                 nextToken();
                 nextToken();
-                std::shared_ptr<ast::Identifier> pIdent = std::make_shared<ast::Identifier>(curToken, curToken.Literal);
+                std::shared_ptr<ast::Identifier> pIdent = newNode<ast::Identifier>(curToken, curToken.Literal);
                 v_pIdentifiers.push_back(pIdent);
             }
             if (!expectPeek(token::types::RPAREN))
@@ -477,7 +511,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseCallExpression(std::shared_ptr<ast::Expression> function)
         {
-            std::shared_ptr<ast::CallExpression> pExp = std::make_shared<ast::CallExpression>(curToken, function);
+            std::shared_ptr<ast::CallExpression> pExp = newNode<ast::CallExpression>(curToken, function);
             //pExp->pArguments = parseCallArguments();
             pExp->pArguments = parseExpressionList(token::types::RPAREN);
             return pExp;
@@ -485,7 +519,7 @@ namespace parser
 
         std::shared_ptr<ast::Expression> parseIndexExpression(std::shared_ptr<ast::Expression> left)
         {
-            std::shared_ptr<ast::IndexExpression> pExp = std::make_shared<ast::IndexExpression>(curToken, left);
+            std::shared_ptr<ast::IndexExpression> pExp = newNode<ast::IndexExpression>(curToken, left);
             nextToken();
             pExp->Index = parseExpression(Priority::LOWEST);
 
@@ -569,6 +603,58 @@ namespace parser
         return pParser;
     }
 
+    // 解析预解析时跳过的函数体, 其中嵌套的函数体继续跳过
+    std::string parseSkippedBody(ast::FunctionLiteral &fn)
+    {
+        auto &skipped = *fn.pSkipped;
+        auto pParser = New(lexer::New(skipped.Source->substr(skipped.Begin, skipped.End - skipped.Begin)));
+        pParser->Preparse = true;
+        pParser->source = skipped.Source;
+        pParser->sourceBase = skipped.Begin;
+        pParser->pArena = std::make_shared<ast::Arena>();
+
+        auto pBody = pParser->parseBlockStatement();
+        if (!pParser->errors.empty())
+        {
+            return ast::Join(pParser->errors, "\n");
+        }
+
+        fn.pBody = pParser->pArena->Retain(pBody);
+        return "";
+    }
+
+    bool Parser::skipFunctionBody(const std::shared_ptr<ast::FunctionLiteral> &pLit)
+    {
+        if (source == nullptr)
+        {
+            source = std::make_shared<const std::string>(pLexer->input);
+        }
+
+        auto skipped = std::make_shared<ast::SkippedBody>();
+        skipped->Source = source;
+        skipped->Begin = sourceBase + pLexer->position - 1;
+        if (!pLexer->SkipBlock(skipped->Names, skipped->Declared))
+        {
+            errors.push_back("expected next token to be }, got EOF instead");
+            curToken = peekToken = pLexer->NextToken();
+            return false;
+        }
+        skipped->End = sourceBase + pLexer->position;
+
+        for (auto names : {&skipped->Names, &skipped->Declared})
+        {
+            std::sort(names->begin(), names->end());
+            names->erase(std::unique(names->begin(), names->end()), names->end());
+        }
+
+        skipped->Parse = &parseSkippedBody;
+        pLit->pSkipped = std::move(skipped);
+
+        curToken = lexer::newToken(token::types::RBRACE, '}');
+        peekToken = pLexer->NextToken();
+        return true;
+    }
+
 }
 
 #endif // H_PARSER_H
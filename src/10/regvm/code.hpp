@@ -0,0 +1,228 @@
+#ifndef H_REGVM_CODE_H
+#define H_REGVM_CODE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+
+#include "code/code.hpp"
+
+// 基于寄存器的三地址指令: 每个函数帧有一组寄存器, 局部变量固定占用前面的寄存器,
+// 临时值紧随其后. 操作数种类: R寄存器(1字节), N计数或下标(1字节), K常量/全局变量下标或跳转目标(2字节, 大端)
+namespace regvm
+{
+    enum class OpcodeType : bytecode::Opcode
+    {
+        OpMove = 0,       // R[A] = R[B]
+        OpLoadConstant,   // R[A] = K
+        OpLoadTrue,
+        OpLoadFalse,
+        OpLoadNull,
+
+        OpAdd,            // R[A] = R[B] + R[C]
+        OpSub,
+        OpMul,
+        OpDiv,
+
+        OpEqual,          // R[A] = R[B] == R[C]
+        OpNotEqual,
+        OpGreaterThan,
+
+        OpMinus,          // R[A] = -R[B]
+        OpBang,
+
+        OpJump,
+        OpJumpNotTruthy,  // if !R[A] goto K
+        OpJumpNotEqual,   // if !(R[A] == R[B]) goto K
+        OpJumpEqual,      // if !(R[A] != R[B]) goto K
+        OpJumpNotGreater, // if !(R[A] > R[B]) goto K
+
+        OpGetGlobal,      // R[A] = G[K]
+        OpSetGlobal,      // G[K] = R[A]
+        OpGetBuiltin,
+        OpGetFree,
+        OpCurrentClosure,
+
+        OpArray,          // R[A] = [R[B], ..., R[B+K-1]]
+        OpHash,
+        OpArrayAppend,    // R[A]中刚建好的数组追加R[B], ..., R[B+K-1]
+        OpHashInsert,     // R[A]中刚建好的哈希表加入R[B], ..., R[B+K-1]中的键值对
+        OpIndex,          // R[A] = R[B][R[C]]
+
+        OpCall,           // R[A] = R[B](R[B+1], ..., R[B+N]), 被调用函数的帧从R[B+1]开始
+        OpReturnValue,
+        OpReturn,
+
+        OpClosure,        // R[A] = closure(K, R[B], ..., R[B+N-1])
+        OpPop,            // 顶层表达式语句的结果
+    };
+
+    struct Definition
+    {
+        std::string Name;
+        std::string Operands; // 每个字符是一个操作数: 'R', 'N' 或 'K'
+
+        Definition(const std::string &name, const std::string &operands) : Name(name), Operands(operands) {}
+
+        int Length() const
+        {
+            int length = 1;
+            for (auto kind : Operands)
+            {
+                length += (kind == 'K') ? 2 : 1;
+            }
+            return length;
+        }
+    };
+
+    static const std::map<OpcodeType, std::shared_ptr<Definition>> definitions{
+        {OpcodeType::OpMove, std::make_shared<Definition>("OpMove", "RR")},
+        {OpcodeType::OpLoadConstant, std::make_shared<Definition>("OpLoadConstant", "RK")},
+        {OpcodeType::OpLoadTrue, std::make_shared<Definition>("OpLoadTrue", "R")},
+        {OpcodeType::OpLoadFalse, std::make_shared<Definition>("OpLoadFalse", "R")},
+        {OpcodeType::OpLoadNull, std::make_shared<Definition>("OpLoadNull", "R")},
+
+        {OpcodeType::OpAdd, std::make_shared<Definition>("OpAdd", "RRR")},
+        {OpcodeType::OpSub, std::make_shared<Definition>("OpSub", "RRR")},
+        {OpcodeType::OpMul, std::make_shared<Definition>("OpMul", "RRR")},
+        {OpcodeType::OpDiv, std::make_shared<Definition>("OpDiv", "RRR")},
+
+        {OpcodeType::OpEqual, std::make_shared<Definition>("OpEqual", "RRR")},
+        {OpcodeType::OpNotEqual, std::make_shared<Definition>("OpNotEqual", "RRR")},
+        {OpcodeType::OpGreaterThan, std::make_shared<Definition>("OpGreaterThan", "RRR")},
+
+        {OpcodeType::OpMinus, std::make_shared<Definition>("OpMinus", "RR")},
+        {OpcodeType::OpBang, std::make_shared<Definition>("OpBang", "RR")},
+
+        {OpcodeType::OpJump, std::make_shared<Definition>("OpJump", "K")},
+        {OpcodeType::OpJumpNotTruthy, std::make_shared<Definition>("OpJumpNotTruthy", "RK")},
+        {OpcodeType::OpJumpNotEqual, std::make_shared<Definition>("OpJumpNotEqual", "RRK")},
+        {OpcodeType::OpJumpEqual, std::make_shared<Definition>("OpJumpEqual", "RRK")},
+        {OpcodeType::OpJumpNotGreater, std::make_shared<Definition>("OpJumpNotGreater", "RRK")},
+
+        {OpcodeType::OpGetGlobal, std::make_shared<Definition>("OpGetGlobal", "RK")},
+        {OpcodeType::OpSetGlobal, std::make_shared<Definition>("OpSetGlobal", "KR")},
+        {OpcodeType::OpGetBuiltin, std::make_shared<Definition>("OpGetBuiltin", "RN")},
+        {OpcodeType::OpGetFree, std::make_shared<Definition>("OpGetFree", "RN")},
+        {OpcodeType::OpCurrentClosure, std::make_shared<Definition>("OpCurrentClosure", "R")},
+
+        {OpcodeType::OpArray, std::make_shared<Definition>("OpArray", "RRK")},
+        {OpcodeType::OpHash, std::make_shared<Definition>("OpHash", "RRK")},
+        {OpcodeType::OpArrayAppend, std::make_shared<Definition>("OpArrayAppend", "RRK")},
+        {OpcodeType::OpHashInsert, std::make_shared<Definition>("OpHashInsert", "RRK")},
+        {OpcodeType::OpIndex, std::make_shared<Definition>("OpIndex", "RRR")},
+
+        {OpcodeType::OpCall, std::make_shared<Definition>("OpCall", "RRN")},
+        {OpcodeType::OpReturnValue, std::make_shared<Definition>("OpReturnValue", "R")},
+        {OpcodeType::OpReturn, std::make_shared<Definition>("OpReturn", "")},
+
+        {OpcodeType::OpClosure, std::make_shared<Definition>("OpClosure", "RKRN")},
+        {OpcodeType::OpPop, std::make_shared<Definition>("OpPop", "R")},
+    };
+
+    std::shared_ptr<Definition> Lookup(OpcodeType op)
+    {
+        auto fit = definitions.find(op);
+        if (fit == definitions.end())
+        {
+            return nullptr;
+        }
+        return fit->second;
+    }
+
+    inline int ReadUint16(const bytecode::Opcode *ins, int offset)
+    {
+        return (static_cast<int>(ins[offset]) << 8) | ins[offset + 1];
+    }
+
+    bytecode::Instructions Make(OpcodeType op, std::vector<int> operands)
+    {
+        auto def = Lookup(op);
+        if (def == nullptr)
+        {
+            return bytecode::Instructions{};
+        }
+
+        bytecode::Instructions instruction(def->Length());
+        instruction[0] = static_cast<bytecode::Opcode>(op);
+
+        int offset = 1;
+        for (unsigned long i = 0; i < operands.size() && i < def->Operands.size(); i++)
+        {
+            if (def->Operands[i] == 'K')
+            {
+                instruction[offset] = static_cast<bytecode::Opcode>((operands[i] >> 8) & 0xFF);
+                instruction[offset + 1] = static_cast<bytecode::Opcode>(operands[i] & 0xFF);
+                offset += 2;
+            }
+            else
+            {
+                instruction[offset] = static_cast<bytecode::Opcode>(operands[i]);
+                offset += 1;
+            }
+        }
+
+        return instruction;
+    }
+
+    // 指令条数, 供和栈式字节码比较
+    int InstructionCount(const bytecode::Instructions &ins)
+    {
+        int count = 0;
+        for (int i = 0, size = ins.size(); i < size; count++)
+        {
+            auto def = Lookup(static_cast<OpcodeType>(ins[i]));
+            if (def == nullptr)
+            {
+                break;
+            }
+            i += def->Length();
+        }
+        return count;
+    }
+
+    std::string InstructionsString(const bytecode::Instructions &ins)
+    {
+        std::stringstream oss;
+
+        int i = 0, size = ins.size();
+        while (i < size)
+        {
+            auto def = Lookup(static_cast<OpcodeType>(ins[i]));
+            if (def == nullptr)
+            {
+                oss << "ERROR: can not Lookup this: " << unsigned(ins[i]) << "\n";
+                i += 1;
+                continue;
+            }
+
+            oss << std::setw(4) << std::setfill('0') << i << " " << def->Name;
+
+            int offset = i + 1;
+            for (auto kind : def->Operands)
+            {
+                if (kind == 'K')
+                {
+                    oss << " " << ReadUint16(ins.data(), offset);
+                    offset += 2;
+                }
+                else
+                {
+                    oss << " " << (kind == 'R' ? "r" : "") << unsigned(ins[offset]);
+                    offset += 1;
+                }
+            }
+            oss << "\n";
+
+            i += def->Length();
+        }
+
+        return oss.str();
+    }
+}
+
+#endif // H_REGVM_CODE_H
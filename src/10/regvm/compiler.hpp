@@ -0,0 +1,871 @@
+#ifndef H_REGVM_COMPILER_H
+#define H_REGVM_COMPILER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "ast/ast.hpp"
+#include "objects/objects.hpp"
+#include "objects/builtins.hpp"
+#include "compiler/symbol_table.hpp"
+#include "regvm/code.hpp"
+
+namespace regvm
+{
+    const int MaxRegisters = 256;
+    const int LiteralChunk = 64; // 数组和哈希表字面量每次最多在这么多个临时寄存器里求值元素
+
+    struct ByteCode
+    {
+        bytecode::Instructions Instructions;
+        std::vector<objects::Ref<objects::Object>> Constants;
+        int NumRegisters; // 顶层代码使用的临时寄存器个数
+
+        ByteCode(bytecode::Instructions ins, std::vector<objects::Ref<objects::Object>> &objs, int numRegisters)
+            : Instructions(std::move(ins)), Constants(objs), NumRegisters(numRegisters)
+        {
+        }
+    };
+
+    struct CompilationScope
+    {
+        bytecode::Instructions instructions;
+        // 临时寄存器在局部变量个数确定前就已分配, 先按临时寄存器编号写入,
+        // 函数编译完后给这些位置加上局部变量个数
+        std::vector<int> tempOperands;
+        int numTemps = 0;
+        int maxTemps = 0;
+    };
+
+    // 局部变量直接对应寄存器编号(>=0), 临时寄存器在编译期间用负数-(t+1)表示
+    struct Compiler
+    {
+        std::vector<objects::Ref<objects::Object>> constants;
+        std::shared_ptr<compiler::SymbolTable> symbolTable;
+
+        std::vector<std::shared_ptr<CompilationScope>> scopes;
+        int scopeIndex;
+
+        Compiler()
+        {
+            symbolTable = compiler::NewSymbolTable();
+
+            scopes.push_back(std::make_shared<CompilationScope>());
+            scopeIndex = 0;
+        }
+
+        objects::Ref<objects::Error> Compile(const std::shared_ptr<ast::Node> &node)
+        {
+            if (node->GetNodeType() != ast::NodeType::Program)
+            {
+                auto resultObj = compileStatement(node);
+                return objects::isError(resultObj) ? resultObj : checkRegisters();
+            }
+
+            auto program = std::static_pointer_cast<ast::Program>(node);
+            for (auto &stmt : program->v_pStatements)
+            {
+                auto resultObj = compileStatement(stmt);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+            }
+            return checkRegisters();
+        }
+
+        // 顶层代码和函数一样只能用1字节的寄存器编号
+        objects::Ref<objects::Error> checkRegisters()
+        {
+            if (scopeIndex == 0 && scopes[0]->maxTemps > MaxRegisters)
+            {
+                return objects::newError("too many registers in program: " + std::to_string(scopes[0]->maxTemps));
+            }
+            return nullptr;
+        }
+
+        objects::Ref<objects::Error> compileStatement(const std::shared_ptr<ast::Node> &node)
+        {
+            int mark = scopes[scopeIndex]->numTemps;
+            objects::Ref<objects::Error> resultObj;
+
+            switch (node->GetNodeType())
+            {
+            case ast::NodeType::ExpressionStatement:
+            {
+                auto exprStmt = std::static_pointer_cast<ast::ExpressionStatement>(node);
+
+                int reg = allocTemp();
+                resultObj = compileInto(exprStmt->pExpression, reg);
+                if (!objects::isError(resultObj) && scopeIndex == 0)
+                {
+                    emit(OpcodeType::OpPop, {reg});
+                }
+                break;
+            }
+            case ast::NodeType::LetStatement:
+            {
+                auto letObj = std::static_pointer_cast<ast::LetStatement>(node);
+                auto symbol = symbolTable->Define(letObj->pName->Value);
+
+                if (symbol->Scope == compiler::SymbolScopeType::GlobalScope)
+                {
+                    int reg = allocTemp();
+                    resultObj = compileInto(letObj->pValue, reg);
+                    emit(OpcodeType::OpSetGlobal, {symbol->Index, reg});
+                }
+                else
+                {
+                    resultObj = compileInto(letObj->pValue, symbol->Index);
+                }
+                break;
+            }
+            case ast::NodeType::ReturnStatement:
+            {
+                auto returnObj = std::static_pointer_cast<ast::ReturnStatement>(node);
+
+                int reg;
+                resultObj = compileOperand(returnObj->pReturnValue, reg);
+                if (!objects::isError(resultObj))
+                {
+                    emit(OpcodeType::OpReturnValue, {reg});
+                }
+                break;
+            }
+            case ast::NodeType::BlockStatement:
+            {
+                auto blockObj = std::static_pointer_cast<ast::BlockStatement>(node);
+                for (auto &stmt : blockObj->v_pStatements)
+                {
+                    resultObj = compileStatement(stmt);
+                    if (objects::isError(resultObj))
+                    {
+                        break;
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+            }
+
+            scopes[scopeIndex]->numTemps = mark;
+            return resultObj;
+        }
+
+        // 计算表达式的值并写入target; 只有最后一条指令写target, 子表达式都放在临时寄存器里
+        objects::Ref<objects::Error> compileInto(const std::shared_ptr<ast::Node> &node, int target)
+        {
+            int mark = scopes[scopeIndex]->numTemps;
+            auto resultObj = compileExpression(node, target);
+            scopes[scopeIndex]->numTemps = mark;
+            return resultObj;
+        }
+
+        // 局部变量直接使用它的寄存器, 其他表达式先算到新的临时寄存器
+        objects::Ref<objects::Error> compileOperand(const std::shared_ptr<ast::Node> &node, int &reg)
+        {
+            if (node->GetNodeType() == ast::NodeType::Identifier)
+            {
+                auto symbol = symbolTable->Resolve(std::static_pointer_cast<ast::Identifier>(node)->Value);
+                if (symbol != nullptr && symbol->Scope == compiler::SymbolScopeType::LocalScope)
+                {
+                    reg = symbol->Index;
+                    return nullptr;
+                }
+            }
+
+            reg = allocTemp();
+            return compileInto(node, reg);
+        }
+
+        // 两个操作数按顺序求值; 右边的代码块里可能重新let左边的局部变量, 这时先复制一份
+        objects::Ref<objects::Error> compileOperands(const std::shared_ptr<ast::Node> &left, const std::shared_ptr<ast::Node> &right, int &l, int &r)
+        {
+            auto resultObj = compileOperand(left, l);
+            if (objects::isError(resultObj))
+            {
+                return resultObj;
+            }
+
+            if (l >= 0 && rebindsLocals(right))
+            {
+                int copy = allocTemp();
+                emit(OpcodeType::OpMove, {copy, l});
+                l = copy;
+            }
+
+            return compileOperand(right, r);
+        }
+
+        objects::Ref<objects::Error> compileExpression(const std::shared_ptr<ast::Node> &node, int target)
+        {
+            switch (node->GetNodeType())
+            {
+            case ast::NodeType::InfixExpression:
+            {
+                auto infixObj = std::static_pointer_cast<ast::InfixExpression>(node);
+
+                int l, r;
+                objects::Ref<objects::Error> resultObj;
+                if (infixObj->Operator == "<")
+                {
+                    resultObj = compileOperands(infixObj->pRight, infixObj->pLeft, l, r);
+                }
+                else
+                {
+                    resultObj = compileOperands(infixObj->pLeft, infixObj->pRight, l, r);
+                }
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                OpcodeType op;
+                if (infixObj->Operator == "+")
+                {
+                    op = OpcodeType::OpAdd;
+                }
+                else if (infixObj->Operator == "-")
+                {
+                    op = OpcodeType::OpSub;
+                }
+                else if (infixObj->Operator == "*")
+                {
+                    op = OpcodeType::OpMul;
+                }
+                else if (infixObj->Operator == "/")
+                {
+                    op = OpcodeType::OpDiv;
+                }
+                else if (infixObj->Operator == ">" || infixObj->Operator == "<")
+                {
+                    op = OpcodeType::OpGreaterThan;
+                }
+                else if (infixObj->Operator == "==")
+                {
+                    op = OpcodeType::OpEqual;
+                }
+                else if (infixObj->Operator == "!=")
+                {
+                    op = OpcodeType::OpNotEqual;
+                }
+                else
+                {
+                    return objects::newError("unknow operator: " + infixObj->Operator);
+                }
+
+                emit(op, {target, l, r});
+                break;
+            }
+            case ast::NodeType::PrefixExpression:
+            {
+                auto prefixObj = std::static_pointer_cast<ast::PrefixExpression>(node);
+
+                int reg;
+                auto resultObj = compileOperand(prefixObj->pRight, reg);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                if (prefixObj->Operator == "!")
+                {
+                    emit(OpcodeType::OpBang, {target, reg});
+                }
+                else if (prefixObj->Operator == "-")
+                {
+                    emit(OpcodeType::OpMinus, {target, reg});
+                }
+                else
+                {
+                    return objects::newError("unknow operator: " + prefixObj->Operator);
+                }
+                break;
+            }
+            case ast::NodeType::IfExpression:
+            {
+                auto ifObj = std::static_pointer_cast<ast::IfExpression>(node);
+
+                int jumpElsePos;
+                auto resultObj = compileCondition(ifObj->pCondition, jumpElsePos);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                resultObj = compileBlockInto(ifObj->pConsequence, target);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                int jumpPos = emit(OpcodeType::OpJump, {9999});
+                changeJumpTarget(jumpElsePos, currentInstructions().size());
+
+                if (ifObj->pAlternative == nullptr)
+                {
+                    emit(OpcodeType::OpLoadNull, {target});
+                }
+                else
+                {
+                    resultObj = compileBlockInto(ifObj->pAlternative, target);
+                    if (objects::isError(resultObj))
+                    {
+                        return resultObj;
+                    }
+                }
+
+                changeJumpTarget(jumpPos, currentInstructions().size());
+                break;
+            }
+            case ast::NodeType::Identifier:
+            {
+                auto identObj = std::static_pointer_cast<ast::Identifier>(node);
+                auto symbol = symbolTable->Resolve(identObj->Value);
+                if (symbol == nullptr)
+                {
+                    return objects::newError("undefined variable " + identObj->Value);
+                }
+
+                loadSymbol(symbol, target);
+                break;
+            }
+            case ast::NodeType::IntegerLiteral:
+            {
+                auto integerLiteral = std::static_pointer_cast<ast::IntegerLiteral>(node);
+                auto pos = addConstant(objects::newInteger(integerLiteral->Value));
+                emit(OpcodeType::OpLoadConstant, {target, pos});
+                break;
+            }
+            case ast::NodeType::Boolean:
+            {
+                auto boolAst = std::static_pointer_cast<ast::Boolean>(node);
+                emit(boolAst->Value ? OpcodeType::OpLoadTrue : OpcodeType::OpLoadFalse, {target});
+                break;
+            }
+            case ast::NodeType::StringLiteral:
+            {
+                auto stringLiteral = std::static_pointer_cast<ast::StringLiteral>(node);
+                auto pos = addConstant(objects::makeRef<objects::String>(stringLiteral->Value));
+                emit(OpcodeType::OpLoadConstant, {target, pos});
+                break;
+            }
+            case ast::NodeType::ArrayLiteral:
+            {
+                auto arrayLiteral = std::static_pointer_cast<ast::ArrayLiteral>(node);
+                auto &elements = arrayLiteral->Elements;
+                int size = elements.size();
+
+                // 元素多于一块时先在临时寄存器中建好数组, 其余的块逐块追加; 不直接写target, 元素里可能还会读取它的旧值
+                int result = (size > LiteralChunk) ? allocTemp() : target;
+                for (int start = 0; start == 0 || start < size; start += LiteralChunk)
+                {
+                    int mark = scopes[scopeIndex]->numTemps;
+                    int count = std::min(LiteralChunk, size - start);
+
+                    int first = result;
+                    for (int i = 0; i < count; i++)
+                    {
+                        int reg = allocTemp();
+                        first = (i == 0) ? reg : first;
+
+                        auto resultObj = compileInto(elements[start + i], reg);
+                        if (objects::isError(resultObj))
+                        {
+                            return resultObj;
+                        }
+                    }
+
+                    emit((start == 0) ? OpcodeType::OpArray : OpcodeType::OpArrayAppend, {result, first, count});
+                    scopes[scopeIndex]->numTemps = mark;
+                }
+
+                if (result != target)
+                {
+                    emit(OpcodeType::OpMove, {target, result});
+                }
+                break;
+            }
+            case ast::NodeType::HashLiteral:
+            {
+                auto hashLiteral = std::static_pointer_cast<ast::HashLiteral>(node);
+
+                std::vector<std::shared_ptr<ast::Expression>> keys{};
+                for (auto &pair : hashLiteral->Pairs)
+                {
+                    keys.push_back(pair.first);
+                }
+
+                std::sort(keys.begin(), keys.end(), [](const auto &lhs, const auto &rhs) { return lhs->String() < rhs->String(); });
+
+                int size = keys.size();
+                int chunk = LiteralChunk / 2;
+                int result = (size > chunk) ? allocTemp() : target;
+                for (int start = 0; start == 0 || start < size; start += chunk)
+                {
+                    int mark = scopes[scopeIndex]->numTemps;
+                    int count = std::min(chunk, size - start);
+
+                    int first = result;
+                    for (int i = 0; i < count; i++)
+                    {
+                        int keyReg = allocTemp();
+                        int valueReg = allocTemp();
+                        first = (i == 0) ? keyReg : first;
+
+                        auto resultObj = compileInto(keys[start + i], keyReg);
+                        if (objects::isError(resultObj))
+                        {
+                            return resultObj;
+                        }
+
+                        resultObj = compileInto(hashLiteral->Pairs[keys[start + i]], valueReg);
+                        if (objects::isError(resultObj))
+                        {
+                            return resultObj;
+                        }
+                    }
+
+                    emit((start == 0) ? OpcodeType::OpHash : OpcodeType::OpHashInsert, {result, first, 2 * count});
+                    scopes[scopeIndex]->numTemps = mark;
+                }
+
+                if (result != target)
+                {
+                    emit(OpcodeType::OpMove, {target, result});
+                }
+                break;
+            }
+            case ast::NodeType::IndexExpression:
+            {
+                auto indexObj = std::static_pointer_cast<ast::IndexExpression>(node);
+
+                int l, r;
+                auto resultObj = compileOperands(indexObj->Left, indexObj->Index, l, r);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                emit(OpcodeType::OpIndex, {target, l, r});
+                break;
+            }
+            case ast::NodeType::FunctionLiteral:
+            {
+                auto funcObj = std::static_pointer_cast<ast::FunctionLiteral>(node);
+
+                auto err = funcObj->ParseBody();
+                if (!err.empty())
+                {
+                    return objects::newError(err);
+                }
+
+                enterScope();
+
+                if (funcObj->Name != "")
+                {
+                    symbolTable->DefineFunctionName(funcObj->Name);
+                }
+
+                for (auto &args : funcObj->v_pParameters)
+                {
+                    symbolTable->Define(args->Value);
+                }
+
+                auto resultObj = compileFunctionBody(funcObj->pBody);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                int numLocals = symbolTable->numDefinitions;
+                int numRegisters = numLocals + scopes[scopeIndex]->maxTemps;
+                if (numRegisters > MaxRegisters)
+                {
+                    return objects::newError("too many registers in function: " + std::to_string(numRegisters));
+                }
+                relocateTemps(numLocals);
+
+                auto freeSymbols = symbolTable->FreeSymbols;
+                int numParameters = funcObj->v_pParameters.size();
+                auto ins = leaveScope();
+
+                int first = target;
+                for (auto &sym : freeSymbols)
+                {
+                    int reg = allocTemp();
+                    first = (first == target) ? reg : first;
+                    loadSymbol(sym, reg);
+                }
+
+                auto compiledFn = objects::makeRef<objects::CompiledFunction>(std::move(ins), numRegisters, numParameters);
+                auto pos = addConstant(compiledFn);
+
+                emit(OpcodeType::OpClosure, {target, pos, first, static_cast<int>(freeSymbols.size())});
+                break;
+            }
+            case ast::NodeType::CallExpression:
+            {
+                auto callObj = std::static_pointer_cast<ast::CallExpression>(node);
+
+                // 被调用者和参数放在连续的寄存器里, 参数正好成为被调用函数的前几个局部变量
+                int callee = allocTemp();
+                auto resultObj = compileInto(callObj->pFunction, callee);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+
+                for (auto &args : callObj->pArguments)
+                {
+                    resultObj = compileInto(args, allocTemp());
+                    if (objects::isError(resultObj))
+                    {
+                        return resultObj;
+                    }
+                }
+
+                emit(OpcodeType::OpCall, {target, callee, static_cast<int>(callObj->pArguments.size())});
+                break;
+            }
+            default:
+                break;
+            }
+
+            return nullptr;
+        }
+
+        // 条件是比较运算时直接比较并跳转, 不生成中间的布尔值
+        objects::Ref<objects::Error> compileCondition(const std::shared_ptr<ast::Expression> &condition, int &jumpPos)
+        {
+            int mark = scopes[scopeIndex]->numTemps;
+            objects::Ref<objects::Error> resultObj;
+
+            std::shared_ptr<ast::InfixExpression> infixObj;
+            if (condition->GetNodeType() == ast::NodeType::InfixExpression)
+            {
+                infixObj = std::static_pointer_cast<ast::InfixExpression>(condition);
+            }
+
+            int l, r;
+            if (infixObj != nullptr && (infixObj->Operator == "==" || infixObj->Operator == "!=" || infixObj->Operator == ">"))
+            {
+                resultObj = compileOperands(infixObj->pLeft, infixObj->pRight, l, r);
+                auto op = (infixObj->Operator == "==") ? OpcodeType::OpJumpNotEqual
+                        : (infixObj->Operator == "!=") ? OpcodeType::OpJumpEqual
+                        : OpcodeType::OpJumpNotGreater;
+                jumpPos = emit(op, {l, r, 9999});
+            }
+            else if (infixObj != nullptr && infixObj->Operator == "<")
+            {
+                resultObj = compileOperands(infixObj->pRight, infixObj->pLeft, l, r);
+                jumpPos = emit(OpcodeType::OpJumpNotGreater, {l, r, 9999});
+            }
+            else
+            {
+                resultObj = compileOperand(condition, l);
+                jumpPos = emit(OpcodeType::OpJumpNotTruthy, {l, 9999});
+            }
+
+            scopes[scopeIndex]->numTemps = mark;
+            return resultObj;
+        }
+
+        // 代码块的值是最后一条表达式语句的值, 否则为null
+        objects::Ref<objects::Error> compileBlockInto(const std::shared_ptr<ast::BlockStatement> &block, int target)
+        {
+            auto &stmts = block->v_pStatements;
+            for (unsigned long i = 0; i + 1 < stmts.size(); i++)
+            {
+                auto resultObj = compileStatement(stmts[i]);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+            }
+
+            if (!stmts.empty() && stmts.back()->GetNodeType() == ast::NodeType::ExpressionStatement)
+            {
+                return compileInto(std::static_pointer_cast<ast::ExpressionStatement>(stmts.back())->pExpression, target);
+            }
+
+            if (!stmts.empty())
+            {
+                auto resultObj = compileStatement(stmts.back());
+                if (objects::isError(resultObj) || stmts.back()->GetNodeType() == ast::NodeType::ReturnStatement)
+                {
+                    return resultObj;
+                }
+            }
+
+            emit(OpcodeType::OpLoadNull, {target});
+            return nullptr;
+        }
+
+        objects::Ref<objects::Error> compileFunctionBody(const std::shared_ptr<ast::BlockStatement> &body)
+        {
+            auto &stmts = body->v_pStatements;
+            for (unsigned long i = 0; i + 1 < stmts.size(); i++)
+            {
+                auto resultObj = compileStatement(stmts[i]);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+            }
+
+            if (!stmts.empty() && stmts.back()->GetNodeType() == ast::NodeType::ExpressionStatement)
+            {
+                int reg;
+                auto resultObj = compileOperand(std::static_pointer_cast<ast::ExpressionStatement>(stmts.back())->pExpression, reg);
+                if (objects::isError(resultObj))
+                {
+                    return resultObj;
+                }
+                emit(OpcodeType::OpReturnValue, {reg});
+                return nullptr;
+            }
+
+            if (!stmts.empty())
+            {
+                auto resultObj = compileStatement(stmts.back());
+                if (objects::isError(resultObj) || stmts.back()->GetNodeType() == ast::NodeType::ReturnStatement)
+                {
+                    return resultObj;
+                }
+            }
+
+            emit(OpcodeType::OpReturn, {});
+            return nullptr;
+        }
+
+        // 表达式中(不含嵌套函数)是否有let语句, 它会改写当前函数的局部变量寄存器
+        bool rebindsLocals(const std::shared_ptr<ast::Node> &node)
+        {
+            if (node == nullptr)
+            {
+                return false;
+            }
+
+            switch (node->GetNodeType())
+            {
+            case ast::NodeType::LetStatement:
+                return true;
+            case ast::NodeType::ExpressionStatement:
+                return rebindsLocals(std::static_pointer_cast<ast::ExpressionStatement>(node)->pExpression);
+            case ast::NodeType::ReturnStatement:
+                return rebindsLocals(std::static_pointer_cast<ast::ReturnStatement>(node)->pReturnValue);
+            case ast::NodeType::BlockStatement:
+                for (auto &stmt : std::static_pointer_cast<ast::BlockStatement>(node)->v_pStatements)
+                {
+                    if (rebindsLocals(stmt))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            case ast::NodeType::PrefixExpression:
+                return rebindsLocals(std::static_pointer_cast<ast::PrefixExpression>(node)->pRight);
+            case ast::NodeType::InfixExpression:
+            {
+                auto infixObj = std::static_pointer_cast<ast::InfixExpression>(node);
+                return rebindsLocals(infixObj->pLeft) || rebindsLocals(infixObj->pRight);
+            }
+            case ast::NodeType::IfExpression:
+            {
+                auto ifObj = std::static_pointer_cast<ast::IfExpression>(node);
+                return rebindsLocals(ifObj->pCondition) || rebindsLocals(ifObj->pConsequence) || rebindsLocals(ifObj->pAlternative);
+            }
+            case ast::NodeType::IndexExpression:
+            {
+                auto indexObj = std::static_pointer_cast<ast::IndexExpression>(node);
+                return rebindsLocals(indexObj->Left) || rebindsLocals(indexObj->Index);
+            }
+            case ast::NodeType::CallExpression:
+            {
+                auto callObj = std::static_pointer_cast<ast::CallExpression>(node);
+                if (rebindsLocals(callObj->pFunction))
+                {
+                    return true;
+                }
+                for (auto &arg : callObj->pArguments)
+                {
+                    if (rebindsLocals(arg))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            case ast::NodeType::ArrayLiteral:
+                for (auto &elem : std::static_pointer_cast<ast::ArrayLiteral>(node)->Elements)
+                {
+                    if (rebindsLocals(elem))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            case ast::NodeType::HashLiteral:
+                for (auto &pair : std::static_pointer_cast<ast::HashLiteral>(node)->Pairs)
+                {
+                    if (rebindsLocals(pair.first) || rebindsLocals(pair.second))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            default:
+                return false;
+            }
+        }
+
+        void loadSymbol(std::shared_ptr<compiler::Symbol> symbol, int target)
+        {
+            if (symbol->Scope == compiler::SymbolScopeType::GlobalScope)
+            {
+                emit(OpcodeType::OpGetGlobal, {target, symbol->Index});
+            }
+            else if (symbol->Scope == compiler::SymbolScopeType::LocalScope)
+            {
+                if (symbol->Index != target)
+                {
+                    emit(OpcodeType::OpMove, {target, symbol->Index});
+                }
+            }
+            else if (symbol->Scope == compiler::SymbolScopeType::BuiltinScope)
+            {
+                emit(OpcodeType::OpGetBuiltin, {target, symbol->Index});
+            }
+            else if (symbol->Scope == compiler::SymbolScopeType::FreeScope)
+            {
+                emit(OpcodeType::OpGetFree, {target, symbol->Index});
+            }
+            else if (symbol->Scope == compiler::SymbolScopeType::FunctionScope)
+            {
+                emit(OpcodeType::OpCurrentClosure, {target});
+            }
+        }
+
+        int allocTemp()
+        {
+            auto &scope = scopes[scopeIndex];
+            int t = scope->numTemps++;
+            scope->maxTemps = std::max(scope->maxTemps, scope->numTemps);
+            return -(t + 1);
+        }
+
+        void relocateTemps(int numLocals)
+        {
+            auto &scope = scopes[scopeIndex];
+            for (auto pos : scope->tempOperands)
+            {
+                scope->instructions[pos] += numLocals;
+            }
+            scope->tempOperands.clear();
+        }
+
+        int addConstant(objects::Ref<objects::Object> obj)
+        {
+            constants.push_back(objects::makeImmortal(std::move(obj)));
+            return (constants.size() - 1);
+        }
+
+        int emit(OpcodeType op, std::vector<int> operands)
+        {
+            auto def = Lookup(op);
+            auto &scope = scopes[scopeIndex];
+            int pos = scope->instructions.size();
+
+            int offset = pos + 1;
+            for (unsigned long i = 0; i < operands.size() && i < def->Operands.size(); i++)
+            {
+                if (def->Operands[i] == 'R' && operands[i] < 0)
+                {
+                    scope->tempOperands.push_back(offset);
+                    operands[i] = -operands[i] - 1;
+                }
+                offset += (def->Operands[i] == 'K') ? 2 : 1;
+            }
+
+            auto ins = Make(op, operands);
+            scope->instructions.insert(scope->instructions.end(), ins.begin(), ins.end());
+            return pos;
+        }
+
+        // 跳转目标总是指令的最后一个操作数
+        void changeJumpTarget(int opPos, int target)
+        {
+            auto &ins = currentInstructions();
+            auto def = Lookup(static_cast<OpcodeType>(ins[opPos]));
+            int offset = opPos + def->Length() - 2;
+            ins[offset] = static_cast<bytecode::Opcode>((target >> 8) & 0xFF);
+            ins[offset + 1] = static_cast<bytecode::Opcode>(target & 0xFF);
+        }
+
+        std::shared_ptr<ByteCode> Bytecode()
+        {
+            relocateTemps(0);
+
+            auto ins = scopes[0]->instructions;
+            auto ret = Make(OpcodeType::OpReturn, {});
+            ins.insert(ins.end(), ret.begin(), ret.end());
+
+            return std::make_shared<ByteCode>(std::move(ins), constants, scopes[0]->maxTemps);
+        }
+
+        bytecode::Instructions &currentInstructions()
+        {
+            return scopes[scopeIndex]->instructions;
+        }
+
+        void enterScope()
+        {
+            scopes.push_back(std::make_shared<CompilationScope>());
+            scopeIndex += 1;
+            symbolTable = compiler::NewEnclosedSymbolTable(symbolTable);
+        }
+
+        bytecode::Instructions leaveScope()
+        {
+            auto ins = std::move(currentInstructions());
+            scopes.pop_back();
+            scopeIndex -= 1;
+            symbolTable = symbolTable->Outer;
+
+            return ins;
+        }
+    };
+
+    std::shared_ptr<Compiler> New()
+    {
+        auto symbolTable = compiler::NewSymbolTable();
+
+        int i = -1;
+        for (auto &fn : objects::Builtins)
+        {
+            i += 1;
+            symbolTable->DefineBuiltin(i, fn->Name);
+        }
+
+        auto comp = std::make_shared<Compiler>();
+        comp->symbolTable = symbolTable;
+
+        return comp;
+    }
+
+    std::shared_ptr<Compiler> NewWithState(std::shared_ptr<compiler::SymbolTable> symbolTable,
+                                           std::vector<objects::Ref<objects::Object>> &constants)
+    {
+        auto comp = New();
+        comp->symbolTable = symbolTable;
+        comp->constants = constants;
+        return comp;
+    }
+}
+
+#endif // H_REGVM_COMPILER_H
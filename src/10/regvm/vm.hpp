@@ -0,0 +1,462 @@
+#ifndef H_REGVM_VM_H
+#define H_REGVM_VM_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iterator>
+
+#include "objects/objects.hpp"
+#include "objects/builtins.hpp"
+#include "regvm/code.hpp"
+#include "regvm/compiler.hpp"
+
+namespace regvm
+{
+    const int FrameSize = 1024;
+    const int RegisterFileSize = 1 << 16;
+    const int GlobalsSize = 65536;
+
+    struct Frame
+    {
+        objects::Ref<objects::Closure> cl;
+        int ip;
+        int base;   // 第一个寄存器在寄存器堆中的位置
+        int result; // 返回值写入的寄存器(绝对位置)
+    };
+
+    struct VM
+    {
+        std::vector<objects::Ref<objects::Object>> constants;
+        std::vector<objects::Ref<objects::Object>> globals;
+
+        std::vector<objects::Ref<objects::Object>> registers;
+
+        std::vector<Frame> frames;
+        int frameIndex;
+
+        objects::Ref<objects::Object> lastPopped;
+        std::vector<objects::Ref<objects::Object>> builtinArgs;
+
+        uint64_t Dispatched = 0; // 执行的指令条数, 仅在定义MONKEY_COUNT_INSTRUCTIONS时统计
+
+        VM(std::vector<objects::Ref<objects::Object>> &objs, objects::Ref<objects::Closure> mainClosure)
+            : constants(objs)
+        {
+            globals.resize(GlobalsSize);
+            registers.resize(RegisterFileSize);
+            frames.resize(FrameSize);
+            frames[0] = Frame{std::move(mainClosure), 0, 0, 0};
+            frameIndex = 1;
+        }
+
+        objects::Ref<objects::Object> LastPoppedStackElem()
+        {
+            return lastPopped;
+        }
+
+        objects::Ref<objects::Object> Run()
+        {
+            Frame *frame = &frames[frameIndex - 1];
+            const bytecode::Opcode *code = frame->cl->Fn->Instructions.data();
+            objects::Ref<objects::Object> *R = &registers[frame->base];
+            int ip = frame->ip;
+
+            while (true)
+            {
+#ifdef MONKEY_COUNT_INSTRUCTIONS
+                Dispatched++;
+#endif
+                auto op = static_cast<OpcodeType>(code[ip]);
+                switch (op)
+                {
+                case OpcodeType::OpMove:
+                    R[code[ip + 1]] = R[code[ip + 2]];
+                    ip += 3;
+                    break;
+                case OpcodeType::OpLoadConstant:
+                    R[code[ip + 1]] = constants[ReadUint16(code, ip + 2)];
+                    ip += 4;
+                    break;
+                case OpcodeType::OpLoadTrue:
+                    R[code[ip + 1]] = objects::TRUE_OBJ;
+                    ip += 2;
+                    break;
+                case OpcodeType::OpLoadFalse:
+                    R[code[ip + 1]] = objects::FALSE_OBJ;
+                    ip += 2;
+                    break;
+                case OpcodeType::OpLoadNull:
+                    R[code[ip + 1]] = objects::NULL_OBJ;
+                    ip += 2;
+                    break;
+                case OpcodeType::OpAdd:
+                case OpcodeType::OpSub:
+                case OpcodeType::OpMul:
+                case OpcodeType::OpDiv:
+                {
+                    auto &left = R[code[ip + 2]];
+                    auto &right = R[code[ip + 3]];
+                    if (left->Type() == objects::ObjectType::INTEGER && right->Type() == objects::ObjectType::INTEGER)
+                    {
+                        auto l = static_cast<objects::Integer *>(left.get())->Value;
+                        auto r = static_cast<objects::Integer *>(right.get())->Value;
+                        int64_t value = (op == OpcodeType::OpAdd) ? l + r
+                                      : (op == OpcodeType::OpSub) ? l - r
+                                      : (op == OpcodeType::OpMul) ? l * r
+                                      : l / r;
+                        R[code[ip + 1]] = objects::newYoungInteger(value);
+                    }
+                    else
+                    {
+                        auto result = executeBinaryOperaction(op, left, right);
+                        if (objects::isError(result))
+                        {
+                            return result;
+                        }
+                        R[code[ip + 1]] = std::move(result);
+                    }
+                    ip += 4;
+                    break;
+                }
+                case OpcodeType::OpEqual:
+                case OpcodeType::OpNotEqual:
+                case OpcodeType::OpGreaterThan:
+                {
+                    int result = compare(op, R[code[ip + 2]], R[code[ip + 3]]);
+                    if (result < 0)
+                    {
+                        return comparisonError(op, R[code[ip + 2]], R[code[ip + 3]]);
+                    }
+                    R[code[ip + 1]] = objects::nativeBoolToBooleanObject(result == 1);
+                    ip += 4;
+                    break;
+                }
+                case OpcodeType::OpMinus:
+                {
+                    auto &operand = R[code[ip + 2]];
+                    if (operand->Type() != objects::ObjectType::INTEGER)
+                    {
+                        return objects::newError("unsupported type for negation: " + operand->TypeStr());
+                    }
+                    R[code[ip + 1]] = objects::newYoungInteger(-1 * static_cast<objects::Integer *>(operand.get())->Value);
+                    ip += 3;
+                    break;
+                }
+                case OpcodeType::OpBang:
+                    R[code[ip + 1]] = objects::nativeBoolToBooleanObject(R[code[ip + 2]] == objects::FALSE_OBJ);
+                    ip += 3;
+                    break;
+                case OpcodeType::OpJump:
+                    ip = ReadUint16(code, ip + 1);
+                    break;
+                case OpcodeType::OpJumpNotTruthy:
+                    ip = objects::isTruthy(R[code[ip + 1]]) ? ip + 4 : ReadUint16(code, ip + 2);
+                    break;
+                case OpcodeType::OpJumpNotEqual:
+                case OpcodeType::OpJumpEqual:
+                case OpcodeType::OpJumpNotGreater:
+                {
+                    auto cmp = (op == OpcodeType::OpJumpNotEqual) ? OpcodeType::OpEqual
+                             : (op == OpcodeType::OpJumpEqual) ? OpcodeType::OpNotEqual
+                             : OpcodeType::OpGreaterThan;
+                    int result = compare(cmp, R[code[ip + 1]], R[code[ip + 2]]);
+                    if (result < 0)
+                    {
+                        return comparisonError(cmp, R[code[ip + 1]], R[code[ip + 2]]);
+                    }
+                    ip = (result == 1) ? ip + 5 : ReadUint16(code, ip + 3);
+                    break;
+                }
+                case OpcodeType::OpGetGlobal:
+                    R[code[ip + 1]] = globals[ReadUint16(code, ip + 2)];
+                    ip += 4;
+                    break;
+                case OpcodeType::OpSetGlobal:
+                    globals[ReadUint16(code, ip + 1)] = R[code[ip + 3]];
+                    lastPopped = R[code[ip + 3]];
+                    ip += 4;
+                    break;
+                case OpcodeType::OpGetBuiltin:
+                    R[code[ip + 1]] = objects::Builtins[code[ip + 2]]->Builtin;
+                    ip += 3;
+                    break;
+                case OpcodeType::OpGetFree:
+                    R[code[ip + 1]] = frame->cl->Free[code[ip + 2]];
+                    ip += 3;
+                    break;
+                case OpcodeType::OpCurrentClosure:
+                    R[code[ip + 1]] = frame->cl;
+                    ip += 2;
+                    break;
+                case OpcodeType::OpArray:
+                {
+                    auto first = R + code[ip + 2];
+                    std::vector<objects::Ref<objects::Object>> elements(std::make_move_iterator(first), std::make_move_iterator(first + ReadUint16(code, ip + 3)));
+                    R[code[ip + 1]] = objects::makePooled<objects::Array>(std::move(elements));
+                    ip += 5;
+                    break;
+                }
+                case OpcodeType::OpHash:
+                {
+                    auto result = buildHash(R + code[ip + 2], ReadUint16(code, ip + 3));
+                    if (objects::isError(result))
+                    {
+                        return result;
+                    }
+                    R[code[ip + 1]] = std::move(result);
+                    ip += 5;
+                    break;
+                }
+                case OpcodeType::OpArrayAppend:
+                {
+                    auto first = R + code[ip + 2];
+                    auto &elements = static_cast<objects::Array *>(R[code[ip + 1]].get())->Elements;
+                    elements.insert(elements.end(), std::make_move_iterator(first), std::make_move_iterator(first + ReadUint16(code, ip + 3)));
+                    ip += 5;
+                    break;
+                }
+                case OpcodeType::OpHashInsert:
+                {
+                    auto result = insertPairs(static_cast<objects::Hash &>(*R[code[ip + 1]]), R + code[ip + 2], ReadUint16(code, ip + 3));
+                    if (objects::isError(result))
+                    {
+                        return result;
+                    }
+                    ip += 5;
+                    break;
+                }
+                case OpcodeType::OpIndex:
+                {
+                    auto result = executeIndexExpression(R[code[ip + 2]], R[code[ip + 3]]);
+                    if (objects::isError(result))
+                    {
+                        return result;
+                    }
+                    R[code[ip + 1]] = std::move(result);
+                    ip += 4;
+                    break;
+                }
+                case OpcodeType::OpCall:
+                {
+                    int a = code[ip + 1], b = code[ip + 2], numArgs = code[ip + 3];
+                    auto &callee = R[b];
+
+                    if (callee->Type() == objects::ObjectType::CLOSURE)
+                    {
+                        auto closureFn = objects::staticRefCast<objects::Closure>(callee);
+                        auto &fn = *closureFn->Fn;
+                        if (fn.NumParameters != numArgs)
+                        {
+                            return objects::newError("wrong number of arguments: want=" + std::to_string(fn.NumParameters) + ", got=" + std::to_string(numArgs));
+                        }
+
+                        int base = frame->base + b + 1;
+                        if (frameIndex >= FrameSize || base + fn.NumLocals > RegisterFileSize)
+                        {
+                            return objects::newError("stack overflow");
+                        }
+
+                        frame->ip = ip + 4;
+                        frames[frameIndex] = Frame{std::move(closureFn), 0, base, frame->base + a};
+                        frameIndex += 1;
+
+                        frame = &frames[frameIndex - 1];
+                        code = frame->cl->Fn->Instructions.data();
+                        R = &registers[base];
+                        ip = 0;
+                    }
+                    else if (callee->Type() == objects::ObjectType::BUILTIN)
+                    {
+                        // 参数寄存器是调用专用的临时寄存器, 直接移给内置函数
+                        builtinArgs.assign(std::make_move_iterator(R + b + 1), std::make_move_iterator(R + b + 1 + numArgs));
+                        auto result = static_cast<objects::Builtin *>(callee.get())->Fn(builtinArgs);
+                        builtinArgs.clear();
+
+                        if (result == nullptr)
+                        {
+                            result = objects::NULL_OBJ;
+                        }
+                        R[a] = std::move(result);
+                        ip += 4;
+                    }
+                    else
+                    {
+                        return objects::newError("calling non-function and non-built-in");
+                    }
+                    break;
+                }
+                case OpcodeType::OpReturnValue:
+                case OpcodeType::OpReturn:
+                {
+                    objects::Ref<objects::Object> returnValue = objects::NULL_OBJ;
+                    if (op == OpcodeType::OpReturnValue)
+                    {
+                        returnValue = std::move(R[code[ip + 1]]);
+                    }
+                    if (frameIndex == 1)
+                    {
+                        frame->ip = ip;
+                        return nullptr;
+                    }
+
+                    // 清空被调用函数的寄存器, 避免残留引用使容器看起来被共享
+                    for (int i = 0, n = frame->cl->Fn->NumLocals; i < n; i++)
+                    {
+                        R[i].reset();
+                    }
+                    registers[frame->result] = std::move(returnValue);
+                    frame->cl.reset();
+                    frameIndex -= 1;
+
+                    frame = &frames[frameIndex - 1];
+                    code = frame->cl->Fn->Instructions.data();
+                    R = &registers[frame->base];
+                    ip = frame->ip;
+                    break;
+                }
+                case OpcodeType::OpClosure:
+                {
+                    auto compiledFn = objects::staticRefCast<objects::CompiledFunction>(constants[ReadUint16(code, ip + 2)]);
+                    auto first = R + code[ip + 4];
+                    std::vector<objects::Ref<objects::Object>> free(std::make_move_iterator(first), std::make_move_iterator(first + code[ip + 5]));
+                    R[code[ip + 1]] = objects::makePooled<objects::Closure>(std::move(compiledFn), std::move(free));
+                    ip += 6;
+                    break;
+                }
+                case OpcodeType::OpPop:
+                    lastPopped = R[code[ip + 1]];
+                    ip += 2;
+                    break;
+                default:
+                    return objects::newError("unknown register instruction: " + std::to_string(code[ip]));
+                }
+            }
+        }
+
+        // 错误信息沿用栈式VM中对应指令的写法
+        static bytecode::OpcodeType stackOpcode(OpcodeType op)
+        {
+            switch (op)
+            {
+            case OpcodeType::OpAdd:
+                return bytecode::OpcodeType::OpAdd;
+            case OpcodeType::OpSub:
+                return bytecode::OpcodeType::OpSub;
+            case OpcodeType::OpMul:
+                return bytecode::OpcodeType::OpMul;
+            case OpcodeType::OpDiv:
+                return bytecode::OpcodeType::OpDiv;
+            case OpcodeType::OpEqual:
+                return bytecode::OpcodeType::OpEqual;
+            case OpcodeType::OpNotEqual:
+                return bytecode::OpcodeType::OpNotEqual;
+            default:
+                return bytecode::OpcodeType::OpGreaterThan;
+            }
+        }
+
+        objects::Ref<objects::Object> executeBinaryOperaction(OpcodeType op, const objects::Ref<objects::Object> &left, const objects::Ref<objects::Object> &right)
+        {
+            if (left->Type() == objects::ObjectType::STRING && right->Type() == objects::ObjectType::STRING)
+            {
+                if (op != OpcodeType::OpAdd)
+                {
+                    return objects::newError("unknow string operator: " + bytecode::OpcodeTypeStr(stackOpcode(op)));
+                }
+                return objects::concatStrings(objects::staticRefCast<objects::String>(left), objects::staticRefCast<objects::String>(right));
+            }
+
+            return objects::newError("unsupported types for binary operaction: " + left->TypeStr() + " " + right->TypeStr());
+        }
+
+        // 返回1/0表示比较结果, -1表示操作数类型不支持该比较
+        static int compare(OpcodeType op, const objects::Ref<objects::Object> &left, const objects::Ref<objects::Object> &right)
+        {
+            if (left->Type() == objects::ObjectType::INTEGER && right->Type() == objects::ObjectType::INTEGER)
+            {
+                auto l = static_cast<objects::Integer *>(left.get())->Value;
+                auto r = static_cast<objects::Integer *>(right.get())->Value;
+                return (op == OpcodeType::OpEqual) ? l == r : (op == OpcodeType::OpNotEqual) ? l != r : l > r;
+            }
+
+            switch (op)
+            {
+            case OpcodeType::OpEqual:
+                return right == left;
+            case OpcodeType::OpNotEqual:
+                return right != left;
+            default:
+                return -1;
+            }
+        }
+
+        objects::Ref<objects::Object> comparisonError(OpcodeType op, const objects::Ref<objects::Object> &left, const objects::Ref<objects::Object> &right)
+        {
+            return objects::newError("unknow operator: " + bytecode::OpcodeTypeStr(stackOpcode(op)) + " (" + left->TypeStr() + " " + right->TypeStr() + ")");
+        }
+
+        objects::Ref<objects::Object> executeIndexExpression(const objects::Ref<objects::Object> &left, const objects::Ref<objects::Object> &index)
+        {
+            if (left->Type() == objects::ObjectType::ARRAY && index->Type() == objects::ObjectType::INTEGER)
+            {
+                return objects::evalArrayIndexExpression(left, index);
+            }
+            else if (left->Type() == objects::ObjectType::HASH)
+            {
+                return objects::evalHashIndexExpression(left, index);
+            }
+
+            return objects::newError("index operator not supported: " + left->TypeStr());
+        }
+
+        objects::Ref<objects::Object> buildHash(objects::Ref<objects::Object> *elements, int numElements)
+        {
+            auto hash = objects::makeRef<objects::Hash>();
+
+            auto result = insertPairs(*hash, elements, numElements);
+            if (objects::isError(result))
+            {
+                return result;
+            }
+
+            return hash;
+        }
+
+        objects::Ref<objects::Object> insertPairs(objects::Hash &hash, objects::Ref<objects::Object> *elements, int numElements)
+        {
+            for (int i = 0; i < numElements; i += 2)
+            {
+                auto &key = elements[i];
+                if (!key->Hashable())
+                {
+                    return objects::newError("unusable as hash type: " + key->TypeStr());
+                }
+
+                auto hashed = key->GetHashKey();
+                hash.Pairs.Insert(hashed, objects::makePooledShared<objects::HashPair>(std::move(key), std::move(elements[i + 1])));
+            }
+
+            return nullptr;
+        }
+    };
+
+    std::shared_ptr<VM> New(std::shared_ptr<ByteCode> code)
+    {
+        auto mainFn = objects::makeRef<objects::CompiledFunction>(code->Instructions, code->NumRegisters, 0);
+        auto mainClosure = objects::makeRef<objects::Closure>(mainFn);
+
+        return std::make_shared<VM>(code->Constants, mainClosure);
+    }
+
+    std::shared_ptr<VM> NewWithGlobalsStore(std::shared_ptr<ByteCode> code,
+                                            std::vector<objects::Ref<objects::Object>> &s)
+    {
+        auto machine = New(code);
+        machine->globals = s;
+        return machine;
+    }
+}
+
+#endif // H_REGVM_VM_H
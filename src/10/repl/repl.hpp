@@ -4,12 +4,18 @@
 #include <iostream>
 #include <string>
 #include <memory>
+#include <fstream>
+#include <sstream>
 
 #include "lexer/lexer.hpp"
 #include "parser/parser.hpp"
 #include "compiler/compiler.hpp"
+#include "compiler/cache.hpp"
 #include "vm/vm.hpp"
+#include "regvm/compiler.hpp"
+#include "regvm/vm.hpp"
 #include "objects/builtins.hpp"
+#include "tier/tier.hpp"
 
 namespace repl
 {
@@ -44,8 +50,8 @@ namespace repl
     {
         //auto env = objects::NewEnvironment();
 
-        std::vector<std::shared_ptr<objects::Object>> constants{};
-        std::vector<std::shared_ptr<objects::Object>> globals(vm::GlobalsSize);
+        std::vector<objects::Ref<objects::Object>> constants{};
+        std::vector<objects::Ref<objects::Object>> globals(vm::GlobalsSize);
         auto symbolTable = compiler::NewSymbolTable();
 
         int i = -1;
@@ -88,7 +94,11 @@ namespace repl
             } */
 
             //auto comp = compiler::New();
+#ifdef MONKEY_REGISTER_VM
+            auto comp = regvm::NewWithState(symbolTable, constants);
+#else
             auto comp = compiler::NewWithState(symbolTable, constants);
+#endif
             auto result = comp->Compile(astNode);
             if(objects::isError(result))
             {
@@ -98,7 +108,11 @@ namespace repl
 
             //auto machine = vm::New(comp->Bytecode());
             auto code = comp->Bytecode();
+#ifdef MONKEY_REGISTER_VM
+            auto machine = regvm::NewWithGlobalsStore(code, globals);
+#else
             auto machine = vm::NewWithGlobalsStore(code, globals);
+#endif
 
             auto runResult = machine->Run();
             if(objects::isError(runResult))
@@ -109,11 +123,168 @@ namespace repl
 
             // auto stackTop = machine->StackTop();
             auto stackTop = machine->LastPoppedStackElem();
-            std::cout << stackTop->Inspect() << std::endl;
+            if(stackTop != nullptr)
+            {
+                std::cout << stackTop->Inspect() << std::endl;
+            }
 
             constants = code->Constants;
             globals = machine->globals;
         }
     }
+
+    // 分层执行源码文件: 从解释器开始, 热函数编译为字节码在VM中执行, 不使用字节码缓存
+    int RunFileTiered(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "Woops! Could not open " << path << std::endl;
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+
+        auto pParser = parser::New(lexer::New(buffer.str()));
+        auto pProgram = pParser->ParseProgram();
+
+        std::vector<std::string> errors = pParser->Errors();
+        if (errors.size() > 0)
+        {
+            printParserErrors(errors);
+            return 1;
+        }
+
+        std::shared_ptr<ast::Node> astNode(reinterpret_cast<ast::Node *>(pProgram.release()));
+
+        tier::Engine engine;
+        auto result = engine.Run(astNode, objects::NewEnvironment());
+        if (objects::isError(result))
+        {
+            std::cout << "Woops! Executing failed: \n" + result->Inspect() << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // 执行源码文件; cache不为空时先查字节码缓存, 未命中则编译后写入, 否则函数体延迟到第一次调用时编译
+    // inlineReport为true时在执行后列出在调用处展开的函数调用
+    int RunFile(const std::string &path, std::shared_ptr<compiler::BytecodeCache> cache = nullptr, bool inlineReport = false)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "Woops! Could not open " << path << std::endl;
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        auto source = buffer.str();
+
+        auto symbolTable = compiler::NewSymbolTable();
+        int i = -1;
+        for (auto &fn : objects::Builtins)
+        {
+            i += 1;
+            symbolTable->DefineBuiltin(i, fn->Name);
+        }
+
+#ifdef MONKEY_REGISTER_VM
+        // 字节码缓存只保存栈式字节码, 寄存器VM每次都从源码编译
+        cache = nullptr;
+        {
+            auto pParser = parser::New(lexer::New(source));
+            auto pProgram = pParser->ParseProgram();
+
+            std::vector<std::string> errors = pParser->Errors();
+            if (errors.size() > 0)
+            {
+                printParserErrors(errors);
+                return 1;
+            }
+
+            std::shared_ptr<ast::Node> astNode(reinterpret_cast<ast::Node *>(pProgram.release()));
+
+            std::vector<objects::Ref<objects::Object>> constants{};
+            auto comp = regvm::NewWithState(symbolTable, constants);
+            auto result = comp->Compile(astNode);
+            if (objects::isError(result))
+            {
+                std::cout << "Woops! Compilation failed: \n" + result->Inspect() << std::endl;
+                return 1;
+            }
+
+            auto machine = regvm::New(comp->Bytecode());
+            auto runResult = machine->Run();
+            if (objects::isError(runResult))
+            {
+                std::cout << "Woops! Executing bytecode failed: \n" + runResult->Inspect() << std::endl;
+                return 1;
+            }
+
+            return 0;
+        }
+#endif
+
+        std::shared_ptr<compiler::InlineState> inlining;
+        auto code = (cache != nullptr) ? cache->Load(source, symbolTable) : nullptr;
+        if (code == nullptr)
+        {
+            auto pParser = parser::New(lexer::New(source));
+            pParser->Preparse = (cache == nullptr);
+            auto pProgram = pParser->ParseProgram();
+
+            std::vector<std::string> errors = pParser->Errors();
+            if (errors.size() > 0)
+            {
+                printParserErrors(errors);
+                return 1;
+            }
+
+            std::shared_ptr<ast::Node> astNode(reinterpret_cast<ast::Node *>(pProgram.release()));
+
+            std::vector<objects::Ref<objects::Object>> constants{};
+            auto comp = compiler::NewWithState(symbolTable, constants);
+            // 不写缓存时只解析和编译被调用到的函数
+            comp->LazyFunctions = (cache == nullptr);
+            comp->InlineThreshold = compiler::DefaultInlineThreshold;
+            comp->ConstantGlobals = (cache == nullptr);
+            comp->LiftClosures = true;
+            auto result = comp->Compile(astNode);
+            if (objects::isError(result))
+            {
+                std::cout << "Woops! Compilation failed: \n" + result->Inspect() << std::endl;
+                return 1;
+            }
+            inlining = comp->inlining;
+
+            code = comp->Bytecode();
+            if (cache != nullptr)
+            {
+                cache->Store(source, *code, *symbolTable);
+            }
+        }
+
+        auto machine = vm::New(code);
+        auto runResult = machine->Run();
+
+        // 延迟编译的函数体在执行时才展开其中的调用
+        if (inlineReport && inlining != nullptr)
+        {
+            for (auto &site : inlining->Sites)
+            {
+                std::cout << "inlined " << site << std::endl;
+            }
+        }
+
+        if (objects::isError(runResult))
+        {
+            std::cout << "Woops! Executing bytecode failed: \n" + runResult->Inspect() << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
 }
 #endif // H_REPL_H
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <memory>
+
+#include "compiler/compiler.hpp"
+#include "vm/vm.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
+
+// 计数分配器: 替换全局operator new, 只在counting为真时累计分配次数
+namespace alloc_counter
+{
+    bool counting = false;
+    size_t allocations = 0;
+}
+
+void *operator new(std::size_t size)
+{
+    if(alloc_counter::counting)
+    {
+        alloc_counter::allocations++;
+    }
+
+    if(void *p = std::malloc(size == 0 ? 1 : size); p != nullptr)
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#pragma GCC diagnostic pop
+
+// 只统计VM执行阶段的分配次数, 编译和VM初始化不计入
+size_t countRunAllocations(const std::string& input)
+{
+    auto compiler = compiler::New();
+    EXPECT_EQ(compiler->Compile(TestHelper(input)), nullptr);
+
+    auto machine = vm::New(compiler->Bytecode());
+
+    alloc_counter::allocations = 0;
+    alloc_counter::counting = true;
+    auto result = machine->Run();
+    alloc_counter::counting = false;
+
+    EXPECT_EQ(result, nullptr);
+    return alloc_counter::allocations;
+}
+
+std::string repeat(const std::string& prefix, const std::string& stmt, int times)
+{
+    std::string input = prefix;
+    for(int i = 0; i < times; i++)
+    {
+        input += stmt;
+    }
+    return input;
+}
+
+TEST(TestAllocationsPerOperation, BasicAssertions)
+{
+    // 数组、闭包对象来自对象池, 不经过operator new
+#ifdef MONKEY_SYSTEM_ALLOCATOR
+    const size_t pooled = 1;
+#else
+    const size_t pooled = 0;
+#endif
+
+    struct {
+        std::string prefix;
+        std::string stmt;
+        size_t perOperation;
+    } tests[] = {
+        {"let f = fn(x) { x };", "f(1);", 0},                      // 帧对象复用
+        {"let a = [1, 2, 3];", "len(a);", 0},                      // 结果来自小整数缓存
+        {"", "[1, 2, 3];", 1 + pooled},                            // 元素缓冲区 + 数组对象
+        {"let g = fn(a) { fn() { a } };", "g(1);", 1 + pooled},    // 自由变量缓冲区 + 闭包对象
+        {"let a = [1]; let b = [2];", "first(a); last(b);", 0},     // 参数缓冲区复用
+    };
+
+    for(auto &test: tests)
+    {
+        auto once = countRunAllocations(repeat(test.prefix, test.stmt, 1));
+        auto many = countRunAllocations(repeat(test.prefix, test.stmt, 101));
+
+        EXPECT_EQ(many - once, 100 * test.perOperation) << test.prefix << test.stmt;
+    }
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+
+#include "compiler/compiler.hpp"
+#include "vm/vm.hpp"
+#include "aot/aot.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
+
+#ifndef MONKEY_SOURCE_DIR
+#define MONKEY_SOURCE_DIR "."
+#endif
+
+#ifndef MONKEY_CXX
+#define MONKEY_CXX "c++"
+#endif
+
+// 所有用例生成到同一个翻译单元中(每个程序一个命名空间), 只调用一次系统编译器
+TEST(TestAotMatchesVM, BasicAssertions)
+{
+    std::vector<std::string> inputs{
+        "1 + 2 * 3 - 4 / 2",
+        "-5 + 10 > 3 == true",
+        "!(1 == 1) != !!false",
+        "if (1 > 2) { 10 } else { 20 }",
+        "if (false) { 10 }",
+        "let one = 1; let two = one + one; one + two",
+        "\"mon\" + \"key\" + \"\\\\ ?\\?= é\"",
+        "[1, 2 * 2, 3 + 3][1 + 1]",
+        "{1: 2, \"a\": [3], true: 4}[\"a\"][0]",
+        "{1: 2}[3]",
+        "let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; fib(20)",
+        "let f = fn(a, b) { let c = a * b; let d = c - a; d / 2 }; f(3, 5) + f(4, 4)",
+        "let f = fn() { }; f()",
+        "let f = fn(x) { return x; 99 }; f(7) + f(8)",
+        "let newAdder = fn(a, b) { fn(c) { a + b + c } }; let adder = newAdder(1, 2); adder(8)",
+        "let newClosure = fn(a, b) { let one = fn() { a }; let two = fn() { b }; fn() { one() + two() } }; newClosure(9, 90)()",
+        "let wrapper = fn() { let countDown = fn(x) { if (x == 0) { return 0; } else { countDown(x - 1) } }; countDown(1) }; wrapper()",
+        "let map = fn(arr, f) { let iter = fn(arr, acc) { if (len(arr) == 0) { acc } else { iter(rest(arr), push(acc, f(first(arr)))) } }; iter(arr, []) }; map([1, 2, 3], fn(x) { x * x })",
+        "len(\"four\") + len([1, 2]) + fibonacci(10)",
+        "len(1)",
+        "first([])",
+        "let h = {\"k\": 1}; let h = set(h, \"j\", 2); keys(h)",
+        "1 + true",
+        "-\"a\"",
+        "\"a\" - \"b\"",
+        "1(2)",
+        "fn(a) { a }()",
+        "{[1]: 2}",
+        "1[0]",
+        "\"a\" > \"b\"",
+    };
+
+    std::string unit;
+    std::string runner = "\nint main()\n{\n";
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        auto comp = compiler::New();
+        comp->Compile(std::shared_ptr<ast::Node>(TestHelper(inputs[i])));
+
+        aot::Options options;
+        options.Namespace = "program" + std::to_string(i);
+        options.EmitMain = false;
+
+        std::string source;
+        auto err = aot::Generate(*comp->Bytecode(), options, source);
+        ASSERT_EQ(err, nullptr) << inputs[i] << ": " << err->Inspect();
+        unit += source;
+
+        runner += "    {\n        auto result = " + options.Namespace + "::Run();\n"
+                  "        std::cout << (result == nullptr ? \"ERROR: \" + aot::Error->Inspect() : result->Inspect()) << \"\\n--\\n\";\n    }\n";
+    }
+    unit += runner + "    return 0;\n}\n";
+
+    char dir[] = "/tmp/monkey-aot-XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    std::string cpp = std::string(dir) + "/programs.cpp";
+    std::string exe = std::string(dir) + "/programs";
+    std::ofstream(cpp) << unit;
+
+    std::string command = std::string(MONKEY_CXX) + " -std=c++17 -O0" + aot::BuildDefines() + " -I" + MONKEY_SOURCE_DIR + " " + cpp + " -o " + exe;
+    ASSERT_EQ(std::system(command.c_str()), 0) << command;
+
+    std::string output;
+    FILE *pipe = popen(exe.c_str(), "r");
+    ASSERT_NE(pipe, nullptr);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0)
+    {
+        output.append(buf, n);
+    }
+    EXPECT_EQ(pclose(pipe), 0);
+
+    std::vector<std::string> results;
+    for (size_t pos = 0, end; (end = output.find("\n--\n", pos)) != std::string::npos; pos = end + 4)
+    {
+        results.push_back(output.substr(pos, end - pos));
+    }
+
+    ASSERT_EQ(results.size(), inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        // 生成的程序在运行出错时会在错误前再加"ERROR: "
+        bool failed = false;
+        auto expected = runVm(inputs[i], vmOptions(), &failed);
+        ASSERT_NE(expected, nullptr) << inputs[i];
+        EXPECT_EQ(results[i], (failed ? "ERROR: " : "") + expected->Inspect()) << inputs[i];
+    }
+
+    unlink(cpp.c_str());
+    unlink(exe.c_str());
+    rmdir(dir);
+}
+
+TEST(TestAotRejectsBadJumps, BasicAssertions)
+{
+    // 越界的跳转目标在记录之前就被拒绝
+    for (auto op : {bytecode::OpcodeType::OpJump, bytecode::OpcodeType::OpJumpNotTruthy})
+    {
+        auto ins = bytecode::Make(bytecode::OpcodeType::OpTrue, {});
+        auto jump = bytecode::Make(op, {1000});
+        ins.insert(ins.end(), jump.begin(), jump.end());
+        std::vector<objects::Ref<objects::Object>> constants;
+        compiler::ByteCode code(ins, constants);
+
+        std::string source;
+        auto err = aot::Generate(code, aot::Options{}, source);
+        ASSERT_NE(err, nullptr);
+        EXPECT_EQ(err->Inspect(), "ERROR: aot: inconsistent stack at 1000");
+    }
+}
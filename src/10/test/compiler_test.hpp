@@ -8,11 +8,12 @@
 
 #include "code/code.hpp"
 #include "compiler/compiler.hpp"
+#include "compiler/cache.hpp"
 
 extern void printParserErrors(std::vector<std::string> errors);
-extern void testIntegerObject(std::shared_ptr<objects::Object> obj, int64_t expected);
-extern void testStringObject(std::shared_ptr<objects::Object> obj, std::string expected);
-extern void testNullObject(std::shared_ptr<objects::Object> obj);
+extern void testIntegerObject(objects::Ref<objects::Object> obj, int64_t expected);
+extern void testStringObject(objects::Ref<objects::Object> obj, std::string expected);
+extern void testNullObject(objects::Ref<objects::Object> obj);
 
 std::unique_ptr<ast::Node> TestHelper(const std::string& input)
 {
@@ -50,7 +51,7 @@ void testInstructions(std::vector<bytecode::Instructions>& expected, bytecode::I
 }
 
 void testConstans(std::vector<std::variant<int, std::string, std::vector<bytecode::Instructions>>> expected,
-                  std::vector<std::shared_ptr<objects::Object>> actual)
+                  std::vector<objects::Ref<objects::Object>> actual)
 {
     EXPECT_EQ(expected.size(), actual.size());
 
@@ -73,11 +74,11 @@ void testConstans(std::vector<std::variant<int, std::string, std::vector<bytecod
 
             // std::cout << actual[i]->TypeStr() << std::endl;
 
-            if(std::shared_ptr<objects::Closure> funcObj = std::dynamic_pointer_cast<objects::Closure>(actual[i]); funcObj != nullptr)
+            if(objects::Ref<objects::Closure> funcObj = objects::refCast<objects::Closure>(actual[i]); funcObj != nullptr)
             {
                 testInstructions(ins, funcObj->Fn->Instructions);
             }
-            else if(std::shared_ptr<objects::CompiledFunction> funcObj = std::dynamic_pointer_cast<objects::CompiledFunction>(actual[i]); funcObj != nullptr)
+            else if(objects::Ref<objects::CompiledFunction> funcObj = objects::refCast<objects::CompiledFunction>(actual[i]); funcObj != nullptr)
             {
                 testInstructions(ins, funcObj->Instructions);
             }
@@ -1515,3 +1516,317 @@ TEST(TestCompileRecursiveFunctions, BasicAssertions)
 
     runCompilerTests(tests);
 } 
+
+
+TEST(TestCompileMoveLastUseArguments, BasicAssertions)
+{
+    std::vector<std::vector<bytecode::Instructions>> ins{
+        {
+            {bytecode::Make(bytecode::OpcodeType::OpGetBuiltin, {5})},
+            {bytecode::Make(bytecode::OpcodeType::OpGetLocalMove, {0})},
+            {bytecode::Make(bytecode::OpcodeType::OpConstant, {0})},
+            {bytecode::Make(bytecode::OpcodeType::OpCall, {2})},
+            {bytecode::Make(bytecode::OpcodeType::OpReturnValue)},
+        },
+        {
+            {bytecode::Make(bytecode::OpcodeType::OpGetBuiltin, {5})},
+            {bytecode::Make(bytecode::OpcodeType::OpGetLocal, {0})},
+            {bytecode::Make(bytecode::OpcodeType::OpConstant, {0})},
+            {bytecode::Make(bytecode::OpcodeType::OpCall, {2})},
+            {bytecode::Make(bytecode::OpcodeType::OpPop)},
+            {bytecode::Make(bytecode::OpcodeType::OpGetLocal, {0})},
+            {bytecode::Make(bytecode::OpcodeType::OpReturnValue)},
+        },
+    };
+
+    std::vector<CompilerTestCase>  tests
+    {
+        {
+            "fn(a){ push(a, 1) }",
+            {
+                1,
+                ins[0],
+            },
+            {
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpClosure, {1, 0})
+                },
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpPop)
+                },
+            }
+        },
+        {
+            "fn(a){ push(a, 1); a }",
+            {
+                1,
+                ins[1],
+            },
+            {
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpClosure, {1, 0})
+                },
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpPop)
+                },
+            }
+        },
+        {
+            "let a = []; let a = push(a, 1);",
+            {
+                1
+            },
+            {
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpArray, {0})
+                },
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {0})
+                },
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpGetBuiltin, {5})
+                },
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpGetGlobalMove, {0})
+                },
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpConstant, {0})
+                },
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpCall, {2})
+                },
+                {
+                    bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {0})
+                },
+            }
+        }
+    };
+
+    runCompilerTests(tests);
+}
+
+TEST(TestCompileConstantGlobals, BasicAssertions)
+{
+    auto comp = compiler::New();
+    comp->ConstantGlobals = true;
+    auto err = comp->Compile(std::shared_ptr<ast::Node>(TestHelper(
+        "let n = 10; let s = \"a\"; let t = true; let f = fn(x) { x + n }; let v = 1; let v = 2; if (t) { let w = 3; w }; f(n) + v + w + len(s)")));
+    ASSERT_EQ(err, nullptr);
+
+    // v被重新绑定, w在if中绑定, 都还从全局变量中读取
+    std::vector<bytecode::Instructions> expected{
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpTrue),
+        bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {2}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {4}),
+        bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {3}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {5}),
+        bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {4}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {6}),
+        bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {4}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {2}),
+        bytecode::Make(bytecode::OpcodeType::OpJumpNotTruthy, {52}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {7}),
+        bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {5}),
+        bytecode::Make(bytecode::OpcodeType::OpGetGlobal, {5}),
+        bytecode::Make(bytecode::OpcodeType::OpJump, {53}),
+        bytecode::Make(bytecode::OpcodeType::OpNull),
+        bytecode::Make(bytecode::OpcodeType::OpPop),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {4}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpCall, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpGetGlobal, {4}),
+        bytecode::Make(bytecode::OpcodeType::OpAdd),
+        bytecode::Make(bytecode::OpcodeType::OpGetGlobal, {5}),
+        bytecode::Make(bytecode::OpcodeType::OpAdd),
+        bytecode::Make(bytecode::OpcodeType::OpGetBuiltin, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpCall, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpAdd),
+        bytecode::Make(bytecode::OpcodeType::OpPop),
+    };
+    testInstructions(expected, comp->currentInstructions());
+
+    std::vector<bytecode::Instructions> body{
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpAdd),
+        bytecode::Make(bytecode::OpcodeType::OpReturnValue),
+    };
+    testInstructions(body, objects::staticRefCast<objects::CompiledFunction>(comp->constants[3])->Instructions);
+    EXPECT_EQ(comp->constants[2]->Inspect(), "true");
+    ASSERT_EQ(comp->constants[4]->Type(), objects::ObjectType::CLOSURE);
+    EXPECT_EQ(objects::staticRefCast<objects::Closure>(comp->constants[4])->Fn.get(), comp->constants[3].get());
+}
+
+TEST(TestBytecodeCacheRoundTrip, BasicAssertions)
+{
+    std::string input = R""(
+let greeting = "hello";
+let add = fn(a, b) { let c = a + b; c };
+let big = 1234567890123;
+let adder = fn(x) { let inner = fn(y) { x + y }; inner };
+add(len(greeting), big);
+)"";
+
+    auto comp = compiler::New();
+    auto astNode = TestHelper(input);
+    auto result = comp->Compile(std::shared_ptr<ast::Node>(std::move(astNode)));
+    EXPECT_FALSE(objects::isError(result));
+    auto code = comp->Bytecode();
+
+    auto hash = compiler::HashSource(input);
+    auto data = compiler::SerializeBytecode(*code, *comp->symbolTable, hash);
+    ASSERT_FALSE(data.empty());
+
+    auto symbols = compiler::NewSymbolTable();
+    auto loaded = compiler::DeserializeBytecode(reinterpret_cast<const uint8_t *>(data.data()), data.size(), hash, symbols);
+    ASSERT_NE(loaded, nullptr);
+
+    EXPECT_EQ(loaded->Instructions, code->Instructions);
+    ASSERT_EQ(loaded->Constants.size(), code->Constants.size());
+    for (size_t i = 0; i < code->Constants.size(); i++)
+    {
+        EXPECT_EQ(loaded->Constants[i]->Type(), code->Constants[i]->Type());
+        if (code->Constants[i]->Type() != objects::ObjectType::COMPILED_FUNCTION)
+        {
+            EXPECT_EQ(loaded->Constants[i]->Inspect(), code->Constants[i]->Inspect());
+        }
+        else
+        {
+            auto expected = objects::staticRefCast<objects::CompiledFunction>(code->Constants[i]);
+            auto actual = objects::staticRefCast<objects::CompiledFunction>(loaded->Constants[i]);
+            EXPECT_EQ(actual->Instructions, expected->Instructions);
+            EXPECT_EQ(actual->NumLocals, expected->NumLocals);
+            EXPECT_EQ(actual->NumParameters, expected->NumParameters);
+            EXPECT_EQ(actual->NumFree, expected->NumFree);
+        }
+    }
+
+    for (auto name : {"greeting", "add", "big"})
+    {
+        auto expected = comp->symbolTable->Resolve(name);
+        auto actual = symbols->Resolve(name);
+        ASSERT_NE(actual, nullptr);
+        EXPECT_EQ(actual->Scope, expected->Scope);
+        EXPECT_EQ(actual->Index, expected->Index);
+    }
+
+    // 源码变化, 截断或损坏的文件都视为未命中
+    EXPECT_EQ(compiler::DeserializeBytecode(reinterpret_cast<const uint8_t *>(data.data()), data.size(), compiler::HashSource(input + " "), nullptr), nullptr);
+    EXPECT_EQ(compiler::DeserializeBytecode(reinterpret_cast<const uint8_t *>(data.data()), data.size() - 1, hash, nullptr), nullptr);
+    auto corrupt = data;
+    corrupt[0] ^= 0xff;
+    EXPECT_EQ(compiler::DeserializeBytecode(reinterpret_cast<const uint8_t *>(corrupt.data()), corrupt.size(), hash, nullptr), nullptr);
+
+    char dir[] = "/tmp/monkey-cache-XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    auto cache = compiler::NewBytecodeCache(std::string(dir) + "/nested");
+
+    EXPECT_EQ(cache->Load(input), nullptr);
+    EXPECT_TRUE(cache->Store(input, *code, *comp->symbolTable));
+    auto cached = cache->Load(input);
+    ASSERT_NE(cached, nullptr);
+    EXPECT_EQ(cached->Instructions, code->Instructions);
+    EXPECT_EQ(cache->Load(input + "\n"), nullptr);
+    EXPECT_EQ(cache->Hits, 1);
+    EXPECT_EQ(cache->Misses, 2);
+
+    unlink(cache->PathFor(hash).c_str());
+    rmdir(cache->Dir.c_str());
+    rmdir(dir);
+}
+
+TEST(TestBytecodeCacheCorruption, BasicAssertions)
+{
+    std::string input = "let add = fn(a, b) { let c = a + b; if (c > 1) { c } else { len(\"x\") } }; add(1, 2);";
+
+    auto comp = compiler::New();
+    EXPECT_EQ(comp->Compile(std::shared_ptr<ast::Node>(TestHelper(input))), nullptr);
+    auto code = comp->Bytecode();
+
+    auto hash = compiler::HashSource(input);
+    auto data = compiler::SerializeBytecode(*code, *comp->symbolTable, hash);
+    ASSERT_FALSE(data.empty());
+
+    auto load = [&](const std::string &bytes, std::shared_ptr<compiler::MappedFile> file = nullptr) {
+        return compiler::DeserializeBytecode(reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size(), hash, nullptr, file);
+    };
+    ASSERT_NE(load(data), nullptr);
+
+    // 校验和之后任意一个字节被改动都视为未命中
+    for (size_t i = compiler::CacheHeaderSize; i < data.size(); i++)
+    {
+        auto corrupt = data;
+        corrupt[i] ^= 0x5a;
+        EXPECT_EQ(load(corrupt), nullptr) << "byte " << i;
+    }
+
+    // 校验和正确但操作数越界或跳转到指令中间的内容同样被拒绝
+    auto serialize = [&](bytecode::Instructions main, std::vector<objects::Ref<objects::Object>> constants) {
+        compiler::ByteCode bad(main, constants);
+        return compiler::SerializeBytecode(bad, *compiler::NewSymbolTable(), hash);
+    };
+    auto join = [](std::vector<bytecode::Instructions> parts) { return concatInstructions(parts); };
+    auto function = [](std::vector<bytecode::Instructions> ins, int numLocals, int numFree = 0) -> objects::Ref<objects::Object> {
+        auto fn = objects::makeRef<objects::CompiledFunction>(concatInstructions(ins), numLocals, 0);
+        fn->NumFree = numFree;
+        return fn;
+    };
+
+    EXPECT_NE(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpConstant, {0})}), {objects::newInteger(1)})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpConstant, {1})}), {objects::newInteger(1)})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpGetGlobal, {0})}), {})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpGetLocal, {0})}), {})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpGetBuiltin, {200})}), {})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpJump, {4})}), {})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpNull, {}),
+                                   bytecode::Make(bytecode::OpcodeType::OpJump, {2})}), {})), nullptr);
+    EXPECT_EQ(load(serialize(bytecode::Instructions{0xee}, {})), nullptr);
+    EXPECT_EQ(load(serialize(bytecode::Instructions{static_cast<bytecode::Opcode>(bytecode::OpcodeType::OpConstant), 0}, {})), nullptr);
+
+    auto badLocal = function({bytecode::Make(bytecode::OpcodeType::OpGetLocal, {1}),
+                              bytecode::Make(bytecode::OpcodeType::OpReturnValue, {})}, 1);
+    EXPECT_EQ(load(serialize({}, {badLocal})), nullptr);
+
+    // 捕获变量的下标超出函数的捕获变量个数, 顶层代码没有捕获变量
+    auto getFree = function({bytecode::Make(bytecode::OpcodeType::OpGetFree, {0}),
+                             bytecode::Make(bytecode::OpcodeType::OpReturnValue, {})}, 0, 1);
+    EXPECT_NE(load(serialize({}, {getFree})), nullptr);
+    auto badFree = function({bytecode::Make(bytecode::OpcodeType::OpGetFree, {1}),
+                             bytecode::Make(bytecode::OpcodeType::OpReturnValue, {})}, 0, 1);
+    EXPECT_EQ(load(serialize({}, {badFree})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpGetFree, {0})}), {})), nullptr);
+
+    // OpClosure捕获的值必须已经在栈上
+    EXPECT_NE(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpNull, {}),
+                                   bytecode::Make(bytecode::OpcodeType::OpClosure, {0, 1}),
+                                   bytecode::Make(bytecode::OpcodeType::OpPop, {})}), {getFree})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpClosure, {0, 1}),
+                                   bytecode::Make(bytecode::OpcodeType::OpPop, {})}), {getFree})), nullptr);
+
+    // 弹出的值多于压入的
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpPop, {})}), {})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpConstant, {0}),
+                                   bytecode::Make(bytecode::OpcodeType::OpAdd, {})}), {objects::newInteger(1)})), nullptr);
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpNull, {}),
+                                   bytecode::Make(bytecode::OpcodeType::OpCall, {1})}), {})), nullptr);
+    auto emptyReturn = function({bytecode::Make(bytecode::OpcodeType::OpReturnValue, {})}, 0);
+    EXPECT_EQ(load(serialize({}, {emptyReturn})), nullptr);
+
+    // 两条路径汇合时栈深度不同
+    EXPECT_EQ(load(serialize(join({bytecode::Make(bytecode::OpcodeType::OpTrue, {}),
+                                   bytecode::Make(bytecode::OpcodeType::OpJumpNotTruthy, {5}),
+                                   bytecode::Make(bytecode::OpcodeType::OpNull, {}),
+                                   bytecode::Make(bytecode::OpcodeType::OpPop, {})}), {})), nullptr);
+
+    // 延迟解码时函数的指令在首次载入常量时检查
+    auto lazyData = serialize({}, {badLocal});
+    auto file = std::make_shared<compiler::MappedFile>();
+    auto lazy = load(lazyData, file);
+    ASSERT_NE(lazy, nullptr);
+    EXPECT_TRUE(objects::isError(lazy->Loader->Load(0)));
+}
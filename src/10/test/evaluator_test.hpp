@@ -11,7 +11,7 @@
 #include "objects/environment.hpp"
 #include "evaluator/evaluator.hpp"
 
-std::shared_ptr<objects::Object> testEval(const std::string &input)
+objects::Ref<objects::Object> testEval(const std::string &input)
 {
     auto env = objects::NewEnvironment();
     std::unique_ptr<lexer::Lexer> pLexer = lexer::New(input);
@@ -22,25 +22,25 @@ std::shared_ptr<objects::Object> testEval(const std::string &input)
     return evaluator::Eval(std::move(astNode), env);
 }
 
-void testIntegerObject(std::shared_ptr<objects::Object> obj, int64_t expected)
+void testIntegerObject(objects::Ref<objects::Object> obj, int64_t expected)
 {
-    std::shared_ptr<objects::Integer> result = std::dynamic_pointer_cast<objects::Integer>(obj);
+    objects::Ref<objects::Integer> result = objects::refCast<objects::Integer>(obj);
 
     EXPECT_NE(result, nullptr);
     EXPECT_EQ(result->Value, expected);
 }
 
-void testStringObject(std::shared_ptr<objects::Object> obj, std::string expected)
+void testStringObject(objects::Ref<objects::Object> obj, std::string expected)
 {
-    std::shared_ptr<objects::String> result = std::dynamic_pointer_cast<objects::String>(obj);
+    objects::Ref<objects::String> result = objects::refCast<objects::String>(obj);
 
     EXPECT_NE(result, nullptr);
-    EXPECT_STREQ(result->Value.c_str(), expected.c_str());
+    EXPECT_STREQ(result->Flatten().c_str(), expected.c_str());
 }
 
-void testBooleanObject(std::shared_ptr<objects::Object> obj, bool expected)
+void testBooleanObject(objects::Ref<objects::Object> obj, bool expected)
 {
-    std::shared_ptr<objects::Boolean> result = std::dynamic_pointer_cast<objects::Boolean>(obj);
+    objects::Ref<objects::Boolean> result = objects::refCast<objects::Boolean>(obj);
     EXPECT_NE(result, nullptr);
 
     if (expected)
@@ -55,9 +55,9 @@ void testBooleanObject(std::shared_ptr<objects::Object> obj, bool expected)
     }
 }
 
-void testNullObject(std::shared_ptr<objects::Object> obj)
+void testNullObject(objects::Ref<objects::Object> obj)
 {
-    std::shared_ptr<objects::Null> result = std::dynamic_pointer_cast<objects::Null>(obj);
+    objects::Ref<objects::Null> result = objects::refCast<objects::Null>(obj);
     EXPECT_NE(result, nullptr);
 }
 
@@ -92,7 +92,7 @@ TEST(TestEvalIntegerExpression, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         testIntegerObject(evaluatedObj, item.expected);
     }
 }
@@ -130,7 +130,7 @@ TEST(TestEvalBooleanExpression, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         testBooleanObject(evaluatedObj, item.expected);
     }
 }
@@ -155,7 +155,7 @@ TEST(TestEvalStringExpression, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         testStringObject(evaluatedObj, item.expected);
     }
 }
@@ -176,7 +176,7 @@ TEST(TestEvalStringConcatenation, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         testStringObject(evaluatedObj, item.expected);
     }
 }
@@ -201,7 +201,7 @@ TEST(TestEvalBangOperator, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         testBooleanObject(evaluatedObj, item.expected);
     }
 }
@@ -227,7 +227,7 @@ TEST(TestEvalIfElseExpressions, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
 
         if (std::holds_alternative<int>(item.expected))
         {
@@ -291,7 +291,7 @@ f(10);)"",
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         testIntegerObject(evaluatedObj, item.expected);
     }
 }
@@ -364,9 +364,9 @@ if (10 > 1) {
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
 
-        std::shared_ptr<objects::Error> errorObj = std::dynamic_pointer_cast<objects::Error>(evaluatedObj);
+        objects::Ref<objects::Error> errorObj = objects::refCast<objects::Error>(evaluatedObj);
 
         EXPECT_NE(errorObj, nullptr);
 
@@ -392,7 +392,7 @@ TEST(TestEvalLetStatements, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         testIntegerObject(evaluatedObj, item.expected);
     }
 }
@@ -401,9 +401,9 @@ TEST(TestEvalFunctionObject, BasicAssertions)
 {
     std::string input = "fn(x) { x + 2; };";
 
-    std::shared_ptr<objects::Object> evaluatedObj = testEval(input);
+    objects::Ref<objects::Object> evaluatedObj = testEval(input);
 
-    std::shared_ptr<objects::Function> funcObj = std::dynamic_pointer_cast<objects::Function>(evaluatedObj);
+    objects::Ref<objects::Function> funcObj = objects::refCast<objects::Function>(evaluatedObj);
     EXPECT_NE(funcObj, nullptr);
     EXPECT_EQ(funcObj->Parameters.size(), 1u);
     EXPECT_STREQ(funcObj->Parameters[0]->String().c_str(), "x");
@@ -430,7 +430,7 @@ TEST(TestEvalFunctionApplication, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         testIntegerObject(evaluatedObj, item.expected);
     }
 }
@@ -450,7 +450,7 @@ let ourFunction = fn(first) {
 
 ourFunction(20) + first + second;)"";
 
-    std::shared_ptr<objects::Object> evaluatedObj = testEval(input);
+    objects::Ref<objects::Object> evaluatedObj = testEval(input);
     testIntegerObject(evaluatedObj, 70);
 }
 
@@ -484,6 +484,18 @@ TEST(TestBuiltinFunctions, BasicAssertions)
         {"let a = [1, 2, 3, 4]; rest(rest(rest(rest(rest(a))))); a;", "[1, 2, 3, 4]"},
         {"let a = [1, 2, 3, 4]; let b = push(a, 5); a;", "[1, 2, 3, 4]"},
         {"let a = [1, 2, 3, 4]; let b = push(a, 5); b;", "[1, 2, 3, 4, 5]"},
+        {"push(push([], 1), 2);", "[1, 2]"},
+        {"set({\"a\": 1}, \"b\", 2)[\"b\"];", 2},
+        {"let h = {\"a\": 1}; let g = set(h, \"a\", 5); h[\"a\"];", 1},
+        {"set([], 1, 2)", "argument to `set` must be HASH, got ARRAY"},
+        {"let h = {\"a\": 1, \"b\": 2}; let g = delete(h, \"a\"); len(keys(h)) + len(values(g));", 3},
+        {"len(keys(delete({\"a\": 1}, \"a\")))", 0},
+        {"keys(1)", "argument to `keys` must be HASH, got INTEGER"},
+        {"len(substr(\"hello world\", 6))", 5},
+        {"len(split(\"a,b,,c\", \",\"))", 4},
+        {"index_of(\"the quick brown fox\", \"brown\")", 10},
+        {"len(trim(\"  hello  \"))", 5},
+        {"substr(1, 2)", "argument to `substr` must be STRING, got INTEGER"},
         {
             R""(
 let map = fn(arr,f){
@@ -531,7 +543,7 @@ sum([1, 2, 3, 4, 5]);
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
 
         if (std::holds_alternative<int>(item.expected))
         {
@@ -542,19 +554,19 @@ sum([1, 2, 3, 4, 5]);
         {
             std::string strVal = std::get<std::string>(item.expected);
 
-            if(std::shared_ptr<objects::Array> arrObj = std::dynamic_pointer_cast<objects::Array>(evaluatedObj); arrObj != nullptr)
+            if(objects::Ref<objects::Array> arrObj = objects::refCast<objects::Array>(evaluatedObj); arrObj != nullptr)
             {
                 EXPECT_NE(arrObj, nullptr);
                 EXPECT_STREQ(arrObj->Inspect().c_str(), strVal.c_str());
             }
-            else if(std::shared_ptr<objects::Error> errObj = std::dynamic_pointer_cast<objects::Error>(evaluatedObj); errObj != nullptr)
+            else if(objects::Ref<objects::Error> errObj = objects::refCast<objects::Error>(evaluatedObj); errObj != nullptr)
             {
                 EXPECT_NE(errObj, nullptr);
                 EXPECT_STREQ(errObj->Message.c_str(), strVal.c_str());
             }
             else
             {
-                std::shared_ptr<objects::Null> nullObj = std::dynamic_pointer_cast<objects::Null>(evaluatedObj);
+                objects::Ref<objects::Null> nullObj = objects::refCast<objects::Null>(evaluatedObj);
                 EXPECT_NE(nullObj, nullptr);
                 EXPECT_STREQ(nullObj->Inspect().c_str(), strVal.c_str());
             }
@@ -567,9 +579,9 @@ TEST(TestEvalArrayLiteral, BasicAssertions)
 {
 	std::string input = "[1, 2 * 2, 3 + 3]";
 
-    std::shared_ptr<objects::Object> evaluatedObj = testEval(input);
+    objects::Ref<objects::Object> evaluatedObj = testEval(input);
 
-    std::shared_ptr<objects::Array> result = std::dynamic_pointer_cast<objects::Array>(evaluatedObj);
+    objects::Ref<objects::Array> result = objects::refCast<objects::Array>(evaluatedObj);
 
     EXPECT_NE(result, nullptr);
     EXPECT_EQ(result->Elements.size(), 3u);
@@ -634,7 +646,7 @@ TEST(TestEvalArrayIndexExpression, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         if (std::holds_alternative<int>(item.expected))
         {
             int integer = std::get<int>(item.expected);
@@ -672,9 +684,9 @@ let two = "two";
         {objects::FALSE_OBJ->GetHashKey(), 6},
     };
 
-    std::shared_ptr<objects::Object> evaluatedObj = testEval(input);
+    objects::Ref<objects::Object> evaluatedObj = testEval(input);
 
-    std::shared_ptr<objects::Hash> result = std::dynamic_pointer_cast<objects::Hash>(evaluatedObj);
+    objects::Ref<objects::Hash> result = objects::refCast<objects::Hash>(evaluatedObj);
 
     EXPECT_NE(result, nullptr);
     EXPECT_EQ(result->Pairs.size(), expected.size());
@@ -750,7 +762,7 @@ TEST(TestEvalHashIndexExpression, BasicAssertions)
 
     for (const auto &item : inputs)
     {
-        std::shared_ptr<objects::Object> evaluatedObj = testEval(item.input);
+        objects::Ref<objects::Object> evaluatedObj = testEval(item.input);
         if (std::holds_alternative<int>(item.expected))
         {
             int integer = std::get<int>(item.expected);
@@ -762,3 +774,70 @@ TEST(TestEvalHashIndexExpression, BasicAssertions)
         }
     }
 }
+
+TEST(TestCycleCollector, BasicAssertions)
+{
+    auto evalIn = [](const std::string &input, std::shared_ptr<objects::Environment> env) {
+        std::unique_ptr<lexer::Lexer> pLexer = lexer::New(input);
+        std::unique_ptr<parser::Parser> pParser = parser::New(std::move(pLexer));
+        std::unique_ptr<ast::Program> pProgram{pParser->ParseProgram()};
+
+        std::unique_ptr<ast::Node> astNode(reinterpret_cast<ast::Node *>(pProgram.release()));
+        return evaluator::Eval(std::move(astNode), env);
+    };
+
+    // 函数引用其定义环境, 环境又保存着该函数
+    auto env = objects::NewEnvironment();
+    evalIn("let f = fn(n) { if (n == 0) { 0 } else { f(n - 1) } }; let a = [fn() { a }];", env);
+    std::weak_ptr<objects::Environment> weak = env;
+
+    objects::GC.Collect();
+    EXPECT_FALSE(weak.expired());
+    testIntegerObject(evalIn("f(10)", env), 0);
+
+    env.reset();
+    EXPECT_FALSE(weak.expired());
+    EXPECT_GE(objects::GC.Collect(), 4u);
+    EXPECT_TRUE(weak.expired());
+
+    // 每次调用都留下一个 调用环境 <-> 内部函数 的环
+    env = objects::NewEnvironment();
+    evalIn("let make = fn() { let g = fn() { g }; g };", env);
+    objects::GC.Collect();
+
+    auto before = objects::GC.Collected;
+    evalIn("make(); make(); make();", env);
+    objects::GC.Collect();
+    EXPECT_GE(objects::GC.Collected - before, 6u);
+    EXPECT_EQ(evalIn("make()", env)->Type(), objects::ObjectType::FUNCTION);
+
+    // 经过Hash的环: 环境 -> Hash -> 函数 -> 环境, 派生的新版本与原Hash共享节点
+    env = objects::NewEnvironment();
+    evalIn("let h = {\"f\": fn() { h }, \"v\": 1}; let g = set(h, \"w\", 2);", env);
+    weak = env;
+    objects::GC.Collect();
+    testIntegerObject(evalIn("h[\"f\"]()[\"v\"] + g[\"v\"] + g[\"w\"]", env), 4);
+    env.reset();
+    EXPECT_GE(objects::GC.Collect(), 3u);
+    EXPECT_TRUE(weak.expired());
+    env = objects::NewEnvironment();
+    evalIn("let make = fn() { let g = fn() { g }; g };", env);
+
+    // 跟踪数达到阈值时自动回收
+    auto threshold = objects::GC.Threshold;
+    auto collections = objects::GC.Collections;
+    objects::GC.Threshold = 64;
+    testIntegerObject(evalIn("let loop = fn(n) { if (n == 0) { 0 } else { loop(n - 1) } }; loop(500)", env), 0);
+    objects::GC.Threshold = threshold;
+    EXPECT_GT(objects::GC.Collections, collections);
+}
+
+TEST(TestFunctionOutlivesProgram, BasicAssertions)
+{
+    // testEval返回时Program及其arena已不再被持有, 函数对象需要让函数体保持存活
+    auto fn = objects::refCast<objects::Function>(testEval("fn(x, y) { x * y + 1 };"));
+    ASSERT_NE(fn, nullptr);
+
+    EXPECT_STREQ(fn->Body->String().c_str(), "((x * y) + 1)");
+    EXPECT_STREQ(fn->Parameters[1]->String().c_str(), "y");
+}
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "parser/parser.hpp"
+#include "compiler/compiler.hpp"
+#include "vm/vm.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
+
+TEST(TestInlineSites, BasicAssertions)
+{
+    auto comp = compiler::New();
+    comp->InlineThreshold = 8;
+    auto err = comp->Compile(std::shared_ptr<ast::Node>(TestHelper(
+        "let g = 1; let inc = fn(x) { x + g }; let big = fn(x) { x + x + x + x + x }; let again = fn(x) { x }; let again = 2; "
+        "let h = fn(g) { inc(g * 10) + big(g) + inc(1, 2) }; inc(inc(2)) + h(3)")));
+    ASSERT_EQ(err, nullptr);
+
+    // big超过了大小限制, again被重新定义过, 参数个数不对的调用保持原样; h中展开的inc仍然读全局的g
+    EXPECT_EQ(comp->inlining->Sites, (std::vector<std::string>{"inc((g * 10))", "inc(2)", "inc(inc(2))"}));
+
+    auto expected = bytecode::Instructions{};
+    for (auto &ins : std::vector<bytecode::Instructions>{
+             bytecode::Make(bytecode::OpcodeType::OpConstant, {9}),
+             bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {5}),
+             bytecode::Make(bytecode::OpcodeType::OpGetGlobal, {5}),
+             bytecode::Make(bytecode::OpcodeType::OpGetGlobal, {0}),
+             bytecode::Make(bytecode::OpcodeType::OpAdd, {}),
+             bytecode::Make(bytecode::OpcodeType::OpSetGlobal, {5}),
+             bytecode::Make(bytecode::OpcodeType::OpGetGlobal, {5}),
+             bytecode::Make(bytecode::OpcodeType::OpGetGlobal, {0}),
+             bytecode::Make(bytecode::OpcodeType::OpAdd, {}),
+         })
+    {
+        expected.insert(expected.end(), ins.begin(), ins.end());
+    }
+    auto &main = comp->currentInstructions();
+    EXPECT_NE(std::search(main.begin(), main.end(), expected.begin(), expected.end()), main.end());
+
+    auto machine = vm::New(comp->Bytecode());
+    auto result = machine->Run();
+    ASSERT_NE(result, nullptr);
+    EXPECT_EQ(result->Inspect(), "ERROR: wrong number of arguments: want=1, got=2");
+}
+
+TEST(TestInlineMatchesVM, BasicAssertions)
+{
+    std::vector<vmTestCases> tests{
+        {"let g = 1; let inc = fn(x) { let y = x + g; y }; let h = fn(g) { inc(g * 10) }; [h(5), inc(inc(1))]", "[51, 3]"s},
+        {"let f = fn() {}; 1; f()", nullptr},
+        {"let f = fn(a) { let b = a; }; f(1)", nullptr},
+        {"let f = fn(a) { if (a > 1) { 1 } }; [f(0), f(2)]", "[null, 1]"s},
+        {"let f = fn(a) { a }; f(1, 2)", "wrong number of arguments: want=1, got=2"s},
+        {"let f = fn(a) { a }; let f = fn(a) { a + 1 }; f(1)", 2},
+        {"let f = fn(a) { a }; let g = fn(f) { f(1) }; g(fn(x) { x * 100 })", 100},
+        {"let f = fn(a) { a + 1 }; let ap = fn(h, x) { h(x) }; ap(f, 1) + f(2)", 5},
+        {"let f = fn(x) { len(x) }; let len = fn(x) { 7 }; f([1]) + len(1)", 8},
+        {"let f = fn(a) { if (a > 1) { a } else { 0 } }; let g = fn(x) { f(x) + f(x * 2) }; [g(1), g(2)]", "[2, 6]"s},
+        {"let less = fn(a, b) { a < b }; let minus = fn(a, b) { a - b }; let fib = fn(x) { if (less(x, 2)) { x } else { fib(minus(x, 1)) + fib(minus(x, 2)) } }; fib(15)", 610},
+        {"let swap = fn(a, b) { [b, a] }; let a = 1; let b = 2; swap(swap(a, b)[0], swap(a, b)[1])", "[1, 2]"s},
+        {"let head = fn(arr) { arr[0] }; let f = fn(x) { let arr = [x, x]; head(arr) + head(push(arr, 3)) }; f(4)", 8},
+        {"let add = fn(a, b) { a + b }; let f = fn(a) { let g = fn(b) { add(a, b) }; g(2) }; f(1)", 3},
+        {"let bad = fn(a) { a + true }; let f = fn() { bad(1) }; f()", "unsupported types for binary operaction: INTEGER BOOLEAN"s},
+        {"let k = fn() { \"s\" }; let f = fn() { { k(): k() }[\"s\"] }; f()", "s"s},
+        {"let f = fn(x){ if (x) { } else { 5 } }; [f(true), f(false)]", "[null, 5]"s},
+        {"let f = fn(x){ if (x) { let y = 1; } else { 5 } }; [f(true), f(false)]", "[null, 5]"s},
+    };
+
+    vmOptions options;
+    options.InlineThreshold = compiler::DefaultInlineThreshold;
+    runVmTests(tests, options);
+    options.LazyFunctions = true;
+    runVmTests(tests, options);
+    options.Preparse = true;
+    runVmTests(tests, options);
+}
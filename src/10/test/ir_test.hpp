@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "compiler/compiler.hpp"
+#include "vm/vm.hpp"
+#include "ir/compiler.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
+
+int countOps(const ir::Function &fn, ir::Op op)
+{
+    int n = 0;
+    for (auto &block : fn.blocks)
+    {
+        for (auto instr : block->Instrs)
+        {
+            n += (instr->Opcode == op) ? 1 : 0;
+        }
+    }
+    return n;
+}
+
+TEST(TestIRBuilder, BasicAssertions)
+{
+    ir::Module module;
+    ir::Builder builder(&module);
+    auto err = builder.Build(std::shared_ptr<ast::Node>(TestHelper("let f = fn(x) { let y = 1; if (x > 0) { let y = x; }; y }; f(2)")));
+    ASSERT_EQ(err, nullptr);
+    ASSERT_EQ(module.Functions.size(), 2);
+
+    EXPECT_EQ(ir::String(*module.Functions[1]),
+              "fn f(1)\n"
+              "b0:\n"
+              "  v0 = param 0\n"
+              "  v1 = const 1\n"
+              "  v2 = copy v1\n"
+              "  v3 = const 2\n"
+              "  v4 = compare > v0 v3\n"
+              "  branch v4 b1 b2\n"
+              "b1: <- b0\n"
+              "  v6 = copy v0\n"
+              "  v7 = null\n"
+              "  jump b3\n"
+              "b2: <- b0\n"
+              "  v8 = null\n"
+              "  jump b3\n"
+              "b3: <- b1 b2\n"
+              "  v11 = phi v6 v2\n"
+              "  v12 = phi v7 v8\n"
+              "  return v11\n");
+
+    ir::DefaultPipeline().Run(module);
+    EXPECT_EQ(countOps(*module.Functions[1], ir::Op::Copy), 0);
+    EXPECT_EQ(countOps(*module.Functions[1], ir::Op::Phi), 1);
+}
+
+TEST(TestIRValueNumbering, BasicAssertions)
+{
+    ir::Module module;
+    ir::Builder builder(&module);
+    auto err = builder.Build(std::shared_ptr<ast::Node>(TestHelper(
+        "let f = fn(a, b) { let x = a * b; if (a > 1) { a * b + g } else { x + a * b } }; let g = 1;")));
+    ASSERT_EQ(err->Inspect(), "ERROR: undefined variable g");
+
+    ir::Module numbered;
+    ir::Builder other(&numbered);
+    err = other.Build(std::shared_ptr<ast::Node>(TestHelper(
+        "let g = 1; let f = fn(a, b) { let x = a * b; if (a > g) { a * b + g } else { x + a * b * g } }; f(2, 3)")));
+    ASSERT_EQ(err, nullptr);
+
+    auto &fn = *numbered.Functions[1];
+    EXPECT_EQ(countOps(fn, ir::Op::Binary), 6);
+    EXPECT_EQ(countOps(fn, ir::Op::GetGlobal), 3);
+
+    // 只做块内CSE时分支中的a * b无法和入口块中的合并
+    auto pipeline = ir::DefaultPipeline();
+    pipeline.Enable("gvn", false);
+    pipeline.Run(numbered);
+    EXPECT_EQ(countOps(fn, ir::Op::Binary), 6);
+
+    pipeline.Enable("gvn", true);
+    pipeline.Run(numbered);
+    EXPECT_EQ(countOps(fn, ir::Op::Binary), 4);
+    EXPECT_EQ(countOps(fn, ir::Op::GetGlobal), 1);
+}
+
+TEST(TestIRMatchesVM, BasicAssertions)
+{
+    std::vector<vmTestCases> tests{
+        {"1 + 2 * 3 - 4 / 2", 5},
+        {"-5 + 10 > 3 == true", true},
+        {"1 < 2; 2 < 1", false},
+        {"!(1 == 1) != !!false", false},
+        {"!if (false) { 1 }", false},
+        {"if (1 > 2) { 10 } else { 20 }", 20},
+        {"if (1 < 2) { 10 }", 10},
+        {"if (false) { 10 }", nullptr},
+        {"if (if (false) { 1 }) { 1 } else { 2 }", 2},
+        {"if (\"a\" == \"a\") { 1 } else { 2 }", 2},
+        {"let one = 1; let two = one + one; one + two", 3},
+        {"let a = 1; let a = a + 1; a", 2},
+        {"let a = if (true) { 1 } else { 2 }; a", 1},
+        {"let a = 1; if (a > 0) { let a = 5; a }; a", 5},
+        {"\"mon\" + \"key\"", "monkey"s},
+        {"[1, 2 * 2, 3 + 3][1 + 1]", 6},
+        {"[]", "[]"s},
+        {"{1: 2, \"a\": [3], true: 4}[\"a\"][0]", 3},
+        {"{}", "{}"s},
+        {"{1: 2}[3]", nullptr},
+        {"let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; fib(20)", 6765},
+        {"let fib = fn(x) { if (x == 0) { return 0; } else { if (x == 1) { return 1; } else { return fib(x - 1) + fib(x - 2); } } }; fib(15)", 610},
+        {"let f = fn(a, b) { let c = a * b; let d = c - a; d / 2 }; f(3, 5) + f(4, 4)", 12},
+        {"let f = fn(a) { let a = a * 2; a }; f(21)", 42},
+        {"let f = fn(a) { a + if (true) { let a = 5; a } else { 0 } }; f(1)", 6},
+        {"let f = fn(x) { if (x > 1) { let y = x; y } }; [f(1), f(2)]", "[null, 2]"s},
+        {"let f = fn(x) { let y = 0; if (x > 1) { let y = x * 2; y } else { let y = x - 1; 0 }; y }; [f(1), f(5)]", "[0, 10]"s},
+        {"let f = fn(x) { let y = x; if (x > 1) { let z = 2; z }; y }; f(3)", 3},
+        {"let f = fn(x) { if (x > 1) { return x; }; x - 1 }; [f(1), f(5)]", "[0, 5]"s},
+        {"let f = fn(x) { if (x > 1) { return 1; } else { return 2; }; 3 }; [f(1), f(5)]", "[2, 1]"s},
+        {"let f = fn(a, b) { let x = a * b; if (a > b) { a * b } else { x + a * b } }; [f(2, 3), f(3, 2)]", "[12, 6]"s},
+        {"let f = fn(s) { (s + \"x\") == (s + \"x\") }; f(\"y\")", false},
+        {"let f = fn(a) { [a] == [a] }; f(1)", false},
+        {"let g = 2; let f = fn(a) { a * g + a * g }; f(5)", 20},
+        {"let f = fn() { }; f()", nullptr},
+        {"let f = fn() { let a = 1; }; f()", nullptr},
+        {"let f = fn(x) { return x; 99 }; f(7) + f(8)", 15},
+        {"let newAdder = fn(a, b) { fn(c) { a + b + c } }; let adder = newAdder(1, 2); adder(8)", 11},
+        {"let newClosure = fn(a, b) { let one = fn() { a }; let two = fn() { b }; fn() { one() + two() } }; newClosure(9, 90)()", 99},
+        {"let f = fn(a) { let g = fn(b) { if (b > 0) { a + b } else { a } }; g(1) + g(0) }; f(10)", 21},
+        {"let wrapper = fn() { let countDown = fn(x) { if (x == 0) { return 0; } else { countDown(x - 1) } }; countDown(1) }; wrapper()", 0},
+        {"let map = fn(arr, f) { let iter = fn(arr, acc) { if (len(arr) == 0) { acc } else { iter(rest(arr), push(acc, f(first(arr)))) } }; iter(arr, []) }; map([1, 2, 3], fn(x) { x * x })", "[1, 4, 9]"s},
+        {"let f = fn(h, k) { h[k] }; f({\"x\": 1, \"y\": 2}, \"y\")", 2},
+        {"let f = fn(a, b) { puts(a); puts(b); a - b }; f(2, 1)", 1},
+        {"len(\"four\") + len([1, 2]) + fibonacci(10)", 61},
+        {"len(1)", "argument to `len` not supported, got INTEGER"s},
+        {"puts()", nullptr},
+        {"1 + true", "unsupported types for binary operaction: INTEGER BOOLEAN"s},
+        {"\"a\" - \"b\"", "unknow string operator: -"s},
+        {"-true", "unsupported type for negation: BOOLEAN"s},
+        {"true > false", "unknow operator: > (BOOLEAN BOOLEAN)"s},
+        {"if (true > false) { 1 }", "unknow operator: > (BOOLEAN BOOLEAN)"s},
+        {"{[1]: 2}", "unusable as hash type: ARRAY"s},
+        {"[1][true]", "index operator not supported: ARRAY"s},
+        {"1(2)", "calling non-function and non-built-in"s},
+        {"fn(a) { a }()", "wrong number of arguments: want=1, got=0"s},
+        {"let f = fn() { 1 + true }; let g = fn() { f() }; g()", "unsupported types for binary operaction: INTEGER BOOLEAN"s},
+        {"let f = fn(a) { let unused = [a, a * 2]; a }; f(1)", 1},
+    };
+
+    vmOptions options;
+    options.Backend = vmBackend::IR;
+    runVmTests(tests, options);
+    options.Backend = vmBackend::IRUnoptimized;
+    runVmTests(tests, options);
+}
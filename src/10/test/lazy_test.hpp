@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "parser/parser.hpp"
+#include "compiler/compiler.hpp"
+#include "vm/vm.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
+
+std::shared_ptr<ast::Node> preparse(const std::string &input)
+{
+    auto pParser = parser::New(lexer::New(input));
+    pParser->Preparse = true;
+    return std::shared_ptr<ast::Node>(pParser->ParseProgram().release());
+}
+
+int countLazyFunctions(const std::vector<objects::Ref<objects::Object>> &constants)
+{
+    int n = 0;
+    for (auto &constant : constants)
+    {
+        if (constant->Type() == objects::ObjectType::COMPILED_FUNCTION &&
+            objects::staticRefCast<objects::CompiledFunction>(constant)->Lazy != nullptr)
+        {
+            n++;
+        }
+    }
+    return n;
+}
+
+TEST(TestLazyFunctionStubs, BasicAssertions)
+{
+    auto comp = compiler::New();
+    comp->LazyFunctions = true;
+    auto err = comp->Compile(std::shared_ptr<ast::Node>(TestHelper(
+        "let f = fn(a) { let g = fn(b) { a + b }; g(1) }; let unused = fn() { \"never\" }; f(2)")));
+    ASSERT_EQ(err, nullptr);
+
+    // 只有顶层的两个函数生成了占位常量, 函数体中的常量还没有编译
+    EXPECT_EQ(comp->constants.size(), 3);
+    EXPECT_EQ(countLazyFunctions(comp->constants), 2);
+
+    auto machine = vm::New(comp->Bytecode());
+    ASSERT_EQ(machine->Run(), nullptr);
+    EXPECT_EQ(machine->LastPoppedStackElem()->Inspect(), "3");
+
+    // f和其中的g在调用时编译, unused一直保持未编译
+    EXPECT_EQ(countLazyFunctions(machine->constants), 1);
+    EXPECT_EQ(machine->constants.size(), 5);
+
+    // 名字在定义时解析: 之后定义的全局变量不可见, 之后被覆盖的内置函数保持原来的绑定
+    std::vector<vmTestCases> tests{
+        {"let f = fn() { g() }; let g = fn() { 1 }; f()", "undefined variable g"s},
+        {"let f = fn(x) { len(x) }; let len = fn(x) { 7 }; f([1]) + len(1)", 8},
+    };
+    vmOptions options;
+    options.LazyFunctions = true;
+    runVmTests(tests, options);
+}
+
+TEST(TestLazyMatchesEager, BasicAssertions)
+{
+    std::vector<vmTestCases> tests{
+        {"let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; fib(15)", 610},
+        {"let f = fn(a, b) { let c = a * b; let d = c - a; d / 2 }; f(3, 5) + f(4, 4)", 12},
+        {"let f = fn() { }; f()", nullptr},
+        {"let f = fn(x) { return x; 99 }; f(7) + f(8)", 15},
+        {"let newAdder = fn(a, b) { fn(c) { a + b + c } }; let adder = newAdder(1, 2); [adder(8), adder(9), newAdder(3, 4)(5)]", "[11, 12, 12]"s},
+        {"let newClosure = fn(a, b) { let one = fn() { a }; let two = fn() { b }; fn() { one() + two() } }; newClosure(9, 90)()", 99},
+        {"let f = fn(a) { let g = fn() { fn() { a } }; g()() }; f(4)", 4},
+        {"let f = fn(a) { let b = a; let g = fn() { let a = 5; a + b }; g() + a }; f(1)", 7},
+        {"let f = fn(a) { let g = fn() { a }; let a = 10; g() + a }; f(1)", 11},
+        {"let wrapper = fn() { let countDown = fn(x) { if (x == 0) { return 0; } else { countDown(x - 1) } }; countDown(3) }; wrapper()", 0},
+        {"let map = fn(arr, f) { let iter = fn(arr, acc) { if (len(arr) == 0) { acc } else { iter(rest(arr), push(acc, f(first(arr)))) } }; iter(arr, []) }; map([1, 2, 3], fn(x) { x * x })", "[1, 4, 9]"s},
+        {"let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } }; let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } }; [even(10), odd(7)]", "undefined variable odd"s},
+        {"let g = 2; let f = fn(a) { {\"k\": a * g}[\"k\"] + [g][0] }; let g = 3; f(5)", 18},
+        {"let f = fn(s) { s + \"!\" }; f(\"a\") + f(\"b\")", "a!b!"s},
+        {"let f = fn(a) { a }; f(1, 2)", "wrong number of arguments: want=1, got=2"s},
+        {"let f = fn() { 1 + true }; let g = fn() { f() }; g()", "unsupported types for binary operaction: INTEGER BOOLEAN"s},
+        {"let f = fn() { h }; 1", "undefined variable h"s},
+    };
+
+    vmOptions options;
+    options.LazyFunctions = true;
+    runVmTests(tests, options);
+    options.Preparse = true;
+    runVmTests(tests, options);
+}
+
+TEST(TestPreparsedFunctions, BasicAssertions)
+{
+    // 只知道名字不知道出现顺序: 之后定义的局部变量同名的外层变量也被捕获, 结果不变
+    auto comp = compiler::New();
+    comp->LazyFunctions = true;
+    auto err = comp->Compile(preparse("let f = fn(a, b) { let g = fn() { let a = 1; a }; g() + b }; f(5, 6)"));
+    ASSERT_EQ(err, nullptr);
+
+    auto machine = vm::New(comp->Bytecode());
+    ASSERT_EQ(machine->Run(), nullptr);
+    EXPECT_EQ(machine->LastPoppedStackElem()->Inspect(), "7");
+
+    // 函数体的语法错误在第一次调用时报告
+    std::vector<vmTestCases> errors{
+        {"let f = fn() { 1 + }; let g = fn() { 2 }; g()", 2},
+        {"let f = fn() { 1 + }; f()", "no prefix parse function for } found"s},
+    };
+    vmOptions options;
+    options.LazyFunctions = true;
+    options.Preparse = true;
+    runVmTests(errors, options);
+
+    // 解释器和没有延迟编译的编译器在用到函数时解析函数体
+    std::vector<vmTestCases> tests{
+        {"let newAdder = fn(a, b) { fn(c) { a + b + c } }; let adder = newAdder(1, 2); [adder(8), newAdder(3, 4)(5)]", "[11, 12]"s},
+        {"let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; fib(10)", 55},
+    };
+    for (auto &test : tests)
+    {
+        SCOPED_TRACE(test.input);
+        testExpectedObject(test.expected, evaluator::Eval(preparse(test.input), objects::NewEnvironment()));
+    }
+    options.LazyFunctions = false;
+    runVmTests(tests, options);
+}
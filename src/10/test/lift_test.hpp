@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "parser/parser.hpp"
+#include "compiler/compiler.hpp"
+#include "vm/vm.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
+
+TEST(TestLiftClosures, BasicAssertions)
+{
+    auto comp = compiler::New();
+    comp->LiftClosures = true;
+    auto err = comp->Compile(std::shared_ptr<ast::Node>(TestHelper(
+        "let f = fn(a, b) { let c = a * 2; let g = fn(x) { x + c + b }; let h = fn() { a }; g(1) + g(2) + len([h]) }; f(3, 4)")));
+    ASSERT_EQ(err, nullptr);
+
+    // g捕获的c和b排在参数x之后; h被当作值传出, 仍然是闭包
+    std::vector<bytecode::Instructions> lifted{
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpAdd),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {2}),
+        bytecode::Make(bytecode::OpcodeType::OpAdd),
+        bytecode::Make(bytecode::OpcodeType::OpReturnValue),
+    };
+    auto g = objects::staticRefCast<objects::CompiledFunction>(comp->constants[1]);
+    testInstructions(lifted, g->Instructions);
+    EXPECT_EQ(g->NumParameters, 3);
+    EXPECT_EQ(g->NumLocals, 3);
+
+    std::vector<bytecode::Instructions> caller{
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpMul),
+        bytecode::Make(bytecode::OpcodeType::OpSetLocal, {2}),
+        bytecode::Make(bytecode::OpcodeType::OpClosure, {1, 0}),
+        bytecode::Make(bytecode::OpcodeType::OpSetLocal, {3}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpClosure, {2, 1}),
+        bytecode::Make(bytecode::OpcodeType::OpSetLocal, {4}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {3}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {3}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {2}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpCall, {3}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {3}),
+        bytecode::Make(bytecode::OpcodeType::OpConstant, {4}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {2}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpCall, {3}),
+        bytecode::Make(bytecode::OpcodeType::OpAdd),
+        bytecode::Make(bytecode::OpcodeType::OpGetBuiltin, {0}),
+        bytecode::Make(bytecode::OpcodeType::OpGetLocal, {4}),
+        bytecode::Make(bytecode::OpcodeType::OpArray, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpCall, {1}),
+        bytecode::Make(bytecode::OpcodeType::OpAdd),
+        bytecode::Make(bytecode::OpcodeType::OpReturnValue),
+    };
+    testInstructions(caller, objects::staticRefCast<objects::CompiledFunction>(comp->constants[5])->Instructions);
+
+    auto machine = vm::New(comp->Bytecode());
+    ASSERT_EQ(machine->Run(), nullptr);
+    EXPECT_EQ(machine->LastPoppedStackElem()->Inspect(), "24");
+
+    // 没有捕获变量的闭包每次OpClosure都是同一个对象
+    auto plain = compiler::New();
+    ASSERT_EQ(plain->Compile(std::shared_ptr<ast::Node>(TestHelper("let mk = fn() { fn() { 1 } }; [mk(), mk(), fn() { 2 }]"))), nullptr);
+    auto shared = vm::New(plain->Bytecode());
+    ASSERT_EQ(shared->Run(), nullptr);
+    auto elements = objects::staticRefCast<objects::Array>(shared->LastPoppedStackElem())->Elements;
+    EXPECT_EQ(elements[0].get(), elements[1].get());
+    EXPECT_NE(elements[0].get(), elements[2].get());
+}
+
+TEST(TestLiftMatchesVM, BasicAssertions)
+{
+    std::vector<vmTestCases> tests{
+        {"let f = fn(a, b) { let c = a * 2; let g = fn(x) { x + c + b }; g(1) + g(2) }; f(3, 4)", 23},
+        {"let f = fn(a) { let g = fn(x) { x + a }; let a = 100; g(1) }; f(1)", 2},
+        {"let f = fn(a) { let g = fn(x) { x + a }; [g(1), len([g])] }; f(1)", "[2, 1]"s},
+        {"let f = fn(a) { let g = fn(x) { if (x > 0) { g(x - 1) + a } else { 0 } }; g(3) }; f(2)", 6},
+        {"let f = fn(a) { let g = fn(x) { x + a }; let h = fn() { g(1) }; h() }; f(1)", 2},
+        {"let f = fn(a) { let g = fn(x) { x + a }; g(1, 2) }; f(1)", "wrong number of arguments: want=1, got=2"s},
+        {"let f = fn(a) { if (a > 0) { let g = fn(x) { x + a }; g(1) } else { 0 } }; f(1)", 2},
+        {"let f = fn(a) { let g = fn(x) { let h = fn(y) { y + a + x }; h(10) }; g(1) + g(2) }; f(1)", 25},
+        {"let f = fn(a) { let b = a + 1; let g = fn() { fn() { a + b } }; g()() }; f(1)", 3},
+        {"let f = fn(a) { let g = fn(x) { x + a + f(0) * 0 }; if (a > 0) { g(1) } else { 5 } }; f(1)", 2},
+        {"let f = fn(arr) { let g = fn(x) { push(arr, x) }; [g(1), g(2), arr] }; f([0])", "[[0, 1], [0, 2], [0]]"s},
+        {"let f = fn(a) { let g = fn(x) { let a = x * 2; a }; g(5) + a }; f(1)", 11},
+        {"let f = fn(a) { let g = fn() { a }; let g = fn() { a + 1 }; g() }; f(1)", 2},
+        {"let f = fn(g) { let g = fn() { 5 }; g() }; f(1)", 5},
+        {"let outer = fn(a) { fn(b) { let g = fn(c) { a + b + c }; g(3) } }; outer(1)(2)", 6},
+        {"let f = fn(a) { let g = fn(x) { x + a + true }; g(1) }; f(1)", "unsupported types for binary operaction: INTEGER BOOLEAN"s},
+    };
+
+    vmOptions options;
+    options.LiftClosures = true;
+    runVmTests(tests, options);
+    options.LazyFunctions = true;
+    runVmTests(tests, options);
+    options.Preparse = true;
+    runVmTests(tests, options);
+}
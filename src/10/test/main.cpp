@@ -9,6 +9,14 @@
 #include "test/compiler_test.hpp"
 #include "test/symbol_table_test.hpp"
 #include "test/vm_test.hpp"
+#include "test/allocation_test.hpp"
+#include "test/aot_test.hpp"
+#include "test/regvm_test.hpp"
+#include "test/ir_test.hpp"
+#include "test/tier_test.hpp"
+#include "test/lazy_test.hpp"
+#include "test/inline_test.hpp"
+#include "test/lift_test.hpp"
 
 int main(int argc, char **argv)
 {
@@ -2,8 +2,13 @@
 
 #include <vector>
 #include <memory>
+#include <thread>
 
 #include "objects/objects.hpp"
+#include "objects/builtins.hpp"
+#include "compiler/compiler.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
 
 TEST(TestStringHashKey, BasicAssertions)
 {
@@ -18,3 +23,376 @@ TEST(TestStringHashKey, BasicAssertions)
 
     EXPECT_NE(hello1.GetHashKey(), diff1.GetHashKey());
 }
+
+TEST(TestBuiltinPushInPlace, BasicAssertions)
+{
+    std::vector<objects::Ref<objects::Object>> elements{objects::makeRef<objects::Integer>(1)};
+
+    std::vector<objects::Ref<objects::Object>> args{objects::makeRef<objects::Array>(elements), objects::makeRef<objects::Integer>(2)};
+    auto array = args[0].get();
+    auto result = objects::BuiltinFunc_Push(args);
+    args.clear();
+
+    EXPECT_EQ(result.get(), array);
+    EXPECT_STREQ(result->Inspect().c_str(), "[1, 2]");
+
+    objects::Ref<objects::Object> shared = objects::makeRef<objects::Array>(elements);
+    args = {shared, objects::makeRef<objects::Integer>(2)};
+    result = objects::BuiltinFunc_Push(args);
+
+    EXPECT_NE(result, shared);
+    EXPECT_STREQ(shared->Inspect().c_str(), "[1]");
+    EXPECT_STREQ(result->Inspect().c_str(), "[1, 2]");
+}
+
+TEST(TestBuiltinSetInPlace, BasicAssertions)
+{
+    std::vector<objects::Ref<objects::Object>> args{objects::makeRef<objects::Hash>(), objects::makeRef<objects::String>("a"), objects::makeRef<objects::Integer>(1)};
+    auto hash = args[0].get();
+    auto result = objects::BuiltinFunc_Set(args);
+    args.clear();
+
+    EXPECT_EQ(result.get(), hash);
+    EXPECT_STREQ(result->Inspect().c_str(), "{\"a\": 1}");
+
+    objects::Ref<objects::Object> shared = objects::makeRef<objects::Hash>();
+    args = {shared, objects::makeRef<objects::String>("a"), objects::makeRef<objects::Integer>(1)};
+    result = objects::BuiltinFunc_Set(args);
+
+    EXPECT_NE(result, shared);
+    EXPECT_STREQ(shared->Inspect().c_str(), "{}");
+}
+
+TEST(TestHashTrie, BasicAssertions)
+{
+    auto pairOf = [](int64_t k, int64_t v) {
+        return std::make_shared<objects::HashPair>(objects::makeRef<objects::Integer>(k), objects::makeRef<objects::Integer>(v));
+    };
+
+    objects::HashPairs trie;
+    for(int64_t i = 0; i < 5000; i++)
+    {
+        trie.Insert(objects::Integer(i * 32).GetHashKey(), pairOf(i * 32, i));
+    }
+    EXPECT_EQ(trie.size(), 5000u);
+
+    auto updated = trie.Set(objects::Integer(64).GetHashKey(), pairOf(64, -1));
+    auto removed = updated.Remove(objects::Integer(32).GetHashKey());
+
+    EXPECT_EQ(updated.size(), 5000u);
+    EXPECT_EQ(removed.size(), 4999u);
+    EXPECT_EQ(trie.find(objects::Integer(64).GetHashKey())->second->Value->Inspect(), "2");
+    EXPECT_EQ(updated.find(objects::Integer(64).GetHashKey())->second->Value->Inspect(), "-1");
+    EXPECT_TRUE(updated.contains(objects::Integer(32).GetHashKey()));
+    EXPECT_FALSE(removed.contains(objects::Integer(32).GetHashKey()));
+    EXPECT_FALSE(trie.contains(objects::Integer(33).GetHashKey()));
+
+    size_t visited = 0;
+    for(auto &[key, pair]: removed)
+    {
+        EXPECT_EQ(key, pair->Key->GetHashKey());
+        visited++;
+    }
+    EXPECT_EQ(visited, 4999u);
+
+    // 整数1和true的HashKey.Value相同, 落在同一个冲突节点
+    objects::HashPairs collided;
+    collided.Insert(objects::Integer(1).GetHashKey(), pairOf(1, 1));
+    collided.Insert(objects::TRUE_OBJ->GetHashKey(), pairOf(1, 2));
+    EXPECT_EQ(collided.size(), 2u);
+    EXPECT_EQ(collided.find(objects::TRUE_OBJ->GetHashKey())->second->Value->Inspect(), "2");
+
+    collided.Erase(objects::Integer(1).GetHashKey());
+    EXPECT_EQ(collided.size(), 1u);
+    EXPECT_TRUE(collided.contains(objects::TRUE_OBJ->GetHashKey()));
+    collided.Erase(objects::TRUE_OBJ->GetHashKey());
+    EXPECT_TRUE(collided.empty());
+    EXPECT_EQ(collided.begin(), collided.end());
+}
+
+TEST(TestStringRope, BasicAssertions)
+{
+    auto left = objects::makeRef<objects::String>(std::string(40, 'a'));
+    auto right = objects::makeRef<objects::String>(std::string(40, 'b'));
+
+    auto rope = objects::concatStrings(left, right);
+    EXPECT_TRUE(rope->IsRope());
+    EXPECT_EQ(rope->Length, 80u);
+
+    auto flat = objects::String(std::string(40, 'a') + std::string(40, 'b'));
+    EXPECT_EQ(rope->GetHashKey(), flat.GetHashKey());
+    EXPECT_FALSE(rope->IsRope());
+    EXPECT_STREQ(rope->Value.c_str(), flat.Value.c_str());
+
+    auto small = objects::concatStrings(objects::makeRef<objects::String>("Hello "), objects::makeRef<objects::String>("World"));
+    EXPECT_FALSE(small->IsRope());
+    EXPECT_STREQ(small->Value.c_str(), "Hello World");
+}
+
+TEST(TestNursery, BasicAssertions)
+{
+    auto &nursery = objects::Nursery;
+    auto allocations = nursery.Allocations;
+
+#ifdef MONKEY_SYSTEM_ALLOCATOR
+    // 临时对象同样改用系统分配器, 不经过新生代
+    auto young = objects::makeYoung<objects::Integer>(1);
+    EXPECT_EQ(young->Value, 1);
+    EXPECT_EQ(nursery.Allocations, allocations);
+#else
+    auto promoted = nursery.Promoted;
+
+    // 持有对象直到当前块用尽, 仍存活的对象随块晋升
+    std::vector<objects::Ref<objects::Integer>> survivors;
+    while(nursery.Promoted == promoted)
+    {
+        survivors.push_back(objects::makeYoung<objects::Integer>(survivors.size()));
+    }
+
+    EXPECT_EQ(nursery.Allocations - allocations, survivors.size());
+    EXPECT_EQ(survivors[0]->Value, 0);
+    EXPECT_EQ(survivors.back()->Value, static_cast<int64_t>(survivors.size() - 1));
+
+    auto collections = nursery.MinorCollections;
+    survivors.clear();
+    EXPECT_GE(nursery.MinorCollections - collections, 2u);
+
+    // 块内对象全部死亡后指针回退, 下一个临时对象复用同一地址
+    void *first = objects::makeYoung<objects::Integer>(1).get();
+    void *second = objects::makeYoung<objects::Integer>(2).get();
+    EXPECT_EQ(first, second);
+
+    // 每个线程有自己的新生代, 其他线程的分配不经过这里的块
+    allocations = nursery.Allocations;
+    size_t otherAllocations = 0;
+    void *other = nullptr;
+    std::thread([&] {
+        auto value = objects::makeYoung<objects::Integer>(3);
+        other = value.get();
+        otherAllocations = objects::Nursery.Allocations;
+    }).join();
+    EXPECT_EQ(otherAllocations, 1u);
+    EXPECT_EQ(nursery.Allocations, allocations);
+    EXPECT_NE(objects::NurserySpace::blockOf(other), objects::NurserySpace::blockOf(first));
+
+    // 其他线程释放的临时对象交还给分配它的新生代, 不改动释放线程的统计
+    auto moved = objects::makeYoung<objects::Integer>(4);
+    auto block = objects::NurserySpace::blockOf(moved.get());
+    auto live = block->live;
+    size_t otherCollections = 1;
+    std::thread([&] {
+        moved.reset();
+        otherCollections = objects::Nursery.MinorCollections;
+    }).join();
+    EXPECT_EQ(otherCollections, 0u);
+    EXPECT_EQ(block->live, live);
+
+    // 分配它的线程退出后, 块由释放它的线程直接还给系统
+    objects::Ref<objects::Integer> orphan;
+    std::thread([&] { orphan = objects::makeYoung<objects::Integer>(5); }).join();
+    collections = nursery.MinorCollections;
+    orphan.reset();
+    EXPECT_EQ(nursery.MinorCollections, collections);
+#endif
+}
+
+TEST(TestSmallIntegerCache, BasicAssertions)
+{
+    auto hits = objects::SmallInts.Hits.load();
+    auto misses = objects::SmallInts.Misses.load();
+
+    auto a = objects::newInteger(42);
+    auto b = objects::newInteger(42);
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_EQ(a->Value, 42);
+    EXPECT_EQ(objects::newInteger(objects::SmallIntegerCache::Min)->Value, objects::SmallIntegerCache::Min);
+    EXPECT_EQ(objects::newInteger(objects::SmallIntegerCache::Max)->Value, objects::SmallIntegerCache::Max);
+
+    auto c = objects::newInteger(objects::SmallIntegerCache::Max + 1);
+    auto d = objects::newInteger(objects::SmallIntegerCache::Max + 1);
+    EXPECT_NE(c.get(), d.get());
+    EXPECT_EQ(c->Value, objects::SmallIntegerCache::Max + 1);
+
+    EXPECT_EQ(objects::SmallInts.Hits.load() - hits, 4u);
+    EXPECT_EQ(objects::SmallInts.Misses.load() - misses, 2u);
+
+    // 多个线程同时计数, 不丢失
+    hits = objects::SmallInts.Hits.load();
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; i++)
+    {
+        threads.emplace_back([] {
+            for(int j = 0; j < 1000; j++)
+            {
+                objects::newInteger(j);
+            }
+        });
+    }
+    for(auto &thread: threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(objects::SmallInts.Hits.load() - hits, 4000u);
+
+    // 缓存对象被多处共享, 永远不会被视为唯一持有
+    EXPECT_GT(a.use_count(), 1);
+
+#ifndef MONKEY_INTRUSIVE_REFCOUNT
+    // 每个整数有自己的控制块, 复制其他整数的句柄不改动它的计数
+    auto count = a.use_count();
+    {
+        std::vector<objects::Ref<objects::Integer>> copies(100, objects::newInteger(43));
+        EXPECT_EQ(a.use_count(), count);
+    }
+    EXPECT_EQ(objects::newInteger(42).get(), a.get());
+#endif
+}
+
+TEST(TestObjectPool, BasicAssertions)
+{
+    auto &pool = objects::Pool;
+    objects::makePooled<objects::Array>();
+
+    auto stats = pool.FindType("objects::Array");
+    ASSERT_NE(stats, nullptr);
+
+    auto live = stats->Live;
+    auto allocations = stats->Allocations;
+
+    std::vector<objects::Ref<objects::Array>> arrays;
+    for(int i = 0; i < 1000; i++)
+    {
+        arrays.push_back(objects::makePooled<objects::Array>());
+    }
+
+    EXPECT_EQ(stats->Live - live, 1000u);
+    EXPECT_EQ(stats->Allocations - allocations, 1000u);
+    EXPECT_GE(pool.PeakBytes, 1000 * sizeof(objects::Array));
+#ifndef MONKEY_SYSTEM_ALLOCATOR
+    EXPECT_GT(pool.Utilization(), 0.5);
+    EXPECT_LE(pool.Utilization(), 1.0);
+#endif
+
+    arrays.clear();
+    EXPECT_EQ(stats->Live, live);
+
+    // 其他线程释放的对象交还给分配它的池, 在这个线程下次分配时回收
+    auto moved = objects::makePooled<objects::Array>();
+    std::thread([&] { moved.reset(); }).join();
+    EXPECT_EQ(stats->Live, live + 1);
+    objects::makePooled<objects::Array>();
+    EXPECT_EQ(stats->Live, live);
+
+    // 分配它的线程退出后, 对象由释放它的线程直接还给系统, 不计入这里的统计
+    objects::Ref<objects::Array> orphan;
+    std::thread([&] { orphan = objects::makePooled<objects::Array>(); }).join();
+    orphan.reset();
+    EXPECT_EQ(stats->Live, live);
+
+#ifndef MONKEY_SYSTEM_ALLOCATOR
+    // 释放的槽位立即被同级别的下一次分配复用
+    void *first = objects::makePooled<objects::Integer>(1LL << 40).get();
+    void *second = objects::makePooled<objects::Integer>(1LL << 41).get();
+    EXPECT_EQ(first, second);
+#endif
+}
+
+TEST(TestImmortalObjects, BasicAssertions)
+{
+#ifdef MONKEY_INTRUSIVE_REFCOUNT
+    // 不朽对象永远不会被视为唯一持有者, push只能复制
+    auto arr = objects::makeImmortal(objects::makeRef<objects::Array>());
+    auto raw = arr.get();
+
+    std::vector<objects::Ref<objects::Object>> args{std::move(arr), objects::makeRef<objects::Integer>(1)};
+    auto result = objects::BuiltinFunc_Push(args);
+    args.clear();
+
+    EXPECT_NE(result.get(), raw);
+    EXPECT_EQ(raw->Elements.size(), 0u);
+    EXPECT_STREQ(result->Inspect().c_str(), "[1]");
+
+    // 复制和销毁句柄都不改动不朽对象的计数
+    auto count = objects::TRUE_OBJ->RefCount;
+    {
+        std::vector<objects::Ref<objects::Object>> copies(100, objects::TRUE_OBJ);
+        EXPECT_EQ(objects::TRUE_OBJ->RefCount, count);
+    }
+    EXPECT_EQ(objects::TRUE_OBJ->RefCount, count);
+#else
+    // 默认构建中不朽标记不额外持有引用, 常量随常量池一起释放
+    auto arr = objects::makeImmortal(objects::makeRef<objects::Array>());
+    EXPECT_EQ(arr.use_count(), 1);
+    std::weak_ptr<objects::Array> weak = arr;
+    arr.reset();
+    EXPECT_TRUE(weak.expired());
+
+    std::weak_ptr<objects::Object> constant;
+    {
+        auto comp = compiler::New();
+        EXPECT_EQ(comp->Compile(std::shared_ptr<ast::Node>(TestHelper("\"constant\""))), nullptr);
+        constant = comp->Bytecode()->Constants[0];
+        EXPECT_FALSE(constant.expired());
+    }
+    EXPECT_TRUE(constant.expired());
+#endif
+}
+
+TEST(TestStringRopeDeepChain, BasicAssertions)
+{
+    auto piece = objects::makeRef<objects::String>(std::string(64, 'x'));
+    auto str = objects::makeRef<objects::String>();
+
+    for (int i = 0; i < 200000; i++)
+    {
+        str = objects::concatStrings(str, piece);
+    }
+
+    EXPECT_EQ(str->Length, 200000u * 64u);
+    EXPECT_EQ(str->Flatten().size(), 200000u * 64u);
+
+    // 未展开的深链同样要能安全释放
+    for (int i = 0; i < 200000; i++)
+    {
+        str = objects::concatStrings(str, piece);
+    }
+    str.reset();
+}
+
+TEST(TestFindSubstring, BasicAssertions)
+{
+    std::string haystack;
+    for (int i = 0; i < 2000; i++)
+    {
+        haystack.push_back("abcab"[(i * 7 + i / 13) % 5]);
+    }
+    haystack += "needle-in-haystack";
+
+    std::vector<std::string> needles{"", "a", "ab", "cab", "bcabc", "needle", "haystack", "needle-in-haystack", "zzz", "abcabcabcabcabcabcabcabc"};
+    for (auto &needle : needles)
+    {
+        for (size_t from : {0, 1, 17, 1999, 2010})
+        {
+            EXPECT_EQ(objects::findSubstring(haystack, needle, from), haystack.find(needle, from));
+        }
+    }
+}
+
+TEST(TestStringSlice, BasicAssertions)
+{
+    auto parent = objects::makeRef<objects::String>("  the quick brown fox jumps over the lazy dog  ");
+
+    auto slice = objects::sliceString(parent, 2, 43);
+    EXPECT_TRUE(slice->IsSlice());
+    EXPECT_EQ(slice->Parent, parent);
+    EXPECT_EQ(slice->View(), "the quick brown fox jumps over the lazy dog");
+
+    auto nested = objects::sliceString(slice, 4, 20);
+    EXPECT_EQ(nested->Parent, parent);
+    EXPECT_EQ(nested->View(), "quick brown fox jump");
+    EXPECT_EQ(nested->GetHashKey(), objects::String("quick brown fox jump").GetHashKey());
+
+    auto small = objects::sliceString(parent, 6, 5);
+    EXPECT_FALSE(small->IsSlice());
+    EXPECT_STREQ(small->Value.c_str(), "quick");
+}
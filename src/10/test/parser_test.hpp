@@ -933,3 +933,68 @@ TEST(TestCallExpressionParameterParsing, BasicAssertions)
 		}
 	}
 }
+
+TEST(TestArenaAllocatedProgram, BasicAssertions)
+{
+	std::string input = "let add = fn(a, b) { a + b; }; let r = add(1, 2 * 3); if (r > 1) { [r, {\"k\": r}][0] } else { -r };";
+
+	auto parse = [&](bool useArena) {
+		std::unique_ptr<parser::Parser> pParser = parser::New(lexer::New(input));
+		pParser->UseArena = useArena;
+		std::unique_ptr<ast::Program> pProgram{pParser->ParseProgram()};
+		printParserErrors(pParser->Errors());
+		return pProgram;
+	};
+
+	auto pArenaProgram = parse(true);
+	auto pHeapProgram = parse(false);
+
+	ASSERT_NE(pArenaProgram->pArena, nullptr);
+	EXPECT_EQ(pHeapProgram->pArena, nullptr);
+	EXPECT_GT(pArenaProgram->pArena->Nodes, 20u);
+	EXPECT_LE(pArenaProgram->pArena->BytesUsed, pArenaProgram->pArena->BytesReserved);
+
+	// arena中的节点句柄不带引用计数
+	for (auto &stmt : pArenaProgram->v_pStatements)
+	{
+		EXPECT_EQ(stmt.use_count(), 0);
+	}
+
+	EXPECT_STREQ(pArenaProgram->String().c_str(), pHeapProgram->String().c_str());
+}
+
+TEST(TestPreparseFunctionBodies, BasicAssertions)
+{
+	std::string input = "let f = fn(a) { let g = fn(b, c) { a + b + \"}\" + x }; g(1, {\"k\": y}) }; f(2)";
+
+	std::unique_ptr<parser::Parser> pParser = parser::New(lexer::New(input));
+	pParser->Preparse = true;
+	std::unique_ptr<ast::Program> pProgram{pParser->ParseProgram()};
+	printParserErrors(pParser->Errors());
+	ASSERT_EQ(pProgram->v_pStatements.size(), 2u);
+
+	auto letStmt = std::dynamic_pointer_cast<ast::LetStatement>(pProgram->v_pStatements[0]);
+	auto funcObj = std::dynamic_pointer_cast<ast::FunctionLiteral>(letStmt->pValue);
+	ASSERT_NE(funcObj->pSkipped, nullptr);
+	EXPECT_EQ(funcObj->pBody, nullptr);
+	EXPECT_EQ(funcObj->pSkipped->Names, (std::vector<std::string>{"a", "b", "g", "x", "y"}));
+	EXPECT_EQ(funcObj->pSkipped->Declared, (std::vector<std::string>{"b", "c", "g"}));
+	EXPECT_EQ(pProgram->String(), "let f = fn<f>(a) { let g = fn(b, c) { a + b + \"}\" + x }; g(1, {\"k\": y}) };f(2)");
+
+	// 函数体在需要时解析, 其中嵌套的函数体仍然跳过
+	EXPECT_EQ(funcObj->ParseBody(), "");
+	EXPECT_EQ(funcObj->pSkipped, nullptr);
+	ASSERT_EQ(funcObj->pBody->v_pStatements.size(), 2u);
+
+	auto innerLet = std::dynamic_pointer_cast<ast::LetStatement>(funcObj->pBody->v_pStatements[0]);
+	auto inner = std::dynamic_pointer_cast<ast::FunctionLiteral>(innerLet->pValue);
+	ASSERT_NE(inner->pSkipped, nullptr);
+	EXPECT_EQ(inner->String(), "fn<g>(b, c) { a + b + \"}\" + x }");
+	EXPECT_EQ(inner->ParseBody(), "");
+	EXPECT_EQ(inner->String(), "fn<g>(b, c) (((a + b) + }) + x)");
+
+	std::unique_ptr<parser::Parser> pUnbalanced = parser::New(lexer::New("let f = fn() { if (x) { 1 }"));
+	pUnbalanced->Preparse = true;
+	pUnbalanced->ParseProgram();
+	EXPECT_EQ(pUnbalanced->Errors(), (std::vector<std::string>{"expected next token to be }, got EOF instead"}));
+}
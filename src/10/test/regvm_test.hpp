@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "compiler/compiler.hpp"
+#include "vm/vm.hpp"
+#include "regvm/compiler.hpp"
+#include "regvm/vm.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
+
+TEST(TestRegisterInstructions, BasicAssertions)
+{
+    auto comp = regvm::New();
+    auto err = comp->Compile(std::shared_ptr<ast::Node>(TestHelper("let add = fn(a, b) { let c = a + b; c * 2 }; add(1, 2);")));
+    ASSERT_EQ(err, nullptr);
+
+    auto code = comp->Bytecode();
+    EXPECT_EQ(regvm::InstructionsString(code->Instructions),
+              "0000 OpClosure r0 1 r0 0\n"
+              "0006 OpSetGlobal 0 r0\n"
+              "0010 OpGetGlobal r1 0\n"
+              "0014 OpLoadConstant r2 2\n"
+              "0018 OpLoadConstant r3 3\n"
+              "0022 OpCall r0 r1 2\n"
+              "0026 OpPop r0\n"
+              "0028 OpReturn\n");
+    EXPECT_EQ(code->NumRegisters, 4);
+
+    // 参数和局部变量占r0-r2, 临时值从r3开始
+    auto fn = objects::refCast<objects::CompiledFunction>(code->Constants[1]);
+    EXPECT_EQ(regvm::InstructionsString(fn->Instructions),
+              "0000 OpAdd r2 r0 r1\n"
+              "0004 OpLoadConstant r4 0\n"
+              "0008 OpMul r3 r2 r4\n"
+              "0012 OpReturnValue r3\n");
+    EXPECT_EQ(fn->NumLocals, 5);
+}
+
+TEST(TestRegisterVMMatchesVM, BasicAssertions)
+{
+    std::vector<vmTestCases> tests{
+        {"1 + 2 * 3 - 4 / 2", 5},
+        {"-5 + 10 > 3 == true", true},
+        {"1 < 2; 2 < 1", false},
+        {"!(1 == 1) != !!false", false},
+        {"!if (false) { 1 }", false},
+        {"if (1 > 2) { 10 } else { 20 }", 20},
+        {"if (1 < 2) { 10 }", 10},
+        {"if (false) { 10 }", nullptr},
+        {"if (if (false) { 1 }) { 1 } else { 2 }", 2},
+        {"if (\"a\" == \"a\") { 1 } else { 2 }", 2},
+        {"let one = 1; let two = one + one; one + two", 3},
+        {"let a = 1; let a = a + 1; a", 2},
+        {"\"mon\" + \"key\"", "monkey"s},
+        {"[1, 2 * 2, 3 + 3][1 + 1]", 6},
+        {"[]", "[]"s},
+        {"{1: 2, \"a\": [3], true: 4}[\"a\"][0]", 3},
+        {"{}", "{}"s},
+        {"{1: 2}[3]", nullptr},
+        {"let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; fib(20)", 6765},
+        {"let fib = fn(x) { if (x == 0) { return 0; } else { if (x == 1) { return 1; } else { return fib(x - 1) + fib(x - 2); } } }; fib(15)", 610},
+        {"let f = fn(a, b) { let c = a * b; let d = c - a; d / 2 }; f(3, 5) + f(4, 4)", 12},
+        {"let f = fn(a) { let a = a * 2; a }; f(21)", 42},
+        {"let f = fn(a) { a + if (true) { let a = 5; a } else { 0 } }; f(1)", 6},
+        {"let f = fn(x) { if (x > 1) { let y = x; y } }; [f(1), f(2)]", "[null, 2]"s},
+        {"let f = fn() { }; f()", nullptr},
+        {"let f = fn() { let a = 1; }; f()", nullptr},
+        {"let f = fn(x) { return x; 99 }; f(7) + f(8)", 15},
+        {"let newAdder = fn(a, b) { fn(c) { a + b + c } }; let adder = newAdder(1, 2); adder(8)", 11},
+        {"let newClosure = fn(a, b) { let one = fn() { a }; let two = fn() { b }; fn() { one() + two() } }; newClosure(9, 90)()", 99},
+        {"let wrapper = fn() { let countDown = fn(x) { if (x == 0) { return 0; } else { countDown(x - 1) } }; countDown(1) }; wrapper()", 0},
+        {"let map = fn(arr, f) { let iter = fn(arr, acc) { if (len(arr) == 0) { acc } else { iter(rest(arr), push(acc, f(first(arr)))) } }; iter(arr, []) }; map([1, 2, 3], fn(x) { x * x })", "[1, 4, 9]"s},
+        {"let f = fn(h, k) { h[k] }; f({\"x\": 1, \"y\": 2}, \"y\")", 2},
+        {"len(\"four\") + len([1, 2]) + fibonacci(10)", 61},
+        {"len(1)", "argument to `len` not supported, got INTEGER"s},
+        {"puts()", nullptr},
+        {"1 + true", "unsupported types for binary operaction: INTEGER BOOLEAN"s},
+        {"\"a\" - \"b\"", "unknow string operator: -"s},
+        {"-true", "unsupported type for negation: BOOLEAN"s},
+        {"true > false", "unknow operator: > (BOOLEAN BOOLEAN)"s},
+        {"if (true > false) { 1 }", "unknow operator: > (BOOLEAN BOOLEAN)"s},
+        {"{[1]: 2}", "unusable as hash type: ARRAY"s},
+        {"[1][true]", "index operator not supported: ARRAY"s},
+        {"1(2)", "calling non-function and non-built-in"s},
+        {"fn(a) { a }()", "wrong number of arguments: want=1, got=0"s},
+        {"let f = fn() { 1 + true }; let g = fn() { f() }; g()", "unsupported types for binary operaction: INTEGER BOOLEAN"s},
+        {"let a = 1;", 1},
+        {"let a = [1, 2]; let b = a;", "[1, 2]"s},
+    };
+
+    // 超过一块寄存器的字面量分块求值
+    std::string elements, pairs;
+    for (int i = 0; i < 300; i++)
+    {
+        elements += ((i == 0) ? "" : ", ") + std::to_string(i);
+        pairs += ((i == 0) ? "" : ", ") + std::to_string(i) + ": [" + std::to_string(i) + "]";
+    }
+    tests.push_back({"[" + elements + "]", "[" + elements + "]"});
+    tests.push_back({"let f = fn(x) { [x, " + elements + ", x] }; f(-1)", "[-1, " + elements + ", -1]"});
+    tests.push_back({"let f = fn(x) { let x = [" + elements + ", x]; x }; len(f(1))", 301});
+    tests.push_back({"{" + pairs + "}[299]", "[299]"s});
+    tests.push_back({"let f = fn(x) { {" + pairs + ", x: x} }; len(f(-1)[150]) + f(-1)[-1]", 0});
+    tests.push_back({"[[" + elements + "], {" + pairs + "}][0][150]", 150});
+
+    vmOptions options;
+    options.Backend = vmBackend::Registers;
+    runVmTests(tests, options);
+
+    // 顶层代码用尽寄存器时报错, 而不是让寄存器编号回绕
+    std::string nested = "1";
+    for (int i = 0; i < 300; i++)
+    {
+        nested = "1 + (" + nested + ")";
+    }
+    auto err = objects::refCast<objects::Error>(runVm(nested, options));
+    ASSERT_NE(err, nullptr);
+    EXPECT_NE(err->Message.find("too many registers in program"), std::string::npos);
+}
@@ -11,7 +11,7 @@
 #include "compiler/symbol_table.hpp"
 
 extern void printParserErrors(std::vector<std::string> errors);
-extern void testIntegerObject(std::shared_ptr<objects::Object> obj, int64_t expected);
+extern void testIntegerObject(objects::Ref<objects::Object> obj, int64_t expected);
 extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
 
 
@@ -335,4 +335,21 @@ TEST(testShadowingFunctionName, Basic)
     std::cout << expected->Scope << " vs " << result->Scope << std::endl;
 
     EXPECT_EQ(*expected, *result);
-}
\ No newline at end of file
+}
+
+TEST(testDefineCountsBindings, Basic)
+{
+    auto global = compiler::NewSymbolTable();
+    auto a = global->Define("a");
+    EXPECT_EQ(a->Bindings, 1);
+    EXPECT_EQ(a->Constant, -1);
+
+    a->Constant = 3;
+    auto again = global->Define("a");
+    EXPECT_EQ(again, a);
+    EXPECT_EQ(a->Bindings, 2);
+    EXPECT_EQ(a->Constant, -1);
+
+    auto local = compiler::NewEnclosedSymbolTable(global);
+    EXPECT_EQ(local->Define("a")->Bindings, 1);
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "evaluator/evaluator.hpp"
+#include "tier/tier.hpp"
+
+extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
+
+TEST(TestTieredCounts, BasicAssertions)
+{
+    tier::Engine engine;
+    engine.HotThreshold = 2;
+
+    auto result = engine.Run(std::shared_ptr<ast::Node>(TestHelper(
+                                 "let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; fib(15)")),
+                             objects::NewEnvironment());
+    EXPECT_EQ(result->Inspect(), "610");
+
+    // 第一次调用在解释器中执行, 第二次调用时编译, 之后的递归都在VM中
+    EXPECT_EQ(engine.Compiled, 1);
+    EXPECT_EQ(engine.Rejected, 0);
+    EXPECT_EQ(engine.InterpretedCalls, 1);
+    EXPECT_EQ(engine.CompiledCalls, 2);
+
+    // f引用了调用时才定义的h, 无法编译时继续解释执行; g被调用时h已经定义
+    tier::Engine late;
+    late.HotThreshold = 1;
+    result = late.Run(std::shared_ptr<ast::Node>(TestHelper(
+                          "let f = fn() { let g = fn() { h() }; let h = fn() { 5 }; g() }; f() + f()")),
+                      objects::NewEnvironment());
+    EXPECT_EQ(result->Inspect(), "10");
+    EXPECT_EQ(late.Rejected, 1);
+    EXPECT_EQ(late.Compiled, 2);
+
+    // 编译后的函数中的错误按VM的报错返回给解释器
+    tier::Engine failing;
+    failing.HotThreshold = 1;
+    result = failing.Run(std::shared_ptr<ast::Node>(TestHelper("let f = fn(x) { x + 1 }; let a = f(1); f(true); a")),
+                         objects::NewEnvironment());
+    EXPECT_TRUE(objects::isError(result));
+}
+
+TEST(TestTieredMatchesEvaluator, BasicAssertions)
+{
+    std::vector<vmTestCases> tests{
+        {"1 + 2 * 3", 7},
+        {"let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; fib(15)", 610},
+        {"let fib = fn(x) { if (x == 0) { return 0; } else { if (x == 1) { return 1; } else { return fib(x - 1) + fib(x - 2); } } }; fib(12)", 144},
+        {"let newAdder = fn(a, b) { fn(c) { a + b + c } }; let adder = newAdder(1, 2); [adder(8), adder(9), newAdder(3, 4)(5)]", "[11, 12, 12]"s},
+        {"let twice = fn(f, x) { f(f(x)) }; let inc = fn(x) { x + 1 }; [twice(inc, 1), twice(inc, 2), twice(fn(x) { x * 2 }, 3)]", "[3, 4, 12]"s},
+        {"let map = fn(arr, f) { let iter = fn(arr, acc) { if (len(arr) == 0) { acc } else { iter(rest(arr), push(acc, f(first(arr)))) } }; iter(arr, []) }; map([1, 2, 3, 4], fn(x) { x * x })", "[1, 4, 9, 16]"s},
+        {"let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } }; let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } }; [even(10), odd(7), even(3)]", "[true, true, false]"s},
+        {"let make = fn(n) { fn() { n } }; let fs = [make(1), make(2), make(3)]; fs[0]() + fs[1]() + fs[2]() + make(4)()", 10},
+        {"let count = fn(n) { if (n == 0) { 0 } else { 1 + count(n - 1) } }; let a = count(5); let count = fn(n) { 100 }; a + count(5)", 105},
+        {"let len = fn(x) { 7 }; let f = fn(a) { len(a) }; f([1]) + f([1, 2])", 14},
+        {"let f = fn(h, k) { h[k] }; [f({\"x\": 1, \"y\": 2}, \"y\"), f({\"x\": 1}, \"x\"), f([5, 6], 1)]", "[2, 1, 6]"s},
+        {"let greet = fn(name) { \"hello \" + name }; [greet(\"a\"), greet(\"b\"), greet(\"c\")]", "[\"hello a\", \"hello b\", \"hello c\"]"s},
+        {"let f = fn(x) { x + 1 }; f(1); f(2); f(3); f(4)", 5},
+        {"let x = 1; let mk = fn() { fn() { x } }; let g = mk(); let x = 2; g()", 2},
+        {"let x = 1; let mk = fn() { fn() { x } }; let a = mk(); let b = mk(); let c = mk(); let x = 2; [a(), b(), c()]", "[2, 2, 2]"s},
+        {"let h = {\"k\": 1}; let mk = fn() { fn() { h[\"k\"] } }; let g = mk(); let h = {\"k\": 9}; g()", 9},
+        {"let x = 1; let f = fn(n) { if (n) { f } else { x } }; let g = f(true); let g = f(true); let x = 2; g(false)", 2},
+    };
+
+    for (uint32_t threshold : {1, 3})
+    {
+        for (auto &test : tests)
+        {
+            SCOPED_TRACE(test.input);
+            tier::Engine engine;
+            engine.HotThreshold = threshold;
+            auto result = engine.Run(std::shared_ptr<ast::Node>(TestHelper(test.input)), objects::NewEnvironment());
+            EXPECT_NE(result, nullptr);
+            if (result != nullptr)
+            {
+                testExpectedObject(test.expected, result);
+            }
+        }
+    }
+}
@@ -5,26 +5,31 @@
 #include <vector>
 #include <memory>
 #include <variant>
+#include <thread>
 
 #include "lexer/lexer.hpp"
 #include "ast/ast.hpp"
 #include "objects/objects.hpp"
 #include "parser/parser.hpp"
 #include "vm/vm.hpp"
+#include "compiler/cache.hpp"
+#include "regvm/compiler.hpp"
+#include "regvm/vm.hpp"
+#include "ir/compiler.hpp"
 
 extern void printParserErrors(std::vector<std::string> errors);
-extern void testIntegerObject(std::shared_ptr<objects::Object> obj, int64_t expected);
+extern void testIntegerObject(objects::Ref<objects::Object> obj, int64_t expected);
 extern std::unique_ptr<ast::Node> TestHelper(const std::string& input);
-extern void testBooleanObject(std::shared_ptr<objects::Object> obj, bool expected);
-extern void testNullObject(std::shared_ptr<objects::Object> obj);
-extern void testStringObject(std::shared_ptr<objects::Object> obj, std::string expected);
+extern void testBooleanObject(objects::Ref<objects::Object> obj, bool expected);
+extern void testNullObject(objects::Ref<objects::Object> obj);
+extern void testStringObject(objects::Ref<objects::Object> obj, std::string expected);
 
 struct vmTestCases{
     std::string input;
-    std::variant<int, bool, std::string, std::shared_ptr<objects::Object>, void*> expected;
+    std::variant<int, bool, std::string, objects::Ref<objects::Object>, void*> expected;
 };
 
-void testExpectedObject(std::variant<int, bool, std::string, std::shared_ptr<objects::Object>, void*> expected, std::shared_ptr<objects::Object> actual)
+void testExpectedObject(std::variant<int, bool, std::string, objects::Ref<objects::Object>, void*> expected, objects::Ref<objects::Object> actual)
 {
     if(std::holds_alternative<int>(expected))
     {
@@ -39,17 +44,17 @@ void testExpectedObject(std::variant<int, bool, std::string, std::shared_ptr<obj
     else if(std::holds_alternative<std::string>(expected))
     {
         std::string val = std::get<std::string>(expected);
-        if(std::shared_ptr<objects::Array> arrObj = std::dynamic_pointer_cast<objects::Array>(actual); arrObj != nullptr)
+        if(objects::Ref<objects::Array> arrObj = objects::refCast<objects::Array>(actual); arrObj != nullptr)
         {
             EXPECT_NE(arrObj, nullptr);
             EXPECT_STREQ(arrObj->Inspect().c_str(), val.c_str());
         } 
-        else if(std::shared_ptr<objects::Hash> hashObj = std::dynamic_pointer_cast<objects::Hash>(actual); hashObj != nullptr)
+        else if(objects::Ref<objects::Hash> hashObj = objects::refCast<objects::Hash>(actual); hashObj != nullptr)
         {
             EXPECT_NE(hashObj, nullptr);
             EXPECT_STREQ(hashObj->Inspect().c_str(), val.c_str());
         }
-        else if(std::shared_ptr<objects::Error> errorObj = std::dynamic_pointer_cast<objects::Error>(actual); errorObj != nullptr)
+        else if(objects::Ref<objects::Error> errorObj = objects::refCast<objects::Error>(actual); errorObj != nullptr)
         {
             EXPECT_NE(errorObj, nullptr);
             EXPECT_STREQ(errorObj->Message.c_str(), val.c_str());
@@ -58,16 +63,16 @@ void testExpectedObject(std::variant<int, bool, std::string, std::shared_ptr<obj
             testStringObject(actual, val);
         }
     }
-    else if(std::holds_alternative<std::shared_ptr<objects::Object>>(expected))
+    else if(std::holds_alternative<objects::Ref<objects::Object>>(expected))
     {
-        auto obj = std::get<std::shared_ptr<objects::Object>>(expected);
-        if(std::shared_ptr<objects::Error> errorObj = std::dynamic_pointer_cast<objects::Error>(obj); errorObj != nullptr)
+        auto obj = std::get<objects::Ref<objects::Object>>(expected);
+        if(objects::Ref<objects::Error> errorObj = objects::refCast<objects::Error>(obj); errorObj != nullptr)
         {
             testExpectedObject(errorObj->Message, actual);
         } 
-        else if(std::shared_ptr<objects::Array> arrayObj = std::dynamic_pointer_cast<objects::Array>(obj); arrayObj != nullptr)
+        else if(objects::Ref<objects::Array> arrayObj = objects::refCast<objects::Array>(obj); arrayObj != nullptr)
         {
-            std::shared_ptr<objects::Array> actualArray = std::dynamic_pointer_cast<objects::Array>(actual);
+            objects::Ref<objects::Array> actualArray = objects::refCast<objects::Array>(actual);
             EXPECT_NE(actualArray, nullptr);
             EXPECT_STREQ(actualArray->Inspect().c_str(), arrayObj->Inspect().c_str());
         }
@@ -101,12 +106,12 @@ void runVmTests(std::vector<vmTestCases>& tests)
 
             if(constant->Type() == objects::ObjectType::COMPILED_FUNCTION)
             {
-                auto obj = std::dynamic_pointer_cast<objects::CompiledFunction>(constant);
+                auto obj = objects::refCast<objects::CompiledFunction>(constant);
                 std::cout << " Instructions: \n" << bytecode::InstructionsString(obj->Instructions) << std::endl;
             }
             else if(constant->Type() == objects::ObjectType::INTEGER)
             {
-                auto obj = std::dynamic_pointer_cast<objects::Integer>(constant);
+                auto obj = objects::refCast<objects::Integer>(constant);
                 std::cout << " Value: " << obj->Value << std::endl;
             }
         }
@@ -122,6 +127,110 @@ void runVmTests(std::vector<vmTestCases>& tests)
     }
 }
 
+enum class vmBackend
+{
+    Stack,         // compiler::Compiler + vm::VM
+    IR,            // 经IR编译, 打开所有优化
+    IRUnoptimized, // 经IR编译, 关闭所有优化
+    Registers,     // regvm
+};
+
+// 前四项对应compiler::Compiler上的同名开关, 只用于Stack
+struct vmOptions
+{
+    bool LazyFunctions = false;
+    bool LiftClosures = false;
+    bool ConstantGlobals = false;
+    int InlineThreshold = 0;
+    bool Preparse = false; // 函数体只做预解析
+    vmBackend Backend = vmBackend::Stack;
+};
+
+extern std::shared_ptr<ast::Node> preparse(const std::string &input);
+
+template <typename Machine>
+objects::Ref<objects::Object> runMachine(Machine machine, bool *failed)
+{
+    auto result = machine->Run();
+    if (result != nullptr)
+    {
+        *failed = true;
+        return result;
+    }
+    return machine->LastPoppedStackElem();
+}
+
+// 返回最后弹出的值, 编译或运行出错时返回错误并置failed, 没有弹出过值时返回nullptr
+objects::Ref<objects::Object> runVm(const std::string &input, const vmOptions &options = vmOptions(), bool *failed = nullptr)
+{
+    bool ignored = false;
+    failed = (failed != nullptr) ? failed : &ignored;
+    *failed = false;
+
+    auto program = options.Preparse ? preparse(input) : std::shared_ptr<ast::Node>(TestHelper(input));
+    objects::Ref<objects::Object> err;
+    switch(options.Backend)
+    {
+        case vmBackend::IR:
+        case vmBackend::IRUnoptimized:
+        {
+            auto comp = ir::New();
+            for(auto &pass: comp->pipeline.Passes)
+            {
+                pass.Enabled = (options.Backend == vmBackend::IR);
+            }
+            err = comp->Compile(program);
+            if (err != nullptr)
+            {
+                *failed = true;
+                return err;
+            }
+            return runMachine(vm::New(comp->Bytecode()), failed);
+        }
+        case vmBackend::Registers:
+        {
+            auto comp = regvm::New();
+            err = comp->Compile(program);
+            if (err != nullptr)
+            {
+                *failed = true;
+                return err;
+            }
+            return runMachine(regvm::New(comp->Bytecode()), failed);
+        }
+        default:
+        {
+            auto comp = compiler::New();
+            comp->LazyFunctions = options.LazyFunctions;
+            comp->LiftClosures = options.LiftClosures;
+            comp->ConstantGlobals = options.ConstantGlobals;
+            comp->InlineThreshold = options.InlineThreshold;
+            err = comp->Compile(program);
+            if (err != nullptr)
+            {
+                *failed = true;
+                return err;
+            }
+            return runMachine(vm::New(comp->Bytecode()), failed);
+        }
+    }
+}
+
+// 期望的字符串也可以是错误信息, 编译错误和运行错误都与之比较
+void runVmTests(std::vector<vmTestCases>& tests, const vmOptions &options)
+{
+    for(auto &test: tests)
+    {
+        SCOPED_TRACE(test.input);
+        auto result = runVm(test.input, options);
+        EXPECT_NE(result, nullptr);
+        if(result != nullptr)
+        {
+            testExpectedObject(test.expected, result);
+        }
+    }
+}
+
 
 TEST(testVMIntegerArithmetic, basicTest)
 {
@@ -193,7 +302,10 @@ TEST(testVMConditionals, basicTest)
         {"if(1 > 2){ 10 } else { 20 }", 20},
         {"if( 1 > 2) { 10 }", nullptr},
         {"if( false ){ 10 }", nullptr},
-        {"if((if (false) { 10 })){ 10 } else { 20 }", 20}
+        {"if((if (false) { 10 })){ 10 } else { 20 }", 20},
+        {"if(true) { }", nullptr},
+        {"if(true) { let a = 1; }", nullptr},
+        {"let f = fn(x) { if (x) { let y = 1; } else { 5 } }; f(true)", nullptr}
         };
 
     runVmTests(tests);  
@@ -204,7 +316,9 @@ TEST(testVMGlobalLetStatements, basicTest)
     std::vector<vmTestCases> tests{
         {"let one = 1; one", 1},
         {"let one = 1; let two = 2; one + two;", 3},
-        {"let one = 1; let two = one + one; one + two;", 3}
+        {"let one = 1; let two = one + one; one + two;", 3},
+        {"let one = 1;", 1},
+        {"let one = 1; let two = [one, 2];", "[1, 2]"s}
         };
 
     runVmTests(tests);  
@@ -501,7 +615,7 @@ TEST(testVMCallingFunctionWithWrongArguments, basicTest)
         auto vmresult = vm->Run();
         EXPECT_NE(vmresult, nullptr);
 
-        std::shared_ptr<objects::Error> errorObj = std::dynamic_pointer_cast<objects::Error>(vmresult);
+        objects::Ref<objects::Error> errorObj = objects::refCast<objects::Error>(vmresult);
 
         EXPECT_NE(errorObj, nullptr);
         EXPECT_STREQ(errorObj->Message.c_str(), test.expected.c_str());
@@ -511,15 +625,15 @@ TEST(testVMCallingFunctionWithWrongArguments, basicTest)
 
 TEST(testVMCallingBuiltinFunction, basicTest)
 {
-    auto int1 = std::make_shared<objects::Integer>(1);
-    auto int2 = std::make_shared<objects::Integer>(2);
-    auto int3 = std::make_shared<objects::Integer>(3);
+    auto int1 = objects::makeRef<objects::Integer>(1);
+    auto int2 = objects::makeRef<objects::Integer>(2);
+    auto int3 = objects::makeRef<objects::Integer>(3);
 
-    std::vector<std::shared_ptr<objects::Object>> Elements1 = {int1};
-    std::vector<std::shared_ptr<objects::Object>> Elements2 = {int2, int3};
+    std::vector<objects::Ref<objects::Object>> Elements1 = {int1};
+    std::vector<objects::Ref<objects::Object>> Elements2 = {int2, int3};
 
-    auto array1 = std::make_shared<objects::Array>(Elements1);
-    auto array2 = std::make_shared<objects::Array>(Elements2);
+    auto array1 = objects::makeRef<objects::Array>(Elements1);
+    auto array2 = objects::makeRef<objects::Array>(Elements2);
 
     std::vector<vmTestCases> tests{
         {
@@ -820,3 +934,283 @@ TEST(testVMRecursiveFebonacci, basicTest)
 
     runVmTests(tests);
 } 
+
+
+TEST(testVMCopyOnWriteContainers, basicTest)
+{
+    std::vector<vmTestCases> tests{
+        {
+            R""(
+                let build = fn(arr, n){
+                    if(n == 0){
+                        arr
+                    } else {
+                        build(push(arr, n), n - 1)
+                    }
+                };
+
+                build([], 3);
+            )"",
+            "[3, 2, 1]"
+        },
+        {"let a = [1]; let b = push(a, 2); a", "[1]"},
+        {"let a = [1]; let b = push(a, 2); b", "[1, 2]"},
+        {"let a = [1]; let a = push(a, 2); let a = push(a, 3); a", "[1, 2, 3]"},
+        {"let f = fn(a){ let b = push(a, 2); a }; f([1])", "[1]"},
+        {"push(push([], 1), 2)", "[1, 2]"},
+        {"set({\"a\": 1}, \"b\", 2)[\"b\"]", 2},
+        {"let h = {\"a\": 1}; let g = set(h, \"a\", 5); h[\"a\"]", 1},
+        {"let h = {\"a\": 1}; let g = set(h, \"a\", 5); g[\"a\"]", 5},
+        {"set([], 1, 2)", objects::newError("argument to `set` must be HASH, got ARRAY")},
+    };
+
+    runVmTests(tests);
+}
+
+
+TEST(testVMStringConcatenation, basicTest)
+{
+    std::vector<vmTestCases> tests{
+        {
+            R""(
+                let repeat = fn(s, n){
+                    if(n == 0){
+                        s
+                    } else {
+                        repeat(s + "0123456789", n - 1)
+                    }
+                };
+
+                len(repeat("", 100));
+            )"",
+            1000
+        },
+        {
+            R""(
+                let s = "0123456789012345678901234567890123456789" + "0123456789012345678901234567890123456789";
+                let h = {s: 1};
+                h["01234567890123456789012345678901234567890123456789012345678901234567890123456789"]
+            )"",
+            1
+        },
+    };
+
+    runVmTests(tests);
+}
+
+
+TEST(testVMStringBuiltins, basicTest)
+{
+    std::vector<vmTestCases> tests{
+        {"substr(\"hello world\", 6)", "world"},
+        {"substr(\"hello world\", 0, 5)", "hello"},
+        {"substr(\"hello\", 3, 5)", objects::newError("argument to `substr` out of range")},
+        {"split(\"a,b,,c\", \",\")", "[\"a\", \"b\", \"\", \"c\"]"},
+        {"split(\"abc\", \"\")", "[\"a\", \"b\", \"c\"]"},
+        {"join([\"a\", \"b\", \"c\"], \"-\")", "a-b-c"},
+        {"join(split(\"x y z\", \" \"), \"\")", "xyz"},
+        {"join([1], \"\")", objects::newError("elements of `join` must be STRING, got INTEGER")},
+        {"index_of(\"the quick brown fox\", \"brown\")", 10},
+        {"index_of(\"the quick brown fox\", \"cat\")", -1},
+        {"contains(\"the quick brown fox\", \"fox\")", true},
+        {"contains(\"the quick brown fox\", \"dog\")", false},
+        {"starts_with(\"the quick brown fox\", \"the\")", true},
+        {"starts_with(\"the\", \"the quick\")", false},
+        {"trim(\"  \t hello \n\")", "hello"},
+        {"let h = {\"key\": 1}; h[trim(\"  key  \")]", 1},
+        {"trim(1)", objects::newError("argument to `trim` must be STRING, got INTEGER")},
+    };
+
+    runVmTests(tests);
+}
+
+TEST(testVMHashBuiltins, basicTest)
+{
+    std::vector<vmTestCases> tests{
+        {"keys({1: 2, 2: 3})", "[1, 2]"s},
+        {"values({1: 2, 2: 3})", "[2, 3]"s},
+        {"has({\"a\": 1}, \"a\")", true},
+        {"has({\"a\": 1}, \"b\")", false},
+        {"has({1: 1}, true)", false},
+        {"{1: \"int\", true: \"bool\"}[true]", "bool"},
+        {"delete({1: 2, 2: 3}, 1)", "{2: 3}"s},
+        {"let h = {1: 2, 2: 3}; let g = delete(h, 1); h", "{1: 2, 2: 3}"s},
+        {"delete({}, 1)", "{}"s},
+        {"delete({}, [])", objects::newError("unusable as hash key: ARRAY")},
+        {"keys([])", objects::newError("argument to `keys` must be HASH, got ARRAY")},
+        {
+            R""(
+let build = fn(h, i, n) {
+    if (i == n) { h } else { build(set(h, i, i * i), i + 1, n) }
+};
+let h = build({}, 0, 200);
+let g = delete(set(h, 7, 0), 100);
+[len(keys(h)), len(values(g)), has(h, 100), has(g, 100), h[7], g[7], g[199]]
+            )"",
+            "[200, 199, true, false, 49, 0, 39601]"s
+        },
+    };
+
+    runVmTests(tests);
+}
+
+TEST(TestLazyConstantsFromCache, BasicAssertions)
+{
+    std::string input = R""(
+let unused = fn() { "never decoded" };
+let big = 1234567890123;
+let add = fn(a, b) { a + b };
+let other = fn(x) { x * 100000 };
+add(2, 40);
+)"";
+
+    auto comp = compiler::New();
+    auto result = comp->Compile(std::shared_ptr<ast::Node>(TestHelper(input)));
+    EXPECT_EQ(result, nullptr);
+
+    char dir[] = "/tmp/monkey-cache-XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    auto cache = compiler::NewBytecodeCache(dir);
+    ASSERT_TRUE(cache->Store(input, *comp->Bytecode(), *comp->symbolTable));
+
+    auto code = cache->Load(input);
+    ASSERT_NE(code, nullptr);
+    ASSERT_NE(code->Loader, nullptr);
+    for (auto &constant : code->Constants)
+    {
+        EXPECT_EQ(constant, nullptr);
+    }
+
+    auto machine = vm::New(code);
+    EXPECT_EQ(machine->Run(), nullptr);
+    testIntegerObject(machine->LastPoppedStackElem(), 42);
+
+    // 只解码了运行中用到的常量: 三个函数, 一个整数和两个参数, 未调用函数里的字符串没有解码
+    auto loader = std::static_pointer_cast<compiler::ImageConstants>(code->Loader);
+    EXPECT_EQ(loader->Decoded, 6);
+    EXPECT_LT(loader->Decoded, code->Constants.size());
+    testStringObject(loader->Load(0), "never decoded");
+    EXPECT_TRUE(objects::isError(loader->Load(code->Constants.size())));
+
+    cache->Lazy = false;
+    auto eager = cache->Load(input);
+    ASSERT_NE(eager, nullptr);
+    EXPECT_EQ(eager->Loader, nullptr);
+    for (auto &constant : eager->Constants)
+    {
+        EXPECT_NE(constant, nullptr);
+    }
+
+    unlink(cache->PathFor(compiler::HashSource(input)).c_str());
+    rmdir(dir);
+}
+
+TEST(TestClosureFreeCount, BasicAssertions)
+{
+    // 载入时只检查函数自身的捕获变量下标, 创建闭包时再确认OpClosure提供了足够的值
+    auto body = bytecode::Make(bytecode::OpcodeType::OpGetFree, {0});
+    auto ret = bytecode::Make(bytecode::OpcodeType::OpReturnValue, {});
+    body.insert(body.end(), ret.begin(), ret.end());
+    auto fn = objects::makeRef<objects::CompiledFunction>(body, 0, 0);
+    fn->NumFree = 1;
+
+    auto main = bytecode::Make(bytecode::OpcodeType::OpClosure, {0, 0});
+    std::vector<objects::Ref<objects::Object>> constants{fn};
+    auto code = std::make_shared<compiler::ByteCode>(main, constants);
+    auto machine = vm::New(code);
+    auto result = machine->Run();
+    ASSERT_TRUE(objects::isError(result));
+    EXPECT_EQ(result->Inspect(), "ERROR: wrong number of free variables: want=1, got=0");
+}
+
+TEST(TestJitMatchesInterpreter, BasicAssertions)
+{
+    std::vector<std::string> inputs{
+        "let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; fib(15);",
+        "let f = fn(a, b) { let c = a * b; let d = c - a; if (d == 0) { -1 } else { d / 2 } }; [f(1, 1), f(3, 5), f(4, 4)]",
+        "let f = fn(x) { if (x != 3) { x > 1 } }; [f(1), f(2), f(3), !f(2)]",
+        "let f = fn(s) { s + \"!\" }; f(f(\"hi\"))",
+        "let f = fn() { }; f()",
+        "let f = fn(x) { return x; 99 }; f(7) + f(8)",
+        "let f = fn(a) { let h = {\"k\": a, a: [a, a + 1]}; h[a][1] + h[\"k\"] }; f(3) + f(4)",
+        "let f = fn(a) { len(push(a, 4)) + first(a) }; f([1, 2, 3])",
+        "let adder = fn(a) { fn(b) { a + b } }; let add = adder(10); add(1) + add(2)",
+        "let countdown = fn(x) { if (x == 0) { return 0; } countdown(x - 1) }; let w = fn() { countdown(5) }; w()",
+        "let g = 10; let f = fn() { g }; let a = f(); let g = 30; a + f() + g",
+        "let f = fn(a) { a + true }; f(1)",
+        "let f = fn(a) { a(1) }; f(2)",
+        "let g = fn(a, b) { a }; let f = fn() { g(1) }; f()",
+    };
+
+    for (auto &input : inputs)
+    {
+        std::string expected;
+        {
+            auto comp = compiler::New();
+            comp->Compile(std::shared_ptr<ast::Node>(TestHelper(input)));
+            auto machine = vm::New(comp->Bytecode());
+            auto err = machine->Run();
+            expected = (err != nullptr) ? err->Inspect() : machine->LastPoppedStackElem()->Inspect();
+        }
+
+        auto compiled = vm::JitCode.Compiled;
+
+        auto comp = compiler::New();
+        comp->Compile(std::shared_ptr<ast::Node>(TestHelper(input)));
+        auto machine = vm::New(comp->Bytecode());
+        machine->JitThreshold = 1;
+        auto err = machine->Run();
+        auto actual = (err != nullptr) ? err->Inspect() : machine->LastPoppedStackElem()->Inspect();
+
+        EXPECT_EQ(actual, expected) << input;
+#ifdef MONKEY_JIT_SUPPORTED
+        EXPECT_GT(vm::JitCode.Compiled, compiled) << input;
+#endif
+    }
+
+    // 每个线程把代码装入自己的代码空间
+    auto compiled = vm::JitCode.Compiled;
+    auto chunk = vm::JitCode.chunk;
+    size_t otherCompiled = 0;
+    uint8_t *otherChunk = nullptr;
+    std::string result;
+    std::thread([&] {
+        auto comp = compiler::New();
+        comp->Compile(std::shared_ptr<ast::Node>(TestHelper(inputs[0])));
+        auto machine = vm::New(comp->Bytecode());
+        machine->JitThreshold = 1;
+        auto err = machine->Run();
+        result = (err != nullptr) ? err->Inspect() : machine->LastPoppedStackElem()->Inspect();
+        otherCompiled = vm::JitCode.Compiled;
+        otherChunk = vm::JitCode.chunk;
+    }).join();
+    EXPECT_EQ(result, "610");
+    EXPECT_EQ(vm::JitCode.Compiled, compiled);
+    EXPECT_EQ(vm::JitCode.chunk, chunk);
+#ifdef MONKEY_JIT_SUPPORTED
+    EXPECT_EQ(otherCompiled, 1u);
+    EXPECT_NE(otherChunk, chunk);
+#endif
+}
+
+TEST(TestVMConstantGlobals, BasicAssertions)
+{
+    std::vector<vmTestCases> tests{
+        {"let n = 10; let s = \"a\"; let t = true; let f = fn(x) { x + n }; let v = 1; let v = 2; if (t) { let w = 3; w }; f(n) + v + w + len(s)", 26},
+        {"let f = fn(x) { x }; [f == f, f(1)]", "[true, 1]"s},
+        {"let fib = fn(x) { if (x < 2) { x } else { fib(x - 1) + fib(x - 2) } }; let n = 15; fib(n)", 610},
+        {"let limit = 3; let less = fn(a) { a < limit }; let count = fn(n) { if (less(n)) { count(n + 1) } else { n } }; count(0)", 3},
+        {"let newAdder = fn(a) { fn(b) { a + b } }; let two = newAdder(2); let three = 3; two(three)", 5},
+        {"let len = fn(x) { 7 }; let f = fn(a) { len(a) }; f([1]) + len(1)", 14},
+        {"let f = fn(a) { a }; let g = fn() { f(1) }; let f = 5; g() + f", "calling non-function and non-built-in"s},
+        {"let a = [1]; let a = push(a, 2); let b = \"x\"; [a, b + b]", "[[1, 2], \"xx\"]"s},
+    };
+    vmOptions options;
+    options.ConstantGlobals = true;
+    runVmTests(tests, options);
+    options.LazyFunctions = true;
+    options.Preparse = true;
+    runVmTests(tests, options);
+    options.InlineThreshold = compiler::DefaultInlineThreshold;
+    runVmTests(tests, options);
+}
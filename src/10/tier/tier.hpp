@@ -0,0 +1,439 @@
+#ifndef H_TIER_H
+#define H_TIER_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <unordered_map>
+
+#include "ast/ast.hpp"
+#include "objects/objects.hpp"
+#include "objects/environment.hpp"
+#include "evaluator/evaluator.hpp"
+#include "compiler/compiler.hpp"
+#include "vm/vm.hpp"
+
+// 分层执行: 程序先由解释器执行, 同一个函数字面量被调用HotThreshold次后编译为字节码,
+// 之后对它的调用在VM中执行. 两边的值是同一套对象, 解释器中的函数和VM中的闭包可以互相调用.
+namespace tier
+{
+    const uint32_t DefaultHotThreshold = 10;
+
+    struct FunctionInfo
+    {
+        uint32_t Calls = 0;
+        bool Rejected = false; // 无法编译(例如引用了调用时还未定义的名字), 一直解释执行
+        objects::Ref<objects::CompiledFunction> Compiled;
+        std::vector<std::string> FreeNames; // 调用时从函数的定义环境中取值
+    };
+
+    // 函数体中出现的名字, 只有在定义环境中找得到的才需要作为自由变量
+    // nested不为空时另外记录嵌套函数字面量中的名字, values不为空时记录除直接调用以外被当作值读取的名字
+    void collectNames(const std::shared_ptr<ast::Node> &node, std::set<std::string> &names,
+                      std::set<std::string> *nested = nullptr, std::set<std::string> *values = nullptr)
+    {
+        if (node == nullptr)
+        {
+            return;
+        }
+
+        auto visit = [&](const std::shared_ptr<ast::Node> &child) { collectNames(child, names, nested, values); };
+
+        switch (node->GetNodeType())
+        {
+        case ast::NodeType::Identifier:
+        {
+            auto &name = std::static_pointer_cast<ast::Identifier>(node)->Value;
+            names.insert(name);
+            if (values != nullptr)
+            {
+                values->insert(name);
+            }
+            break;
+        }
+        case ast::NodeType::BlockStatement:
+            for (auto &stmt : std::static_pointer_cast<ast::BlockStatement>(node)->v_pStatements)
+            {
+                visit(stmt);
+            }
+            break;
+        case ast::NodeType::ExpressionStatement:
+            visit(std::static_pointer_cast<ast::ExpressionStatement>(node)->pExpression);
+            break;
+        case ast::NodeType::LetStatement:
+            visit(std::static_pointer_cast<ast::LetStatement>(node)->pValue);
+            break;
+        case ast::NodeType::ReturnStatement:
+            visit(std::static_pointer_cast<ast::ReturnStatement>(node)->pReturnValue);
+            break;
+        case ast::NodeType::PrefixExpression:
+            visit(std::static_pointer_cast<ast::PrefixExpression>(node)->pRight);
+            break;
+        case ast::NodeType::InfixExpression:
+        {
+            auto infixObj = std::static_pointer_cast<ast::InfixExpression>(node);
+            visit(infixObj->pLeft);
+            visit(infixObj->pRight);
+            break;
+        }
+        case ast::NodeType::IfExpression:
+        {
+            auto ifObj = std::static_pointer_cast<ast::IfExpression>(node);
+            visit(ifObj->pCondition);
+            visit(ifObj->pConsequence);
+            visit(ifObj->pAlternative);
+            break;
+        }
+        case ast::NodeType::FunctionLiteral:
+        {
+            auto funcObj = std::static_pointer_cast<ast::FunctionLiteral>(node);
+            std::set<std::string> inner;
+            if (funcObj->pSkipped != nullptr)
+            {
+                inner.insert(funcObj->pSkipped->Names.begin(), funcObj->pSkipped->Names.end());
+            }
+            else
+            {
+                collectNames(funcObj->pBody, inner);
+            }
+            names.insert(inner.begin(), inner.end());
+            if (nested != nullptr)
+            {
+                nested->insert(inner.begin(), inner.end());
+            }
+            if (values != nullptr)
+            {
+                values->insert(inner.begin(), inner.end());
+            }
+            break;
+        }
+        case ast::NodeType::CallExpression:
+        {
+            auto callObj = std::static_pointer_cast<ast::CallExpression>(node);
+            if (callObj->pFunction->GetNodeType() == ast::NodeType::Identifier)
+            {
+                names.insert(std::static_pointer_cast<ast::Identifier>(callObj->pFunction)->Value);
+            }
+            else
+            {
+                visit(callObj->pFunction);
+            }
+            for (auto &arg : callObj->pArguments)
+            {
+                visit(arg);
+            }
+            break;
+        }
+        case ast::NodeType::ArrayLiteral:
+            for (auto &elem : std::static_pointer_cast<ast::ArrayLiteral>(node)->Elements)
+            {
+                visit(elem);
+            }
+            break;
+        case ast::NodeType::HashLiteral:
+            for (auto &[key, value] : std::static_pointer_cast<ast::HashLiteral>(node)->Pairs)
+            {
+                visit(key);
+                visit(value);
+            }
+            break;
+        case ast::NodeType::IndexExpression:
+        {
+            auto indexObj = std::static_pointer_cast<ast::IndexExpression>(node);
+            visit(indexObj->Left);
+            visit(indexObj->Index);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    struct Engine
+    {
+        uint32_t HotThreshold = DefaultHotThreshold;
+
+        std::unordered_map<const ast::BlockStatement *, FunctionInfo> functions; // 按函数字面量统计
+        std::shared_ptr<compiler::SymbolTable> symbolTable; // 符号表和VM在第一次升层时才创建, 短脚本只付解释器的开销
+        std::vector<objects::Ref<objects::Object>> constants;
+        std::shared_ptr<vm::VM> machine;
+
+        uint64_t InterpretedCalls = 0;
+        uint64_t CompiledCalls = 0; // 从解释器或外部函数进入VM的调用
+        int Compiled = 0;
+        int Rejected = 0;
+
+        objects::Ref<objects::Object> Run(const std::shared_ptr<ast::Node> &node, const std::shared_ptr<objects::Environment> &env);
+
+        // 返回已编译的函数信息; 冷函数和无法编译的函数返回nullptr
+        FunctionInfo *tierUp(const objects::Ref<objects::Function> &fn)
+        {
+            auto &info = functions[fn->Body.get()];
+            if (info.Compiled != nullptr)
+            {
+                return &info;
+            }
+            if (info.Rejected || ++info.Calls < HotThreshold)
+            {
+                return nullptr;
+            }
+
+            if (!compile(fn, info))
+            {
+                info.Rejected = true;
+                Rejected++;
+                return nullptr;
+            }
+            Compiled++;
+            return &info;
+        }
+
+        // 在一个外层作用域中编译函数字面量, 外层作用域的局部变量就是函数的自由变量
+        bool compile(const objects::Ref<objects::Function> &fn, FunctionInfo &info)
+        {
+            auto literal = std::make_shared<ast::FunctionLiteral>(token::Token(token::types::FUNCTION, "fn"));
+            literal->v_pParameters = fn->Parameters;
+            literal->pBody = fn->Body;
+            literal->Name = fn->Name;
+
+            std::set<std::string> names, nested, values;
+            collectNames(fn->Body, names, &nested, &values);
+
+            if (symbolTable == nullptr)
+            {
+                symbolTable = compiler::NewSymbolTable();
+                int i = -1;
+                for (auto &builtin : objects::Builtins)
+                {
+                    i += 1;
+                    symbolTable->DefineBuiltin(i, builtin->Name);
+                }
+            }
+
+            auto comp = compiler::NewWithState(symbolTable, constants);
+            comp->enterScope();
+
+            std::vector<std::string> outerNames;
+            for (auto &name : names)
+            {
+                if (outerNames.size() < 256 && fn->Env->Get(name) != nullptr)
+                {
+                    // VM中的闭包在创建时复制自由变量的值, 嵌套的函数捕获外层名字后会看不到之后重新let的绑定
+                    if (nested.count(name) > 0)
+                    {
+                        return false;
+                    }
+                    comp->symbolTable->Define(name);
+                    outerNames.push_back(name);
+                }
+            }
+
+            auto resultObj = comp->Compile(literal);
+            if (objects::isError(resultObj))
+            {
+                return false;
+            }
+
+            // 外层作用域中只有自由变量的读取和OpClosure
+            auto ins = comp->leaveScope();
+            int constIndex = -1;
+            for (int i = 0, size = ins.size(); i < size;)
+            {
+                auto op = static_cast<bytecode::OpcodeType>(ins[i]);
+                if (op == bytecode::OpcodeType::OpGetLocal || op == bytecode::OpcodeType::OpGetLocalMove)
+                {
+                    info.FreeNames.push_back(outerNames[ins[i + 1]]);
+                }
+                else if (op == bytecode::OpcodeType::OpClosure)
+                {
+                    uint16_t index;
+                    bytecode::ReadUint16(ins, i + 1, index);
+                    constIndex = index;
+                }
+
+                i += 1;
+                for (auto &w : bytecode::Lookup(op)->OperandWidths)
+                {
+                    i += w;
+                }
+            }
+
+            // 同理, 函数把自身当作值交出去时, 带着的自由变量也会过时
+            if (!info.FreeNames.empty() && values.count(fn->Name) > 0)
+            {
+                info.FreeNames.clear();
+                return false;
+            }
+
+            constants = comp->constants;
+            if (machine != nullptr)
+            {
+                for (auto i = machine->constants.size(); i < constants.size(); i++)
+                {
+                    machine->constants.push_back(constants[i]);
+                }
+            }
+
+            info.Compiled = objects::refCast<objects::CompiledFunction>(constants[constIndex]);
+            return info.Compiled != nullptr;
+        }
+
+        // 用调用时定义环境中的值作为自由变量; 这个环境里缺少某个名字时返回nullptr
+        objects::Ref<objects::Closure> closureFor(const objects::Ref<objects::Function> &fn, const FunctionInfo &info)
+        {
+            std::vector<objects::Ref<objects::Object>> free;
+            for (auto &name : info.FreeNames)
+            {
+                auto value = fn->Env->Get(name);
+                if (value == nullptr)
+                {
+                    return nullptr;
+                }
+                free.push_back(std::move(value));
+            }
+            return objects::makePooled<objects::Closure>(info.Compiled, std::move(free));
+        }
+
+        vm::VM &vm()
+        {
+            if (machine == nullptr)
+            {
+                bytecode::Instructions main{};
+                machine = vm::New(std::make_shared<compiler::ByteCode>(main, constants));
+                machine->CallForeign = callFromVM;
+            }
+            return *machine;
+        }
+
+        // 在VM中执行一次调用, 可以在解释器和VM之间任意嵌套
+        objects::Ref<objects::Object> callInVM(objects::Ref<objects::Object> callee, std::vector<objects::Ref<objects::Object>> &args)
+        {
+            auto &machine = vm();
+            CompiledCalls++;
+
+            int depth = machine.frameIndex;
+            int base = machine.sp;
+
+            objects::Ref<objects::Object> result = machine.Push(std::move(callee));
+            for (auto &arg : args)
+            {
+                if (result == nullptr)
+                {
+                    result = machine.Push(arg);
+                }
+            }
+
+            if (result == nullptr)
+            {
+                result = machine.executeCall(args.size());
+            }
+            if (result == nullptr && machine.frameIndex > depth)
+            {
+                result = machine.Run(depth);
+            }
+
+            if (objects::isError(result))
+            {
+                machine.releaseSlots(base, machine.sp);
+                machine.sp = base;
+                machine.frameIndex = depth;
+                return result;
+            }
+            return machine.Pop();
+        }
+
+        objects::Ref<objects::Object> interpret(const objects::Ref<objects::Function> &fn, std::vector<objects::Ref<objects::Object>> &args)
+        {
+            if (fn->Parameters.size() != args.size())
+            {
+                return objects::newError("wrong number of arguments: want=" + std::to_string(fn->Parameters.size()) + ", got=" + std::to_string(args.size()));
+            }
+
+            InterpretedCalls++;
+            auto env = evaluator::extendFunctionEnv(fn, args);
+            auto result = evaluator::unwrapReturnValue(evaluator::Eval(fn->Body, env));
+            return (result != nullptr) ? result : objects::NULL_OBJ;
+        }
+
+        static objects::Ref<objects::Object> callFromEvaluator(const objects::Ref<objects::Object> &fn, std::vector<objects::Ref<objects::Object>> &args);
+        static objects::Ref<objects::Object> callFromVM(vm::VM *machine, int numArgs);
+    };
+
+    Engine *Current = nullptr;
+
+    // 解释器调用VM中的闭包, 或者调用已经变热的函数
+    objects::Ref<objects::Object> Engine::callFromEvaluator(const objects::Ref<objects::Object> &fn, std::vector<objects::Ref<objects::Object>> &args)
+    {
+        auto engine = Current;
+
+        if (fn->Type() == objects::ObjectType::CLOSURE)
+        {
+            return engine->callInVM(fn, args);
+        }
+
+        auto function = objects::refCast<objects::Function>(fn);
+        if (function == nullptr)
+        {
+            return nullptr;
+        }
+
+        auto info = engine->tierUp(function);
+        auto closure = (info != nullptr) ? engine->closureFor(function, *info) : nullptr;
+        if (closure == nullptr)
+        {
+            engine->InterpretedCalls++;
+            return nullptr;
+        }
+        return engine->callInVM(std::move(closure), args);
+    }
+
+    // VM调用解释器中的函数: 已编译的换成闭包在当前循环中继续执行, 否则交给解释器
+    objects::Ref<objects::Object> Engine::callFromVM(vm::VM *machine, int numArgs)
+    {
+        auto engine = Current;
+        auto &slot = machine->stack[machine->sp - 1 - numArgs];
+
+        auto function = objects::refCast<objects::Function>(slot);
+        if (function == nullptr)
+        {
+            return objects::newError("calling non-function and non-built-in");
+        }
+
+        auto info = engine->tierUp(function);
+        auto closure = (info != nullptr) ? engine->closureFor(function, *info) : nullptr;
+        if (closure != nullptr)
+        {
+            slot = closure;
+            return machine->callClosure(std::move(closure), numArgs);
+        }
+
+        std::vector<objects::Ref<objects::Object>> args(std::make_move_iterator(machine->stack.begin() + machine->sp - numArgs),
+                                                        std::make_move_iterator(machine->stack.begin() + machine->sp));
+        machine->releaseSlots(machine->sp - 1 - numArgs, machine->sp);
+        machine->sp -= numArgs + 1;
+
+        auto result = engine->interpret(function, args);
+        if (objects::isError(result))
+        {
+            return result;
+        }
+        return machine->Push(std::move(result));
+    }
+
+    objects::Ref<objects::Object> Engine::Run(const std::shared_ptr<ast::Node> &node, const std::shared_ptr<objects::Environment> &env)
+    {
+        auto outer = Current;
+        auto outerHook = evaluator::Tiering;
+        Current = this;
+        evaluator::Tiering = callFromEvaluator;
+
+        auto result = evaluator::Eval(node, env);
+
+        Current = outer;
+        evaluator::Tiering = outerHook;
+        return result;
+    }
+}
+
+#endif // H_TIER_H
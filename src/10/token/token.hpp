@@ -3,12 +3,36 @@
 
 #include <iostream>
 #include <string>
+#include <cstring>
 #include <map>
 
 namespace token
 {
 
-    using TokenType = std::string;
+    // 词法单元类型只是指向静态类型名的指针, 每个AST节点都内嵌Token, 这样能少占24字节.
+    // 类型名必须是字符串字面量等静态存储的字符串
+    struct TokenType
+    {
+        const char *Name = "";
+
+        TokenType() {}
+        TokenType(const char *name) : Name(name) {}
+
+        const char *c_str() const { return Name; }
+
+        bool operator==(const TokenType &rhs) const { return (Name == rhs.Name || std::strcmp(Name, rhs.Name) == 0); }
+        bool operator!=(const TokenType &rhs) const { return !(*this == rhs); }
+        bool operator<(const TokenType &rhs) const { return (std::strcmp(Name, rhs.Name) < 0); }
+    };
+
+    std::string operator+(const std::string &lhs, const TokenType &rhs) { return lhs + rhs.Name; }
+    std::string operator+(const char *lhs, const TokenType &rhs) { return std::string(lhs) + rhs.Name; }
+
+    std::ostream &operator<<(std::ostream &out, const TokenType &type)
+    {
+        out << type.Name;
+        return out;
+    }
 
     struct Token
     {
@@ -16,7 +40,7 @@ namespace token
         std::string Literal;
 
         Token(){}
-        Token(TokenType type, std::string literal): Type(type), Literal(literal){}
+        Token(TokenType type, std::string literal): Type(type), Literal(std::move(literal)){}
     };
 
     namespace types
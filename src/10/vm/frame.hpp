@@ -12,19 +12,19 @@
 namespace vm
 {
     struct Frame{
-        std::shared_ptr<objects::Closure> cl;
+        objects::Ref<objects::Closure> cl;
         int ip;
         int basePointer;
 
-        Frame(std::shared_ptr<objects::Closure> cl, const int i, const int bp): cl(cl), ip(i), basePointer(bp){}
+        Frame(objects::Ref<objects::Closure> cl, const int i, const int bp): cl(cl), ip(i), basePointer(bp){}
 
-        bytecode::Instructions Instruction()
+        const bytecode::Instructions& Instruction()
         {
             return cl->Fn->Instructions;
         }
     };
 
-    std::shared_ptr<Frame> NewFrame(std::shared_ptr<objects::Closure> cl, int basePointer)
+    std::shared_ptr<Frame> NewFrame(objects::Ref<objects::Closure> cl, int basePointer)
     {
         return std::make_shared<Frame>(cl, -1, basePointer);
     }
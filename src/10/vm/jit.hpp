@@ -0,0 +1,714 @@
+#ifndef H_JIT_H
+#define H_JIT_H
+
+#include <vector>
+#include <new>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "code/code.hpp"
+#include "objects/objects.hpp"
+#include "vm/vm.hpp"
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(MONKEY_DISABLE_JIT)
+#define MONKEY_JIT_SUPPORTED 1
+#endif
+
+namespace vm
+{
+    // 基线JIT: 每条字节码翻译成一段固定的机器码模板, 复杂的操作调用下面的运行时函数完成,
+    // 跳转直接变成机器码的跳转. 省掉的是解释器的取指、解码和分派开销, 语义与VM::Run一致.
+    //
+    // 生成的函数遵循System V调用约定: rdi=VM*, esi=basePointer.
+    // rbx保存VM*, r12保存basePointer, 运行时函数返回非0时直接跳到出口把状态返回给调用方
+
+    int jitFail(VM *vm, objects::Ref<objects::Object> err)
+    {
+        vm->jitError = std::move(err);
+        return 1;
+    }
+
+    int jitCheck(VM *vm, objects::Ref<objects::Object> result)
+    {
+        if (objects::isError(result))
+        {
+            return jitFail(vm, std::move(result));
+        }
+        return 0;
+    }
+
+    int jitConstant(VM *vm, int constIndex)
+    {
+        if (vm->constants[constIndex] == nullptr)
+        {
+            auto constant = vm->loadConstant(constIndex);
+            if (objects::isError(constant))
+            {
+                return jitFail(vm, std::move(constant));
+            }
+        }
+        return jitCheck(vm, vm->Push(vm->constants[constIndex]));
+    }
+
+    int jitPop(VM *vm)
+    {
+        vm->sp -= 1; // 保留在原槽位, 与解释器一致
+        return 0;
+    }
+
+    int jitTrue(VM *vm) { return jitCheck(vm, vm->Push(objects::TRUE_OBJ)); }
+    int jitFalse(VM *vm) { return jitCheck(vm, vm->Push(objects::FALSE_OBJ)); }
+    int jitNull(VM *vm) { return jitCheck(vm, vm->Push(objects::NULL_OBJ)); }
+
+    // 两个整数的加减乘在栈上原地完成, 其他情况交给解释器的实现
+    int jitArithmetic(VM *vm, int op)
+    {
+        auto &left = vm->stack[vm->sp - 2];
+        auto &right = vm->stack[vm->sp - 1];
+        if (left->Type() == objects::ObjectType::INTEGER && right->Type() == objects::ObjectType::INTEGER)
+        {
+            auto l = static_cast<objects::Integer *>(left.get())->Value;
+            auto r = static_cast<objects::Integer *>(right.get())->Value;
+
+            long long int result;
+            switch (static_cast<bytecode::OpcodeType>(op))
+            {
+            case bytecode::OpcodeType::OpAdd:
+                result = l + r;
+                break;
+            case bytecode::OpcodeType::OpSub:
+                result = l - r;
+                break;
+            case bytecode::OpcodeType::OpMul:
+                result = l * r;
+                break;
+            default:
+                return jitCheck(vm, vm->executeBinaryOperaction(static_cast<bytecode::OpcodeType>(op)));
+            }
+
+            right.reset();
+            left = objects::newYoungInteger(result);
+            vm->sp -= 1;
+            return 0;
+        }
+
+        return jitCheck(vm, vm->executeBinaryOperaction(static_cast<bytecode::OpcodeType>(op)));
+    }
+
+    int jitComparison(VM *vm, int op)
+    {
+        return jitCheck(vm, vm->executeComparison(static_cast<bytecode::OpcodeType>(op)));
+    }
+
+    // 比较后紧跟OpJumpNotTruthy时合并执行, 不必构造布尔对象: 返回1/0表示真假, -1表示出错
+    int jitCompareAndBranch(VM *vm, int op)
+    {
+        auto &left = vm->stack[vm->sp - 2];
+        auto &right = vm->stack[vm->sp - 1];
+        if (left->Type() == objects::ObjectType::INTEGER && right->Type() == objects::ObjectType::INTEGER)
+        {
+            auto l = static_cast<objects::Integer *>(left.get())->Value;
+            auto r = static_cast<objects::Integer *>(right.get())->Value;
+
+            bool result;
+            switch (static_cast<bytecode::OpcodeType>(op))
+            {
+            case bytecode::OpcodeType::OpEqual:
+                result = (l == r);
+                break;
+            case bytecode::OpcodeType::OpNotEqual:
+                result = (l != r);
+                break;
+            default:
+                result = (l > r);
+                break;
+            }
+
+            left.reset();
+            right.reset();
+            vm->sp -= 2;
+            return result ? 1 : 0;
+        }
+
+        if (jitComparison(vm, op) != 0)
+        {
+            return -1;
+        }
+        return objects::isTruthy(vm->Pop()) ? 1 : 0;
+    }
+
+    int jitBang(VM *vm) { return jitCheck(vm, vm->executeBangOperator()); }
+    int jitMinus(VM *vm) { return jitCheck(vm, vm->executeMinusOperator()); }
+
+    int jitPopTruthy(VM *vm)
+    {
+        return objects::isTruthy(vm->Pop()) ? 1 : 0;
+    }
+
+    int jitGetGlobal(VM *vm, int globalIndex) { return jitCheck(vm, vm->Push(vm->globals[globalIndex])); }
+    int jitGetGlobalMove(VM *vm, int globalIndex) { return jitCheck(vm, vm->Push(std::move(vm->globals[globalIndex]))); }
+
+    int jitSetGlobal(VM *vm, int globalIndex)
+    {
+        vm->globals[globalIndex] = vm->Pop();
+        return 0;
+    }
+
+    // 局部变量的槽位已由生成代码算成basePointer+index
+    int jitGetLocal(VM *vm, int slot) { return jitCheck(vm, vm->Push(vm->stack[slot])); }
+    int jitGetLocalMove(VM *vm, int slot) { return jitCheck(vm, vm->Push(std::move(vm->stack[slot]))); }
+
+    int jitSetLocal(VM *vm, int slot)
+    {
+        vm->stack[slot] = vm->Pop();
+        return 0;
+    }
+
+    int jitArray(VM *vm, int numElements)
+    {
+        auto arrayObj = vm->buildArray(vm->sp - numElements, vm->sp);
+        if (objects::isError(arrayObj))
+        {
+            return jitFail(vm, std::move(arrayObj));
+        }
+        vm->sp -= numElements;
+        return jitCheck(vm, vm->Push(std::move(arrayObj)));
+    }
+
+    int jitHash(VM *vm, int numElements)
+    {
+        auto hashObj = vm->buildHash(vm->sp - numElements, vm->sp);
+        if (objects::isError(hashObj))
+        {
+            return jitFail(vm, std::move(hashObj));
+        }
+        vm->sp -= numElements;
+        return jitCheck(vm, vm->Push(std::move(hashObj)));
+    }
+
+    int jitIndex(VM *vm)
+    {
+        auto index = vm->Pop();
+        auto left = vm->Pop();
+        return jitCheck(vm, vm->executeIndexExpression(left, index));
+    }
+
+    // 被调用的函数已编译时callClosure直接执行它; 否则在这里以解释方式执行到它返回
+    int jitCall(VM *vm, int numArgs)
+    {
+        int depth = vm->frameIndex;
+
+        auto result = vm->executeCall(numArgs);
+        if (objects::isError(result))
+        {
+            return jitFail(vm, std::move(result));
+        }
+
+        if (vm->frameIndex > depth)
+        {
+            return jitCheck(vm, vm->Run(depth));
+        }
+        return 0;
+    }
+
+    int jitReturnValue(VM *vm)
+    {
+        auto returnValue = vm->Pop();
+
+        auto &callFrame = vm->frames[vm->frameIndex - 1];
+        vm->frameIndex -= 1;
+        vm->releaseSlots(callFrame->basePointer - 1, vm->sp);
+        vm->sp = callFrame->basePointer - 1;
+        callFrame->cl.reset();
+
+        return jitCheck(vm, vm->Push(std::move(returnValue)));
+    }
+
+    int jitReturn(VM *vm)
+    {
+        auto &callFrame = vm->frames[vm->frameIndex - 1];
+        vm->frameIndex -= 1;
+        vm->releaseSlots(callFrame->basePointer - 1, vm->sp);
+        vm->sp = callFrame->basePointer - 1;
+        callFrame->cl.reset();
+
+        return jitCheck(vm, vm->Push(objects::NULL_OBJ));
+    }
+
+    int jitGetBuiltin(VM *vm, int builtinIndex)
+    {
+        return jitCheck(vm, vm->Push(objects::Builtins[builtinIndex]->Builtin));
+    }
+
+    int jitClosure(VM *vm, int constIndex, int numFree)
+    {
+        return jitCheck(vm, vm->PushClosure(constIndex, numFree));
+    }
+
+    int jitGetFree(VM *vm, int freeIndex)
+    {
+        return jitCheck(vm, vm->Push(vm->frames[vm->frameIndex - 1]->cl->Free[freeIndex]));
+    }
+
+    int jitCurrentClosure(VM *vm)
+    {
+        return jitCheck(vm, vm->Push(vm->frames[vm->frameIndex - 1]->cl));
+    }
+
+    // 生成x86-64机器码, 只包含模板需要的几种指令
+    struct JitAssembler
+    {
+        std::vector<uint8_t> code;
+
+        void Byte(uint8_t b) { code.push_back(b); }
+
+        void Bytes(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+
+        void Imm32(int32_t v)
+        {
+            uint8_t buf[4];
+            std::memcpy(buf, &v, 4);
+            code.insert(code.end(), buf, buf + 4);
+        }
+
+        void Imm64(uint64_t v)
+        {
+            uint8_t buf[8];
+            std::memcpy(buf, &v, 8);
+            code.insert(code.end(), buf, buf + 8);
+        }
+
+        void Prologue()
+        {
+            Byte(0x53);                     // push rbx
+            Bytes({0x41, 0x54});            // push r12
+            Bytes({0x48, 0x83, 0xEC, 0x08}); // sub rsp, 8 (调用前rsp按16字节对齐)
+            Bytes({0x48, 0x89, 0xFB});      // mov rbx, rdi
+            Bytes({0x41, 0x89, 0xF4});      // mov r12d, esi
+        }
+
+        void Epilogue()
+        {
+            Bytes({0x48, 0x83, 0xC4, 0x08}); // add rsp, 8
+            Bytes({0x41, 0x5C});            // pop r12
+            Byte(0x5B);                     // pop rbx
+            Byte(0xC3);                     // ret
+        }
+
+        void ArgVM() { Bytes({0x48, 0x89, 0xDF}); } // mov rdi, rbx
+
+        void ArgImm(int32_t v) // mov esi, imm32
+        {
+            Byte(0xBE);
+            Imm32(v);
+        }
+
+        void ArgImm2(int32_t v) // mov edx, imm32
+        {
+            Byte(0xBA);
+            Imm32(v);
+        }
+
+        void ArgSlot(int32_t localIndex) // lea esi, [r12 + localIndex]
+        {
+            Bytes({0x41, 0x8D, 0xB4, 0x24});
+            Imm32(localIndex);
+        }
+
+        void Call(const void *fn) // mov rax, imm64; call rax
+        {
+            Bytes({0x48, 0xB8});
+            Imm64(reinterpret_cast<uint64_t>(fn));
+            Bytes({0xFF, 0xD0});
+        }
+
+        void TestResult() { Bytes({0x85, 0xC0}); } // test eax, eax
+
+        // 以下跳转返回rel32的位置, 目标确定后再回填
+        size_t Jump() // jmp rel32
+        {
+            Byte(0xE9);
+            Imm32(0);
+            return code.size() - 4;
+        }
+
+        size_t JumpIfZero() // jz rel32
+        {
+            Bytes({0x0F, 0x84});
+            Imm32(0);
+            return code.size() - 4;
+        }
+
+        size_t JumpIfNotZero() // jnz rel32
+        {
+            Bytes({0x0F, 0x85});
+            Imm32(0);
+            return code.size() - 4;
+        }
+
+        size_t JumpIfNegative() // js rel32
+        {
+            Bytes({0x0F, 0x88});
+            Imm32(0);
+            return code.size() - 4;
+        }
+
+        void Patch(size_t at, size_t target)
+        {
+            int32_t rel = static_cast<int32_t>(target) - static_cast<int32_t>(at + 4);
+            std::memcpy(&code[at], &rel, 4);
+        }
+    };
+
+    // 存放生成代码的可执行内存, 按块分配, 写入时可写不可执行, 写完改为可执行不可写. 代码不回收.
+    // 每个线程一个, 写入只会翻转本线程的块, 此时本线程不在执行其中的代码;
+    // 生成的代码由编译它的线程执行, 与对象池一样不跨线程共享
+    struct JitCodeSpace
+    {
+        static constexpr size_t ChunkSize = 256 * 1024;
+
+        uint8_t *chunk = nullptr;
+        size_t used = 0;
+        size_t chunkSize = 0;
+
+        size_t Compiled = 0; // 编译成功的函数数
+        size_t Rejected = 0; // 含有不支持的指令而留给解释器的函数数
+        size_t CodeBytes = 0;
+
+        void *Install(const std::vector<uint8_t> &code)
+        {
+            size_t size = (code.size() + 15) & ~size_t(15);
+            if (chunk == nullptr || used + size > chunkSize)
+            {
+                size_t pageSize = sysconf(_SC_PAGESIZE);
+                chunkSize = std::max(ChunkSize, (size + pageSize - 1) / pageSize * pageSize);
+                void *mem = mmap(nullptr, chunkSize, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (mem == MAP_FAILED)
+                {
+                    chunk = nullptr;
+                    return nullptr;
+                }
+                chunk = static_cast<uint8_t *>(mem);
+                used = 0;
+            }
+
+            if (mprotect(chunk, chunkSize, PROT_READ | PROT_WRITE) != 0)
+            {
+                return nullptr;
+            }
+            uint8_t *entry = chunk + used;
+            std::memcpy(entry, code.data(), code.size());
+            if (mprotect(chunk, chunkSize, PROT_READ | PROT_EXEC) != 0)
+            {
+                // 块里已有的代码无法再执行, 调用栈上可能还有它们的返回地址
+                throw std::bad_alloc();
+            }
+
+            used += size;
+            CodeBytes += code.size();
+            return entry;
+        }
+    };
+
+    thread_local JitCodeSpace JitCode;
+
+    NativeFunction JitCompile(objects::CompiledFunction &fn)
+    {
+#ifndef MONKEY_JIT_SUPPORTED
+        JitCode.Rejected += 1;
+        return nullptr;
+#else
+        const auto &ins = fn.Instructions;
+        const int size = ins.size();
+
+        // 第一遍: 确认所有指令都支持, 并找出跳转目标
+        std::vector<bool> isStart(size + 1, false);
+        std::vector<bool> isTarget(size + 1, false);
+        for (int ip = 0; ip < size;)
+        {
+            auto op = static_cast<bytecode::OpcodeType>(ins[ip]);
+            auto def = bytecode::Lookup(op);
+            if (def == nullptr)
+            {
+                JitCode.Rejected += 1;
+                return nullptr;
+            }
+
+            isStart[ip] = true;
+            int width = 1;
+            for (auto w : def->OperandWidths)
+            {
+                width += w;
+            }
+            if (ip + width > size)
+            {
+                JitCode.Rejected += 1;
+                return nullptr;
+            }
+
+            if (op == bytecode::OpcodeType::OpJump || op == bytecode::OpcodeType::OpJumpNotTruthy)
+            {
+                uint16_t pos;
+                bytecode::ReadUint16(ins, ip + 1, pos);
+                if (pos > size)
+                {
+                    JitCode.Rejected += 1;
+                    return nullptr;
+                }
+                isTarget[pos] = true;
+            }
+            ip += width;
+        }
+        isStart[size] = true;
+        for (int ip = 0; ip <= size; ip++)
+        {
+            if (isTarget[ip] && !isStart[ip])
+            {
+                JitCode.Rejected += 1;
+                return nullptr;
+            }
+        }
+
+        // 第二遍: 逐条生成模板
+        JitAssembler a;
+        std::vector<size_t> labels(size + 1, 0);
+        std::vector<std::pair<size_t, int>> jumps; // rel32位置, 字节码目标
+        std::vector<size_t> exits;                 // 跳到出口的rel32位置
+
+        auto call0 = [&](const void *helper) {
+            a.ArgVM();
+            a.Call(helper);
+        };
+        auto call1 = [&](const void *helper, int operand) {
+            a.ArgVM();
+            a.ArgImm(operand);
+            a.Call(helper);
+        };
+        auto checked = [&]() {
+            a.TestResult();
+            exits.push_back(a.JumpIfNotZero());
+        };
+
+        a.Prologue();
+
+        for (int ip = 0; ip < size;)
+        {
+            labels[ip] = a.code.size();
+
+            auto op = static_cast<bytecode::OpcodeType>(ins[ip]);
+            uint16_t u16 = 0;
+            uint8_t u8 = 0;
+
+            switch (op)
+            {
+            case bytecode::OpcodeType::OpConstant:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                call1(reinterpret_cast<const void *>(&jitConstant), u16);
+                checked();
+                ip += 3;
+                break;
+            case bytecode::OpcodeType::OpPop:
+                call0(reinterpret_cast<const void *>(&jitPop));
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpAdd:
+            case bytecode::OpcodeType::OpSub:
+            case bytecode::OpcodeType::OpMul:
+            case bytecode::OpcodeType::OpDiv:
+                call1(reinterpret_cast<const void *>(&jitArithmetic), static_cast<int>(op));
+                checked();
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpTrue:
+                call0(reinterpret_cast<const void *>(&jitTrue));
+                checked();
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpFalse:
+                call0(reinterpret_cast<const void *>(&jitFalse));
+                checked();
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpNull:
+                call0(reinterpret_cast<const void *>(&jitNull));
+                checked();
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpEqual:
+            case bytecode::OpcodeType::OpNotEqual:
+            case bytecode::OpcodeType::OpGreaterThan:
+                // 紧跟的条件跳转不是其他跳转的目标时与比较合并
+                if (ip + 1 < size && !isTarget[ip + 1] && static_cast<bytecode::OpcodeType>(ins[ip + 1]) == bytecode::OpcodeType::OpJumpNotTruthy)
+                {
+                    bytecode::ReadUint16(ins, ip + 2, u16);
+                    call1(reinterpret_cast<const void *>(&jitCompareAndBranch), static_cast<int>(op));
+                    a.TestResult();
+                    exits.push_back(a.JumpIfNegative());
+                    jumps.emplace_back(a.JumpIfZero(), u16);
+                    labels[ip + 1] = a.code.size();
+                    ip += 4;
+                }
+                else
+                {
+                    call1(reinterpret_cast<const void *>(&jitComparison), static_cast<int>(op));
+                    checked();
+                    ip += 1;
+                }
+                break;
+            case bytecode::OpcodeType::OpBang:
+                call0(reinterpret_cast<const void *>(&jitBang));
+                checked();
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpMinus:
+                call0(reinterpret_cast<const void *>(&jitMinus));
+                checked();
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpJump:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                jumps.emplace_back(a.Jump(), u16);
+                ip += 3;
+                break;
+            case bytecode::OpcodeType::OpJumpNotTruthy:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                call0(reinterpret_cast<const void *>(&jitPopTruthy));
+                a.TestResult();
+                jumps.emplace_back(a.JumpIfZero(), u16);
+                ip += 3;
+                break;
+            case bytecode::OpcodeType::OpGetGlobal:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                call1(reinterpret_cast<const void *>(&jitGetGlobal), u16);
+                checked();
+                ip += 3;
+                break;
+            case bytecode::OpcodeType::OpGetGlobalMove:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                call1(reinterpret_cast<const void *>(&jitGetGlobalMove), u16);
+                checked();
+                ip += 3;
+                break;
+            case bytecode::OpcodeType::OpSetGlobal:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                call1(reinterpret_cast<const void *>(&jitSetGlobal), u16);
+                ip += 3;
+                break;
+            case bytecode::OpcodeType::OpGetLocal:
+            case bytecode::OpcodeType::OpGetLocalMove:
+            case bytecode::OpcodeType::OpSetLocal:
+                bytecode::ReadUint8(ins, ip + 1, u8);
+                a.ArgVM();
+                a.ArgSlot(u8);
+                if (op == bytecode::OpcodeType::OpSetLocal)
+                {
+                    a.Call(reinterpret_cast<const void *>(&jitSetLocal));
+                }
+                else
+                {
+                    a.Call(op == bytecode::OpcodeType::OpGetLocal ? reinterpret_cast<const void *>(&jitGetLocal) : reinterpret_cast<const void *>(&jitGetLocalMove));
+                    checked();
+                }
+                ip += 2;
+                break;
+            case bytecode::OpcodeType::OpArray:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                call1(reinterpret_cast<const void *>(&jitArray), u16);
+                checked();
+                ip += 3;
+                break;
+            case bytecode::OpcodeType::OpHash:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                call1(reinterpret_cast<const void *>(&jitHash), u16);
+                checked();
+                ip += 3;
+                break;
+            case bytecode::OpcodeType::OpIndex:
+                call0(reinterpret_cast<const void *>(&jitIndex));
+                checked();
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpCall:
+                bytecode::ReadUint8(ins, ip + 1, u8);
+                call1(reinterpret_cast<const void *>(&jitCall), u8);
+                checked();
+                ip += 2;
+                break;
+            case bytecode::OpcodeType::OpReturnValue:
+                call0(reinterpret_cast<const void *>(&jitReturnValue));
+                exits.push_back(a.Jump());
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpReturn:
+                call0(reinterpret_cast<const void *>(&jitReturn));
+                exits.push_back(a.Jump());
+                ip += 1;
+                break;
+            case bytecode::OpcodeType::OpGetBuiltin:
+                bytecode::ReadUint8(ins, ip + 1, u8);
+                call1(reinterpret_cast<const void *>(&jitGetBuiltin), u8);
+                checked();
+                ip += 2;
+                break;
+            case bytecode::OpcodeType::OpClosure:
+                bytecode::ReadUint16(ins, ip + 1, u16);
+                bytecode::ReadUint8(ins, ip + 3, u8);
+                a.ArgVM();
+                a.ArgImm(u16);
+                a.ArgImm2(u8);
+                a.Call(reinterpret_cast<const void *>(&jitClosure));
+                checked();
+                ip += 4;
+                break;
+            case bytecode::OpcodeType::OpGetFree:
+                bytecode::ReadUint8(ins, ip + 1, u8);
+                call1(reinterpret_cast<const void *>(&jitGetFree), u8);
+                checked();
+                ip += 2;
+                break;
+            case bytecode::OpcodeType::OpCurrentClosure:
+                call0(reinterpret_cast<const void *>(&jitCurrentClosure));
+                checked();
+                ip += 1;
+                break;
+            default:
+                // 没有模板的指令: 整个函数留给解释器
+                JitCode.Rejected += 1;
+                return nullptr;
+            }
+        }
+
+        // 函数体末尾(正常情况下不可达)按return null处理
+        labels[size] = a.code.size();
+        call0(reinterpret_cast<const void *>(&jitReturn));
+
+        size_t exit = a.code.size();
+        a.Epilogue();
+
+        for (auto &[at, target] : jumps)
+        {
+            a.Patch(at, labels[target]);
+        }
+        for (auto at : exits)
+        {
+            a.Patch(at, exit);
+        }
+
+        auto entry = JitCode.Install(a.code);
+        if (entry == nullptr)
+        {
+            JitCode.Rejected += 1;
+            return nullptr;
+        }
+
+        JitCode.Compiled += 1;
+        fn.Native = entry;
+        return reinterpret_cast<NativeFunction>(entry);
+#endif
+    }
+}
+
+#endif // H_JIT_H
@@ -6,6 +6,7 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <iterator>
 
 #include "objects/objects.hpp"
 #include "compiler/compiler.hpp"
@@ -18,17 +19,39 @@ namespace vm
     const int StackSize = 2048;
     const int GlobalsSize = 65536;
 
+    struct VM;
+
+    // JIT生成的函数: 在callClosure压入的帧上执行函数体, 返回0表示正常返回, 否则错误在vm->jitError中
+    using NativeFunction = int (*)(VM *vm, int basePointer);
+
+    // 把函数翻译为机器码并记录在fn.Native, 遇到不支持的指令或平台时返回nullptr (定义在vm/jit.hpp)
+    NativeFunction JitCompile(objects::CompiledFunction &fn);
+
+    // 调用闭包和内置函数以外的函数对象(例如解释器中的函数), 被调用者和参数在栈顶, 返回错误或nullptr
+    using ForeignCall = objects::Ref<objects::Object> (*)(VM *vm, int numArgs);
+
     struct VM{
-        std::vector<std::shared_ptr<objects::Object>> constants;
-        std::vector<std::shared_ptr<objects::Object>> globals;
+        std::vector<objects::Ref<objects::Object>> constants;
+        std::shared_ptr<compiler::ConstantLoader> constantLoader; // 不为空时constants按需填充
+        std::vector<objects::Ref<objects::Object>> globals;
 
-        std::vector<std::shared_ptr<objects::Object>> stack;
+        std::vector<objects::Ref<objects::Object>> stack;
         int sp; // 始终指向调用栈的下一个空闲位置，栈顶的值是stack[sp-1]
 
         std::vector<std::shared_ptr<Frame>> frames;
         int frameIndex;
 
-        VM(std::vector<std::shared_ptr<objects::Object>>& objs, std::vector<std::shared_ptr<Frame>>& f):
+        std::vector<objects::Ref<objects::Object>> builtinArgs; // 复用的内置函数参数缓冲区
+        std::vector<objects::Ref<objects::Object>> sharedClosures; // 没有捕获变量的闭包, 按函数常量的下标缓存
+
+        int JitThreshold = 0; // 函数被调用这么多次后编译为机器码, 0表示不启用JIT
+        objects::Ref<objects::Object> jitError;
+
+        uint64_t Dispatched = 0; // 执行的指令条数, 仅在定义MONKEY_COUNT_INSTRUCTIONS时统计
+
+        ForeignCall CallForeign = nullptr;
+
+        VM(std::vector<objects::Ref<objects::Object>>& objs, std::vector<std::shared_ptr<Frame>>& f):
         constants(objs),
         frames(f)
         {
@@ -38,12 +61,12 @@ namespace vm
             frameIndex = 1;
         }
 
-        std::shared_ptr<objects::Object> LastPoppedStackElem()
+        objects::Ref<objects::Object> LastPoppedStackElem()
         {
             return stack[sp];
         }
 
-        std::shared_ptr<objects::Object> StackTop()
+        objects::Ref<objects::Object> StackTop()
         {
             if(sp == 0)
             {
@@ -53,72 +76,130 @@ namespace vm
             return stack[sp - 1];
         }
 
-        std::shared_ptr<objects::Object> Push(std::shared_ptr<objects::Object> obj)
+        objects::Ref<objects::Object> Push(objects::Ref<objects::Object> obj)
         {
             if(sp > StackSize)
             {
                 return objects::newError("stack overflow");
             }
 
-            stack[sp] = obj;
+            stack[sp] = std::move(obj);
             sp += 1;
 
             return nullptr;
         }
 
-        std::shared_ptr<objects::Object> PushClosure(int constIndex, int numFree)
+        // 首次访问时解码常量并缓存, 失败时返回错误
+        objects::Ref<objects::Object> loadConstant(int constIndex)
+        {
+            if(constantLoader == nullptr)
+            {
+                return objects::newError("missing constant: " + std::to_string(constIndex));
+            }
+
+            auto constant = constantLoader->Load(constIndex);
+            if(!objects::isError(constant))
+            {
+                constants[constIndex] = constant;
+            }
+            return constant;
+        }
+
+        objects::Ref<objects::Object> PushClosure(int constIndex, int numFree)
         {
             auto constant = constants[constIndex];
-            auto compiledFn = std::dynamic_pointer_cast<objects::CompiledFunction>(constant);
+            if(constant == nullptr)
+            {
+                constant = loadConstant(constIndex);
+                if(objects::isError(constant))
+                {
+                    return constant;
+                }
+            }
+            auto compiledFn = objects::refCast<objects::CompiledFunction>(constant);
             if(compiledFn == nullptr)
             {
                 return objects::newError("not a function: " + constant->Inspect());
             }
+            if(numFree < compiledFn->NumFree)
+            {
+                return objects::newError("wrong number of free variables: want=" + std::to_string(compiledFn->NumFree) + ", got=" + std::to_string(numFree));
+            }
 
-            std::vector<std::shared_ptr<objects::Object>> free(numFree);
-            for(int i = 0; i < numFree; i++)
+            // 闭包只由函数和捕获的值决定, 没有捕获变量时不必每次新建
+            if(numFree == 0)
             {
-                free[i] = stack[sp - numFree + i];
+                if(sharedClosures.size() <= static_cast<size_t>(constIndex))
+                {
+                    sharedClosures.resize(constants.size());
+                }
+                auto &shared = sharedClosures[constIndex];
+                if(shared == nullptr)
+                {
+                    shared = objects::makeRef<objects::Closure>(std::move(compiledFn));
+                }
+                return Push(shared);
             }
 
+            std::vector<objects::Ref<objects::Object>> free(std::make_move_iterator(stack.begin() + sp - numFree), std::make_move_iterator(stack.begin() + sp));
+
             sp -= numFree;
 
-            auto closure = std::make_shared<objects::Closure>(compiledFn, free);
+            return Push(objects::makePooled<objects::Closure>(std::move(compiledFn), std::move(free)));
+        }
 
-            return Push(closure);
+        // 丢弃已返回帧的局部变量, 避免残留引用使容器看起来被共享
+        void releaseSlots(int from, int to)
+        {
+            for(int i = from; i < to; i++)
+            {
+                stack[i].reset();
+            }
         }
 
-        std::shared_ptr<objects::Object> Pop()
+        objects::Ref<objects::Object> Pop()
         {
-            auto obj = stack[sp - 1];
+            auto obj = std::move(stack[sp - 1]);
             sp -= 1;
 
             return obj;
         }
 
-        std::shared_ptr<objects::Object> Run()
+        // exitDepth大于0时, 函数返回到第exitDepth帧后立即结束, 供机器码以解释方式调用尚未编译的函数
+        objects::Ref<objects::Object> Run(int exitDepth = 0)
         {
             auto frame = currentFrame();
 
             int ip;
             bytecode::OpcodeType op;
-            bytecode::Instructions instructions = currentFrame()->Instruction();
-            int ins_size = instructions.size();
+            const bytecode::Instructions *instructions = &currentFrame()->Instruction();
+            int ins_size = instructions->size();
 
             while(frame->ip < ins_size - 1) // frame->ip start with -1
             {
                 frame->ip += 1;
+#ifdef MONKEY_COUNT_INSTRUCTIONS
+                Dispatched++;
+#endif
 
                 ip = frame->ip;
-                op = static_cast<bytecode::OpcodeType>(instructions[ip]);
+                op = static_cast<bytecode::OpcodeType>((*instructions)[ip]);
 
                 switch(op)
                 {
                     case bytecode::OpcodeType::OpConstant:
                         {
                             uint16_t constIndex;
-                            bytecode::ReadUint16(instructions, ip+1, constIndex);
+                            bytecode::ReadUint16(*instructions, ip+1, constIndex);
                             frame->ip += 2;
+                            if(constants[constIndex] == nullptr)
+                            {
+                                auto constant = loadConstant(constIndex);
+                                if(objects::isError(constant))
+                                {
+                                    return constant;
+                                }
+                            }
                             auto result = Push(constants[constIndex]);
                             if(objects::isError(result))
                             {
@@ -140,7 +221,7 @@ namespace vm
                         break;
                     case bytecode::OpcodeType::OpPop:
                         {
-                            Pop();
+                            sp -= 1; // 保留在原槽位, 供LastPoppedStackElem读取
                         }
                         break;
                     case bytecode::OpcodeType::OpTrue:
@@ -193,14 +274,14 @@ namespace vm
                     case bytecode::OpcodeType::OpJump:
                         {
                             uint16_t pos;
-                            bytecode::ReadUint16(instructions, ip+1, pos);
+                            bytecode::ReadUint16(*instructions, ip+1, pos);
                             frame->ip = pos - 1;
                         }
                         break;
                     case bytecode::OpcodeType::OpJumpNotTruthy:
                         {
                             uint16_t pos;
-                            bytecode::ReadUint16(instructions, ip+1, pos);
+                            bytecode::ReadUint16(*instructions, ip+1, pos);
                             frame->ip += 2;
                             
                             auto condition = Pop();
@@ -222,15 +303,17 @@ namespace vm
                     case bytecode::OpcodeType::OpSetGlobal:
                         {
                             uint16_t globalIndex;
-                            bytecode::ReadUint16(instructions, ip+1, globalIndex);
+                            bytecode::ReadUint16(*instructions, ip+1, globalIndex);
                             frame->ip += 2;
-                            globals[globalIndex] = Pop();
+                            // 和OpPop一样保留原槽位, 以let结尾的程序也能由LastPoppedStackElem读到结果
+                            globals[globalIndex] = stack[sp - 1];
+                            sp -= 1;
                         }
                         break;
                     case bytecode::OpcodeType::OpGetGlobal:
                         {
                             uint16_t globalIndex;
-                            bytecode::ReadUint16(instructions, ip+1, globalIndex);
+                            bytecode::ReadUint16(*instructions, ip+1, globalIndex);
                             frame->ip += 2;
                             auto result = Push(globals[globalIndex]);
                             if(objects::isError(result))
@@ -242,7 +325,7 @@ namespace vm
                     case bytecode::OpcodeType::OpSetLocal:
                         {
                             uint8_t localIndex;
-                            bytecode::ReadUint8(instructions, ip+1, localIndex);
+                            bytecode::ReadUint8(*instructions, ip+1, localIndex);
                             frame->ip += 1;
 
                             stack[frame->basePointer + int(localIndex)] = Pop();
@@ -251,7 +334,7 @@ namespace vm
                     case bytecode::OpcodeType::OpGetLocal:
                         {
                             uint8_t localIndex;
-                            bytecode::ReadUint8(instructions, ip+1, localIndex);
+                            bytecode::ReadUint8(*instructions, ip+1, localIndex);
                             frame->ip += 1;
 
                             auto result = Push(stack[frame->basePointer + int(localIndex)]);
@@ -261,10 +344,36 @@ namespace vm
                             }
                         }
                         break;
+                    case bytecode::OpcodeType::OpGetLocalMove:
+                        {
+                            uint8_t localIndex;
+                            bytecode::ReadUint8(*instructions, ip+1, localIndex);
+                            frame->ip += 1;
+
+                            // 编译器已证明该槽位之后不再被读取, 把引用交给栈顶
+                            auto result = Push(std::move(stack[frame->basePointer + int(localIndex)]));
+                            if(objects::isError(result))
+                            {
+                               return result;
+                            }
+                        }
+                        break;
+                    case bytecode::OpcodeType::OpGetGlobalMove:
+                        {
+                            uint16_t globalIndex;
+                            bytecode::ReadUint16(*instructions, ip+1, globalIndex);
+                            frame->ip += 2;
+                            auto result = Push(std::move(globals[globalIndex]));
+                            if(objects::isError(result))
+                            {
+                               return result;
+                            }
+                        }
+                        break;
                     case bytecode::OpcodeType::OpArray:
                         {
                             uint16_t numElements;
-                            bytecode::ReadUint16(instructions, ip+1, numElements);
+                            bytecode::ReadUint16(*instructions, ip+1, numElements);
                             frame->ip += 2;
 
                             auto arrayObj = buildArray(sp - numElements, sp);
@@ -285,7 +394,7 @@ namespace vm
                     case bytecode::OpcodeType::OpHash:
                         {
                             uint16_t numElements;
-                            bytecode::ReadUint16(instructions, ip+1, numElements);
+                            bytecode::ReadUint16(*instructions, ip+1, numElements);
                             frame->ip += 2;
 
                             auto hashObj = buildHash(sp - numElements, sp);
@@ -318,7 +427,7 @@ namespace vm
                     case bytecode::OpcodeType::OpCall:
                         {
                             uint8_t numArgs;
-                            bytecode::ReadUint8(instructions, ip+1, numArgs);
+                            bytecode::ReadUint8(*instructions, ip+1, numArgs);
                             frame->ip += 1;
 
                             auto result = executeCall((int)numArgs);
@@ -328,8 +437,8 @@ namespace vm
                             }
 
                             frame = currentFrame();
-                            instructions = frame->Instruction();
-                            ins_size = instructions.size();
+                            instructions = &frame->Instruction();
+                            ins_size = instructions->size();
                         }
                         break;
                     case bytecode::OpcodeType::OpReturnValue:
@@ -337,11 +446,13 @@ namespace vm
                             auto returnValue = Pop();
 
                             auto callFrame = popFrame();
+                            releaseSlots(callFrame->basePointer - 1, sp);
                             sp = callFrame->basePointer - 1;
+                            callFrame->cl.reset();
 
                             frame = currentFrame();
-                            instructions = frame->Instruction();
-                            ins_size = instructions.size();
+                            instructions = &frame->Instruction();
+                            ins_size = instructions->size();
 
                             //Pop(); // 函数本体出栈
 
@@ -350,16 +461,23 @@ namespace vm
                             {
                                return result;
                             }
+
+                            if(frameIndex == exitDepth)
+                            {
+                                return nullptr;
+                            }
                         }
                         break;
                     case bytecode::OpcodeType::OpReturn:
                         {
                             auto callFrame = popFrame();
+                            releaseSlots(callFrame->basePointer - 1, sp);
                             sp = callFrame->basePointer - 1;
+                            callFrame->cl.reset();
 
                             frame = currentFrame();
-                            instructions = frame->Instruction();
-                            ins_size = instructions.size();
+                            instructions = &frame->Instruction();
+                            ins_size = instructions->size();
 
                             //Pop(); // 函数本体出栈
 
@@ -368,12 +486,17 @@ namespace vm
                             {
                                return result;
                             }
+
+                            if(frameIndex == exitDepth)
+                            {
+                                return nullptr;
+                            }
                         }
                         break;
                     case bytecode::OpcodeType::OpGetBuiltin:
                         {
                             uint8_t builtinIndex;
-                            bytecode::ReadUint8(instructions, ip+1, builtinIndex);
+                            bytecode::ReadUint8(*instructions, ip+1, builtinIndex);
                             frame->ip += 1;
 
                             auto definition = objects::Builtins[builtinIndex];
@@ -387,11 +510,11 @@ namespace vm
                     case bytecode::OpcodeType::OpClosure:
                         {
                             uint16_t constIndex;
-                            bytecode::ReadUint16(instructions, ip+1, constIndex);
+                            bytecode::ReadUint16(*instructions, ip+1, constIndex);
                             frame->ip += 2;
 
                             uint8_t numFree;
-                            bytecode::ReadUint8(instructions, ip+3, numFree);
+                            bytecode::ReadUint8(*instructions, ip+3, numFree);
                             frame->ip += 1;
 
                             auto result = PushClosure((int)constIndex, (int)numFree);
@@ -404,7 +527,7 @@ namespace vm
                     case bytecode::OpcodeType::OpGetFree:
                         {
                             uint8_t freeIndex;
-                            bytecode::ReadUint8(instructions, ip+1, freeIndex);
+                            bytecode::ReadUint8(*instructions, ip+1, freeIndex);
                             frame->ip += 1;
 
                             auto currentClosure = frame->cl;
@@ -431,7 +554,7 @@ namespace vm
             return nullptr;
         }
 
-        std::shared_ptr<objects::Object> executeBinaryOperaction(bytecode::OpcodeType op)
+        objects::Ref<objects::Object> executeBinaryOperaction(bytecode::OpcodeType op)
         {
             auto right = Pop();
             auto left = Pop();
@@ -449,7 +572,7 @@ namespace vm
             }
         }
 
-        std::shared_ptr<objects::Object> executeBangOperator()
+        objects::Ref<objects::Object> executeBangOperator()
         {
             auto operand = Pop();
 
@@ -467,7 +590,7 @@ namespace vm
             }
         }
 
-        std::shared_ptr<objects::Object> executeMinusOperator()
+        objects::Ref<objects::Object> executeMinusOperator()
         {
             auto operand = Pop();
 
@@ -475,16 +598,16 @@ namespace vm
             {
                 return objects::newError("unsupported type for negation: " + operand->TypeStr());
             }
-            auto integerObj = std::dynamic_pointer_cast<objects::Integer>(operand);
-            return Push(std::make_shared<objects::Integer>(-1 * integerObj->Value));
+            auto integerObj = objects::refCast<objects::Integer>(operand);
+            return Push(objects::newYoungInteger(-1 * integerObj->Value));
         }
 
-        std::shared_ptr<objects::Object> executeBinaryIntegerOperaction(bytecode::OpcodeType op,
-                                                                        std::shared_ptr<objects::Object> left,
-                                                                        std::shared_ptr<objects::Object> right)
+        objects::Ref<objects::Object> executeBinaryIntegerOperaction(bytecode::OpcodeType op,
+                                                                        objects::Ref<objects::Object> left,
+                                                                        objects::Ref<objects::Object> right)
         {
-            auto rightObj = std::dynamic_pointer_cast<objects::Integer>(right);
-            auto leftObj = std::dynamic_pointer_cast<objects::Integer>(left);
+            auto rightObj = objects::refCast<objects::Integer>(right);
+            auto leftObj = objects::refCast<objects::Integer>(left);
 
             int64_t result = 0;
 
@@ -508,22 +631,22 @@ namespace vm
                 break;
             }
 
-            return Push(std::make_shared<objects::Integer>(result));
+            return Push(objects::newYoungInteger(result));
         }
 
-        std::shared_ptr<objects::Object> executeBinaryStringOperaction(bytecode::OpcodeType op,
-                                                                        std::shared_ptr<objects::Object> left,
-                                                                        std::shared_ptr<objects::Object> right)
+        objects::Ref<objects::Object> executeBinaryStringOperaction(bytecode::OpcodeType op,
+                                                                        objects::Ref<objects::Object> left,
+                                                                        objects::Ref<objects::Object> right)
         {
-            auto rightObj = std::dynamic_pointer_cast<objects::String>(right);
-            auto leftObj = std::dynamic_pointer_cast<objects::String>(left);
+            auto rightObj = objects::refCast<objects::String>(right);
+            auto leftObj = objects::refCast<objects::String>(left);
 
-            std::string result;
+            objects::Ref<objects::String> result;
 
             switch (op)
             {
             case bytecode::OpcodeType::OpAdd:
-                result = leftObj->Value + rightObj->Value;
+                result = objects::concatStrings(leftObj, rightObj);
                 break;
             
             default:
@@ -531,10 +654,10 @@ namespace vm
                 break;
             }
 
-            return Push(std::make_shared<objects::String>(result));
+            return Push(result);
         }
 
-        std::shared_ptr<objects::Object> executeComparison(bytecode::OpcodeType op)
+        objects::Ref<objects::Object> executeComparison(bytecode::OpcodeType op)
         {
             auto right = Pop();
             auto left = Pop();
@@ -558,12 +681,12 @@ namespace vm
             }
         }
 
-        std::shared_ptr<objects::Object> executeIntegerComparison(bytecode::OpcodeType op,
-                                                                        std::shared_ptr<objects::Object> left,
-                                                                        std::shared_ptr<objects::Object> right)
+        objects::Ref<objects::Object> executeIntegerComparison(bytecode::OpcodeType op,
+                                                                        objects::Ref<objects::Object> left,
+                                                                        objects::Ref<objects::Object> right)
         {
-            auto rightObj = std::dynamic_pointer_cast<objects::Integer>(right);
-            auto leftObj = std::dynamic_pointer_cast<objects::Integer>(left);
+            auto rightObj = objects::refCast<objects::Integer>(right);
+            auto leftObj = objects::refCast<objects::Integer>(left);
 
             switch (op)
             {
@@ -582,8 +705,8 @@ namespace vm
             }
         }
 
-        std::shared_ptr<objects::Object> executeIndexExpression(std::shared_ptr<objects::Object> left,
-                                                                std::shared_ptr<objects::Object> index)
+        objects::Ref<objects::Object> executeIndexExpression(objects::Ref<objects::Object> left,
+                                                                objects::Ref<objects::Object> index)
         {
             if(left->Type() == objects::ObjectType::ARRAY && index->Type() == objects::ObjectType::INTEGER)
             {
@@ -612,62 +735,61 @@ namespace vm
             }
         }
 
-        std::shared_ptr<objects::Object> buildArray(const int& startIndex, const int& endIndex)
+        objects::Ref<objects::Object> buildArray(const int& startIndex, const int& endIndex)
         {
-            std::vector<std::shared_ptr<objects::Object>> elements(endIndex - startIndex);
-            for(int i=startIndex; i < endIndex; i++)
-            {
-                elements[i - startIndex] = stack[i];
-            }
+            // 元素槽位随后即被弹出, 直接移入数组
+            std::vector<objects::Ref<objects::Object>> elements(std::make_move_iterator(stack.begin() + startIndex), std::make_move_iterator(stack.begin() + endIndex));
 
-            return std::make_shared<objects::Array>(elements);
+            return objects::makePooled<objects::Array>(std::move(elements));
         }
 
-        std::shared_ptr<objects::Object> buildHash(const int& startIndex, const int& endIndex)
+        objects::Ref<objects::Object> buildHash(const int& startIndex, const int& endIndex)
         {
-            std::map<objects::HashKey, std::shared_ptr<objects::HashPair>> hashPairs;
+            auto hash = objects::makeRef<objects::Hash>();
             
             for(int i=startIndex; i < endIndex; i += 2)
             {
-                auto key = stack[i];
-                auto value = stack[i+1];
-
-                auto pair = std::make_shared<objects::HashPair>(key, value);
+                auto &key = stack[i];
 
                 if(!key->Hashable())
                 {
                     return objects::newError("unusable as hash type: " + key->TypeStr());
                 }
 
-                hashPairs[key->GetHashKey()] = pair;
+                auto hashed = key->GetHashKey();
+                hash->Pairs.Insert(hashed, objects::makePooledShared<objects::HashPair>(std::move(key), std::move(stack[i+1])));
             }
 
-            return std::make_shared<objects::Hash>(hashPairs);
+            return hash;
         }
 
-        std::shared_ptr<objects::Object>  executeCall(int numArgs)
+        objects::Ref<objects::Object>  executeCall(int numArgs)
         {
             auto fnObj = stack[sp - 1 - numArgs];
 
             if(fnObj->Type() == objects::ObjectType::CLOSURE)
             {
-                //auto compiledFnObj = std::dynamic_pointer_cast<objects::CompiledFunction>(fnObj);
-                //auto closureFn = std::make_shared<objects::Closure>(compiledFnObj);
-                auto closureFn = std::dynamic_pointer_cast<objects::Closure>(fnObj);
+                //auto compiledFnObj = objects::refCast<objects::CompiledFunction>(fnObj);
+                //auto closureFn = objects::makeRef<objects::Closure>(compiledFnObj);
+                auto closureFn = objects::refCast<objects::Closure>(fnObj);
                 return callClosure(closureFn, numArgs);
             }
             else if(fnObj->Type() == objects::ObjectType::BUILTIN)
             {
-                auto builtinFnObj = std::dynamic_pointer_cast<objects::Builtin>(fnObj);
+                auto builtinFnObj = objects::refCast<objects::Builtin>(fnObj);
                 return callBuiltin(builtinFnObj, numArgs);
             }
+            else if(CallForeign != nullptr)
+            {
+                return CallForeign(this, numArgs);
+            }
             else
             {
                 return objects::newError("calling non-function and non-built-in");
             }
         }
 
-        std::shared_ptr<objects::Object> callClosure(std::shared_ptr<objects::Closure> closureFn,int numArgs)
+        objects::Ref<objects::Object> callClosure(objects::Ref<objects::Closure> closureFn,int numArgs)
         {
             if(closureFn->Fn->NumParameters != numArgs)
             {
@@ -676,21 +798,58 @@ namespace vm
                 return objects::newError("wrong number of arguments: want=" + str1 + ", got=" + str2);
             }
 
-            auto funcFrame = NewFrame(closureFn, sp - numArgs);
+            // 延迟编译的函数在第一次调用时生成指令, 所有共享它的闭包都会看到编译结果
+            if(closureFn->Fn->Lazy != nullptr)
+            {
+                auto err = closureFn->Fn->Lazy->Compile(*closureFn->Fn, constants);
+                if(err != nullptr)
+                {
+                    return err;
+                }
+                closureFn->Fn->Lazy.reset();
+            }
 
-            pushFrame(funcFrame);
+            // 复用已返回调用留下的帧对象, 避免每次调用都分配
+            auto &slot = frames[frameIndex];
+            if(slot != nullptr && slot.use_count() == 1)
+            {
+                slot->cl = std::move(closureFn);
+                slot->ip = -1;
+                slot->basePointer = sp - numArgs;
+            }
+            else
+            {
+                slot = NewFrame(std::move(closureFn), sp - numArgs);
+            }
+            frameIndex += 1;
 
-            sp = funcFrame->basePointer + closureFn->Fn->NumLocals;
+            sp = slot->basePointer + slot->cl->Fn->NumLocals;
+
+            auto &fn = *slot->cl->Fn;
+            if(fn.Native == nullptr && JitThreshold > 0 && ++fn.Calls == static_cast<uint32_t>(JitThreshold))
+            {
+                JitCompile(fn);
+            }
+
+            // 已编译的函数直接执行到返回, 调用方看到的是已经弹出的帧和栈顶的返回值
+            if(fn.Native != nullptr)
+            {
+                if(reinterpret_cast<NativeFunction>(fn.Native)(this, slot->basePointer) != 0)
+                {
+                    return std::move(jitError);
+                }
+            }
 
             return nullptr;
         }
 
-        std::shared_ptr<objects::Object> callBuiltin(std::shared_ptr<objects::Builtin> builtinFnObj,int numArgs)
+        objects::Ref<objects::Object> callBuiltin(objects::Ref<objects::Builtin> builtinFnObj,int numArgs)
         {
-            std::vector<std::shared_ptr<objects::Object>> args;
-            args.assign(stack.begin() + sp - numArgs, stack.begin() + sp);
+            // 参数槽位在调用后即被丢弃, 移出而不是复制, 让内置函数能识别唯一持有的容器
+            builtinArgs.assign(std::make_move_iterator(stack.begin() + sp - numArgs), std::make_move_iterator(stack.begin() + sp));
 
-            auto result = builtinFnObj->Fn(args);
+            auto result = builtinFnObj->Fn(builtinArgs);
+            builtinArgs.clear();
 
             sp = sp - numArgs - 1;
 
@@ -724,18 +883,20 @@ namespace vm
 
     std::shared_ptr<VM> New(std::shared_ptr<compiler::ByteCode> bytecode)
     {
-        auto mainFn = std::make_shared<objects::CompiledFunction>(bytecode->Instructions, 0, 0);
-        auto mainClosure = std::make_shared<objects::Closure>(mainFn);
+        auto mainFn = objects::makeRef<objects::CompiledFunction>(bytecode->Instructions, 0, 0);
+        auto mainClosure = objects::makeRef<objects::Closure>(mainFn);
         auto mainFrame = NewFrame(mainClosure, 0);
 
         std::vector<std::shared_ptr<Frame>> frames(FrameSize);
         frames[0] = mainFrame;
 
-        return std::make_shared<VM>(bytecode->Constants, frames);
+        auto vm = std::make_shared<VM>(bytecode->Constants, frames);
+        vm->constantLoader = bytecode->Loader;
+        return vm;
     }
 
     std::shared_ptr<VM> NewWithGlobalsStore(std::shared_ptr<compiler::ByteCode> bytecode,
-                                            std::vector<std::shared_ptr<objects::Object>>& s)
+                                            std::vector<objects::Ref<objects::Object>>& s)
     {
         std::shared_ptr<VM> vm = New(bytecode);
         vm->globals = s;
@@ -743,5 +904,7 @@ namespace vm
     }
 }
 
+#include "vm/jit.hpp"
+
 
 #endif // H_VM_H
\ No newline at end of file